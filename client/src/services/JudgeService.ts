@@ -43,12 +43,17 @@ export interface StatusResponse {
   result?: SubmissionResult;
 }
 
+// The server holds a status request open until the verdict is published
+// (or this many ms pass), so polling loops rarely need a second request.
+export const VERDICT_WAIT_MS = 20000;
+
 export const getRunStatus = async (
   jobId: string
 ): Promise<JudgeVerdict> => {
   try {
     const { data } = await apiClient.get<JudgeVerdict>(
-      `/judge/status/run/${jobId}`
+      `/judge/status/run/${jobId}`,
+      { params: { wait: VERDICT_WAIT_MS } }
     );
     return data;
   } catch (error) {
@@ -79,7 +84,8 @@ export const getSubmitStatus = async (
 ): Promise<JudgeVerdict> => {
   try {
     const { data } = await apiClient.get<JudgeVerdict>(
-      `/judge/status/submit/${jobId}`
+      `/judge/status/submit/${jobId}`,
+      { params: { wait: VERDICT_WAIT_MS } }
     );
     return data;
   } catch (error) {
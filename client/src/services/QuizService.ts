@@ -1,5 +1,6 @@
 import apiClient from './APIclient';
 import { QuizCreationData, QuizUpdateData } from '../types/Quiz';
+import { VERDICT_WAIT_MS } from './JudgeService';
 
 // ── Instructor: quiz CRUD ─────────────────────────────────────────────────────
 
@@ -76,7 +77,9 @@ export const submitProblemCode = async (
 };
 
 export const getQuizSubmitStatus = async (submissionId: number): Promise<any> => {
-  const response = await apiClient.get(`/quizzes/submissions/${submissionId}/status`);
+  const response = await apiClient.get(`/quizzes/submissions/${submissionId}/status`, {
+    params: { wait: VERDICT_WAIT_MS },
+  });
   return response.data;
 };
 
@@ -0,0 +1,110 @@
+#ifndef FAKE_REDIS_H
+#define FAKE_REDIS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "JobClass.h"
+#include "RedisHandler.h"
+
+/**
+ * @class FakeRedis
+ * @brief In-memory stand-in for the Redis server behind RedisHandler, for
+ * judge_bench. bench/FakeRedisHandler.cpp implements RedisHandler on top of
+ * it and is linked in place of src/RedisHandler.cpp, so the engine and the
+ * workers run unchanged.
+ *
+ * Both intakes are modelled: the list and the stream of a lane share one
+ * queue, and claims take the earliest due job first across the lanes they
+ * name, like the claim scripts do. Nothing is ever reclaimed; a bench judge
+ * does not die.
+ */
+class FakeRedis
+{
+public:
+    // key, verdict JSON and jobId of each published verdict
+    using VerdictHook = std::function<void(const std::string &key, const std::string &value, const std::string &jobId)>;
+
+    static FakeRedis &instance();
+
+    /**
+     * @brief Queues a job the way the server's JudgeQueue does: its data
+     * under judge:<jobId> and its id on the class's pending queue.
+     * @param deadlineMs epoch ms, 0 for none
+     */
+    void enqueue(JobClass jobClass, const std::string &jobId, std::string data, uint64_t deadlineMs = 0);
+    /** @brief Same on any lane, e.g. PLAGIARISM_QUEUE. */
+    void enqueue(const std::string &queue, const std::string &jobId, std::string data, uint64_t deadlineMs = 0);
+
+    /** @brief A plain key, e.g. a test set the server stored. */
+    void setValue(const std::string &key, std::string value);
+
+    /** @brief Called on the publishing worker thread for every verdict. */
+    void onVerdict(VerdictHook hook);
+
+    /**
+     * @brief Time every command takes, as if it went to a server over the
+     * network. Default: none.
+     */
+    void setRoundTrip(std::chrono::microseconds roundTrip);
+
+    /** @brief Makes blocked and later intake reads fail, so the intake can stop. */
+    void close();
+
+    uint64_t acks() const { return acks_; }
+
+    // The server side, used by FakeRedisHandler.cpp.
+
+    /**
+     * @brief Takes up to `max` jobs, earliest due first across `lanes`
+     * (lists or streams), each job's queue its index in `lanes`.
+     * @param wait how long to block while every one of them is empty
+     * @return false once closed
+     */
+    bool claim(const std::vector<std::string> &lanes, size_t max, const std::vector<uint64_t> &targetsMs,
+               std::chrono::milliseconds wait, std::vector<ClaimedJob> &jobs);
+    void ack() { acks_++; }
+    bool value(const std::string &key, std::string &value) const;
+    void publish(const std::string &key, const std::string &value, const std::string &jobId);
+    size_t length(const std::string &key) const;
+    /** @brief Stands for the network round-trip of one command. */
+    void roundTrip() const;
+
+private:
+    FakeRedis() = default;
+    FakeRedis(const FakeRedis &) = delete;
+    FakeRedis &operator=(const FakeRedis &) = delete;
+
+    struct Pending
+    {
+        std::string jobId;
+        uint64_t createdAtMs;
+        uint64_t deadlineMs;
+    };
+
+    /** @brief The list a lane stream shares its queue with. */
+    static std::string queueOf(const std::string &lane);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    // by list name
+    std::unordered_map<std::string, std::deque<Pending>> queues_;
+    std::unordered_map<std::string, std::string> data_;
+    std::unordered_map<std::string, std::string> values_;
+    uint64_t nextEntry_ = 0;
+    bool closed_ = false;
+
+    VerdictHook hook_;
+    std::atomic<int64_t> roundTripUs_{0};
+    std::atomic<uint64_t> acks_{0};
+};
+
+#endif // FAKE_REDIS_H
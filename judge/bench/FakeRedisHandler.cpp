@@ -0,0 +1,337 @@
+// RedisHandler over FakeRedis, linked into judge_bench in place of
+// src/RedisHandler.cpp. Every command costs one FakeRedis::roundTrip().
+
+#include "FakeRedis.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+    uint64_t nowMs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::system_clock::now().time_since_epoch())
+                                         .count());
+    }
+}
+
+FakeRedis &FakeRedis::instance()
+{
+    static FakeRedis redis;
+    return redis;
+}
+
+void FakeRedis::enqueue(JobClass jobClass, const std::string &jobId, std::string data, uint64_t deadlineMs)
+{
+    enqueue(jobClassQueue(jobClass), jobId, std::move(data), deadlineMs);
+}
+
+void FakeRedis::enqueue(const std::string &queue, const std::string &jobId, std::string data, uint64_t deadlineMs)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        data_[jobId] = std::move(data);
+        queues_[queue].push_back({jobId, nowMs(), deadlineMs});
+    }
+    cv_.notify_all();
+}
+
+std::string FakeRedis::queueOf(const std::string &lane)
+{
+    for (JobClass jobClass : {JobClass::Quiz, JobClass::Submit, JobClass::Run})
+    {
+        if (lane == jobClassStream(jobClass))
+            return jobClassQueue(jobClass);
+    }
+    return lane == PLAGIARISM_STREAM ? PLAGIARISM_QUEUE : lane;
+}
+
+void FakeRedis::setValue(const std::string &key, std::string value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    values_[key] = std::move(value);
+}
+
+void FakeRedis::onVerdict(VerdictHook hook)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    hook_ = std::move(hook);
+}
+
+void FakeRedis::setRoundTrip(std::chrono::microseconds roundTrip)
+{
+    roundTripUs_ = roundTrip.count();
+}
+
+void FakeRedis::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    cv_.notify_all();
+}
+
+bool FakeRedis::claim(const std::vector<std::string> &lanes, size_t max, const std::vector<uint64_t> &targetsMs,
+                      std::chrono::milliseconds wait, std::vector<ClaimedJob> &jobs)
+{
+    std::vector<std::deque<Pending> *> queues;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const auto &lane : lanes)
+    {
+        queues.push_back(&queues_[queueOf(lane)]);
+    }
+    cv_.wait_for(lock, wait, [this, &queues]
+                 { return closed_ || std::any_of(queues.begin(), queues.end(), [](const std::deque<Pending> *queue)
+                                                 { return !queue->empty(); }); });
+    if (closed_)
+    {
+        return false;
+    }
+
+    while (jobs.size() < max)
+    {
+        // earliest due first across the lane heads, like the claim scripts
+        size_t best = queues.size();
+        uint64_t bestDue = 0;
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            if (queues[i]->empty())
+                continue;
+            const Pending &head = queues[i]->front();
+            uint64_t due = head.createdAtMs + (i < targetsMs.size() ? targetsMs[i] : 0);
+            if (head.deadlineMs > 0)
+                due = std::min(due, head.deadlineMs);
+            if (best == queues.size() || due < bestDue)
+            {
+                best = i;
+                bestDue = due;
+            }
+        }
+        if (best == queues.size())
+        {
+            break;
+        }
+
+        const Pending pending = queues[best]->front();
+        queues[best]->pop_front();
+        ClaimedJob job;
+        job.jobId = pending.jobId;
+        job.queue = best;
+        job.createdAtMs = pending.createdAtMs;
+        job.dueMs = bestDue;
+        job.entryId = std::to_string(++nextEntry_) + "-0";
+        auto data = data_.find(pending.jobId);
+        if (data != data_.end())
+        {
+            job.data = std::move(data->second);
+            job.hasData = true;
+            data_.erase(data);
+        }
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+bool FakeRedis::value(const std::string &key, std::string &value) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = values_.find(key);
+    if (it == values_.end())
+        return false;
+    value = it->second;
+    return true;
+}
+
+void FakeRedis::publish(const std::string &key, const std::string &value, const std::string &jobId)
+{
+    VerdictHook hook;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hook = hook_;
+    }
+    if (hook)
+    {
+        hook(key, value, jobId);
+    }
+}
+
+size_t FakeRedis::length(const std::string &key) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = queues_.find(queueOf(key));
+    return it != queues_.end() ? it->second.size() : 0;
+}
+
+void FakeRedis::roundTrip() const
+{
+    const int64_t us = roundTripUs_.load(std::memory_order_relaxed);
+    if (us > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+std::unique_ptr<RedisHandler> RedisHandler::instance_ = nullptr;
+
+void RedisHandler::initialize(const char *host, int port, size_t connections)
+{
+    if (!instance_)
+    {
+        instance_.reset(new RedisHandler(host, port, connections));
+    }
+}
+
+RedisHandler &RedisHandler::getInstance()
+{
+    if (!instance_)
+    {
+        LOG_ERROR("RedisHandler has not been initialized, call initialize() first.");
+        exit(1);
+    }
+    return *instance_;
+}
+
+RedisHandler::RedisHandler(const char *host, int port, size_t)
+    : host_(host),
+      port_(port),
+      claimSeconds_(METRICS()->histogram("judge_redis_command_seconds", "Latency of judge Redis operations.",
+                                         {{"command", "claim"}})),
+      publishSeconds_(METRICS()->histogram("judge_redis_command_seconds", "Latency of judge Redis operations.",
+                                           {{"command", "publish_verdict"}}))
+{
+    LOG_INFO("Using the in-process fake Redis.");
+}
+
+RedisHandler::~RedisHandler() = default;
+
+bool RedisHandler::waitForWakeUp(const std::string &wakeKey, int timeoutSec)
+{
+    // the lanes the server pushes a token on wakeKey for
+    std::vector<std::string> lanes;
+    if (wakeKey == PLAGIARISM_WAKE_KEY)
+    {
+        lanes = {PLAGIARISM_QUEUE};
+    }
+    else
+    {
+        for (JobClass jobClass : {JobClass::Quiz, JobClass::Submit, JobClass::Run})
+            lanes.push_back(jobClassQueue(jobClass));
+    }
+    // claiming nothing, only waiting for a job to be queued
+    std::vector<ClaimedJob> none;
+    const bool ok = FakeRedis::instance().claim(lanes, 0, {}, std::chrono::seconds(timeoutSec), none);
+    FakeRedis::instance().roundTrip();
+    return ok;
+}
+
+bool RedisHandler::brpoplpush(const std::string &, const std::string &, int, std::string &)
+{
+    return false;
+}
+
+bool RedisHandler::claimJobs(const std::vector<std::string> &queues, const std::string &,
+                             const std::vector<uint64_t> &targetsMs, size_t max, std::vector<ClaimedJob> &jobs)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    FakeRedis::instance().roundTrip();
+    const bool ok = FakeRedis::instance().claim(queues, max, targetsMs, std::chrono::milliseconds(0), jobs);
+    claimSeconds_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    return ok;
+}
+
+void RedisHandler::lrem(const std::string &, int, const std::string &)
+{
+    FakeRedis::instance().roundTrip();
+}
+
+bool RedisHandler::createStreamGroups(const std::vector<std::string> &)
+{
+    FakeRedis::instance().roundTrip();
+    return true;
+}
+
+bool RedisHandler::claimStreamJobs(const std::vector<std::string> &streams, const std::string &,
+                                   const std::vector<uint64_t> &targetsMs, size_t max, std::vector<ClaimedJob> &jobs)
+{
+    return claimJobs(streams, "", targetsMs, max, jobs);
+}
+
+bool RedisHandler::waitForStreamJobs(const std::vector<std::string> &streams, const std::string &,
+                                     const std::vector<uint64_t> &targetsMs, int blockMs, std::vector<ClaimedJob> &jobs)
+{
+    const bool ok = FakeRedis::instance().claim(streams, 1, targetsMs, std::chrono::milliseconds(blockMs), jobs);
+    FakeRedis::instance().roundTrip();
+    return ok;
+}
+
+bool RedisHandler::reclaimStreamJobs(const std::vector<std::string> &, const std::string &,
+                                     const std::vector<uint64_t> &, uint64_t, size_t, std::vector<ClaimedJob> &)
+{
+    FakeRedis::instance().roundTrip();
+    return true;
+}
+
+void RedisHandler::touchStreamJobs(const std::string &, const std::string &, const std::vector<std::string> &)
+{
+    FakeRedis::instance().roundTrip();
+}
+
+void RedisHandler::ack(const JobAck &)
+{
+    FakeRedis::instance().roundTrip();
+    FakeRedis::instance().ack();
+}
+
+bool RedisHandler::queueLength(const std::string &key, bool, uint64_t &length)
+{
+    FakeRedis::instance().roundTrip();
+    length = FakeRedis::instance().length(key);
+    return true;
+}
+
+bool RedisHandler::hget(const std::string &, const std::string &, std::string &)
+{
+    FakeRedis::instance().roundTrip();
+    return false;
+}
+
+bool RedisHandler::get(const std::string &key, std::string &outValue)
+{
+    FakeRedis::instance().roundTrip();
+    return FakeRedis::instance().value(key, outValue);
+}
+
+void RedisHandler::set(const std::string &, const std::string &)
+{
+    FakeRedis::instance().roundTrip();
+}
+
+bool RedisHandler::expire(const std::string &, int)
+{
+    FakeRedis::instance().roundTrip();
+    return true;
+}
+
+bool RedisHandler::publishVerdict(const std::string &key, const std::string &value, int, const JobAck &ack)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    FakeRedis::instance().roundTrip();
+    FakeRedis::instance().ack();
+    FakeRedis::instance().publish(key, value, ack.jobId);
+    verdicts_++;
+    publishSeconds_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    return true;
+}
+
+AsyncRedis::Stats RedisHandler::stats() const
+{
+    return AsyncRedis::Stats();
+}
+
+void RedisHandler::logStats() const
+{
+    LOG_INFO("Fake Redis: " << verdicts_.load() << " verdicts, " << FakeRedis::instance().acks() << " acks.");
+}
@@ -0,0 +1,108 @@
+// Compares judging an output the way the runners did, normalizing both
+// outputs into new strings (split into lines, strip each, join) and then
+// comparing, against compareOutputs(), which walks both in place.
+//
+//   compare_bench [lines] [bytes per line] [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "OutputComparator.h"
+
+namespace
+{
+    // runner.py normalize_output(): strip, split into lines, rstrip each
+    std::string normalize(const std::string &s)
+    {
+        const char *space = " \t\n\v\f\r";
+        const size_t first = s.find_first_not_of(space);
+        if (first == std::string::npos)
+            return "";
+        const size_t last = s.find_last_not_of(space);
+        std::string out;
+        out.reserve(last - first + 1);
+        size_t begin = first;
+        while (begin <= last)
+        {
+            size_t end = s.find_first_of("\r\n", begin);
+            if (end == std::string::npos || end > last)
+                end = last + 1;
+            const size_t kept = s.find_last_not_of(" \t\v\f", end - 1);
+            if (kept != std::string::npos && kept >= begin)
+                out.append(s, begin, kept - begin + 1);
+            if (end > last)
+                break;
+            out += '\n';
+            begin = end + (s[end] == '\r' && end + 1 < s.size() && s[end + 1] == '\n' ? 2 : 1);
+        }
+        return out;
+    }
+
+    std::string makeOutput(int lines, size_t lineBytes)
+    {
+        std::string out;
+        out.reserve(static_cast<size_t>(lines) * (lineBytes + 1));
+        for (int i = 0; i < lines; ++i)
+        {
+            for (size_t k = 0; k < lineBytes; ++k)
+                out += k % 8 == 7 ? ' ' : static_cast<char>('0' + (i + k) % 10);
+            out += '\n';
+        }
+        return out;
+    }
+
+    template <typename F>
+    void measure(const char *label, size_t bytes, int iterations, F &&body)
+    {
+        body(); // warm up
+        const auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            body();
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        const double perCompare = ms / iterations;
+        std::cout << label << ": " << perCompare << " ms/compare, "
+                  << (bytes / 1e6) / (perCompare / 1e3) << " MB/s\n";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const int lines = argc > 1 ? std::atoi(argv[1]) : 100000;
+    const size_t lineBytes = argc > 2 ? static_cast<size_t>(std::atol(argv[2])) : 80;
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 50;
+
+    const std::string expected = makeOutput(lines, lineBytes);
+    // a correct answer with Windows line endings and trailing blanks, which
+    // every mode but Exact accepts
+    std::string actual;
+    for (char c : expected)
+    {
+        if (c == '\n')
+            actual += "  \r\n";
+        else
+            actual += c;
+    }
+    std::cout << "output: " << lines << " lines, " << expected.size() / 1e6 << " MB\n";
+
+    size_t sink = 0;
+    measure("normalize+compare", expected.size(), iterations, [&]
+            { sink += normalize(expected) == normalize(actual); });
+    for (const char *name : {"exact", "lines", "tokens"})
+    {
+        CompareOptions options;
+        parseCompareMode(name, options.mode);
+        const std::string label = std::string("compareOutputs ") + name + std::string(6 - std::string(name).size(), ' ');
+        measure(label.c_str(), expected.size(), iterations, [&]
+                { sink += compareOutputs(expected, actual, options).equal; });
+        if (options.mode != CompareMode::Exact && !compareOutputs(expected, actual, options).equal)
+        {
+            std::cerr << name << " mode rejected a correct output\n";
+            return 1;
+        }
+    }
+    return sink == 0;
+}
@@ -0,0 +1,136 @@
+// Compares the old ThreadPool (one mutex-guarded std::queue of
+// std::function) with WorkStealingExecutor on two loads:
+//
+//   flat    one thread submits every task, like the judge's intake loop
+//   nested  tasks submit further tasks from inside the pool, the case where
+//           per-worker deques and stealing matter most
+//
+//   executor_bench [threads] [tasks] [work per task in ns]
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "ThreadPool.h"
+#include "WorkStealingExecutor.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    void spin(long ns)
+    {
+        const auto until = Clock::now() + std::chrono::nanoseconds(ns);
+        while (Clock::now() < until)
+        {
+        }
+    }
+
+    // payload about the size of a judge job's captures (ids + views)
+    struct Captures
+    {
+        std::string jobId = "job-000000";
+        std::string queue = "judge:processing_queue";
+        long work = 0;
+    };
+
+    template <class WaitFn>
+    double timed(long tasks, std::atomic<long> &done, WaitFn &&submitAll)
+    {
+        const auto begin = Clock::now();
+        submitAll();
+        while (done.load(std::memory_order_acquire) < tasks)
+        {
+            std::this_thread::yield();
+        }
+        return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    }
+
+    void report(const char *name, const char *load, long tasks, double ms)
+    {
+        std::cout << name << " " << load << ": " << ms << " ms, "
+                  << static_cast<long>(tasks / (ms / 1000.0)) << " tasks/s" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8;
+    const long tasks = argc > 2 ? std::atol(argv[2]) : 200000;
+    const long work = argc > 3 ? std::atol(argv[3]) : 1000;
+    const long fanout = 8;
+
+    std::cout << threads << " threads, " << tasks << " tasks of ~" << work << " ns" << std::endl;
+
+    {
+        ThreadPool pool(threads);
+        std::atomic<long> done{0};
+        Captures captures;
+        captures.work = work;
+        double ms = timed(tasks, done, [&]
+                          {
+            for (long i = 0; i < tasks; ++i)
+            {
+                pool.enqueue([&done, captures]
+                             {
+                    spin(captures.work);
+                    done.fetch_add(1, std::memory_order_release); });
+            } });
+        report("ThreadPool", "flat", tasks, ms);
+
+        done = 0;
+        ms = timed(tasks, done, [&]
+                   {
+            for (long i = 0; i < tasks / fanout; ++i)
+            {
+                pool.enqueue([&pool, &done, captures, fanout]
+                             {
+                    for (long k = 0; k < fanout; ++k)
+                    {
+                        pool.enqueue([&done, captures]
+                                     {
+                            spin(captures.work);
+                            done.fetch_add(1, std::memory_order_release); });
+                    } });
+            } });
+        report("ThreadPool", "nested", tasks, ms);
+    }
+
+    {
+        WorkStealingExecutor executor(threads);
+        std::atomic<long> done{0};
+        Captures captures;
+        captures.work = work;
+        double ms = timed(tasks, done, [&]
+                          {
+            for (long i = 0; i < tasks; ++i)
+            {
+                executor.submit([&done, captures](const CancellationToken &)
+                                {
+                    spin(captures.work);
+                    done.fetch_add(1, std::memory_order_release); });
+            } });
+        report("WorkStealingExecutor", "flat", tasks, ms);
+
+        done = 0;
+        ms = timed(tasks, done, [&]
+                   {
+            for (long i = 0; i < tasks / fanout; ++i)
+            {
+                executor.submit([&executor, &done, captures, fanout](const CancellationToken &)
+                                {
+                    for (long k = 0; k < fanout; ++k)
+                    {
+                        executor.submit([&done, captures](const CancellationToken &)
+                                        {
+                            spin(captures.work);
+                            done.fetch_add(1, std::memory_order_release); });
+                    } });
+            } });
+        report("WorkStealingExecutor", "nested", tasks, ms);
+        executor.logStats();
+    }
+    return 0;
+}
@@ -0,0 +1,740 @@
+// End-to-end load test of the judge without Redis or docker: synthetic
+// submissions go through the fake Redis (bench/FakeRedis.h) into an
+// unmodified JudgeEngine, whose sandboxes are simulated with per-language
+// startup and per-test run times. Reports throughput, end-to-end latency
+// and the per-stage breakdown the engine records in its metrics.
+//
+// The mix cycles through every language, sends 20% of jobs to the quiz
+// lane and splits the rest between submit and run; a fifth of the
+// submissions carry a large test set. With --testsets 1 submissions refer
+// to their test set by hash, as the server does, instead of carrying it.
+// With --capacity N the simulated host runs N sandboxes at full speed and
+// slows all of them down beyond that, which is what --concurrency adaptive
+// (between --min-slots and --slots) is for. --resubmit P makes that share
+// of jobs an exact copy of an earlier one, what --verdict-cache-mb serves.
+//
+//   judge_bench [--jobs N] [--rate jobs/s, 0 = all at once] [--threads N]
+//               [--slots N] [--fanout N] [--fanout-global N]
+//               [--intake list|stream] [--testsets 0|1]
+//               [--scale sandbox time factor] [--rtt-us Redis round-trip]
+//               [--capacity N] [--concurrency fixed|adaptive] [--min-slots N]
+//               [--resubmit share] [--verdict-cache-mb N] [--seed N]
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "FakeRedis.h"
+#include "JudgeConfig.h"
+#include "JudgeEngine.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "SandboxExecutor.h"
+#include "Sha256.h"
+#include "TestSetStore.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const char *LANGUAGES[] = {"c", "cpp", "python", "javascript", "typescript", "sql"};
+    const char *MODES[] = {"submit", "run"};
+
+    // simulated sandbox: start (compile, interpreter boot) and time per test
+    struct LanguageProfile
+    {
+        double startupMs;
+        double perTestMs;
+    };
+
+    LanguageProfile profileFor(const std::string &language)
+    {
+        static const std::map<std::string, LanguageProfile> profiles = {
+            {"c", {350, 5}},
+            {"cpp", {600, 5}},
+            {"python", {60, 25}},
+            {"javascript", {80, 15}},
+            {"typescript", {900, 15}},
+            {"sql", {150, 20}},
+        };
+        auto it = profiles.find(language);
+        return it != profiles.end() ? it->second : LanguageProfile{100, 10};
+    }
+
+    size_t countOccurrences(std::string_view text, std::string_view needle)
+    {
+        size_t count = 0;
+        for (size_t at = text.find(needle); at != std::string_view::npos; at = text.find(needle, at + needle.size()))
+        {
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * Sandbox backend that runs nothing: a run completes on a timer thread
+     * after its language's startup plus a run time per test case (each
+     * +-20%, times `scale`), with every test passed. Honours the request
+     * deadline like the real backends, and deferComparison like the
+     * runners: the expected output comes back as the actual one, "unchecked",
+     * for the judge to compare. Test sets passed by testCasesPath are read
+     * from the judge data directory, which a sandbox would see at /judge.
+     * With a capacity, a run that starts while more sandboxes than that are
+     * running takes proportionally longer, as if they shared the CPUs.
+     */
+    class SimulatedExecutor : public SandboxExecutor
+    {
+    public:
+        SimulatedExecutor(double scale, unsigned int capacity, unsigned int seed, std::string dataDir)
+            : scale_(scale), capacity_(capacity), random_(seed), dataDir_(std::move(dataDir))
+        {
+            thread_ = std::thread([this]
+                                  { loop(); });
+        }
+
+        ~SimulatedExecutor() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_one();
+            thread_.join();
+        }
+
+        const char *name() const override { return "simulated"; }
+        std::string imageDigest(const std::string &) override { return "simulated"; }
+
+    protected:
+        void executeAsync(const SandboxRequest &request, Completion done) override
+        {
+            const auto begin = Clock::now();
+            // the worker would be writing the payload to the runner here
+            const std::string testSet = readTestSet(request);
+            const size_t tests = testSet.empty() ? countOccurrences(request.input, "\"testCaseId\"") +
+                                                       countOccurrences(request.inputTail, "\"testCaseId\"")
+                                                 : countOccurrences(testSet, "\"testCaseId\"");
+            const auto language = request.input.find("\"language\":\"");
+            const LanguageProfile profile =
+                profileFor(language == std::string_view::npos
+                               ? ""
+                               : std::string(request.input.substr(language + 12, request.input.find('"', language + 12) - language - 12)));
+
+            Run run;
+            run.result.launched = true;
+            run.result.exitCode = 0;
+            run.result.spawnMs = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                std::uniform_real_distribution<double> jitter(0.8, 1.2);
+                const double slowdown = capacity_ > 0 && running_ >= capacity_
+                                            ? static_cast<double>(running_ + 1) / capacity_
+                                            : 1.0;
+                running_++;
+                run.result.startupMs = profile.startupMs * scale_ * slowdown * jitter(random_);
+                const double runMs = run.result.startupMs + tests * profile.perTestMs * scale_ * slowdown * jitter(random_);
+                run.due = begin + std::chrono::microseconds(static_cast<int64_t>(runMs * 1000));
+            }
+            if (request.deadline != Clock::time_point() && request.deadline < run.due)
+            {
+                run.due = request.deadline;
+                run.result.cancelled = true;
+            }
+            else if (request.input.find("\"deferComparison\":true") != std::string_view::npos ||
+                     request.inputTail.find("\"deferComparison\":true") != std::string_view::npos)
+            {
+                run.result.output = uncheckedVerdict(testSet.empty() ? request.input : testSet);
+            }
+            else
+            {
+                run.result.output = verdict(tests);
+            }
+            run.done = std::move(done);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                run.sequence = sequence_++;
+                runs_.push(std::move(run));
+            }
+            cv_.notify_one();
+        }
+
+    private:
+        struct Run
+        {
+            Clock::time_point due;
+            uint64_t sequence = 0;
+            SandboxResult result;
+            Completion done;
+
+            bool operator>(const Run &other) const
+            {
+                return due != other.due ? due > other.due : sequence > other.sequence;
+            }
+        };
+
+        // what the runner would read from testCasesPath, empty if not given
+        std::string readTestSet(const SandboxRequest &request) const
+        {
+            const std::string_view key = "\"testCasesPath\":\"/judge";
+            std::string_view input = request.inputTail;
+            size_t at = input.find(key);
+            if (at == std::string_view::npos)
+            {
+                input = request.input;
+                at = input.find(key);
+            }
+            if (at == std::string_view::npos)
+                return "";
+            const size_t begin = at + key.size();
+            const std::string path = dataDir_ + std::string(input.substr(begin, input.find('"', begin) - begin));
+            std::ifstream in(path, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        static std::string verdict(size_t tests)
+        {
+            std::string out = R"({"status":"completed","testResults":[)";
+            for (size_t i = 0; i < tests; ++i)
+            {
+                out += i ? "," : "";
+                out += R"({"testCaseId":)" + std::to_string(i + 1) +
+                       R"(,"status":"passed","executionTime":3,"actualOutput":"ok"})";
+            }
+            out += R"(],"metrics":{"passedTests":)" + std::to_string(tests) + R"(,"totalTests":)" +
+                   std::to_string(tests) + R"(,"averageRuntime":3}})";
+            return out;
+        }
+
+        /**
+         * Echoes each test case's expectedOutput. The bench's payloads hold
+         * no escapes and the runner input is a compact dump, whose keys are
+         * sorted, so a scan for the two fields is enough.
+         */
+        static std::string uncheckedVerdict(std::string_view input)
+        {
+            const std::string_view expectedKey = "\"expectedOutput\":\"";
+            const std::string_view idKey = "\"testCaseId\":";
+            std::string out = R"({"status":"completed","testResults":[)";
+            size_t tests = 0;
+            for (size_t at = input.find(expectedKey); at != std::string_view::npos; at = input.find(expectedKey, at))
+            {
+                const size_t begin = at + expectedKey.size();
+                const size_t end = input.find('"', begin);
+                const size_t id = input.find(idKey, end);
+                if (end == std::string_view::npos || id == std::string_view::npos)
+                    break;
+                const size_t idBegin = id + idKey.size();
+                out += tests++ ? "," : "";
+                out += R"({"testCaseId":)";
+                out += input.substr(idBegin, input.find_first_of(",}", idBegin) - idBegin);
+                out += R"(,"status":"unchecked","executionTime":3,"actual":")";
+                out += input.substr(begin, end - begin);
+                out += "\"}";
+                at = idBegin;
+            }
+            out += R"(],"metrics":{"passedTests":0,"totalTests":)" + std::to_string(tests) +
+                   R"(,"averageRuntime":3}})";
+            return out;
+        }
+
+        void loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_)
+            {
+                if (runs_.empty())
+                {
+                    cv_.wait(lock);
+                    continue;
+                }
+                if (Clock::now() < runs_.top().due)
+                {
+                    cv_.wait_until(lock, runs_.top().due);
+                    continue;
+                }
+                // priority_queue::top() is const; the run is popped right after
+                Run run = std::move(const_cast<Run &>(runs_.top()));
+                runs_.pop();
+                running_--;
+                lock.unlock();
+                run.done(std::move(run.result));
+                lock.lock();
+            }
+        }
+
+        const double scale_;
+        const unsigned int capacity_;
+        std::mt19937 random_;
+        const std::string dataDir_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::priority_queue<Run, std::vector<Run>, std::greater<Run>> runs_;
+        uint64_t sequence_ = 0;
+        unsigned int running_ = 0;
+        bool stop_ = false;
+        std::thread thread_;
+    };
+
+    struct Options
+    {
+        long jobs = 600;
+        double rate = 0;
+        unsigned int threads = std::max(2u, std::thread::hardware_concurrency());
+        unsigned int slots = 64;
+        unsigned int fanout = 4;
+        // default: JUDGE_FANOUT_GLOBAL, one per core
+        int fanoutGlobal = -1;
+        std::string intake = "list";
+        double scale = 0.1;
+        long rttUs = 0;
+        unsigned int seed = 1;
+        bool testSets = false;
+        // sandboxes the simulated host runs at full speed, 0 = any number
+        unsigned int capacity = 0;
+        std::string concurrency = "fixed";
+        unsigned int minSlots = 1;
+        double resubmit = 0;
+        unsigned int verdictCacheMb = 0;
+    };
+
+    struct Submission
+    {
+        JobClass jobClass;
+        std::string language;
+        std::string mode;
+        size_t tests;
+        std::string payload;
+    };
+
+    Submission makeSubmission(long i, bool testSets, std::mt19937 &random)
+    {
+        Submission submission;
+        submission.language = LANGUAGES[i % std::size(LANGUAGES)];
+        const double lane = std::uniform_real_distribution<double>(0, 1)(random);
+        submission.jobClass = lane < 0.2 ? JobClass::Quiz : lane < 0.6 ? JobClass::Submit : JobClass::Run;
+        submission.mode = submission.jobClass == JobClass::Run ? "run" : "submit";
+
+        // run mode only has the public examples; a fifth of submissions
+        // bring a large hidden test set
+        size_t inputBytes = 64;
+        submission.tests = 3;
+        if (submission.mode == "submit")
+        {
+            const bool large = std::uniform_int_distribution<int>(0, 4)(random) == 0;
+            submission.tests = large ? 60 : 10;
+            inputBytes = large ? 16 * 1024 : 256;
+        }
+
+        nlohmann::json testCases = nlohmann::json::array();
+        for (size_t t = 0; t < submission.tests; ++t)
+        {
+            testCases.push_back({{"testCaseId", t + 1},
+                                 {"input", std::string(inputBytes, static_cast<char>('a' + t % 26))},
+                                 {"expectedOutput", std::string(inputBytes / 4, 'x')},
+                                 {"isPublic", t < 3}});
+        }
+        nlohmann::json payload = {
+            {"language", submission.language},
+            {"mode", submission.mode},
+            {"code", std::string(2048, ' ') + "solution " + std::to_string(i)},
+            {"libraryCode", ""},
+            {"outputType", "text"},
+        };
+        // like the server: graded submissions refer to the problem's tests,
+        // run mode brings its own
+        if (testSets && submission.mode == "submit")
+        {
+            std::string testSet = testCases.dump();
+            const std::string hash = Sha256::hex(testSet);
+            FakeRedis::instance().setValue(TestSetStore::redisKey(hash), std::move(testSet));
+            payload["testSetRef"] = hash;
+        }
+        else
+        {
+            payload["testCases"] = std::move(testCases);
+        }
+        submission.payload = payload.dump();
+        return submission;
+    }
+
+    double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+    }
+
+    // histogram series summed over label sets
+    struct Summed
+    {
+        std::vector<double> bounds;
+        std::vector<uint64_t> cumulative;
+        uint64_t count = 0;
+        double sum = 0;
+
+        void add(const Metrics::Histogram &histogram)
+        {
+            const Metrics::Histogram::Snapshot snapshot = histogram.snapshot();
+            bounds = histogram.bounds();
+            cumulative.resize(snapshot.cumulative.size());
+            for (size_t i = 0; i < snapshot.cumulative.size(); ++i)
+                cumulative[i] += snapshot.cumulative[i];
+            count += snapshot.count;
+            sum += snapshot.sum;
+        }
+
+        // upper bound of the bucket the percentile falls into, in ms
+        std::string upperMs(double p) const
+        {
+            const uint64_t rank = static_cast<uint64_t>(p * count + 0.999999);
+            for (size_t i = 0; i < bounds.size() && i < cumulative.size(); ++i)
+            {
+                if (cumulative[i] >= rank)
+                    return "<=" + std::to_string(static_cast<long>(bounds[i] * 1000)) + "ms";
+            }
+            return ">" + std::to_string(static_cast<long>(bounds.empty() ? 0 : bounds.back() * 1000)) + "ms";
+        }
+    };
+
+    void printStage(const std::string &stage, const Summed &summed)
+    {
+        if (summed.count == 0)
+            return;
+        std::cout << "  " << std::left << std::setw(14) << stage << std::right << std::setw(7) << summed.count
+                  << "  mean " << std::setw(9) << summed.sum * 1000 / summed.count << "ms"
+                  << "  p50 " << std::setw(9) << summed.upperMs(0.50) << "  p99 " << std::setw(9) << summed.upperMs(0.99)
+                  << "\n";
+    }
+
+    void printStages()
+    {
+        std::cout << "stages (from the engine's histograms, percentiles are bucket bounds):\n"
+                  << std::fixed << std::setprecision(1);
+        Summed queueWait;
+        for (JobClass jobClass : {JobClass::Quiz, JobClass::Submit, JobClass::Run})
+        {
+            Summed perClass;
+            perClass.add(METRICS()->histogram("judge_queue_wait_seconds", "", {{"class", jobClassName(jobClass)}}));
+            printStage(std::string("wait:") + jobClassName(jobClass), perClass);
+        }
+        for (const char *stage : {"spawn", "startup", "compile", "execute", "parse", "compare", "publish"})
+        {
+            Summed summed;
+            for (const char *language : LANGUAGES)
+            {
+                for (const char *mode : MODES)
+                {
+                    summed.add(METRICS()->histogram("judge_stage_seconds", "",
+                                                    {{"stage", stage}, {"language", language}, {"mode", mode}}));
+                }
+            }
+            printStage(stage, summed);
+        }
+        Summed job;
+        for (const char *language : LANGUAGES)
+        {
+            for (const char *mode : MODES)
+            {
+                job.add(METRICS()->histogram("judge_job_seconds", "",
+                                             {{"language", language}, {"mode", mode}, {"outcome", "verdict"}}));
+            }
+        }
+        printStage("job", job);
+        std::cout << std::defaultfloat << std::setprecision(6);
+    }
+
+    void printPayloads()
+    {
+        std::cout << "payloads read from Redis:\n";
+        for (const char *tests : {"inline", "testset"})
+        {
+            const Metrics::Histogram::Snapshot payload =
+                METRICS()->histogram("judge_job_payload_bytes", "", {{"tests", tests}}).snapshot();
+            if (payload.count > 0)
+            {
+                std::cout << "  " << std::left << std::setw(14) << tests << std::right << std::setw(7) << payload.count
+                          << "  mean " << std::setw(9) << std::fixed << std::setprecision(1)
+                          << payload.sum / payload.count / 1024 << "KiB\n";
+            }
+        }
+        const uint64_t hits = METRICS()->counter("judge_testset_lookups_total", "", {{"result", "hit"}}).value();
+        const uint64_t misses = METRICS()->counter("judge_testset_lookups_total", "", {{"result", "miss"}}).value();
+        if (hits + misses > 0)
+        {
+            std::cout << "  test sets: " << hits << " hits, " << misses << " misses ("
+                      << 100.0 * hits / (hits + misses) << "% hit rate)\n";
+        }
+        const uint64_t verdictHits =
+            METRICS()->counter("judge_verdict_cache_lookups_total", "", {{"result", "hit"}}).value();
+        const uint64_t verdictMisses =
+            METRICS()->counter("judge_verdict_cache_lookups_total", "", {{"result", "miss"}}).value();
+        if (verdictHits + verdictMisses > 0)
+        {
+            std::cout << "  verdicts: " << verdictHits << " hits, " << verdictMisses << " misses ("
+                      << 100.0 * verdictHits / (verdictHits + verdictMisses) << "% hit rate)\n";
+        }
+        std::cout << std::defaultfloat << std::setprecision(6);
+    }
+
+    void printConcurrency()
+    {
+        const uint64_t increases = METRICS()->counter("judge_concurrency_adjustments_total", "",
+                                       {{"direction", "increase"}, {"reason", "headroom"}})
+                        .value();
+        std::string decreases;
+        for (const char *reason : {"cpu", "memory", "io", "latency"})
+        {
+            const uint64_t count = METRICS()->counter("judge_concurrency_adjustments_total", "",
+                                                      {{"direction", "decrease"}, {"reason", reason}})
+                                       .value();
+            if (count > 0)
+                decreases += " " + std::to_string(count) + " " + reason;
+        }
+        if (increases > 0 || !decreases.empty())
+        {
+            std::cout << "job slot limit: " << increases << " increases, decreases:"
+                      << (decreases.empty() ? " none" : decreases) << "\n";
+        }
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const std::string name = argv[i];
+            const char *value = argv[i + 1];
+            if (name == "--jobs")
+                options.jobs = std::max(1L, std::atol(value));
+            else if (name == "--rate")
+                options.rate = std::max(0.0, std::atof(value));
+            else if (name == "--threads")
+                options.threads = std::max(1, std::atoi(value));
+            else if (name == "--slots")
+                options.slots = std::max(1, std::atoi(value));
+            else if (name == "--fanout")
+                options.fanout = std::max(1, std::atoi(value));
+            else if (name == "--fanout-global")
+                options.fanoutGlobal = std::max(0, std::atoi(value));
+            else if (name == "--intake")
+                options.intake = value;
+            else if (name == "--scale")
+                options.scale = std::max(0.0, std::atof(value));
+            else if (name == "--rtt-us")
+                options.rttUs = std::max(0L, std::atol(value));
+            else if (name == "--seed")
+                options.seed = static_cast<unsigned int>(std::atoi(value));
+            else if (name == "--testsets")
+                options.testSets = std::atoi(value) != 0;
+            else if (name == "--capacity")
+                options.capacity = static_cast<unsigned int>(std::max(0, std::atoi(value)));
+            else if (name == "--concurrency")
+                options.concurrency = value;
+            else if (name == "--min-slots")
+                options.minSlots = std::max(1, std::atoi(value));
+            else if (name == "--resubmit")
+                options.resubmit = std::clamp(std::atof(value), 0.0, 1.0);
+            else if (name == "--verdict-cache-mb")
+                options.verdictCacheMb = static_cast<unsigned int>(std::max(0, std::atoi(value)));
+            else
+                return false;
+        }
+        return argc % 2 == 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << "usage: judge_bench [--jobs N] [--rate jobs/s] [--threads N] [--slots N] [--fanout N]"
+                     " [--fanout-global N] [--intake list|stream] [--testsets 0|1] [--scale X] [--rtt-us N]"
+                     " [--capacity N] [--concurrency fixed|adaptive] [--min-slots N] [--resubmit share]"
+                     " [--verdict-cache-mb N] [--seed N]\n";
+        return EXIT_FAILURE;
+    }
+    // a line per job would be most of what the bench measures
+    if (!std::getenv("JUDGE_LOG_LEVEL"))
+    {
+        Logger::setLevel(LogLevel::Warning);
+    }
+
+    JudgeConfig config = JudgeConfig::fromEnvironment();
+    config.sandboxBackend = "simulated";
+    config.numThreads = options.threads;
+    config.maxSandboxes = options.slots;
+    config.concurrencyMode = options.concurrency;
+    config.minSandboxes = std::min(options.minSlots, options.slots);
+    // a bench run lasts seconds, not hours
+    config.concurrencyIntervalMs = 250;
+    config.fanoutPerJob = options.fanout;
+    if (options.fanoutGlobal >= 0)
+    {
+        config.fanoutGlobal = static_cast<unsigned int>(options.fanoutGlobal);
+    }
+    config.intakeMode = options.intake;
+    config.consumerName = "judge-bench";
+    // runs nothing to cache, and the scrape endpoint would only get in the way
+    config.compileCacheBytes = 0;
+    config.metricsPort = 0;
+    config.verdictCacheBytes = static_cast<uint64_t>(options.verdictCacheMb) << 20;
+    // test set files, removed at the end
+    char dataDir[] = "/tmp/judge_bench-XXXXXX";
+    if (!mkdtemp(dataDir))
+    {
+        std::cerr << "cannot create a data directory: " << strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    config.dataDir = dataDir;
+
+    std::mt19937 random(options.seed);
+    std::vector<Submission> submissions;
+    submissions.reserve(static_cast<size_t>(options.jobs));
+    for (long i = 0; i < options.jobs; ++i)
+    {
+        // the same payload again, as when a student submits unchanged code
+        if (i > 0 && std::uniform_real_distribution<double>(0, 1)(random) < options.resubmit)
+        {
+            const size_t earlier = std::uniform_int_distribution<size_t>(0, submissions.size() - 1)(random);
+            submissions.push_back(submissions[earlier]);
+            continue;
+        }
+        submissions.push_back(makeSubmission(i, options.testSets, random));
+    }
+
+    struct Outcome
+    {
+        const Submission *submission;
+        Clock::time_point queued;
+        double latencyMs = -1;
+    };
+    std::mutex mutex;
+    std::condition_variable allDone;
+    std::unordered_map<std::string, Outcome> outcomes;
+    long finished = 0;
+    long wrong = 0;
+    long errors = 0;
+
+    FakeRedis &redis = FakeRedis::instance();
+    redis.setRoundTrip(std::chrono::microseconds(options.rttUs));
+    redis.onVerdict([&](const std::string &, const std::string &value, const std::string &jobId)
+                    {
+        const auto now = Clock::now();
+        nlohmann::json verdict = nlohmann::json::parse(value, nullptr, false);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = outcomes.find(jobId);
+        if (it == outcomes.end() || it->second.latencyMs >= 0)
+            return;
+        it->second.latencyMs = std::chrono::duration<double, std::milli>(now - it->second.queued).count();
+        // the simulated runner passes every test; anything else was lost in
+        // splitting or merging, or the job ran out of time
+        if (!verdict.is_object() || verdict.value("status", std::string()) != "completed")
+            errors++;
+        else if (verdict["metrics"].value("passedTests", size_t(0)) != it->second.submission->tests)
+            wrong++;
+        if (++finished == static_cast<long>(outcomes.size()))
+            allDone.notify_all(); });
+
+    std::cout << options.jobs << " jobs, ";
+    if (options.rate > 0)
+        std::cout << options.rate << " jobs/s";
+    else
+        std::cout << "all queued at once";
+    std::cout << ", " << options.threads << " threads, ";
+    if (options.concurrency == "adaptive")
+        std::cout << options.minSlots << "-";
+    std::cout << options.slots << " slots, fan-out " << options.fanout
+              << " (" << config.fanoutGlobal << " extra)"
+              << ", " << options.intake << " intake" << (options.testSets ? ", test sets by hash" : "")
+              << ", sandbox time x" << options.scale;
+    if (options.resubmit > 0)
+        std::cout << ", " << options.resubmit * 100 << "% resubmissions";
+    if (options.verdictCacheMb > 0)
+        std::cout << ", verdict cache " << options.verdictCacheMb << " MiB";
+    if (options.capacity > 0)
+        std::cout << ", host capacity " << options.capacity << " sandboxes";
+    std::cout << ", Redis rtt "
+              << options.rttUs << "us" << std::endl;
+
+    const auto begin = Clock::now();
+    {
+        JudgeEngine engine(config, std::make_unique<SimulatedExecutor>(options.scale, options.capacity, options.seed,
+                                                                       config.dataDir));
+        std::thread intake([&engine]
+                           { engine.start(); });
+
+        for (long i = 0; i < options.jobs; ++i)
+        {
+            if (options.rate > 0)
+            {
+                std::this_thread::sleep_until(begin + std::chrono::microseconds(static_cast<int64_t>(i * 1e6 / options.rate)));
+            }
+            const Submission &submission = submissions[static_cast<size_t>(i)];
+            const std::string jobId = "bench-" + std::to_string(i);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                outcomes[jobId] = {&submission, Clock::now()};
+            }
+            redis.enqueue(submission.jobClass, jobId, submission.payload);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // a job that never gets a verdict must not hang the bench
+            if (!allDone.wait_for(lock, std::chrono::minutes(10), [&]
+                                  { return finished == options.jobs; }))
+            {
+                std::cerr << "timed out with " << options.jobs - finished << " jobs unfinished\n";
+            }
+        }
+        engine.stop();
+        redis.close();
+        intake.join();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    std::map<std::string, std::vector<double>> latencies;
+    for (const auto &[jobId, outcome] : outcomes)
+    {
+        if (outcome.latencyMs < 0)
+            continue;
+        latencies["all"].push_back(outcome.latencyMs);
+        latencies[std::string("class:") + jobClassName(outcome.submission->jobClass)].push_back(outcome.latencyMs);
+        latencies["language:" + outcome.submission->language].push_back(outcome.latencyMs);
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "finished " << finished << "/" << options.jobs << " in " << seconds << "s, "
+              << finished / seconds << " jobs/s, " << wrong << " wrong verdicts, " << errors
+              << " error verdicts (timeouts)\n"
+              << "end-to-end latency (queued to verdict):\n";
+    for (const auto &[name, values] : latencies)
+    {
+        std::cout << "  " << std::left << std::setw(20) << name << std::right << std::setw(6) << values.size()
+                  << "  p50 " << std::setw(9) << percentile(values, 0.50) << "ms  p99 " << std::setw(9)
+                  << percentile(values, 0.99) << "ms\n";
+    }
+    printStages();
+    printPayloads();
+    printConcurrency();
+    std::filesystem::remove_all(config.dataDir);
+    return finished == options.jobs && wrong == 0 && errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
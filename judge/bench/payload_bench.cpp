@@ -0,0 +1,119 @@
+// Compares the judge's submission handling before and after the switch to a
+// streaming pass: the old DOM parse -> rebuild -> dump() round-trip against
+// scanSubmission(), which validates in place and forwards the payload as is.
+//
+//   payload_bench [tests] [bytes per test input] [iterations]
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "SubmissionScanner.h"
+
+using json = nlohmann::json;
+
+namespace
+{
+    std::atomic<uint64_t> allocatedBytes{0};
+
+    // What JudgeWorker::processSubmission did per job before.
+    std::string rebuildPayload(const std::string &payload)
+    {
+        auto j = json::parse(payload);
+        json inputJson;
+        inputJson["language"] = j["language"].get<std::string>();
+        inputJson["code"] = j["code"].get<std::string>();
+        inputJson["libraryCode"] = j["libraryCode"].is_null() ? std::string() : j["libraryCode"].get<std::string>();
+        inputJson["outputType"] = j.value("outputType", std::string("text"));
+        inputJson["testCases"] = json::array();
+        for (const auto &tc : j["testCases"])
+        {
+            json tcJson;
+            tcJson["testCaseId"] = tc.at("testCaseId").get<int>();
+            tcJson["input"] = tc.at("input").get<std::string>();
+            tcJson["expectedOutput"] = tc.at("expectedOutput").get<std::string>();
+            tcJson["isPublic"] = tc.at("isPublic").get<bool>();
+            inputJson["testCases"].push_back(tcJson);
+        }
+        return inputJson.dump();
+    }
+
+    std::string makePayload(int tests, size_t inputBytes)
+    {
+        json j;
+        j["code"] = "#include <cstdio>\nint main(int argc, char **argv) { puts(argv[1]); }\n";
+        j["language"] = "cpp";
+        j["mode"] = "submit";
+        j["outputType"] = "text";
+        j["libraryCode"] = nullptr;
+        j["testCases"] = json::array();
+        for (int i = 0; i < tests; ++i)
+        {
+            std::string input(inputBytes, 'x');
+            for (size_t k = 0; k < input.size(); k += 7)
+                input[k] = static_cast<char>('0' + (k % 10));
+            j["testCases"].push_back({{"testCaseId", i}, {"input", input}, {"expectedOutput", input}, {"isPublic", i == 0}});
+        }
+        return j.dump();
+    }
+
+    template <typename F>
+    void measure(const char *label, const std::string &payload, int iterations, F &&body)
+    {
+        body(); // warm up
+        const uint64_t allocBefore = allocatedBytes;
+        const auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            body();
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        const double perJob = ms / iterations;
+        const double allocPerJob = static_cast<double>(allocatedBytes - allocBefore) / iterations;
+        std::cout << label << ": " << perJob << " ms/job, "
+                  << (payload.size() / 1e6) / (perJob / 1e3) << " MB/s, "
+                  << allocPerJob / 1e6 << " MB allocated/job ("
+                  << allocPerJob / payload.size() << "x payload)\n";
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    allocatedBytes += size;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char *argv[])
+{
+    const int tests = argc > 1 ? std::atoi(argv[1]) : 20;
+    const size_t inputBytes = argc > 2 ? static_cast<size_t>(std::atol(argv[2])) : 256 * 1024;
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    const std::string payload = makePayload(tests, inputBytes);
+    std::cout << "payload: " << tests << " tests, " << payload.size() / 1e6 << " MB\n";
+
+    size_t sink = 0;
+    measure("parse+rebuild+dump", payload, iterations, [&]
+            { sink += rebuildPayload(payload).size(); });
+    measure("scanSubmission    ", payload, iterations, [&]
+            {
+        SubmissionHeader header;
+        std::string error;
+        if (!scanSubmission(payload, header, error))
+        {
+            std::cerr << "scan failed: " << error << "\n";
+            std::exit(1);
+        }
+        sink += header.testCaseCount; });
+
+    return sink == 0;
+}
@@ -0,0 +1,595 @@
+// Plagiarism fingerprinting on a synthetic assignment: every submission
+// starts from the same starter code, most are written independently from
+// their own random program, and a share are copies of an earlier one with
+// identifiers renamed, the layout and brace style changed, comments added,
+// functions reordered and a few dead statements slipped in.
+//
+//   fingerprint   tokenizing and winnowing every submission, one thread
+//   incremental   indexing each submission in order and querying it
+//                 against the prior ones, as check jobs do
+//   all-pairs     PlagiarismIndex::allPairs at 1, 2, 4, ... threads, and
+//                 the plain pairwise merge of sorted fingerprints it replaces
+//
+// Detection is scored against the known copies at the server's 0.3
+// reporting threshold.
+//
+//   plagiarism_bench [submissions] [copy share] [cpp|python]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Fingerprint.h"
+#include "PlagiarismIndex.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const double THRESHOLD = 0.3;
+
+    double msSince(Clock::time_point begin)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    }
+
+    // an expression: text and references to the program's variables
+    struct Piece
+    {
+        std::string text;
+        int var = -1;
+    };
+    using Expr = std::vector<Piece>;
+
+    struct Stmt
+    {
+        enum Kind
+        {
+            Declare,
+            Assign,
+            If,
+            For,
+            While,
+            Print,
+            Return,
+            Dead,
+        } kind;
+        int target = -1;
+        Expr expr;
+        Expr bound;
+        std::vector<Stmt> body;
+        std::vector<Stmt> orElse;
+    };
+
+    struct Function
+    {
+        int name = 0;
+        std::vector<int> params;
+        std::vector<Stmt> body;
+    };
+
+    struct Program
+    {
+        std::vector<Function> functions;
+        int names = 0;
+    };
+
+    class Generator
+    {
+    public:
+        explicit Generator(uint32_t seed) : rng_(seed) {}
+
+        Program program()
+        {
+            Program p;
+            const int functions = pick(3, 6);
+            for (int f = 0; f < functions; ++f)
+            {
+                Function function;
+                function.name = p.names++;
+                std::vector<int> scope;
+                for (int i = pick(1, 3); i > 0; --i)
+                {
+                    function.params.push_back(p.names);
+                    scope.push_back(p.names++);
+                }
+                function.body = block(p, scope, pick(4, 10), 0, p.functions);
+                Stmt ret;
+                ret.kind = Stmt::Return;
+                ret.expr = expr(scope, 2, p.functions);
+                function.body.push_back(std::move(ret));
+                p.functions.push_back(std::move(function));
+            }
+            return p;
+        }
+
+        int pick(int low, int high) { return std::uniform_int_distribution<int>(low, high)(rng_); }
+        std::mt19937 &rng() { return rng_; }
+
+    private:
+        Expr expr(const std::vector<int> &scope, int depth, const std::vector<Function> &callable)
+        {
+            static const char *const OPS[] = {"+", "-", "*", "/", "%"};
+            const int kind = depth > 0 ? pick(0, 5) : pick(0, 1);
+            if (kind == 0 || scope.empty())
+                return {{std::to_string(pick(0, 1000)), -1}};
+            if (kind == 1 || kind == 2)
+                return {{"", scope[static_cast<size_t>(pick(0, static_cast<int>(scope.size()) - 1))]}};
+            if (kind == 5 && !callable.empty())
+            {
+                const Function &f = callable[static_cast<size_t>(pick(0, static_cast<int>(callable.size()) - 1))];
+                Expr call = {{"", f.name}, {"(", -1}};
+                for (size_t i = 0; i < f.params.size(); ++i)
+                {
+                    if (i > 0)
+                        call.push_back({", ", -1});
+                    Expr arg = expr(scope, 0, callable);
+                    call.insert(call.end(), arg.begin(), arg.end());
+                }
+                call.push_back({")", -1});
+                return call;
+            }
+            Expr left = expr(scope, depth - 1, callable);
+            Expr right = expr(scope, depth - 1, callable);
+            Expr out = {{"(", -1}};
+            out.insert(out.end(), left.begin(), left.end());
+            out.push_back({std::string(" ") + OPS[pick(0, 4)] + " ", -1});
+            out.insert(out.end(), right.begin(), right.end());
+            out.push_back({")", -1});
+            return out;
+        }
+
+        std::vector<Stmt> block(Program &p, std::vector<int> &scope, int count, int depth,
+                                const std::vector<Function> &callable)
+        {
+            std::vector<Stmt> out;
+            for (int i = 0; i < count; ++i)
+            {
+                Stmt s;
+                const int kind = depth < 2 ? pick(0, 9) : pick(0, 4);
+                if (kind <= 1 || scope.empty())
+                {
+                    s.kind = Stmt::Declare;
+                    s.expr = expr(scope, 2, callable);
+                    s.target = p.names++;
+                    scope.push_back(s.target);
+                }
+                else if (kind <= 3)
+                {
+                    s.kind = Stmt::Assign;
+                    s.target = scope[static_cast<size_t>(pick(0, static_cast<int>(scope.size()) - 1))];
+                    s.expr = expr(scope, 2, callable);
+                }
+                else if (kind == 4)
+                {
+                    s.kind = Stmt::Print;
+                    s.expr = expr(scope, 1, callable);
+                }
+                else if (kind <= 6)
+                {
+                    s.kind = Stmt::If;
+                    s.expr = expr(scope, 1, callable);
+                    s.bound = expr(scope, 1, callable);
+                    std::vector<int> inner = scope;
+                    s.body = block(p, inner, pick(1, 3), depth + 1, callable);
+                    if (pick(0, 1))
+                    {
+                        inner = scope;
+                        s.orElse = block(p, inner, pick(1, 3), depth + 1, callable);
+                    }
+                }
+                else if (kind <= 8)
+                {
+                    s.kind = Stmt::For;
+                    s.target = p.names++;
+                    s.bound = expr(scope, 1, callable);
+                    std::vector<int> inner = scope;
+                    inner.push_back(s.target);
+                    s.body = block(p, inner, pick(1, 4), depth + 1, callable);
+                }
+                else
+                {
+                    s.kind = Stmt::While;
+                    s.target = scope[static_cast<size_t>(pick(0, static_cast<int>(scope.size()) - 1))];
+                    std::vector<int> inner = scope;
+                    s.body = block(p, inner, pick(1, 3), depth + 1, callable);
+                }
+                out.push_back(std::move(s));
+            }
+            return out;
+        }
+
+        std::mt19937 rng_;
+    };
+
+    // how a student lays out and names their code
+    struct Style
+    {
+        std::vector<std::string> names;
+        int indent = 4;
+        bool braceOnOwnLine = false;
+        int commentPercent = 0;
+    };
+
+    Style randomStyle(Generator &g, int names)
+    {
+        static const char *const WORDS[] = {"count", "total", "value", "res", "tmp", "idx", "acc", "cur", "best",
+                                            "left", "right", "mid", "sum", "prod", "ans", "num", "x", "y", "k",
+                                            "step", "limit", "item", "score", "size"};
+        Style style;
+        const int suffix = g.pick(0, 1000);
+        for (int i = 0; i < names; ++i)
+        {
+            style.names.push_back(std::string(WORDS[g.pick(0, 23)]) + "_" + std::to_string(suffix) + "_" +
+                                  std::to_string(i));
+        }
+        style.indent = g.pick(0, 1) ? 4 : 2;
+        style.braceOnOwnLine = g.pick(0, 1);
+        style.commentPercent = g.pick(0, 20);
+        return style;
+    }
+
+    class Emitter
+    {
+    public:
+        Emitter(const Style &style, bool python, Generator &g) : style_(style), python_(python), g_(g) {}
+
+        std::string program(const Program &p, const std::vector<size_t> &order)
+        {
+            out_ = python_ ? "import sys\n\n\ndef read_ints():\n    return list(map(int, sys.stdin.readline().split()))\n\n"
+                           : "#include <bits/stdc++.h>\nusing namespace std;\n\n"
+                             "vector<long long> readInts(int n) {\n    vector<long long> v(n);\n"
+                             "    for (auto &x : v) cin >> x;\n    return v;\n}\n\n";
+            for (size_t f : order)
+            {
+                const Function &function = p.functions[f];
+                std::string params;
+                for (size_t i = 0; i < function.params.size(); ++i)
+                {
+                    params += (i > 0 ? ", " : "") + std::string(python_ ? "" : "long long ") + name(function.params[i]);
+                }
+                if (python_)
+                    line(0, "def " + name(function.name) + "(" + params + "):");
+                else
+                    open(0, "long long " + name(function.name) + "(" + params + ")");
+                block(function.body, 1);
+                if (!python_)
+                    line(0, "}");
+                out_ += "\n";
+            }
+            const Function &last = p.functions.back();
+            std::string args;
+            for (size_t i = 0; i < last.params.size(); ++i)
+                args += (i > 0 ? ", " : "") + std::string(python_ ? "read_ints()[0]" : "readInts(1)[0]");
+            if (python_)
+                line(0, "print(" + name(last.name) + "(" + args + "))");
+            else
+                line(0, "int main() { cout << " + name(last.name) + "(" + args + ") << endl; return 0; }");
+            return out_;
+        }
+
+    private:
+        std::string name(int var) const { return style_.names[static_cast<size_t>(var)]; }
+
+        std::string text(const Expr &expr) const
+        {
+            std::string s;
+            for (const Piece &piece : expr)
+                s += piece.var >= 0 ? name(piece.var) : piece.text;
+            return s;
+        }
+
+        void line(int depth, const std::string &s)
+        {
+            if (g_.pick(1, 100) <= style_.commentPercent)
+            {
+                out_ += std::string(static_cast<size_t>(depth * style_.indent), ' ') + (python_ ? "# " : "// ") +
+                        "step " + std::to_string(g_.pick(1, 99)) + "\n";
+            }
+            out_ += std::string(static_cast<size_t>(depth * style_.indent), ' ') + s + "\n";
+        }
+
+        void open(int depth, const std::string &head)
+        {
+            if (style_.braceOnOwnLine)
+            {
+                line(depth, head);
+                line(depth, "{");
+            }
+            else
+            {
+                line(depth, head + " {");
+            }
+        }
+
+        void block(const std::vector<Stmt> &stmts, int depth)
+        {
+            for (const Stmt &s : stmts)
+                stmt(s, depth);
+        }
+
+        void stmt(const Stmt &s, int depth)
+        {
+            const std::string end = python_ ? "" : ";";
+            switch (s.kind)
+            {
+            case Stmt::Declare:
+                line(depth, std::string(python_ ? "" : "long long ") + name(s.target) + " = " + text(s.expr) + end);
+                break;
+            case Stmt::Assign:
+                line(depth, name(s.target) + " = " + text(s.expr) + end);
+                break;
+            case Stmt::Print:
+                line(depth, python_ ? "print(" + text(s.expr) + ")" : "cout << " + text(s.expr) + " << endl;");
+                break;
+            case Stmt::Return:
+                line(depth, "return " + text(s.expr) + end);
+                break;
+            case Stmt::Dead:
+                line(depth, python_ ? "pass" : ";");
+                break;
+            case Stmt::If:
+                if (python_)
+                {
+                    line(depth, "if " + text(s.expr) + " > " + text(s.bound) + ":");
+                    block(s.body, depth + 1);
+                    if (!s.orElse.empty())
+                    {
+                        line(depth, "else:");
+                        block(s.orElse, depth + 1);
+                    }
+                }
+                else
+                {
+                    open(depth, "if (" + text(s.expr) + " > " + text(s.bound) + ")");
+                    block(s.body, depth + 1);
+                    if (!s.orElse.empty())
+                    {
+                        line(depth, "}");
+                        open(depth, "else");
+                        block(s.orElse, depth + 1);
+                    }
+                    line(depth, "}");
+                }
+                break;
+            case Stmt::For:
+                if (python_)
+                {
+                    line(depth, "for " + name(s.target) + " in range(" + text(s.bound) + "):");
+                    block(s.body, depth + 1);
+                }
+                else
+                {
+                    open(depth, "for (long long " + name(s.target) + " = 0; " + name(s.target) + " < " +
+                                    text(s.bound) + "; " + name(s.target) + "++)");
+                    block(s.body, depth + 1);
+                    line(depth, "}");
+                }
+                break;
+            case Stmt::While:
+                if (python_)
+                {
+                    line(depth, "while " + name(s.target) + " > 1:");
+                    block(s.body, depth + 1);
+                    line(depth + 1, name(s.target) + " //= 2");
+                }
+                else
+                {
+                    open(depth, "while (" + name(s.target) + " > 1)");
+                    block(s.body, depth + 1);
+                    line(depth + 1, name(s.target) + " /= 2;");
+                    line(depth, "}");
+                }
+                break;
+            }
+        }
+
+        const Style &style_;
+        const bool python_;
+        Generator &g_;
+        std::string out_;
+    };
+
+    // a few statements that do nothing, where a copier pads the code
+    void pad(Generator &g, std::vector<Stmt> &body)
+    {
+        for (int i = g.pick(0, 2); i > 0; --i)
+        {
+            Stmt dead;
+            dead.kind = Stmt::Dead;
+            body.insert(body.begin() + g.pick(0, static_cast<int>(body.size()) - 1), dead);
+        }
+    }
+
+    struct Submission
+    {
+        std::string code;
+        size_t family = 0; // the original it derives from, its own index for originals
+    };
+
+    std::vector<Submission> corpus(size_t count, double copyShare, bool python)
+    {
+        Generator g(20240611);
+        std::vector<Program> programs;
+        std::vector<Submission> out;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const bool copy = !out.empty() && std::uniform_real_distribution<double>(0, 1)(g.rng()) < copyShare;
+            Program p;
+            size_t family = i;
+            if (copy)
+            {
+                const size_t source = static_cast<size_t>(g.pick(0, static_cast<int>(out.size()) - 1));
+                family = out[source].family;
+                p = programs[source];
+                for (Function &f : p.functions)
+                    pad(g, f.body);
+            }
+            else
+            {
+                Generator own(static_cast<uint32_t>(i * 7919 + 17));
+                p = own.program();
+            }
+            std::vector<size_t> order(p.functions.size());
+            for (size_t f = 0; f < order.size(); ++f)
+                order[f] = f;
+            if (copy && g.pick(0, 1))
+                std::shuffle(order.begin(), order.end(), g.rng());
+            Style style = randomStyle(g, p.names);
+            out.push_back({Emitter(style, python, g).program(p, order), family});
+            programs.push_back(std::move(p));
+        }
+        return out;
+    }
+
+    // the pairwise comparison the index replaces: a merge of every two
+    // sorted fingerprints
+    size_t pairwise(const std::vector<Fingerprint> &fingerprints)
+    {
+        size_t found = 0;
+        for (size_t i = 0; i < fingerprints.size(); ++i)
+        {
+            for (size_t j = i + 1; j < fingerprints.size(); ++j)
+            {
+                const Fingerprint &a = fingerprints[i];
+                const Fingerprint &b = fingerprints[j];
+                size_t shared = 0;
+                for (size_t x = 0, y = 0; x < a.size() && y < b.size();)
+                {
+                    if (a[x] < b[y])
+                        x++;
+                    else if (b[y] < a[x])
+                        y++;
+                    else
+                        shared++, x++, y++;
+                }
+                if (2.0 * static_cast<double>(shared) / static_cast<double>(a.size() + b.size()) >= THRESHOLD)
+                    found++;
+            }
+        }
+        return found;
+    }
+
+    double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0;
+        std::sort(values.begin(), values.end());
+        return values[static_cast<size_t>(p * static_cast<double>(values.size() - 1))];
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 3000;
+    const double copyShare = argc > 2 ? std::atof(argv[2]) : 0.1;
+    const std::string language = argc > 3 ? argv[3] : "cpp";
+    const int64_t assignment = 1;
+
+    const std::vector<Submission> submissions = corpus(count, copyShare, language == "python");
+    size_t bytes = 0;
+    size_t copies = 0;
+    size_t truePairs = 0;
+    {
+        std::vector<size_t> familySizes(count, 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            bytes += submissions[i].code.size();
+            copies += submissions[i].family != i;
+            familySizes[submissions[i].family]++;
+        }
+        for (size_t size : familySizes)
+            truePairs += size * (size - 1) / 2;
+    }
+    std::cout << std::fixed << std::setprecision(1) << count << " " << language << " submissions, " << copies
+              << " copies, " << truePairs << " copied pairs, " << bytes / count << " bytes each" << std::endl;
+
+    std::vector<Fingerprint> fingerprints;
+    fingerprints.reserve(count);
+    size_t hashes = 0;
+    auto begin = Clock::now();
+    for (const Submission &s : submissions)
+    {
+        fingerprints.push_back(fingerprint(s.code, language));
+        hashes += fingerprints.back().size();
+    }
+    double ms = msSince(begin);
+    std::cout << "fingerprint: " << ms << " ms, " << static_cast<double>(count) / (ms / 1000.0) << " submissions/s, "
+              << static_cast<double>(bytes) / 1048576.0 / (ms / 1000.0) << " MiB/s, " << hashes / count
+              << " hashes each" << std::endl;
+
+    // incremental: each submission checked against the ones before it
+    {
+        PlagiarismIndex index(uint64_t(1) << 34, 1);
+        std::vector<double> latencies;
+        latencies.reserve(count);
+        size_t caught = 0;
+        size_t falseAlarms = 0;
+        begin = Clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto one = Clock::now();
+            const int64_t id = static_cast<int64_t>(i + 1);
+            index.add(assignment, id, fingerprints[i]);
+            const auto matches = index.query(assignment, fingerprints[i], id, THRESHOLD);
+            latencies.push_back(msSince(one));
+            bool found = false;
+            for (const auto &match : matches)
+            {
+                if (submissions[static_cast<size_t>(match.submissionId - 1)].family == submissions[i].family)
+                    found = true;
+                else
+                    falseAlarms++;
+            }
+            caught += submissions[i].family != i && found;
+        }
+        ms = msSince(begin);
+        std::cout << std::setprecision(3) << "incremental: " << ms << " ms, p50 " << percentile(latencies, 0.5)
+                  << " ms, p99 " << percentile(latencies, 0.99) << " ms per check; " << caught << "/" << copies
+                  << " copies caught, " << falseAlarms << " false alarms" << std::endl;
+        index.logStats();
+    }
+
+    std::vector<size_t> threadCounts = {1};
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t t = 2; t <= cores; t *= 2)
+        threadCounts.push_back(t);
+    if (threadCounts.back() != cores)
+        threadCounts.push_back(cores);
+    double single = 0;
+    for (size_t threads : threadCounts)
+    {
+        PlagiarismIndex index(uint64_t(1) << 34, threads);
+        for (size_t i = 0; i < count; ++i)
+            index.add(assignment, static_cast<int64_t>(i + 1), fingerprints[i]);
+        begin = Clock::now();
+        const auto pairs = index.allPairs(assignment, THRESHOLD);
+        ms = msSince(begin);
+        if (threads == 1)
+            single = ms;
+        size_t correct = 0;
+        for (const auto &pair : pairs)
+        {
+            correct += submissions[static_cast<size_t>(pair.first - 1)].family ==
+                       submissions[static_cast<size_t>(pair.second - 1)].family;
+        }
+        std::cout << "all-pairs, " << threads << " threads: " << ms << " ms (" << single / ms << "x), "
+                  << pairs.size() << " pairs, precision "
+                  << (pairs.empty() ? 1.0 : static_cast<double>(correct) / static_cast<double>(pairs.size()))
+                  << ", recall " << (truePairs ? static_cast<double>(correct) / static_cast<double>(truePairs) : 1.0)
+                  << std::endl;
+    }
+
+    begin = Clock::now();
+    const size_t found = pairwise(fingerprints);
+    ms = msSince(begin);
+    std::cout << "pairwise merge, 1 thread: " << ms << " ms, " << found << " pairs (no common-hash filter)"
+              << std::endl;
+    return 0;
+}
@@ -6,8 +6,79 @@ import time
 import re
 import glob
 import base64
+import resource
+import signal
+import threading
 from tempfile import TemporaryDirectory
 
+# The time limit is on CPU time, which does not depend on the container's
+# CPU quota or on how busy the host is. The wall clock limit only stops
+# programs that wait instead of computing (sleep, blocking reads).
+MAX_CPUTIME_SEC = 5
+MAX_WALLTIME_SEC = 3 * MAX_CPUTIME_SEC
+
+def set_cpu_limit():
+    """SIGXCPU at the limit, SIGKILL a second later if that is ignored"""
+    resource.setrlimit(resource.RLIMIT_CPU, (MAX_CPUTIME_SEC, MAX_CPUTIME_SEC + 1))
+
+def run_measured(cmd, **popen_args):
+    """Runs one test program to completion and measures it.
+
+    CPU time (user + system) and peak RSS come from wait4(), so they are the
+    program's own whatever else the sandbox or the host is doing; the wall
+    clock mostly measures how long the CPU quota made it wait. The kernel
+    counts peak RSS from the fork, so it never reads below this runner's own
+    resident memory at that point (about 10 MB).
+    Returns (returncode, stdout, stderr, measurement); returncode is -signal
+    if the program was killed.
+    """
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, **popen_args)
+
+    output = {}
+
+    def read(name, pipe):
+        output[name] = pipe.read()
+
+    readers = [threading.Thread(target=read, args=item, daemon=True)
+               for item in (('stdout', proc.stdout), ('stderr', proc.stderr))]
+    for reader in readers:
+        reader.start()
+
+    wall_expired = threading.Event()
+
+    def expire():
+        wall_expired.set()
+        proc.kill()
+
+    timer = threading.Timer(MAX_WALLTIME_SEC, expire)
+    timer.start()
+    # wait without reaping, so the timer can never signal a recycled pid
+    os.waitid(os.P_PID, proc.pid, os.WEXITED | os.WNOWAIT)
+    timer.cancel()
+    timer.join()
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall_ms = int((time.monotonic() - start) * 1000)
+    proc.returncode = -os.WTERMSIG(status) if os.WIFSIGNALED(status) else os.WEXITSTATUS(status)
+
+    # a background child may still hold the pipes open; don't wait on it
+    for reader in readers:
+        reader.join(1)
+
+    cpu_ms = int((usage.ru_utime + usage.ru_stime) * 1000)
+    measurement = {
+        "wallMs": wall_ms,
+        "cpuTimeMs": cpu_ms,
+        "peakMemoryKb": usage.ru_maxrss,
+        # SIGXCPU at the soft RLIMIT_CPU, SIGKILL at the hard one for a
+        # program that ignores the first
+        "cpuLimitExceeded": proc.returncode == -signal.SIGXCPU or (
+            proc.returncode == -signal.SIGKILL and not wall_expired.is_set() and cpu_ms >= MAX_CPUTIME_SEC * 1000),
+        "wallLimitExceeded": wall_expired.is_set(),
+    }
+    return proc.returncode, output.get('stdout', ''), output.get('stderr', ''), measurement
+
+
 def main():
     try:
         data = json.load(sys.stdin)
@@ -18,6 +89,11 @@ def main():
         }))
         return
 
+    # shared test sets come as a read-only file under /judge instead
+    if data.get('testCasesPath'):
+        with open(data['testCasesPath']) as f:
+            data['testCases'] = json.load(f)
+
     code = data.get('code', '')
     test_cases = data.get('testCases', [])
     lang = data.get('language', 'cpp').lower()
@@ -25,18 +101,31 @@ def main():
 
     results = []
 
+    # emitBinary: also hand the compiled executable back to the judge for its
+    # compile cache. binaryPath: a cached executable from that cache, mounted
+    # read-only; if it has been evicted meanwhile, just compile as usual.
+    emit_binary = bool(data.get('emitBinary'))
+    binary = None
+    binary_path = data.get('binaryPath')
+    if binary_path and not os.path.isfile(binary_path):
+        binary_path = None
+    # deferComparison: the judge compares text outputs itself; hand them back
+    # raw and marked "unchecked"
+    defer_comparison = bool(data.get('deferComparison'))
+
     with TemporaryDirectory() as tmpdir:
         os.chdir(tmpdir)
         ext = 'c' if lang == 'c' else 'cpp'
         source_path = os.path.join(tmpdir, f'main.{ext}')
-        exe_path = os.path.join(tmpdir, 'main')
+        exe_path = binary_path or os.path.join(tmpdir, 'main')
 
         # Write user code
-        with open(source_path, 'w') as f:
-            f.write(code)
+        if not binary_path:
+            with open(source_path, 'w') as f:
+                f.write(code)
 
         library_code = data.get('libraryCode')
-        if library_code:
+        if library_code and not binary_path:
             with open(os.path.join(tmpdir, 'lib.h'), 'w') as f:
                 f.write(library_code)
 
@@ -45,9 +134,14 @@ def main():
         #     ['g++', '-std=c++17', '-Wall', '-Wextra', '-O2', '-o', exe_path, source_path],
         #     capture_output=True, text=True
         # )
+        # NOTE: the judge's compile cache key includes these flags
+        # (compilerFlags() in JudgeWorker.cpp), keep the two in sync.
         compiler = ['gcc', '-std=c11'] if lang == 'c' else ['g++', '-std=c++17']
         compile_cmd = compiler + ['-Wall', '-Wextra', '-O2', '-o', exe_path, source_path, '-lpng']
-        compile_result = subprocess.run(compile_cmd, capture_output=True, text=True)
+        if binary_path:
+            compile_result = subprocess.CompletedProcess(compile_cmd, 0, '', '')
+        else:
+            compile_result = subprocess.run(compile_cmd, capture_output=True, text=True)
         
         if compile_result.returncode != 0:
             # format compiler errors
@@ -76,11 +170,16 @@ def main():
             print(json.dumps(verdict))
             return
 
-        os.chmod(exe_path, 0o755)
+        if emit_binary and not binary_path:
+            with open(exe_path, 'rb') as exe_f:
+                binary = base64.b64encode(exe_f.read()).decode('ascii')
+
+        if not binary_path:
+            os.chmod(exe_path, 0o755)
 
         for tc in test_cases:
             test_case_id = tc.get('testCaseId')
-            raw_input = tc.get('input', '')
+            raw_input = tc.get('input') or ''
             expected_output = (tc.get('expectedOutput') or '').strip()
             is_public = tc.get('isPublic')
 
@@ -113,19 +212,25 @@ def main():
                         pass
 
             try:
-                start = time.time()
-                proc = subprocess.run(
+                returncode, stdout, stderr, measured = run_measured(
                     [exe_path] + args,
-                    capture_output=True,
-                    text=True,
-                    timeout=5
+                    preexec_fn=set_cpu_limit
                 )
-                elapsed = (time.time() - start) * 1000
 
-                errout = proc.stderr.strip()
-                result["executionTime"] = int(elapsed)
+                errout = stderr.strip()
+                result["executionTime"] = measured["wallMs"]
+                result["cpuTimeMs"] = measured["cpuTimeMs"]
+                result["peakMemoryKb"] = measured["peakMemoryKb"]
 
-                if proc.returncode != 0:
+                if measured["cpuLimitExceeded"]:
+                    result["status"] = "timeout"
+                    result["errorType"] = "EXECUTION_TIMEOUT"
+                    result["error"] = f"Execution used more than {MAX_CPUTIME_SEC} seconds of CPU time"
+                elif measured["wallLimitExceeded"]:
+                    result["status"] = "timeout"
+                    result["errorType"] = "WALL_TIME_EXCEEDED"
+                    result["error"] = f"Execution did not finish within {MAX_WALLTIME_SEC} seconds"
+                elif returncode != 0:
                     result["status"] = "runtime_error"
 
                     if "Segmentation fault" in errout:
@@ -142,7 +247,7 @@ def main():
                         result["error"] = "Program aborted - possibly due to a failed assertion"
                     else:
                         result["errorType"] = "RUNTIME_ERROR"
-                        result["error"] = errout if errout else f"Program exited with code {proc.returncode}"
+                        result["error"] = errout if errout else f"Program exited with code {returncode}"
 
                     result["fullError"] = errout
                 elif output_type == 'image':
@@ -159,8 +264,12 @@ def main():
                     else:
                         result["status"] = "no_output"
                         result["error"] = "Program completed but did not produce a .png file"
+                elif defer_comparison:
+                    result["actual"] = stdout
+                    result["status"] = "unchecked"
+                    del result["expectedOutput"]
                 else:
-                    actual = proc.stdout.strip()
+                    actual = stdout.strip()
                     result["actual"] = actual
                     if actual == expected_output:
                         result["status"] = "passed"
@@ -168,11 +277,6 @@ def main():
                         result["status"] = "failed"
                         result["error"] = f"Expected: '{expected_output}', Got: '{actual}'"
 
-            except subprocess.TimeoutExpired:
-                result["status"] = "timeout"
-                result["errorType"] = "EXECUTION_TIMEOUT"
-                result["error"] = "Execution timed out after 5 seconds"
-                result["executionTime"] = 5000
             except Exception as e:
                 result["status"] = "error"
                 result["errorType"] = "EXECUTION_EXCEPTION"
@@ -194,6 +298,8 @@ def main():
         "averageRuntime": average_runtime
       }
     }
+    if binary is not None:
+        verdict["binary"] = binary
     print(json.dumps(verdict))
 
 if __name__ == '__main__':
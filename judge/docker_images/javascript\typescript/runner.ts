@@ -1,7 +1,8 @@
 import * as fs from 'fs';
 import * as path from 'path';
-import { exec, spawn } from 'child_process';
+import { ChildProcess, exec, spawn } from 'child_process';
 import { tmpdir } from 'os';
+import { Readable, Writable } from 'stream';
 import { mkdtempSync, writeFileSync, chmodSync } from 'fs';
 
 interface TestCase {
@@ -14,13 +15,17 @@ interface TestCase {
 interface TestResult {
   testCaseId: string;
   input: string[];
-  expectedOutput: string;
+  // left out when the judge compares the output itself
+  expectedOutput?: string;
   actual: string | null;
   status: string | null;
   error: string | null;
   errorType?: string;
   fullError?: string;
   executionTime: number | null;
+  // CPU time (user + system) and peak RSS of the program itself
+  cpuTimeMs?: number;
+  peakMemoryKb?: number;
   isPublic?: boolean;
 }
 
@@ -29,6 +34,13 @@ interface InputData {
   testCases: TestCase[];
   language: string;
   libraryCode?: string;
+  // shared test sets come as a read-only file under /judge instead
+  testCasesPath?: string;
+  // the judge compares text outputs itself; hand them back raw and marked
+  // "unchecked"
+  deferComparison?: boolean;
+  // start each test's interpreter ahead of time, see ZYGOTE
+  zygote?: boolean;
 }
 
 interface Verdict {
@@ -46,6 +58,96 @@ interface Verdict {
   };
 }
 
+// The time limit is on CPU time, which does not depend on the container's
+// CPU quota or on how busy the host is. The wall clock limit only stops
+// programs that wait instead of computing (timers, blocking reads).
+const MAX_CPUTIME_SEC = 5;
+const MAX_WALLTIME_MS = 3 * MAX_CPUTIME_SEC * 1000;
+
+// Loaded into every test program: reports what it used on fd 3 as it exits.
+// A program killed by a signal reports nothing.
+const USAGE_REPORTER = `
+process.on('exit', () => {
+  try {
+    const u = process.resourceUsage();
+    require('fs').writeSync(3, JSON.stringify({
+      cpuTimeMs: Math.round((u.userCPUTime + u.systemCPUTime) / 1000),
+      peakMemoryKb: u.maxRSS
+    }));
+  } catch (e) {
+    // fd 3 closed by the program
+  }
+});
+`;
+
+// Node cannot fork a running interpreter, so zygote mode only keeps the boot
+// out of a test's timing: its interpreter boots, says so with a newline on
+// fd 4, and only then gets its program and arguments there and has its clock
+// started; its usage report on fd 3 leaves out the boot too. Every test
+// still pays for a boot, one after another, so a job takes as long as
+// without zygotes. fd 4 is the child's end of a socketpair, which libuv
+// leaves blocking, so the wait sleeps in the kernel and costs no CPU time.
+const ZYGOTE = `
+const fs = require('fs');
+const buffer = Buffer.alloc(64 * 1024);
+fs.writeSync(4, '\\n');
+let line = '';
+while (!line.includes('\\n')) {
+  const n = fs.readSync(4, buffer, 0, buffer.length, null);
+  // the runner is done with its tests
+  if (n === 0) process.exit(0);
+  line += buffer.toString('utf8', 0, n);
+}
+fs.closeSync(4);
+const { program, args } = JSON.parse(line);
+const base = process.resourceUsage();
+process.on('exit', () => {
+  try {
+    const u = process.resourceUsage();
+    fs.writeSync(3, JSON.stringify({
+      cpuTimeMs: Math.round((u.userCPUTime + u.systemCPUTime - base.userCPUTime - base.systemCPUTime) / 1000),
+      peakMemoryKb: u.maxRSS
+    }));
+  } catch (e) {
+    // fd 3 closed by the program
+  }
+});
+process.argv = [process.argv[0], program, ...args];
+require('module').runMain();
+`;
+
+/**
+ * Starts node on `script` under the CPU time limit: RLIMIT_CPU through the
+ * shell, SIGXCPU at the limit and SIGKILL a second later if that is ignored.
+ */
+function spawnNode(script: string[], extraFds: number): ChildProcess {
+  return spawn('/bin/sh', [
+    '-c', `ulimit -S -t ${MAX_CPUTIME_SEC} && ulimit -H -t ${MAX_CPUTIME_SEC + 1} && exec node "$@"`,
+    'node', ...script
+  ], {
+    stdio: ['pipe', 'pipe', 'pipe', ...Array(extraFds).fill('pipe')],
+  });
+}
+
+/**
+ * Starts a zygote interpreter and resolves once it has booted and waits for
+ * its test, or with null if it died first.
+ */
+function bootZygote(zygotePath: string): Promise<ChildProcess | null> {
+  const zygote = spawnNode([zygotePath], 2);
+  return new Promise((resolve) => {
+    (zygote.stdio[4] as Readable).once('data', () => resolve(zygote));
+    zygote.once('error', () => resolve(null));
+    zygote.once('close', () => resolve(null));
+  });
+}
+
+/** Hands a waiting zygote interpreter its test. */
+function startZygote(zygote: ChildProcess, program: string, args: string[]): ChildProcess {
+  (zygote.stdio[4] as Writable).end(JSON.stringify({ program, args }) + '\n');
+  return zygote;
+}
+
 async function main() {
   try {
     let inputData = '';
@@ -68,6 +170,10 @@ async function main() {
       return;
     }
 
+    if (data.testCasesPath) {
+      data.testCases = JSON.parse(fs.readFileSync(data.testCasesPath, 'utf8'));
+    }
+
     const code = data.code || '';
     const testCases = data.testCases || [];
     const lang = (data.language || 'typescript').toLowerCase();
@@ -82,6 +188,10 @@ async function main() {
     const compiledPath = path.join(tmpDir, 'main.js');
     
     writeFileSync(sourcePath, code);
+    const usageReporterPath = path.join(tmpDir, 'usage.js');
+    writeFileSync(usageReporterPath, USAGE_REPORTER);
+    const zygotePath = path.join(tmpDir, 'zygote.js');
+    writeFileSync(zygotePath, ZYGOTE);
 
     const libraryCode = data.libraryCode;
     let libPath: string | null = null;
@@ -90,6 +200,13 @@ async function main() {
       writeFileSync(libPath, libraryCode);
     }
 
+    // The first test's interpreter boots during the compile, which is not
+    // timed. Every other one boots after the test before it has finished:
+    // booting next to a test that is being timed would take its CPU share,
+    // and nothing short of CAP_SYS_NICE could put a zygote booted at low
+    // priority back to normal for its own test.
+    const firstZygote = data.zygote && testCases.length > 0 ? bootZygote(zygotePath) : null;
+
     if (lang === 'typescript') {
       // Create a basic tsconfig.json
       const tsConfig = {
@@ -140,6 +257,7 @@ async function main() {
           }
         };
         
+        (await firstZygote)?.kill('SIGKILL');
         console.log(JSON.stringify(verdict));
         return;
       }
@@ -154,7 +272,11 @@ async function main() {
       // ignore
     }
     
-    for (const tc of testCases) {
+    // a zygote that died while booting leaves the tests it would have run
+    // to a fresh interpreter each
+    let zygote: ChildProcess | null = await firstZygote;
+
+    for (const [index, tc] of testCases.entries()) {
       const testCaseId = tc.testCaseId;
       const rawInput = tc.input || '';
       const expectedOutput = (tc.expectedOutput || '').trim();
@@ -183,35 +305,72 @@ async function main() {
       
       try {
         const start = Date.now();
-        
-        const nodeProcess = spawn('node', [compiledPath, ...args], {
-          timeout: 5000,
-        });
+
+        let nodeProcess: ChildProcess;
+        if (zygote) {
+          nodeProcess = startZygote(zygote, compiledPath, args);
+          zygote = null;
+        } else {
+          nodeProcess = spawnNode(['--require', usageReporterPath, compiledPath, ...args], 1);
+        }
         
         let stdout = '';
         let stderr = '';
+        let usage = '';
         
-        nodeProcess.stdout.on('data', (data) => {
+        nodeProcess.stdout!.on('data', (data) => {
           stdout += data.toString();
         });
         
-        nodeProcess.stderr.on('data', (data) => {
+        nodeProcess.stderr!.on('data', (data) => {
           stderr += data.toString();
         });
+
+        (nodeProcess.stdio[3] as Readable).on('data', (data) => {
+          usage += data.toString();
+        });
+
+        let wallLimitExceeded = false;
+        const wallTimer = setTimeout(() => {
+          wallLimitExceeded = true;
+          nodeProcess.kill('SIGKILL');
+        }, MAX_WALLTIME_MS);
         
-        const exitCode = await new Promise<number>((resolve) => {
-          nodeProcess.on('close', resolve);
+        const [exitCode, signal] = await new Promise<[number | null, NodeJS.Signals | null]>((resolve) => {
+          nodeProcess.on('close', (code, signal) => resolve([code, signal]));
         });
+        clearTimeout(wallTimer);
         
         const elapsed = Date.now() - start;
+        try {
+          const measured = JSON.parse(usage);
+          result.cpuTimeMs = measured.cpuTimeMs;
+          result.peakMemoryKb = measured.peakMemoryKb;
+        } catch (e) {
+          // killed before it could report
+        }
+        // a SIGKILL well short of the hard limit is the memory limit instead
+        const cpuLimitExceeded = signal === 'SIGXCPU' ||
+          (signal === 'SIGKILL' && !wallLimitExceeded && elapsed >= (MAX_CPUTIME_SEC + 1) * 1000);
+        if (cpuLimitExceeded) {
+          result.cpuTimeMs = MAX_CPUTIME_SEC * 1000;
+        }
         
         const actual = stdout.trim();
         const errout = stderr.trim();
         
-        result.actual = actual;
+        result.actual = data.deferComparison ? stdout : actual;
         result.executionTime = elapsed;
         
-        if (exitCode !== 0) {
+        if (cpuLimitExceeded) {
+          result.status = "timeout";
+          result.errorType = "EXECUTION_TIMEOUT";
+          result.error = `Execution used more than ${MAX_CPUTIME_SEC} seconds of CPU time`;
+        } else if (wallLimitExceeded) {
+          result.status = "timeout";
+          result.errorType = "WALL_TIME_EXCEEDED";
+          result.error = `Execution did not finish within ${MAX_WALLTIME_MS / 1000} seconds`;
+        } else if (exitCode !== 0) {
           result.status = "runtime_error";
           
           if (errout.includes('RangeError')) {
@@ -232,6 +391,9 @@ async function main() {
           }
           
           result.fullError = errout;
+        } else if (data.deferComparison) {
+          result.status = "unchecked";
+          delete result.expectedOutput;
         } else {
           if (actual === expectedOutput) {
             result.status = "passed";
@@ -242,20 +404,19 @@ async function main() {
         }
       } catch (e) {
         const error = e as Error;
-        if (error.message.includes('timeout')) {
-          result.status = "timeout";
-          result.errorType = "EXECUTION_TIMEOUT";
-          result.error = "Execution timed out after 5 seconds";
-          result.executionTime = 5000;
-        } else {
-          result.status = "error";
-          result.errorType = "EXECUTION_EXCEPTION";
-          result.error = error.message;
-        }
+        result.status = "error";
+        result.errorType = "EXECUTION_EXCEPTION";
+        result.error = error.message;
       }
       
       results.push(result);
+
+      if (data.zygote && index + 1 < testCases.length) {
+        zygote = await bootZygote(zygotePath);
+      }
     }
+    // left over only if handing it its test failed
+    zygote?.kill('SIGKILL');
     
     const passedTests = results.filter(r => r.status === "passed").length;
     const totalTests = results.length;
@@ -1,27 +1,240 @@
+import atexit
+import builtins
 import json
 import sys
 import subprocess
 import os
+import py_compile
 import resource
+import signal
+import threading
 import time
+import traceback
+import types
 import shlex
 from pathlib import Path
 from tempfile import TemporaryDirectory
 
 # Security limits
 MAX_MEMORY_MB = 256
+# The time limit is on CPU time, which does not depend on the container's
+# CPU quota or on how busy the host is. The wall clock limit only stops
+# programs that wait instead of computing (sleep, blocking reads).
 MAX_CPUTIME_SEC = 5
+MAX_WALLTIME_SEC = 3 * MAX_CPUTIME_SEC
 MAX_OUTPUT_KB = 1024
 
 def set_limits():
     """Set resource limits for child processes"""
     resource.setrlimit(resource.RLIMIT_AS, 
         (MAX_MEMORY_MB * 1024 * 1024, MAX_MEMORY_MB * 1024 * 1024))
-    resource.setrlimit(resource.RLIMIT_CPU, 
-        (MAX_CPUTIME_SEC, MAX_CPUTIME_SEC))
+    # SIGXCPU at the limit, SIGKILL a second later if that is ignored
+    resource.setrlimit(resource.RLIMIT_CPU,
+        (MAX_CPUTIME_SEC, MAX_CPUTIME_SEC + 1))
     resource.setrlimit(resource.RLIMIT_FSIZE,
         (MAX_OUTPUT_KB * 1024, MAX_OUTPUT_KB * 1024))
 
+def run_measured(cmd, **popen_args):
+    """Runs one test program to completion and measures it.
+
+    CPU time (user + system) and peak RSS come from wait4(), so they are the
+    program's own whatever else the sandbox or the host is doing; the wall
+    clock mostly measures how long the CPU quota made it wait. The kernel
+    counts peak RSS from the fork, so it never reads below this runner's own
+    resident memory at that point (about 10 MB).
+    Returns (returncode, stdout, stderr, measurement); returncode is -signal
+    if the program was killed.
+    """
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, **popen_args)
+    return measure(proc, start)
+
+def measure(proc, start):
+    """Waits for a started test program, see run_measured()."""
+    output = {}
+
+    def read(name, pipe):
+        output[name] = pipe.read()
+
+    readers = [threading.Thread(target=read, args=item, daemon=True)
+               for item in (('stdout', proc.stdout), ('stderr', proc.stderr))]
+    for reader in readers:
+        reader.start()
+
+    wall_expired = threading.Event()
+
+    def expire():
+        wall_expired.set()
+        proc.kill()
+
+    timer = threading.Timer(MAX_WALLTIME_SEC, expire)
+    timer.start()
+    # wait without reaping, so the timer can never signal a recycled pid
+    os.waitid(os.P_PID, proc.pid, os.WEXITED | os.WNOWAIT)
+    timer.cancel()
+    timer.join()
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall_ms = int((time.monotonic() - start) * 1000)
+    proc.returncode = -os.WTERMSIG(status) if os.WIFSIGNALED(status) else os.WEXITSTATUS(status)
+
+    # a background child may still hold the pipes open; don't wait on it
+    for reader in readers:
+        reader.join(1)
+
+    cpu_ms = int((usage.ru_utime + usage.ru_stime) * 1000)
+    measurement = {
+        "wallMs": wall_ms,
+        "cpuTimeMs": cpu_ms,
+        "peakMemoryKb": usage.ru_maxrss,
+        # SIGXCPU at the soft RLIMIT_CPU, SIGKILL at the hard one for a
+        # program that ignores the first
+        "cpuLimitExceeded": proc.returncode == -signal.SIGXCPU or (
+            proc.returncode == -signal.SIGKILL and not wall_expired.is_set() and cpu_ms >= MAX_CPUTIME_SEC * 1000),
+        "wallLimitExceeded": wall_expired.is_set(),
+    }
+    return proc.returncode, output.get('stdout', ''), output.get('stderr', ''), measurement
+
+class ForkedTest:
+    """A test program forked off the zygote, with what measure() needs of a Popen."""
+
+    def __init__(self, pid, stdout, stderr):
+        self.pid = pid
+        self.stdout = stdout
+        self.stderr = stderr
+        self.returncode = None
+
+    def kill(self):
+        os.kill(self.pid, signal.SIGKILL)
+
+def run_program(code, path):
+    """Runs compiled submission code as `python3 path` would, in a forked
+    test process. Returns its exit status: 0, the SystemExit code, or 1 after
+    printing an uncaught exception; 120 if its output cannot be flushed."""
+    main_module = types.ModuleType('__main__')
+    main_module.__file__ = path
+    main_module.__builtins__ = builtins
+    sys.modules['__main__'] = main_module
+    try:
+        exec(code, main_module.__dict__)
+        status = 0
+    except SystemExit as e:
+        if e.code is None:
+            status = 0
+        elif isinstance(e.code, int):
+            status = e.code
+        else:
+            print(e.code, file=sys.stderr)
+            status = 1
+    except BaseException as e:
+        # from the submission's frame on, this one is not part of its stack
+        traceback.print_exception(type(e), e, e.__traceback__.tb_next)
+        status = 1
+
+    # what the interpreter does before it exits
+    for thread in threading.enumerate():
+        if thread is not threading.current_thread() and not thread.daemon:
+            thread.join()
+    atexit._run_exitfuncs()
+    try:
+        sys.stdout.flush()
+        sys.stderr.flush()
+    except Exception:
+        status = 120
+    return status
+
+def fork_test(code, path, args):
+    """Forks a test process off the zygote: a fresh copy of an interpreter
+    that is already running, with the limits, streams and arguments a new
+    `python3 path args` process would have."""
+    out_r, out_w = os.pipe()
+    err_r, err_w = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        status = 1
+        try:
+            null = os.open(os.devnull, os.O_RDONLY)
+            os.dup2(null, 0)
+            os.dup2(out_w, 1)
+            os.dup2(err_w, 2)
+            # nothing but the three streams, above all not the zygote's
+            # channel to the runner
+            os.closerange(3, os.sysconf('SC_OPEN_MAX'))
+            sys.stdin = open(0, closefd=False)
+            sys.stdout = open(1, 'w', closefd=False)
+            sys.stderr = open(2, 'w', closefd=False)
+            set_limits()
+            sys.argv = [path] + args
+            sys.path[0] = os.path.dirname(path)
+            status = run_program(code, path)
+        finally:
+            os._exit(status)
+    os.close(out_w)
+    os.close(err_w)
+    return ForkedTest(pid, open(out_r), open(err_r))
+
+def serve_zygote(requests, replies):
+    """The zygote's loop: one test per request line, {"path", "args"}, each
+    answered with a line of run_measured()'s results, or {"error"}."""
+    compiled = {}
+    for line in requests:
+        try:
+            request = json.loads(line)
+            path = request['path']
+            if path not in compiled:
+                compiled[path] = compile(Path(path).read_text(), path, 'exec')
+            start = time.monotonic()
+            reply = measure(fork_test(compiled[path], path, request['args']), start)
+        except Exception as e:
+            reply = {"error": str(e)}
+        replies.write(json.dumps(reply) + '\n')
+        replies.flush()
+
+class Zygote:
+    """Forks each test program off an interpreter that has already started,
+    instead of starting a new one per test.
+
+    The zygote is forked before the runner reads the job, so what it and
+    the tests it forks can see holds no test case, only the inputs it is
+    sent one at a time.
+    """
+
+    def __init__(self):
+        requests_r, requests_w = os.pipe()
+        replies_r, replies_w = os.pipe()
+        self.pid = os.fork()
+        if self.pid == 0:
+            try:
+                os.close(requests_w)
+                os.close(replies_r)
+                # stdin is the job, stdout the verdict: neither is the zygote's
+                null = os.open(os.devnull, os.O_RDWR)
+                os.dup2(null, 0)
+                os.dup2(null, 1)
+                serve_zygote(open(requests_r), open(replies_w, 'w'))
+            finally:
+                os._exit(0)
+        os.close(requests_r)
+        os.close(replies_w)
+        self.requests = open(requests_w, 'w')
+        self.replies = open(replies_r)
+
+    def run(self, path, args):
+        """Runs one test, returns what run_measured() does."""
+        self.requests.write(json.dumps({"path": str(path), "args": args}) + '\n')
+        self.requests.flush()
+        line = self.replies.readline()
+        if not line:
+            raise RuntimeError("zygote exited")
+        reply = json.loads(line)
+        if isinstance(reply, dict):
+            raise RuntimeError(f"zygote: {reply['error']}")
+        return tuple(reply)
+
+    def close(self):
+        self.requests.close()
+        self.replies.close()
+        os.waitpid(self.pid, 0)
+
 def normalize_output(output: str) -> str:
     """Standardize output formatting"""
     return '\n'.join(line.rstrip() for line in output.strip().splitlines())
@@ -37,11 +250,26 @@ def parse_input_args(input_str: str):
         return [arg for arg in input_str.split() if arg]
 
 def main():
+    zygote = Zygote()
+    try:
+        run_job(zygote)
+    finally:
+        zygote.close()
+
+def run_job(zygote):
     try:
         data = json.load(sys.stdin)
     except json.JSONDecodeError:
         print(json.dumps({"status": "error", "error": "Invalid JSON input"}))
         return
+    # the judge asks for forked tests; without it every test starts its own
+    # interpreter, as before
+    use_zygote = data.get('zygote', False)
+
+    # shared test sets come as a read-only file under /judge instead
+    if data.get('testCasesPath'):
+        with open(data['testCasesPath']) as f:
+            data['testCases'] = json.load(f)
 
     results = []
     
@@ -53,14 +281,23 @@ def main():
         if library_code:
             (Path(tmpdir) / 'lib.py').write_text(library_code)
 
-        syntax_check = subprocess.run(
-            ['python3', '-m', 'py_compile', str(code_file)],
-            capture_output=True,
-            text=True
-        )
-        
-        if syntax_check.returncode != 0:
-            error_msg = normalize_output(syntax_check.stderr)
+        if use_zygote:
+            # what `python3 -m py_compile` prints, without starting it
+            try:
+                py_compile.compile(str(code_file), doraise=True)
+                syntax_error = None
+            except py_compile.PyCompileError as e:
+                syntax_error = e.msg
+        else:
+            syntax_check = subprocess.run(
+                ['python3', '-m', 'py_compile', str(code_file)],
+                capture_output=True,
+                text=True
+            )
+            syntax_error = syntax_check.stderr if syntax_check.returncode != 0 else None
+
+        if syntax_error is not None:
+            error_msg = normalize_output(syntax_error)
             print(json.dumps({
                 "status": "compile_error",
                 "error": {
@@ -73,11 +310,13 @@ def main():
             
         passed_tests = 0
         total_runtime = 0
+        # the judge compares the outputs itself and only wants them raw
+        defer_comparison = data.get('deferComparison', False)
         
         for idx, tc in enumerate(data.get('testCases', [])):
             test_id = tc.get('testCaseId', str(idx))
-            expected_output = normalize_output(tc.get('expectedOutput', ''))
-            input_str = tc.get('input', '')
+            expected_output = normalize_output(tc.get('expectedOutput') or '')
+            input_str = tc.get('input') or ''
             is_public = tc.get('isPublic', True)
             
             args = parse_input_args(input_str)
@@ -94,27 +333,38 @@ def main():
             }
             
             try:
-                start_time = time.monotonic()
-                
-                process = subprocess.run(
-                    ['python3', str(code_file)] + args,
-                    capture_output=True,
-                    text=True,
-                    timeout=5,
-                    preexec_fn=set_limits
-                )
-                
-                elapsed = time.monotonic() - start_time
-                execution_time = int(elapsed * 1000)
+                if use_zygote:
+                    returncode, stdout, stderr, measured = zygote.run(code_file, args)
+                else:
+                    returncode, stdout, stderr, measured = run_measured(
+                        ['python3', str(code_file)] + args,
+                        preexec_fn=set_limits
+                    )
+
+                execution_time = measured["wallMs"]
                 result["executionTime"] = execution_time
+                result["cpuTimeMs"] = measured["cpuTimeMs"]
+                result["peakMemoryKb"] = measured["peakMemoryKb"]
                 total_runtime += execution_time
-                
-                actual_output = normalize_output(process.stdout)
+
+                actual_output = stdout if defer_comparison else normalize_output(stdout)
                 result["actual"] = actual_output
 
-                if process.returncode != 0:
+                if measured["cpuLimitExceeded"]:
+                    result.update({
+                        "status": "timeout",
+                        "errorType": "EXECUTION_TIMEOUT",
+                        "error": f"Execution used more than {MAX_CPUTIME_SEC} seconds of CPU time"
+                    })
+                elif measured["wallLimitExceeded"]:
+                    result.update({
+                        "status": "timeout",
+                        "errorType": "WALL_TIME_EXCEEDED",
+                        "error": f"Execution did not finish within {MAX_WALLTIME_SEC} seconds"
+                    })
+                elif returncode != 0:
                     result["status"] = "runtime_error"
-                    error_msg = normalize_output(process.stderr)
+                    error_msg = normalize_output(stderr)
                     
                     # Classify common Python errors
                     if "MemoryError" in error_msg:
@@ -136,6 +386,9 @@ def main():
                         
                     result["error"] = error_msg
                     result["fullError"] = error_msg
+                elif defer_comparison:
+                    result["status"] = "unchecked"
+                    del result["expectedOutput"]
                 else:
                     if actual_output == expected_output:
                         result["status"] = "passed"
@@ -144,13 +397,6 @@ def main():
                         result["status"] = "failed"
                         result["error"] = f"Expected: '{expected_output}', Got: '{actual_output}'"
 
-            except subprocess.TimeoutExpired:
-                result.update({
-                    "status": "timeout",
-                    "errorType": "EXECUTION_TIMEOUT",
-                    "error": "Execution timed out after 5 seconds",
-                    "executionTime": 5000 
-                })
             except Exception as e:
                 result.update({
                     "status": "error",
@@ -1,10 +1,27 @@
+import base64
+import hashlib
 import json
+import os
+import re
 import sys
 import sqlite3
 import time
 
+# The limit is on the CPU time the query takes on this thread, so it does
+# not depend on the container's CPU quota or on how busy the host is.
 MAX_CPUTIME_SEC = 5
 
+# Larger images are not handed back to the judge: the verdict would carry
+# them base64-encoded, on top of the copies the tests already hold.
+MAX_SNAPSHOT_BYTES = 32 * 1024 * 1024
+
+# Statements whose effect lives in the connection rather than in the
+# database file, so a snapshot of the file would lose it. Matched anywhere a
+# statement may start, string literals included: a false match only costs
+# running the script per test, as without snapshots.
+CONNECTION_STATEMENT = re.compile(r"(?:^|;)\s*(?:--[^\n]*\n\s*)*(?:pragma|attach|create\s+temp)\b",
+                                  re.IGNORECASE)
+
 
 def normalize_output(output: str) -> str:
     return '\n'.join(line.rstrip() for line in output.strip().splitlines())
@@ -74,6 +91,80 @@ def run_query(conn: sqlite3.Connection, code: str):
     return last_result
 
 
+class Snapshots:
+    """The database each distinct setup script builds, by the SHA-256 of
+    the script. A script runs once per job and every test starts from a
+    deserialized copy of what it built, so a large seed dataset costs one
+    copy per test instead of being rebuilt from text each time.
+
+    With a snapshot directory from the judge (read-only, under /judge), a
+    script whose image is there does not run at all; the images built here
+    are handed back for the judge to store there, and the ones found there
+    reported so it keeps them."""
+
+    def __init__(self, directory):
+        self.directory = directory
+        # image by key, None for scripts that run per test
+        self.images = {}
+        self.built = {}
+        self.hits = []
+
+    def connect(self, setup_sql, progress_handler):
+        """A fresh connection holding what setup_sql builds. Raises what
+        running the script raises."""
+        if not setup_sql.strip():
+            return self._new_connection(progress_handler)
+        key = hashlib.sha256(setup_sql.encode("utf-8")).hexdigest()
+        if key not in self.images:
+            if not hasattr(sqlite3.Connection, "deserialize") or CONNECTION_STATEMENT.search(setup_sql):
+                self.images[key] = None
+            else:
+                self.images[key] = self._load(key) or self._build(key, setup_sql, progress_handler)
+        image = self.images[key]
+        conn = self._new_connection(progress_handler)
+        if image is None:
+            conn.executescript(setup_sql)
+        else:
+            conn.deserialize(image)
+        return conn
+
+    def report(self, verdict):
+        if self.directory is None:
+            return
+        verdict["snapshotHits"] = self.hits
+        verdict["snapshots"] = {key: base64.b64encode(image).decode("ascii")
+                                for key, image in self.built.items()}
+
+    @staticmethod
+    def _new_connection(progress_handler):
+        conn = sqlite3.connect(":memory:")
+        conn.set_progress_handler(progress_handler, 1000)
+        return conn
+
+    def _load(self, key):
+        if self.directory is None:
+            return None
+        try:
+            with open(os.path.join(self.directory, key + ".db"), "rb") as f:
+                image = f.read()
+        except OSError:
+            # not built yet, or evicted since
+            return None
+        self.hits.append(key)
+        return image
+
+    def _build(self, key, setup_sql, progress_handler):
+        conn = self._new_connection(progress_handler)
+        try:
+            conn.executescript(setup_sql)
+            image = conn.serialize()
+        finally:
+            conn.close()
+        if self.directory is not None and len(image) <= MAX_SNAPSHOT_BYTES:
+            self.built[key] = image
+        return image
+
+
 def main():
     try:
         data = json.load(sys.stdin)
@@ -81,10 +172,18 @@ def main():
         print(json.dumps({"status": "error", "error": "Invalid JSON input"}))
         return
 
+    # shared test sets come as a read-only file under /judge instead
+    if data.get('testCasesPath'):
+        with open(data['testCasesPath']) as f:
+            data['testCases'] = json.load(f)
+
     code = data.get('code', '')
     results = []
     passed_tests = 0
     total_runtime = 0
+    # the judge compares the canonical result tables itself
+    defer_comparison = data.get('deferComparison', False)
+    snapshots = Snapshots(data.get('sqlSnapshotDir'))
 
     for idx, tc in enumerate(data.get('testCases', [])):
         test_id = tc.get('testCaseId', str(idx))
@@ -103,9 +202,10 @@ def main():
             "executionTime": None,
         }
 
-        conn = sqlite3.connect(":memory:")
+        conn = None
         try:
             start_time = time.monotonic()
+            start_cpu = time.thread_time()
             # signal.alarm can't interrupt a query blocked inside sqlite3's C
             # extension -- Python only checks for pending signals between
             # bytecode instructions, which doesn't happen again until the C
@@ -115,17 +215,17 @@ def main():
             # instructions), and returning non-zero aborts the query in
             # progress with sqlite3.OperationalError.
             def _check_timeout():
-                return 1 if (time.monotonic() - start_time) > MAX_CPUTIME_SEC else 0
-            conn.set_progress_handler(_check_timeout, 1000)
-
-            if setup_sql.strip():
-                conn.executescript(setup_sql)
+                return 1 if (time.thread_time() - start_cpu) > MAX_CPUTIME_SEC else 0
+            # the first test with a setup script pays for running it, the
+            # others start from its snapshot
+            conn = snapshots.connect(setup_sql, _check_timeout)
 
             last_result = run_query(conn, code)
 
             elapsed = time.monotonic() - start_time
             execution_time = int(elapsed * 1000)
             result["executionTime"] = execution_time
+            result["cpuTimeMs"] = int((time.thread_time() - start_cpu) * 1000)
             total_runtime += execution_time
 
             if last_result is None:
@@ -135,7 +235,10 @@ def main():
                 actual_output = canonicalize(columns, rows)
             result["actual"] = actual_output
 
-            if actual_output == expected_output:
+            if defer_comparison:
+                result["status"] = "unchecked"
+                del result["expectedOutput"]
+            elif actual_output == expected_output:
                 result["status"] = "passed"
                 passed_tests += 1
             else:
@@ -148,8 +251,9 @@ def main():
                 result.update({
                     "status": "timeout",
                     "errorType": "EXECUTION_TIMEOUT",
-                    "error": f"Query exceeded {MAX_CPUTIME_SEC} seconds",
-                    "executionTime": MAX_CPUTIME_SEC * 1000,
+                    "error": f"Query used more than {MAX_CPUTIME_SEC} seconds of CPU time",
+                    "executionTime": int((time.monotonic() - start_time) * 1000),
+                    "cpuTimeMs": int((time.thread_time() - start_cpu) * 1000),
                 })
             else:
                 result.update({
@@ -172,14 +276,15 @@ def main():
                 "error": str(e),
             })
         finally:
-            conn.close()
+            if conn is not None:
+                conn.close()
 
         results.append(result)
 
     total_tests = len(results)
     average_runtime = total_runtime // total_tests if total_tests > 0 else 0
 
-    print(json.dumps({
+    verdict = {
         "status": "completed",
         "testResults": results,
         "metrics": {
@@ -187,7 +292,9 @@ def main():
             "totalTests": total_tests,
             "averageRuntime": average_runtime,
         },
-    }))
+    }
+    snapshots.report(verdict)
+    print(json.dumps(verdict))
 
 
 if __name__ == '__main__':
@@ -0,0 +1,128 @@
+#ifndef ASYNC_REDIS_H
+#define ASYNC_REDIS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+struct redisAsyncContext;
+struct redisReply;
+
+/**
+ * @class AsyncRedis
+ * @brief hiredis async client driven by its own epoll loop thread, over a
+ * small pool of connections.
+ *
+ * Worker threads never talk to a socket: they queue a request (one or more
+ * commands that are written back to back as a pipeline) and wake the loop
+ * through an eventfd. The loop spreads requests over the connections round
+ * robin, so many workers' commands are in flight at once instead of queuing
+ * on a mutex for a full round-trip each. A request's callback runs on the
+ * loop thread with the reply to its last command, or nullptr if the
+ * connection failed; it must copy out what it needs and must not block.
+ */
+class AsyncRedis
+{
+public:
+    using Command = std::vector<std::string>;
+    using Callback = std::function<void(redisReply *reply)>;
+
+    struct Stats
+    {
+        uint64_t requests = 0;   // round-trips: a pipelined request counts once
+        uint64_t commands = 0;
+        uint64_t failures = 0;   // no reply (connection lost) or error reply
+        uint64_t reconnects = 0;
+        // time spent in the submission queue before being written, and from
+        // being written to the reply
+        double totalQueueWaitMs = 0;
+        double totalRoundTripMs = 0;
+        double maxRoundTripMs = 0;
+        size_t connections = 0;
+    };
+
+    AsyncRedis(std::string host, int port, size_t connections);
+    ~AsyncRedis();
+
+    AsyncRedis(const AsyncRedis &) = delete;
+    AsyncRedis &operator=(const AsyncRedis &) = delete;
+
+    /**
+     * @brief Connects the pool and starts the loop thread.
+     * @return false if no connection could be opened.
+     */
+    bool start();
+
+    /**
+     * @brief Queues commands to be pipelined on one connection. Never blocks
+     * on the network.
+     */
+    void submit(std::vector<Command> commands, Callback done = nullptr);
+
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    struct Request
+    {
+        std::vector<Command> commands;
+        Callback done;
+        std::chrono::steady_clock::time_point submitted;
+        std::chrono::steady_clock::time_point sent;
+        AsyncRedis *owner = nullptr;
+    };
+
+    struct Connection
+    {
+        AsyncRedis *owner = nullptr;
+        redisAsyncContext *context = nullptr;
+        int fd = -1;
+        uint32_t events = 0;
+        bool registered = false;
+    };
+
+    void loop();
+    void drainSubmissions();
+    void dispatch(std::unique_ptr<Request> request);
+    bool connect(Connection &connection);
+    void updateEvents(Connection &connection, uint32_t add, uint32_t remove);
+    void complete(Request *request, redisReply *reply);
+
+    // hiredis event-loop adapter hooks
+    static void addRead(void *privdata);
+    static void delRead(void *privdata);
+    static void addWrite(void *privdata);
+    static void delWrite(void *privdata);
+    static void cleanup(void *privdata);
+    static void onDisconnect(const redisAsyncContext *context, int status);
+    static void onReply(redisAsyncContext *context, void *reply, void *privdata);
+
+    std::string host_;
+    int port_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+    size_t nextConnection_ = 0;
+
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::thread loopThread_;
+    std::atomic<bool> stop_{false};
+
+    std::mutex queueMutex_;
+    std::deque<std::unique_ptr<Request>> queue_;
+
+    mutable std::mutex statsMutex_;
+    Stats stats_;
+    Metrics::Histogram &roundTripSeconds_;
+    Metrics::Histogram &sendWaitSeconds_;
+};
+
+#endif // ASYNC_REDIS_H
@@ -0,0 +1,74 @@
+#ifndef CANCELLATION_TOKEN_H
+#define CANCELLATION_TOKEN_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/**
+ * @class CancellationToken
+ * @brief Shared flag for cooperative cancellation of one job.
+ *
+ * Copies share state. Code that can poll checks cancelled(); code that sits
+ * in a blocking call (a sandbox child being waited on) registers a callback
+ * with onCancel() that unblocks it, e.g. by killing the child.
+ */
+class CancellationToken
+{
+    struct State;
+
+public:
+    /**
+     * @brief Keeps an onCancel() callback registered until destroyed.
+     * Destruction waits for the callback if it is running right now, so
+     * whatever it captured may be released afterwards.
+     */
+    class Registration
+    {
+    public:
+        Registration() = default;
+        Registration(Registration &&other) noexcept;
+        Registration &operator=(Registration &&other) noexcept;
+        Registration(const Registration &) = delete;
+        Registration &operator=(const Registration &) = delete;
+        ~Registration();
+
+    private:
+        friend class CancellationToken;
+        Registration(std::shared_ptr<State> state, uint64_t id) : state_(std::move(state)), id_(id) {}
+        void reset();
+
+        std::shared_ptr<State> state_;
+        uint64_t id_ = 0;
+    };
+
+    CancellationToken();
+
+    /**
+     * @brief Sets the flag and runs the registered callbacks, once.
+     */
+    void cancel() const;
+    bool cancelled() const;
+
+    /**
+     * @brief Runs `callback` when the token is cancelled, right away if it
+     * already is.
+     */
+    Registration onCancel(std::function<void()> callback) const;
+
+private:
+    struct State
+    {
+        std::atomic<bool> cancelled{false};
+        std::mutex mutex;
+        std::map<uint64_t, std::function<void()>> callbacks;
+        uint64_t nextId = 1;
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+#endif // CANCELLATION_TOKEN_H
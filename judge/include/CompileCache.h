@@ -0,0 +1,105 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+struct JudgeConfig;
+
+/**
+ * @class CompileCache
+ * @brief Bounded, content-addressed LRU of compiled C/C++ submissions on
+ * local disk.
+ *
+ * Entries are keyed by a hash of everything that determines the compiler's
+ * output (code, library code, language, compiler flags, runner image
+ * digest) and hold either the executable or the compile_error verdict.
+ * The cache lives under the judge data directory, which every sandbox sees
+ * read-only at /judge, so a hit is run straight from the cache without
+ * copying. The binaries directory is traverse-only (0711): a sandbox can
+ * open an entry whose hash it was given but cannot list the others.
+ */
+class CompileCache
+{
+public:
+    struct Entry
+    {
+        // path of the executable inside the sandbox, empty for a compile error
+        std::string binaryPath;
+        // cached compile_error verdict, empty for a binary
+        std::string compileError;
+    };
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t stores = 0;
+        uint64_t evictions = 0;
+        uint64_t bytes = 0;
+        uint64_t entries = 0;
+    };
+
+    /**
+     * @param dataDir judge data directory as seen by the judge
+     * @param maxBytes size budget for executables plus cached errors
+     */
+    CompileCache(const std::string &dataDir, uint64_t maxBytes);
+
+    /**
+     * @brief Creates the cache directory and indexes entries left by a
+     * previous run, oldest first.
+     */
+    bool initialize();
+
+    static std::string key(const std::string &code, const std::string &libraryCode,
+                           const std::string &language, const std::string &compilerFlags,
+                           const std::string &imageDigest);
+
+    std::optional<Entry> lookup(const std::string &key);
+
+    /**
+     * @brief Where the executable for `key` is, or would be, inside the sandbox.
+     */
+    static std::string binaryPath(const std::string &key);
+
+    bool storeBinary(const std::string &key, const std::string &binary);
+    bool storeCompileError(const std::string &key, const std::string &verdict);
+
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    struct Node
+    {
+        std::list<std::string>::iterator position;
+        uint64_t bytes = 0;
+        bool compileError = false;
+    };
+
+    bool store(const std::string &key, const std::string &fileName, const std::string &content, mode_t mode);
+    void evictLocked();
+    void removeEntry(const std::string &key);
+
+    std::string dir_;
+    uint64_t maxBytes_;
+
+    mutable std::mutex mutex_;
+    std::list<std::string> lru_; // most recently used at the front
+    std::unordered_map<std::string, Node> index_;
+    Stats stats_;
+};
+
+/**
+ * @brief The cache JUDGE_COMPILE_CACHE_MB asks for, initialized; null if it
+ * is disabled or cannot be used.
+ */
+std::unique_ptr<CompileCache> makeCompileCache(const JudgeConfig &config);
+
+#endif // COMPILE_CACHE_H
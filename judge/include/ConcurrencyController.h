@@ -0,0 +1,118 @@
+#ifndef CONCURRENCY_CONTROLLER_H
+#define CONCURRENCY_CONTROLLER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Share of wall time (percent) in which some task was stalled on
+ * each resource, from Linux pressure stall information (PSI).
+ */
+struct HostPressure
+{
+    double cpu = 0;
+    double memory = 0;
+    double io = 0;
+};
+
+/**
+ * @class ConcurrencyController
+ * @brief AIMD limit on how many jobs may be in sandboxes at once.
+ *
+ * Every control interval the judge hands it the host's pressure and the mean
+ * latency of the sandboxes that finished in the interval. If CPU, memory or
+ * IO pressure is over its limit, or sandboxes take more than
+ * latencyTolerance times their usual time (judged only in intervals in which
+ * some finished), the limit is cut by a quarter (at most once per cooldown,
+ * so a cut can take effect before the next); otherwise, if every slot is in
+ * use, it grows by one. It never leaves [min, max].
+ *
+ * "Usual time" is a slow moving average of the latency, ~1 minute, so a
+ * shift in the job mix is absorbed while a sudden slowdown is not.
+ */
+class ConcurrencyController
+{
+public:
+    struct Options
+    {
+        size_t min = 1;
+        size_t max = 1;
+        // stall percentages above which the host counts as overloaded
+        double cpuPressureLimit = 40;
+        double memoryPressureLimit = 10;
+        double ioPressureLimit = 30;
+        double latencyTolerance = 2.0;
+        std::chrono::milliseconds decreaseCooldown{10000};
+        // where the cpu, memory and io PSI files are
+        std::string pressureDir = "/proc/pressure";
+    };
+
+    enum class Reason
+    {
+        None,
+        Cpu,
+        Memory,
+        Io,
+        Latency,
+    };
+
+    struct Stats
+    {
+        size_t limit = 0;
+        bool pressureAvailable = false;
+        HostPressure pressure;
+        double latencyMs = 0;
+        double baselineMs = 0;
+        uint64_t increases = 0;
+        uint64_t decreases = 0;
+        Reason lastDecrease = Reason::None;
+    };
+
+    explicit ConcurrencyController(const Options &options);
+
+    /**
+     * @brief Host pressure since the previous call, from the `total=` stall
+     * counters rather than the kernel's 10 s averages, which lag a control
+     * interval of a few seconds.
+     * @return false if the host has no PSI (kernel without CONFIG_PSI, or
+     * psi=0); the controller then goes by latency alone
+     */
+    bool samplePressure(HostPressure &pressure);
+
+    /**
+     * @brief One control step.
+     * @param latencyMs mean wall time of the sandboxes that finished since
+     * the last step, 0 if none did
+     * @param inUse jobs in sandboxes right now
+     * @return the new limit
+     */
+    size_t update(const HostPressure &pressure, double latencyMs, size_t inUse,
+                  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    size_t limit() const;
+    Stats stats() const;
+    void logStats() const;
+
+    static const char *reasonName(Reason reason);
+
+private:
+    /** @param sampled whether sandboxes finished in the interval, the latency signal counts only then */
+    Reason overloaded(const HostPressure &pressure, bool sampled) const;
+
+    const Options options_;
+
+    // stall totals (us) at the previous sample, per resource
+    uint64_t lastStallUs_[3] = {0, 0, 0};
+    std::chrono::steady_clock::time_point lastSample_;
+    bool sampled_ = false;
+
+    mutable std::mutex mutex_;
+    Stats stats_;
+    double recentMs_ = 0;
+    std::chrono::steady_clock::time_point lastDecrease_;
+};
+
+#endif // CONCURRENCY_CONTROLLER_H
@@ -0,0 +1,67 @@
+#ifndef DOCKER_EXECUTOR_H
+#define DOCKER_EXECUTOR_H
+
+#include "SandboxExecutor.h"
+#include "SandboxPool.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * @class DockerExecutor
+ * @brief Runs runners through the docker CLI: `docker exec` into a warm pool
+ * container when one is idle, otherwise a cold `docker run --rm`.
+ *
+ * With accounting enabled a cold container is started under a cgroup parent
+ * of its own, named after it. `docker run --rm` returns only once the
+ * container and its cgroup are gone, but the parent keeps the hierarchical
+ * CPU and memory.peak counters, so the judge reads them there and then
+ * removes it. Pooled containers serve many jobs in one cgroup and are not
+ * accounted.
+ */
+class DockerExecutor : public SandboxExecutor
+{
+public:
+    DockerExecutor(SandboxPool &pool, const std::string &dataHostDir);
+
+    const char *name() const override { return "docker"; }
+    std::string imageDigest(const std::string &image) override;
+    void refreshImageDigests() override;
+
+    /**
+     * @brief Accounts cold runs in cgroups under `parent`, as seen at `mount`
+     * (the host's cgroup v2 hierarchy, writable).
+     * @return false, leaving runs unaccounted, if the daemon does not use
+     * the cgroupfs driver on cgroup v2 or `mount` is not that hierarchy
+     */
+    bool enableAccounting(const std::string &parent, const std::string &mount);
+
+protected:
+    void executeAsync(const SandboxRequest &request, Completion done) override;
+
+private:
+    static pid_t spawnDocker(std::vector<std::string> &args, int inFd, int outFd);
+    void removeDetached(const std::string &container);
+    /** @brief Removes a run's parent cgroup, and any earlier one that was still busy. */
+    void removeCgroup(const std::string &dir);
+
+    SandboxPool &pool_;
+    std::string dataHostDir_;
+
+    std::mutex digestMutex_;
+    std::map<std::string, std::string> digests_;
+
+    // names cold containers, so a cancelled run can be removed by name
+    std::atomic<uint64_t> sequence_{0};
+
+    // cgroup parents of cold runs, empty if they are not accounted
+    std::string cgroupParent_;
+    std::string cgroupMount_;
+    std::mutex cgroupMutex_;
+    // run cgroups that were still busy, retried with the next removal
+    std::vector<std::string> staleCgroups_;
+};
+
+#endif // DOCKER_EXECUTOR_H
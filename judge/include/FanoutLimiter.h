@@ -0,0 +1,77 @@
+#ifndef FANOUT_LIMITER_H
+#define FANOUT_LIMITER_H
+
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @class FanoutLimiter
+ * @brief Bounds how many extra sandboxes jobs may run in parallel to split
+ * their test cases.
+ *
+ * A job's first chunk runs in the job's own sandbox slot and needs nothing;
+ * each further chunk takes one from a global budget shared by all jobs.
+ * Acquiring never blocks: under load a job simply gets fewer chunks (down to
+ * one, i.e. no fan-out), so fan-out can never starve the worker pool.
+ */
+class FanoutLimiter
+{
+public:
+    struct Stats
+    {
+        uint64_t fannedOut = 0;   // jobs that ran in more than one chunk
+        uint64_t throttled = 0;   // jobs that got fewer chunks than they asked for
+        unsigned int inUse = 0;
+        unsigned int peakInUse = 0;
+        unsigned int global = 0;
+    };
+
+    /**
+     * @brief Chunks granted to one job, returned to the limiter on destruction.
+     */
+    class Grant
+    {
+    public:
+        Grant(Grant &&other) noexcept;
+        Grant(const Grant &) = delete;
+        Grant &operator=(const Grant &) = delete;
+        Grant &operator=(Grant &&) = delete;
+        ~Grant();
+
+        unsigned int chunks() const { return 1 + extra_; }
+
+    private:
+        friend class FanoutLimiter;
+        Grant(FanoutLimiter *limiter, unsigned int extra) : limiter_(limiter), extra_(extra) {}
+
+        FanoutLimiter *limiter_;
+        unsigned int extra_;
+    };
+
+    /**
+     * @param perJob most chunks a single job is split into (1 disables fan-out)
+     * @param global most extra sandboxes in flight across all jobs
+     */
+    FanoutLimiter(unsigned int perJob, unsigned int global);
+
+    /**
+     * @brief Grants up to `wanted` chunks (capped per job), at least one.
+     */
+    Grant acquire(unsigned int wanted);
+
+    unsigned int perJob() const { return perJob_; }
+
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    void release(unsigned int extra);
+
+    const unsigned int perJob_;
+    const unsigned int global_;
+
+    mutable std::mutex mutex_;
+    Stats stats_;
+};
+
+#endif // FANOUT_LIMITER_H
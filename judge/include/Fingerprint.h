@@ -0,0 +1,41 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Hashes of a submission's normalized token stream, 31-bit so they
+ * fit the server's integer columns, sorted and unique.
+ */
+using Fingerprint = std::vector<uint32_t>;
+
+/**
+ * @brief Splits source code into tokens with everything a copy can change
+ * for free taken out: comments, whitespace, preprocessor lines and the
+ * spelling of identifiers, literals and SQL keywords. Keywords and
+ * operators stay as they are, every identifier becomes "V", every number
+ * "N" and every string "S".
+ *
+ * "c", "cpp", "javascript" and "typescript" share a C-like lexer; "python"
+ * and "sql" have their own comment and string rules. Anything else is
+ * lexed as C.
+ */
+std::vector<std::string> tokenize(std::string_view code, const std::string &language);
+
+/**
+ * @brief Winnowed k-gram fingerprint (Schleimer et al.): hashes every run
+ * of `k` tokens and keeps the smallest hash of every `window` consecutive
+ * ones, so two submissions sharing a run of at least k + window - 1
+ * tokens are guaranteed to share a hash, at about 2 / (window + 1) of the
+ * k-grams' cost.
+ */
+Fingerprint fingerprint(std::string_view code, const std::string &language, size_t k = 12, size_t window = 8);
+
+/** @brief The fingerprint of an already tokenized submission. */
+Fingerprint fingerprintTokens(const std::vector<std::string> &tokens, size_t k = 12, size_t window = 8);
+
+#endif // FINGERPRINT_H
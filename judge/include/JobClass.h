@@ -0,0 +1,74 @@
+#ifndef JOB_CLASS_H
+#define JOB_CLASS_H
+
+#include <cstddef>
+
+/**
+ * @brief Priority classes of judge jobs, most urgent first. Each has its own
+ * Redis list (or stream, see jobClassStream()), written by the server's
+ * JudgeQueue service; run jobs keep the original judge:queue.
+ */
+enum class JobClass
+{
+    Quiz,
+    Submit,
+    Run,
+};
+
+constexpr size_t JOB_CLASS_COUNT = 3;
+
+inline const char *jobClassName(JobClass jobClass)
+{
+    switch (jobClass)
+    {
+    case JobClass::Quiz:
+        return "quiz";
+    case JobClass::Submit:
+        return "submit";
+    default:
+        return "run";
+    }
+}
+
+inline const char *jobClassQueue(JobClass jobClass)
+{
+    switch (jobClass)
+    {
+    case JobClass::Quiz:
+        return "judge:queue:quiz";
+    case JobClass::Submit:
+        return "judge:queue:submit";
+    default:
+        return "judge:queue";
+    }
+}
+
+// The server pushes a token here with every job it queues on a list (trimmed
+// to a few), so an idle judge parks on it and then claims through the claim
+// script instead of popping a job off a queue itself.
+constexpr const char *JOB_WAKE_KEY = "judge:queue:wake";
+
+// Lanes of the stream intake (JUDGE_INTAKE=stream), one per class, all read
+// through the same consumer group.
+inline const char *jobClassStream(JobClass jobClass)
+{
+    switch (jobClass)
+    {
+    case JobClass::Quiz:
+        return "judge:stream:quiz";
+    case JobClass::Submit:
+        return "judge:stream:submit";
+    default:
+        return "judge:stream:run";
+    }
+}
+
+// Plagiarism jobs (see PlagiarismWorker) are no priority class: they have a
+// lane of their own, list or stream, claimed by an intake of their own up to
+// JUDGE_PLAGIARISM_CONCURRENCY at a time and never counted against the
+// sandbox slots. The server wakes that intake through its own key.
+constexpr const char *PLAGIARISM_QUEUE = "judge:queue:plagiarism";
+constexpr const char *PLAGIARISM_STREAM = "judge:stream:plagiarism";
+constexpr const char *PLAGIARISM_WAKE_KEY = "judge:queue:plagiarism:wake";
+
+#endif // JOB_CLASS_H
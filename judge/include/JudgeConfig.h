@@ -0,0 +1,149 @@
+#ifndef JUDGE_CONFIG_H
+#define JUDGE_CONFIG_H
+
+#include "JobClass.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * @brief Runtime configuration for the judge, read once at startup.
+ *
+ * Everything here comes from the environment so the judge container can be
+ * tuned from docker-compose without a rebuild.
+ */
+struct JudgeConfig
+{
+    std::string redisHost = "127.0.0.1";
+    int redisPort = 6379;
+    // Async connections shared by every worker thread for verdicts and
+    // lookups; the blocking queue pop has one more of its own.
+    unsigned int redisConnections = 2;
+
+    // Threads that run job steps (parsing, merging, publishing); none of
+    // them ever waits on a sandbox.
+    unsigned int numThreads = 0;
+    // Jobs whose sandboxes may run at once, independent of numThreads; each
+    // has one sandbox at a time plus whatever fan-out grants it.
+    unsigned int maxSandboxes = 0;
+    // "fixed" keeps maxSandboxes as the limit; "adaptive" moves it between
+    // minSandboxes and maxSandboxes with the host's load (AIMD, see
+    // ConcurrencyController): it shrinks when CPU, memory or IO pressure
+    // (PSI, percent of time some task stalled) goes over its limit or
+    // sandboxes slow down past latencyTolerance times their usual time.
+    std::string concurrencyMode = "fixed";
+    unsigned int minSandboxes = 1;
+    double cpuPressureLimit = 40;
+    double memoryPressureLimit = 10;
+    double ioPressureLimit = 30;
+    double latencyTolerance = 2.0;
+    unsigned int concurrencyIntervalMs = 2000;
+    // Wall-clock budget for one job once it starts; past it the job's
+    // sandboxes are killed and it gets an error verdict. 0 disables it.
+    unsigned int jobTimeoutSec = 300;
+
+    // Number of pre-started containers to keep warm per runner image. An image
+    // missing from the map (or mapped to 0) always takes the cold
+    // `docker run --rm` path.
+    std::map<std::string, size_t> poolSizes;
+
+    // How many jobs a warm container serves before it is torn down and
+    // replaced. Between uses it is reset in place (processes killed, /tmp
+    // wiped), which is much cheaper than a fresh container.
+    unsigned int poolMaxUses = 20;
+
+    // "docker" runs runners through the docker CLI (and the pool above);
+    // "native" uses the in-process namespace/cgroup/seccomp sandbox; "stub"
+    // runs nothing and answers every job after stubRunMs.
+    std::string sandboxBackend = "docker";
+    unsigned int stubRunMs = 200;
+    // Unpacked runner images for the native backend, see export_runners.sh.
+    std::string nativeRunnerRoot = "/var/lib/judge/runners";
+    // Delegated cgroup v2 directory the native backend creates run leaves in.
+    std::string cgroupRoot = "/sys/fs/cgroup/judge";
+    // Cgroup v2 parent (a path under the host's cgroupfs, e.g. /judge-docker)
+    // under which each cold docker run gets one of its own, so its CPU time
+    // and peak memory can be read after --rm removed it; empty leaves docker
+    // runs unaccounted. Needs dockerd's cgroupfs driver and the host's
+    // cgroupfs writable at dockerCgroupMount. Pooled containers are never
+    // accounted.
+    std::string dockerCgroupParent;
+    std::string dockerCgroupMount = "/sys/fs/cgroup";
+
+    // Local state owned by the judge (compile cache, ...). Every sandbox sees
+    // it read-only at /judge. dataHostDir is the same directory as the docker
+    // daemon sees it, which differs when the judge itself runs in a container.
+    std::string dataDir = "/var/lib/judge/data";
+    std::string dataHostDir;
+    // Disk budget for compiled C/C++ submissions, 0 disables the cache.
+    uint64_t compileCacheBytes = 512ull << 20;
+    // Disk budget for the databases SQL tests' setup scripts build, 0
+    // disables the cache and every test runs its script again.
+    uint64_t sqlSnapshotBytes = 256ull << 20;
+    // Memory budget for test sets jobs refer to by hash (testSetRef); sets
+    // in use by a job are kept regardless.
+    uint64_t testSetCacheBytes = 256ull << 20;
+    // Memory budget for verdicts handed out again to identical jobs, 0
+    // disables it: a job whose program prints something different on each
+    // run would get its first verdict again for verdictCacheTtlSec.
+    uint64_t verdictCacheBytes = 0;
+    unsigned int verdictCacheTtlSec = 600;
+    // Memory budget for the plagiarism fingerprint index, whole assignments
+    // least recently checked first leave it; 0 turns plagiarism jobs away.
+    uint64_t plagiarismIndexBytes = 256ull << 20;
+    // Threads comparing an assignment's submissions pairwise for a report.
+    unsigned int plagiarismThreads = 0;
+    // Plagiarism jobs answered at once, on threads of their own; they have
+    // their own lane and never take a sandbox slot.
+    unsigned int plagiarismConcurrency = 2;
+
+    // Test-case fan-out: a job's test cases may be split over up to
+    // fanoutPerJob sandboxes running in parallel (1 disables it), with at
+    // most fanoutGlobal extra sandboxes in flight across all jobs.
+    unsigned int fanoutPerJob = 4;
+    unsigned int fanoutGlobal = 0;
+
+    // Latency targets per priority class (quiz, submit, run): how long a job
+    // may wait before it should start. Jobs are claimed earliest due first,
+    // due being created + target or the job's own deadline, so lower
+    // classes age into being picked and never starve.
+    std::array<uint64_t, JOB_CLASS_COUNT> queueTargetsMs = {5000, 30000, 60000};
+
+    // "list" pops jobs off the judge:queue* lists through one shared
+    // processing list; "stream" reads the judge:stream:* lanes through the
+    // "judge" consumer group, so every judge node has its own pending list
+    // and entries of a node that died are reclaimed by the others.
+    std::string intakeMode = "list";
+    // This node's consumer in the group, unique per judge process (default
+    // hostname-pid).
+    std::string consumerName;
+    // Stream entries unacked for this long are taken over from their
+    // consumer. Live judges refresh their entries well within it.
+    uint64_t reclaimIdleMs = 60000;
+
+    // "judge" has the runners send their raw output back and compares it
+    // with the expected output here (OutputComparator); "runner" leaves the
+    // comparison to the runners, as before.
+    bool compareInJudge = true;
+    // Python runners fork each test off an interpreter that is already up
+    // instead of starting a new one per test. JavaScript/TypeScript runners
+    // still boot one per test but leave the boot out of its timing.
+    bool zygoteRunners = true;
+    // Comparison for submissions that do not pick one themselves: "exact",
+    // "lines" (what the runners' strip()/normalize_output() accept, plus
+    // trailing spaces and CRLF) or "tokens".
+    std::string compareMode = "lines";
+    // Submit verdicts carry at most this much of each test's expected and
+    // actual output (0: all of it); run verdicts always carry all of it.
+    size_t verdictOutputBytes = 16 * 1024;
+
+    // Port of the Prometheus metrics endpoint (GET /metrics), 0 disables it.
+    int metricsPort = 9464;
+
+    static JudgeConfig fromEnvironment();
+};
+
+#endif // JUDGE_CONFIG_H
@@ -3,7 +3,28 @@
 #include "RedisHandler.h"
 #include "JudgeWorker.h"
 #include <string>
-#include "ThreadPool.h"
+#include "WorkStealingExecutor.h"
+#include "JudgeConfig.h"
+#include "SandboxPool.h"
+#include "SandboxExecutor.h"
+#include "CompileCache.h"
+#include "SqlSnapshotCache.h"
+#include "VerdictCache.h"
+#include "PlagiarismIndex.h"
+#include "PlagiarismWorker.h"
+#include "TestSetStore.h"
+#include "FanoutLimiter.h"
+#include "ConcurrencyController.h"
+#include "QueueWaitStats.h"
+#include "MetricsServer.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
 /**
  * @class JudgeEngine
@@ -12,10 +33,134 @@
 class JudgeEngine
 {
 public:
-    JudgeEngine(const std::string &redisHost, int redisPort, size_t numThreads);
+    /**
+     * @param executor sandbox backend to use instead of the one
+     * config.sandboxBackend selects, e.g. a simulated one in judge_bench
+     */
+    explicit JudgeEngine(const JudgeConfig &config, std::unique_ptr<SandboxExecutor> executor = nullptr);
+    ~JudgeEngine();
+    /** @brief Runs the intake loop until stop() is called. */
     void start();
+    /**
+     * @brief Makes start() return once the intake's current Redis call is
+     * over. Jobs already claimed still finish; the destructor waits for them.
+     */
+    void stop();
 
 private:
+    /**
+     * @brief Logs sandbox pool, compile cache, fan-out, executor, Redis and queue wait statistics once a minute,
+     * whenever something happened since the last report.
+     */
+    void reportStats();
+
+    /** @brief What one intake loop claims from. */
+    struct Lanes
+    {
+        // pending lists (JUDGE_INTAKE=list) or streams, in claim-script order
+        std::vector<std::string> keys;
+        // latency target per lane, see JudgeConfig::queueTargetsMs
+        std::vector<uint64_t> targetsMs;
+        // where the server pushes a token with every list job
+        std::string wakeKey;
+        // plagiarism jobs, counted against plagiarismSlots_ instead of slots_
+        bool plagiarism = false;
+    };
+
+    /** @brief The priority class lanes, or the plagiarism lane. */
+    Lanes intakeLanes(bool plagiarism) const;
+
+    /** @brief Intake loop over pending lists (JUDGE_INTAKE=list). */
+    void runListIntake(const Lanes &lanes);
+    /**
+     * @brief Intake loop over lane streams (JUDGE_INTAKE=stream), which also
+     * takes over entries other consumers left pending.
+     */
+    void runStreamIntake(const Lanes &lanes);
+    /**
+     * @brief Keeps this consumer's entries from looking abandoned while
+     * their jobs run, see RedisHandler::touchStreamJobs().
+     */
+    void heartbeat();
+
+    /**
+     * @brief Moves the job slot limit with host pressure and sandbox latency
+     * every control interval (JUDGE_CONCURRENCY=adaptive).
+     */
+    void adjustConcurrency();
+
+    /** @brief Waits a second after a Redis error, or less if stop() is called. */
+    void backOff();
+
+    /** @brief Gauges read when the metrics endpoint is scraped. */
+    void registerGauges();
+
+    /**
+     * @brief Blocks until a sandbox slot, or a plagiarism one, is free.
+     * @return the number of free slots
+     */
+    size_t waitForFreeSlots(bool plagiarism);
+
+    /**
+     * @brief Hands a claimed job to the workers, holding a slot until its
+     * verdict is out; plagiarism jobs go to their own threads and slots.
+     */
+    void dispatch(ClaimedJob job, JobAck ack);
+    /** @brief Acks a job unless its verdict did and frees its slot. */
+    void finish(const JobAck &ack, bool acked, bool plagiarism);
+    /** @brief Stops heartbeating a finished job's stream entry. */
+    void forgetEntry(const JobAck &ack);
+
+    SandboxPool sandboxPool_;
+    std::unique_ptr<SandboxExecutor> executor_;
+    std::unique_ptr<CompileCache> compileCache_;
+    std::unique_ptr<SqlSnapshotCache> sqlSnapshots_;
+    std::unique_ptr<VerdictCache> verdictCache_;
+    TestSetStore testSets_;
+    FanoutLimiter fanoutLimiter_;
     JudgeWorker judgeWorker_;
-    ThreadPool threadPool_;
+    // null with JUDGE_PLAGIARISM_MB=0
+    std::unique_ptr<PlagiarismIndex> plagiarismIndex_;
+    std::unique_ptr<PlagiarismWorker> plagiarismWorker_;
+
+    // jobs started and not finished yet, at most slots_: JUDGE_MAX_SANDBOXES,
+    // or whatever concurrency_ currently allows; guarded by slotsMutex_
+    size_t slots_;
+    std::unique_ptr<ConcurrencyController> concurrency_;
+    const std::chrono::milliseconds concurrencyInterval_;
+    // latency target per pending queue, see JudgeConfig::queueTargetsMs
+    const std::vector<uint64_t> queueTargetsMs_;
+    QueueWaitStats queueWaitStats_;
+
+    const bool streamIntake_;
+    const std::string consumer_;
+    const std::chrono::milliseconds reclaimIdle_;
+    // stream entries of jobs in flight, per stream
+    std::map<std::string, std::set<std::string>> inFlight_;
+    std::mutex inFlightMutex_;
+
+    size_t busySlots_ = 0;
+    // plagiarism jobs in flight, at most plagiarismSlots_ from their own
+    // lane; guarded by slotsMutex_ like the sandbox slots
+    const size_t plagiarismSlots_;
+    size_t busyPlagiarism_ = 0;
+    std::mutex slotsMutex_;
+    std::condition_variable slotsCv_;
+
+    // after everything its tasks touch, so it is destroyed (and drains its
+    // queue) first; judgeWorker_ only keeps a reference to it
+    WorkStealingExecutor workers_;
+    // plagiarism jobs run to completion on a thread, so not on workers_
+    WorkStealingExecutor plagiarismWorkers_;
+    const std::chrono::seconds jobTimeout_;
+
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> stopIntake_{false};
+    std::mutex statsMutex_;
+    std::condition_variable statsCv_;
+    std::thread statsReporter_;
+    std::thread heartbeat_;
+    std::thread concurrencyThread_;
+    std::thread plagiarismIntake_;
+    std::unique_ptr<MetricsServer> metricsServer_;
 };
\ No newline at end of file
@@ -1,65 +1,155 @@
 #pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include "nlohmann/json.hpp"
 #include <vector>
+#include "SandboxExecutor.h"
+#include "SubmissionScanner.h"
+#include "CompileCache.h"
+#include "SqlSnapshotCache.h"
+#include "TestSetStore.h"
+#include "VerdictCache.h"
+#include "FanoutLimiter.h"
+#include "WorkStealingExecutor.h"
+#include "RedisHandler.h"
+#include "OutputComparator.h"
 
-struct TestCase
-{
-    int test_case_id;
-    std::string input;
-    std::string expected_output;
-    bool is_public;
-};
+struct JudgeConfig;
 
-struct Submission
+class JudgeWorker
 {
-    std::string code;
-    std::string language;
-    std::vector<TestCase> testCases;
-    std::string mode;
-    std::string libraryCode;
-    std::string outputType;
-};
+public:
+    // called once per job with whether its verdict acked it
+    using Done = std::function<void(bool acked)>;
+    // takes a job's verdict instead of Redis (offline regrading), returns
+    // whether it was stored
+    using Publish = std::function<bool(const std::string &jobId, const std::string &status, const std::string &verdict)>;
 
-namespace nlohmann
-{
-    template <>
-    struct adl_serializer<TestCase>
+    /** @brief Where outputs are checked and how much of them a verdict keeps, see JudgeConfig. */
+    struct OutputChecks
     {
-        // input/expectedOutput can legitimately be SQL NULL (e.g. a test case with
-        // no stdin/argv, or an image-output problem with nothing to diff), which
-        // arrives here as JSON null. Neither .at(...).get_to(std::string&) nor
-        // .value(key, default) tolerate an explicit null (only a missing key) --
-        // both throw type_error.302. And since this runs inside a
-        // std::packaged_task (see ThreadPool::enqueue), an uncaught throw here is
-        // silently swallowed into a future nobody reads, leaving the job stuck in
-        // the processing queue forever with no verdict and no log line. Extract
-        // manually so null is handled the same as a missing key.
-        static std::string stringOrEmpty(const json &j, const char *key)
-        {
-            if (!j.contains(key) || j.at(key).is_null())
-            {
-                return "";
-            }
-            return j.at(key).get<std::string>();
-        }
-
-        static void from_json(const json &j, TestCase &tc)
-        {
-            j.at("testCaseId").get_to(tc.test_case_id);
-            tc.input = stringOrEmpty(j, "input");
-            tc.expected_output = stringOrEmpty(j, "expectedOutput");
-            j.at("isPublic").get_to(tc.is_public);
-        }
+        bool inJudge = true;
+        CompareMode defaultMode = CompareMode::Lines;
+        // per output and test in submit verdicts, 0 for no limit
+        size_t maxVerdictBytes = 16 * 1024;
     };
-}
 
-class JudgeWorker
-{
-public:
-    explicit JudgeWorker();
-    void processSubmission(const std::string &jobId, const std::string &jsonSubmissionData);
+    static OutputChecks outputChecks(const JudgeConfig &config);
+
+    /**
+     * @param compileCache may be null, C/C++ is then compiled on every job
+     * @param sqlSnapshots may be null, SQL tests then run their setup
+     * script every time
+     * @param verdictCache may be null, every job then runs
+     * @param testSets resolves the testSetRef of jobs that carry no test cases
+     * @param fanout bounds splitting a job's test cases over parallel sandboxes
+     * @param continuations runs each step of a job once its sandbox is done
+     * @param zygote whether interpreted runners are asked to start tests off
+     * a running interpreter, see JudgeConfig::zygoteRunners
+     * @param publish where verdicts go, default: their Redis verdict key
+     */
+    JudgeWorker(SandboxExecutor &executor, CompileCache *compileCache, SqlSnapshotCache *sqlSnapshots,
+                VerdictCache *verdictCache,
+                TestSetStore &testSets, FanoutLimiter &fanout, WorkStealingExecutor &continuations,
+                OutputChecks outputChecks, bool zygote, Publish publish = nullptr);
+
+    /**
+     * @brief Starts judging one job and returns once its first sandbox is
+     * running. Every later step runs on `continuations` as a sandbox
+     * completes, so no thread waits on a sandbox; the verdict is published
+     * at the end and `done` called.
+     * @param ack acked together with the verdict
+     * @param deadline its sandboxes are killed once it passes and the job gets
+     * an error verdict; default: none
+     * @param done told whether the job was acked, false if the caller still
+     * has to
+     */
+    void processSubmission(const std::string &jobId, std::string jsonSubmissionData,
+                           const JobAck &ack, std::chrono::steady_clock::time_point deadline,
+                           Done done);
 
 private:
-    Submission parseSubmission(const std::string &jsonSubmissionData);
-};
\ No newline at end of file
+    struct Job;
+    using JobPtr = std::shared_ptr<Job>;
+    using Next = std::function<void(std::optional<nlohmann::json> results)>;
+
+    /**
+     * @brief Starts the runner on `input` followed by `inputTail` (both owned
+     * by the job) and calls `next` on a continuation thread with its parsed
+     * verdict: nullopt if the sandbox did not start or printed no valid JSON.
+     * @param stage what the run is timed as in judge_stage_seconds
+     * ("compile" or "execute")
+     */
+    void runSandbox(const JobPtr &job, std::string_view input, std::string_view inputTail, const char *stage,
+                    Next next);
+
+    /** @brief Continues a job after the compile-only run that precedes fan-out. */
+    void compiled(const JobPtr &job, std::optional<nlohmann::json> results);
+
+    /** @brief Runs the tests, in one sandbox or split over the grant's chunks. */
+    void runTests(const JobPtr &job);
+
+    /**
+     * @brief Splits the test cases over the grant's chunks, all running in
+     * parallel, and merges their verdicts into the one the runner would have
+     * produced once the last one is in.
+     */
+    void runChunks(const JobPtr &job);
+    std::optional<nlohmann::json> mergeChunks(Job &job);
+
+    /** @brief Publishes the job's verdict and reports it done. */
+    void complete(const JobPtr &job, std::optional<nlohmann::json> results);
+    void finish(Job &job, bool acked);
+
+    /**
+     * @brief Looks the submission up in the compile cache and points the runner
+     * at the cached binary, or asks it to emit the binary it builds, through
+     * `extraFields`.
+     * @param cacheKey set if the runner output should be stored afterwards
+     * @return a cached compile_error verdict, if that is what this code gives
+     */
+    std::optional<nlohmann::json> useCompileCache(const SubmissionHeader &submission, nlohmann::json &extraFields,
+                                                  std::string &cacheKey);
+    void storeCompileResult(const std::string &cacheKey, nlohmann::json &results);
+
+    /**
+     * @brief Stores the snapshots an SQL runner built and records the ones it
+     * used, taking both out of its verdict. Keys that are not the hash of one
+     * of the job's own setup scripts are dropped.
+     */
+    void storeSqlSnapshots(const Job &job, nlohmann::json &results);
+
+    /**
+     * @brief Grades the test results the runner left "unchecked" (it was
+     * asked to defer the comparison) against the expected outputs.
+     */
+    void checkOutputs(Job &job, nlohmann::json &results);
+
+    /**
+     * @brief The verdict cache key for the job, empty if there is no cache
+     * or its runner image cannot be identified.
+     */
+    std::string verdictCacheKey(const Job &job);
+
+    /** @brief How much of each output the job's verdict keeps, 0 for all of it. */
+    size_t outputLimit(const Job &job) const;
+
+    /** @brief Publishes a verdict, its outputs cut down to outputLimit(). */
+    bool publishVerdict(const Job &job, nlohmann::json results);
+    /** @brief Publishes a verdict already serialized and cut down. */
+    bool publishVerdict(const Job &job, const std::string &status, const std::string &verdict);
+
+    SandboxExecutor &executor_;
+    CompileCache *compileCache_;
+    SqlSnapshotCache *sqlSnapshots_;
+    VerdictCache *verdictCache_;
+    TestSetStore &testSets_;
+    FanoutLimiter &fanout_;
+    WorkStealingExecutor &continuations_;
+    const OutputChecks outputChecks_;
+    const bool zygote_;
+    const Publish publish_;
+};
@@ -1,24 +1,112 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <iostream>
-#include <chrono>
-#include <iomanip>
-#include <sstream>
+#include <atomic>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
-inline std::string get_timestamp()
+enum class LogLevel : int
 {
-    auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %X");
-    return ss.str();
+    Debug = 0,
+    Info,
+    Warning,
+    Error,
+    Off,
+};
+
+/**
+ * @class Logger
+ * @brief Asynchronous logger behind the LOG_* macros.
+ *
+ * A log call formats its line into a buffer owned by the calling thread and
+ * copies it into that thread's ring buffer; a background thread drains all
+ * rings and writes them out in batches (warnings and errors to stderr, the
+ * rest to stdout). Logging therefore never takes a lock, never flushes and
+ * never waits on the terminal; only a full ring makes the caller wait for
+ * the writer. Timestamps are taken when the line is logged and formatted by
+ * the writer, which caches the date part per second.
+ *
+ * The level can be changed at runtime (JUDGE_LOG_LEVEL at startup, the
+ * metrics endpoint's /loglevel later). A disabled level costs one relaxed
+ * load: the macro does not evaluate its message at all.
+ */
+class Logger
+{
+public:
+    static bool enabled(LogLevel level) { return static_cast<int>(level) >= level_.load(std::memory_order_relaxed); }
+    static LogLevel level() { return static_cast<LogLevel>(level_.load(std::memory_order_relaxed)); }
+    static void setLevel(LogLevel level);
+
+    static const char *levelName(LogLevel level);
+    /** @brief Parses "debug", "info", "warning" (or "warn"), "error", "off". */
+    static bool parseLevel(std::string_view name, LogLevel &level);
+
+    /** @brief This thread's line buffer, emptied; used by the macros. */
+    static std::ostream &begin();
+    /** @brief Queues the line built since begin(). */
+    static void commit(LogLevel level);
+
+    /**
+     * @brief Writes out everything queued so far and stops the writer; later
+     * lines are written synchronously. Runs at exit.
+     */
+    static void shutdown();
+
+private:
+    static int initialLevel();
+    static std::atomic<int> level_;
+};
+
+/**
+ * @brief Structured field, rendered as ` key=value`; string values with
+ * spaces, quotes or '=' are quoted. Use as
+ * `LOG_INFO("Job done" << kv("jobId", id) << kv("ms", ms))`.
+ */
+template <typename T>
+struct LogField
+{
+    const char *key;
+    const T &value;
+};
+
+template <typename T>
+LogField<T> kv(const char *key, const T &value)
+{
+    return {key, value};
 }
 
-#define LOG_INFO(msg) (std::cout << "[" << get_timestamp() << "] INFO: " << msg << std::endl)
-#define LOG_ERROR(msg) (std::cerr << "[" << get_timestamp() << "] ERROR: " << msg << std::endl)
-#define LOG_DEBUG(msg) (std::cout << "[" << get_timestamp() << "] DEBUG: " << msg << std::endl)
-#define LOG_WARNING(msg) (std::cout << "[" << get_timestamp() << "] WARNING: " << msg << std::endl)
+void writeLogValue(std::ostream &out, std::string_view value);
+
+template <typename T>
+std::ostream &operator<<(std::ostream &out, const LogField<T> &field)
+{
+    out << ' ' << field.key << '=';
+    if constexpr (std::is_convertible_v<const T &, std::string_view>)
+    {
+        writeLogValue(out, std::string_view(field.value));
+    }
+    else
+    {
+        out << field.value;
+    }
+    return out;
+}
+
+#define JUDGE_LOG(level, msg)              \
+    do                                     \
+    {                                      \
+        if (Logger::enabled(level))        \
+        {                                  \
+            Logger::begin() << msg;        \
+            Logger::commit(level);         \
+        }                                  \
+    } while (0)
+
+#define LOG_INFO(msg) JUDGE_LOG(LogLevel::Info, msg)
+#define LOG_ERROR(msg) JUDGE_LOG(LogLevel::Error, msg)
+#define LOG_DEBUG(msg) JUDGE_LOG(LogLevel::Debug, msg)
+#define LOG_WARNING(msg) JUDGE_LOG(LogLevel::Warning, msg)
 
 #endif // LOGGER_H
@@ -0,0 +1,130 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @class Metrics
+ * @brief Process-wide registry of counters, histograms and gauges, rendered
+ * in the Prometheus text format by the metrics endpoint (MetricsServer).
+ *
+ * Recording is meant for hot paths: every counter and histogram is split
+ * into cache-line sized shards and a thread only ever adds to its own with a
+ * relaxed atomic, so recording never takes a lock or bounces a cache line
+ * between cores. Shards are summed when the registry is scraped.
+ *
+ * Looking a metric up by name and labels does take a (shared) lock, so code
+ * that records the same series over and over keeps the reference; series
+ * live as long as the process.
+ */
+class Metrics
+{
+public:
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    // threads are spread over this many shards; more threads share them
+    static constexpr size_t SHARDS = 16;
+
+    class Counter
+    {
+    public:
+        void inc(uint64_t n = 1);
+        uint64_t value() const;
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> value{0};
+        };
+        std::array<Shard, SHARDS> shards_;
+    };
+
+    class Histogram
+    {
+    public:
+        // cumulative counts per upper bound (the last one is +Inf), count
+        // and sum, as Prometheus wants them
+        struct Snapshot
+        {
+            std::vector<uint64_t> cumulative;
+            uint64_t count = 0;
+            double sum = 0;
+        };
+
+        explicit Histogram(std::vector<double> bounds);
+
+        void observe(double value);
+        // for latencies kept in milliseconds, recorded in seconds
+        void observeMs(double ms) { observe(ms / 1000.0); }
+
+        const std::vector<double> &bounds() const { return bounds_; }
+        Snapshot snapshot() const;
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+            // in millionths of the unit, so it can be an integer atomic
+            std::atomic<uint64_t> sumMicros{0};
+        };
+
+        std::vector<double> bounds_;
+        std::array<Shard, SHARDS> shards_;
+    };
+
+    // latency buckets in seconds, 1ms to 2 minutes
+    static const std::vector<double> &latencyBounds();
+
+    static Metrics &instance();
+
+    Counter &counter(const std::string &name, const std::string &help, const Labels &labels = {});
+    Histogram &histogram(const std::string &name, const std::string &help, const Labels &labels = {},
+                         const std::vector<double> &bounds = latencyBounds());
+    /**
+     * @brief Registers a value read when scraped, e.g. a queue length. The
+     * callback runs on the scraping thread and may block briefly; NaN marks
+     * a value that cannot be read right now.
+     */
+    void gauge(const std::string &name, const std::string &help, const Labels &labels, std::function<double()> read);
+
+    /** @brief Everything registered, in the Prometheus text format 0.0.4. */
+    std::string render() const;
+
+private:
+    Metrics() = default;
+
+    struct Family
+    {
+        std::string help;
+        const char *type = "";
+        // keyed by the rendered label set, e.g. {stage="parse"}
+        std::map<std::string, std::unique_ptr<Counter>> counters;
+        std::map<std::string, std::unique_ptr<Histogram>> histograms;
+        std::map<std::string, std::function<double()>> gauges;
+    };
+
+    Family &family(const std::string &name, const std::string &help, const char *type);
+
+    mutable std::shared_mutex mutex_;
+    std::map<std::string, Family> families_;
+};
+
+#define METRICS() (&Metrics::instance())
+
+/**
+ * @brief Keeps a label value from user input (a submission's language, ...)
+ * to a known set, so a bad payload cannot create unbounded series.
+ */
+const char *metricLabel(const std::string &value, std::initializer_list<const char *> known);
+
+#endif // METRICS_H
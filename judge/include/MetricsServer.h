@@ -0,0 +1,46 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+/**
+ * @class MetricsServer
+ * @brief Minimal HTTP endpoint that answers GET /metrics with the Metrics
+ * registry for Prometheus to scrape. It also serves /loglevel: GET returns
+ * the current log level, PUT /loglevel?level=debug changes it.
+ *
+ * One thread, one connection at a time: a scrape every few seconds is all
+ * it serves, so it has no need for keep-alive, chunking or anything else a
+ * real HTTP server would do.
+ */
+class MetricsServer
+{
+public:
+    explicit MetricsServer(int port);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    /**
+     * @brief Binds the port and starts serving.
+     * @return false if the port cannot be bound; the judge runs without
+     * the endpoint then.
+     */
+    bool start();
+
+private:
+    void loop();
+    void serve(int client);
+    void serveLogLevel(int client, const std::string &method, const std::string &query);
+
+    const int port_;
+    int listenFd_ = -1;
+    int wakeFd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+#endif // METRICS_SERVER_H
@@ -0,0 +1,93 @@
+#ifndef NATIVE_EXECUTOR_H
+#define NATIVE_EXECUTOR_H
+
+#include "SandboxExecutor.h"
+
+#include <linux/filter.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class NativeExecutor
+ * @brief Sandbox backend that bypasses docker entirely.
+ *
+ * Each run is a clone3() child in fresh user/pid/mount/net/ipc/uts/cgroup
+ * namespaces, placed directly into its own cgroup v2 leaf with the same
+ * limits the docker backend passes on the command line (256m memory, no
+ * swap, 64 pids, half a CPU). The child pivots into the runner image's
+ * unpacked root filesystem (read-only, with a tmpfs /tmp, fresh /proc and
+ * a minimal /dev, and the judge data directory read-only at /judge), drops
+ * every capability, installs the image's seccomp profile and execs the
+ * image entrypoint. Before the cgroup is removed its CPU time, throttled
+ * time and memory high-water mark go into the SandboxResult.
+ *
+ * Runner root filesystems are produced by scripts/export_runners.sh:
+ *   <runnerRoot>/<image>/rootfs        docker export of the image
+ *   <runnerRoot>/<image>/config.json   docker image inspect .Config
+ *   <runnerRoot>/<image>/seccomp.json  optional docker-format profile
+ *   <runnerRoot>/<image>/digest        image id, for cache keys
+ */
+class NativeExecutor : public SandboxExecutor
+{
+public:
+    NativeExecutor(std::string runnerRoot, std::string cgroupRoot, std::string dataDir);
+
+    const char *name() const override { return "native"; }
+    std::string imageDigest(const std::string &image) override;
+    void refreshImageDigests() override;
+
+    /**
+     * @brief Loads the unpacked runners and prepares the cgroup root.
+     * @return false if the backend cannot run anything on this host.
+     */
+    bool initialize();
+
+protected:
+    void executeAsync(const SandboxRequest &request, Completion done) override;
+
+private:
+    struct Runner
+    {
+        std::string image;
+        std::string rootfs;
+        std::string tmpDir;
+        std::string procDir;
+        std::string devDir;
+        std::string dataMount; // empty if the rootfs has no /judge
+        std::vector<std::pair<std::string, std::string>> devNodes; // host path, rootfs path
+        std::vector<std::pair<std::string, std::string>> devLinks; // target, rootfs path
+        unsigned long lockedMountFlags = 0;
+
+        std::string workdir;
+        std::string executable;
+        std::vector<std::string> args;
+        std::vector<std::string> env;
+
+        std::vector<sock_filter> seccomp;
+        std::string digest; // guarded by digestMutex_
+    };
+
+    bool loadRunner(const std::string &image, Runner &runner);
+    std::string createCgroup();
+    void destroyCgroup(const std::string &path);
+    // retries cgroups whose processes were still exiting when destroyed
+    void sweepCgroups();
+
+    std::string runnerRoot_;
+    std::string cgroupRoot_;
+    std::string dataDir_;
+    unsigned long dataLockedFlags_ = 0;
+    std::map<std::string, Runner> runners_;
+    std::mutex digestMutex_;
+
+    uid_t outerUid_ = 0;
+    gid_t outerGid_ = 0;
+    std::atomic<uint64_t> sequence_{0};
+
+    std::mutex staleMutex_;
+    std::vector<std::string> staleCgroups_;
+};
+
+#endif // NATIVE_EXECUTOR_H
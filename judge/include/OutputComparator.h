@@ -0,0 +1,68 @@
+#ifndef OUTPUT_COMPARATOR_H
+#define OUTPUT_COMPARATOR_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief How a program's output is matched against the expected output.
+ *
+ * Exact   byte for byte.
+ * Lines   what the Python runner's normalize_output() accepts: leading and
+ *         trailing whitespace of the whole output, trailing whitespace of
+ *         each line and the kind of line ending (\n, \r\n, \r) do not
+ *         matter; everything else, indentation included, does.
+ * Tokens  whitespace-separated tokens, however they are spaced or broken
+ *         over lines; tokens that both parse as numbers match within the
+ *         tolerances.
+ */
+enum class CompareMode
+{
+    Exact,
+    Lines,
+    Tokens,
+};
+
+struct CompareOptions
+{
+    CompareMode mode = CompareMode::Lines;
+    // Tokens mode: numbers a and b (expected) match if |a - b| is at most
+    // absTolerance or relTolerance * |b|
+    double absTolerance = 0;
+    double relTolerance = 0;
+};
+
+/** @brief Parses "exact", "lines" or "tokens". */
+bool parseCompareMode(std::string_view name, CompareMode &mode);
+
+struct CompareResult
+{
+    bool equal = true;
+    // first difference, as byte offsets into each output and as 1-based
+    // line and column of the expected output
+    size_t expectedOffset = 0;
+    size_t actualOffset = 0;
+    size_t line = 0;
+    size_t column = 0;
+    // short excerpts of both outputs from the first difference on, cut at
+    // the end of the line and on a UTF-8 character boundary
+    std::string expectedExcerpt;
+    std::string actualExcerpt;
+
+    /** @brief e.g. `line 3, column 5: expected "12", got "13"`; empty if equal. */
+    std::string summary() const;
+};
+
+/**
+ * @brief Compares `actual` with `expected` in one forward pass over both,
+ * without building normalized copies, and stops at the first difference.
+ *
+ * The scan runs 16 bytes at a time (SSE2) through stretches where both
+ * outputs agree and hold no whitespace, which is nearly all of a correct
+ * output; only whitespace runs and the difference itself are looked at
+ * byte by byte.
+ */
+CompareResult compareOutputs(std::string_view expected, std::string_view actual, const CompareOptions &options);
+
+#endif // OUTPUT_COMPARATOR_H
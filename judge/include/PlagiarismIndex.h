@@ -0,0 +1,115 @@
+#ifndef PLAGIARISM_INDEX_H
+#define PLAGIARISM_INDEX_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Fingerprint.h"
+#include "WorkStealingExecutor.h"
+
+/**
+ * @class PlagiarismIndex
+ * @brief Fingerprints of submissions and an inverted index from hash to
+ * submissions, per assignment, in a memory-bounded LRU of assignments.
+ *
+ * Similarity is the Dice coefficient of two fingerprints, 2|A∩B| / (|A|+|B|),
+ * after dropping hashes that more than commonShare of an assignment's
+ * submissions have: starter code and the idioms everyone writes are not
+ * evidence of copying. The filter only applies from MIN_FOR_COMMON
+ * submissions on, before that nothing is common yet.
+ *
+ * Queries on one assignment run concurrently; adding to it takes it
+ * exclusively. All-pairs reports are split over the index's worker threads.
+ */
+class PlagiarismIndex
+{
+public:
+    struct Match
+    {
+        int64_t submissionId = 0;
+        double similarity = 0;
+    };
+
+    struct Pair
+    {
+        int64_t first = 0;
+        int64_t second = 0;
+        double similarity = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t assignments = 0;
+        uint64_t submissions = 0;
+        uint64_t bytes = 0;
+        uint64_t queries = 0;
+        uint64_t reports = 0;
+        uint64_t evictions = 0;
+    };
+
+    static constexpr size_t MIN_FOR_COMMON = 10;
+
+    /**
+     * @param maxBytes memory budget for fingerprints and postings; an
+     * assignment in use is kept regardless
+     * @param threads workers for all-pairs reports
+     * @param commonShare share of submissions above which a hash is ignored
+     */
+    PlagiarismIndex(uint64_t maxBytes, size_t threads, double commonShare = 0.5);
+
+    /** @brief Indexes a submission, replacing what it had before. */
+    void add(int64_t assignmentId, int64_t submissionId, Fingerprint fingerprint);
+
+    bool contains(int64_t assignmentId, int64_t submissionId) const;
+
+    /**
+     * @brief Submissions of the assignment that share at least minSimilarity
+     * with `fingerprint`, most similar first, excluding `exclude`.
+     */
+    std::vector<Match> query(int64_t assignmentId, const Fingerprint &fingerprint, int64_t exclude,
+                             double minSimilarity);
+
+    /**
+     * @brief Every pair of the assignment's submissions with at least
+     * minSimilarity (at least one shared hash if 0), most similar first.
+     */
+    std::vector<Pair> allPairs(int64_t assignmentId, double minSimilarity);
+
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    struct Assignment
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<int64_t, Fingerprint> fingerprints;
+        std::unordered_map<uint32_t, std::vector<int64_t>> postings;
+        uint64_t bytes = 0;
+        std::list<int64_t>::iterator position;
+    };
+    using AssignmentPtr = std::shared_ptr<Assignment>;
+
+    /** @brief The assignment, created if `create`; null otherwise if unknown. */
+    AssignmentPtr assignment(int64_t assignmentId, bool create);
+    /** @brief Hashes too frequent to count, under a lock on `a`. */
+    size_t commonLimit(const Assignment &a) const;
+    void evictLocked();
+
+    const uint64_t maxBytes_;
+    const double commonShare_;
+
+    mutable std::mutex mutex_;
+    std::list<int64_t> lru_; // most recently used at the front
+    std::unordered_map<int64_t, AssignmentPtr> assignments_;
+    Stats stats_;
+
+    // last, so it is stopped before anything its tasks touch goes away
+    WorkStealingExecutor workers_;
+};
+
+#endif // PLAGIARISM_INDEX_H
@@ -0,0 +1,64 @@
+#ifndef PLAGIARISM_WORKER_H
+#define PLAGIARISM_WORKER_H
+
+#include <functional>
+#include <string>
+
+#include "nlohmann/json.hpp"
+#include "PlagiarismIndex.h"
+#include "RedisHandler.h"
+
+/**
+ * @class PlagiarismWorker
+ * @brief Answers plagiarism jobs, queued under a "plagiarism-" job id on a
+ * lane of their own (PLAGIARISM_QUEUE), from a PlagiarismIndex. No sandbox
+ * is involved.
+ *
+ * A check job indexes one new submission and compares it with the prior
+ * ones of its assignment:
+ *   {"action": "check", "assignmentId", "submissionId", "language", "code",
+ *    "existing": [{"id", "fingerprint"}], "minSimilarity"}
+ * `existing` brings fingerprints stored earlier, for the submissions this
+ * judge has not indexed (yet, or since a restart or eviction). The verdict,
+ *   {"status": "completed", "fingerprint": [...],
+ *    "results": [{"compared_submission", "similarity"}]}
+ * goes to judge:plagiarism:verdict:<jobId>.
+ *
+ * A report job compares every pair of an assignment's submissions, after
+ * indexing those it brings as {"id", "code", "language"} or {"id",
+ * "fingerprint"}:
+ *   {"action": "report", "assignmentId", "submissions": [...], "minSimilarity"}
+ * and answers {"status": "completed", "skipped", "pairs": [{"first",
+ * "second", "similarity"}]}, minSimilarity defaulting to 0.3 there.
+ */
+class PlagiarismWorker
+{
+public:
+    using Done = std::function<void(bool acked)>;
+
+    static constexpr const char *JOB_PREFIX = "plagiarism-";
+
+    /** @brief Whether the job is one for this worker rather than a sandbox. */
+    static bool handles(const std::string &jobId);
+
+    explicit PlagiarismWorker(PlagiarismIndex &index);
+
+    /**
+     * @brief Answers one job on the calling thread and publishes the answer,
+     * acking `ack` with it; then calls `done`.
+     */
+    void processJob(const std::string &jobId, const std::string &payload, const JobAck &ack, Done done);
+
+private:
+    nlohmann::json check(const nlohmann::json &job);
+    nlohmann::json report(const nlohmann::json &job);
+    /**
+     * @brief Indexes a submission from its stored fingerprint or its code.
+     * @return false if it has neither
+     */
+    bool addSubmission(int64_t assignmentId, const nlohmann::json &submission);
+
+    PlagiarismIndex &index_;
+};
+
+#endif // PLAGIARISM_WORKER_H
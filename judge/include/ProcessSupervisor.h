@@ -0,0 +1,86 @@
+#ifndef PROCESS_SUPERVISOR_H
+#define PROCESS_SUPERVISOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <sys/types.h>
+
+#include "CancellationToken.h"
+
+struct SandboxRequest;
+struct SandboxResult;
+
+/**
+ * @class ProcessSupervisor
+ * @brief Watches every running sandbox from one epoll thread.
+ *
+ * A launched child is tracked through a pidfd plus its stdin and stdout
+ * pipes, so feeding input, draining output, noticing the exit, enforcing a
+ * deadline and reacting to cancellation are all events on the same loop and
+ * no thread is parked on a sandbox. The number of sandboxes in flight is
+ * therefore independent of the number of threads.
+ *
+ * Completions run on the loop thread and must not block; anything heavier
+ * than handing the result on belongs on a worker.
+ */
+class ProcessSupervisor
+{
+public:
+    // given the read end of the input pipe and the write end of the output
+    // pipe, starts the child with them as stdin/stdout; returns its pid or -1
+    using Spawn = std::function<pid_t(int inFd, int outFd, SandboxResult &result)>;
+    using Completion = std::function<void(SandboxResult result)>;
+
+    ProcessSupervisor();
+    ~ProcessSupervisor();
+
+    ProcessSupervisor(const ProcessSupervisor &) = delete;
+    ProcessSupervisor &operator=(const ProcessSupervisor &) = delete;
+
+    /**
+     * @brief Spawns the child on the calling thread and returns once it is
+     * registered with the loop. `done` is called exactly once, from the loop
+     * thread, after the child has been reaped; if it could not be started it
+     * is called before launch() returns, with `launched` false.
+     *
+     * The request's input views must stay valid until `done` runs.
+     */
+    void launch(const SandboxRequest &request, const Spawn &spawn, Completion done);
+
+    /** @brief Children currently being supervised. */
+    size_t running() const { return running_; }
+
+private:
+    struct Child;
+
+    void loop();
+    void handle(Child &child, int kind, uint32_t events);
+    void drainOutput(Child &child);
+    void finish(uint64_t id);
+    int nextTimeoutMs();
+
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, std::unique_ptr<Child>> children_;
+    std::multimap<std::chrono::steady_clock::time_point, uint64_t> deadlines_;
+    uint64_t nextId_ = 1;
+    std::atomic<size_t> running_{0};
+
+    // Runner output is usually about the same size from run to run, so each
+    // read buffer starts at the last size instead of growing from empty.
+    std::atomic<size_t> outputSizeHint_{64 * 1024};
+};
+
+#endif // PROCESS_SUPERVISOR_H
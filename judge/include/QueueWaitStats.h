@@ -0,0 +1,48 @@
+#ifndef QUEUE_WAIT_STATS_H
+#define QUEUE_WAIT_STATS_H
+
+#include "JobClass.h"
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @class QueueWaitStats
+ * @brief Per-class histograms of how long jobs waited between being queued
+ * by the server and starting on a worker, and how many started after their
+ * deadline.
+ */
+class QueueWaitStats
+{
+public:
+    // upper bucket bounds in ms, the last bucket takes everything above
+    static constexpr std::array<uint64_t, 12> BOUNDS_MS = {10, 25, 50, 100, 250, 500,
+                                                           1000, 2500, 5000, 10000, 30000, 60000};
+
+    struct Histogram
+    {
+        std::array<uint64_t, BOUNDS_MS.size() + 1> buckets{};
+        uint64_t count = 0;
+        uint64_t totalMs = 0;
+        uint64_t maxMs = 0;
+        uint64_t missedDeadline = 0;
+
+        /**
+         * @brief Smallest bucket bound below which at least `quantile` of
+         * the waits fall, an upper estimate.
+         */
+        uint64_t percentileMs(double quantile) const;
+    };
+
+    void record(JobClass jobClass, uint64_t waitMs, bool missedDeadline);
+
+    Histogram histogram(JobClass jobClass) const;
+    void logStats() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::array<Histogram, JOB_CLASS_COUNT> histograms_;
+};
+
+#endif // QUEUE_WAIT_STATS_H
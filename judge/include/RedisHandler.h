@@ -1,12 +1,49 @@
 #ifndef REDIS_JUDGE_H
 #define REDIS_JUDGE_H
 
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AsyncRedis.h"
+#include "Metrics.h"
 
 struct redisContext;
 
+struct ClaimedJob
+{
+    std::string jobId;
+    std::string data;
+    // false if the job's hash had no data field
+    bool hasData = false;
+    // index of the pending queue it came from
+    size_t queue = 0;
+    // epoch ms: when the server queued it, and when it should start by
+    uint64_t createdAtMs = 0;
+    uint64_t dueMs = 0;
+    // stream intake only: the entry pending for this consumer
+    std::string entryId;
+};
+
+/**
+ * @brief Where a claimed job is acked once it is done: its id on the
+ * processing list (list intake), or its entry in the lane stream, pending
+ * for this consumer in the judge group (stream intake).
+ */
+struct JobAck
+{
+    std::string jobId;
+    std::string processingQueue;
+    std::string stream;
+    std::string entryId;
+};
+
 class RedisHandler
 {
 public:
@@ -15,30 +52,158 @@ public:
 
     /**
      * @brief Initializes the singleton instance. Must be called once at startup.
+     * @param connections size of the async connection pool used by everything
+     * but the intake, which has a blocking connection per thread
      */
-    static void initialize(const char *host, int port);
+    static void initialize(const char *host, int port, size_t connections = 2);
 
     static RedisHandler &getInstance();
 
-    bool brpop(std::string &jobId, std::string &value);
+    /**
+     * @brief Parks until the server signals a newly queued job on `wakeKey`
+     * or `timeoutSec` passes. Takes no job itself: the caller claims through
+     * claimJobs(), so a job only ever leaves the queues atomically onto the
+     * processing queue.
+     * @return false on a connection error
+     */
+    bool waitForWakeUp(const std::string &wakeKey, int timeoutSec);
     bool brpoplpush(const std::string &source, const std::string &destination, int timeout, std::string &outValue);
+    /**
+     * @brief Moves up to `max` jobs from `queues` to `processingQueue` and
+     * reads their data, atomically and in one round-trip (a Lua script). Jobs
+     * are taken earliest due first across the queues, where a job is due
+     * `targetsMs` of its queue after it was queued, or at its deadline if
+     * that is earlier. Never blocks; `jobs` is left empty when the queues are.
+     * @return false on a connection or script error.
+     */
+    bool claimJobs(const std::vector<std::string> &queues, const std::string &processingQueue,
+                   const std::vector<uint64_t> &targetsMs, size_t max, std::vector<ClaimedJob> &jobs);
     void lrem(const std::string &key, int count, const std::string &value);
+
+    /**
+     * @brief Creates the judge consumer group on each stream (and the stream
+     * itself) where it is missing, starting from the beginning of the stream.
+     */
+    bool createStreamGroups(const std::vector<std::string> &streams);
+    /**
+     * @brief Stream-intake counterpart of claimJobs(): delivers up to `max`
+     * new entries to `consumer`, earliest due first across the lane streams,
+     * and reads their data, in one script. The entries stay pending for the
+     * consumer until acked.
+     */
+    bool claimStreamJobs(const std::vector<std::string> &streams, const std::string &consumer,
+                         const std::vector<uint64_t> &targetsMs, size_t max, std::vector<ClaimedJob> &jobs);
+    /**
+     * @brief Blocks up to `blockMs` for new entries on any of `streams`;
+     * takes at most one per stream.
+     * @return false on an error; true with no jobs on timeout.
+     */
+    bool waitForStreamJobs(const std::vector<std::string> &streams, const std::string &consumer,
+                           const std::vector<uint64_t> &targetsMs, int blockMs, std::vector<ClaimedJob> &jobs);
+    /**
+     * @brief Takes over up to `max` entries pending for longer than
+     * `minIdleMs` with any consumer (XAUTOCLAIM), i.e. jobs of judges that
+     * died or lost Redis without acking them.
+     */
+    bool reclaimStreamJobs(const std::vector<std::string> &streams, const std::string &consumer,
+                           const std::vector<uint64_t> &targetsMs, uint64_t minIdleMs, size_t max,
+                           std::vector<ClaimedJob> &jobs);
+    /**
+     * @brief Resets the idle time of entries this consumer is still working
+     * on, so reclaimStreamJobs() on other judges leaves them alone.
+     */
+    void touchStreamJobs(const std::string &stream, const std::string &consumer, const std::vector<std::string> &entryIds);
+
+    /**
+     * @brief Acks a job without a verdict: LREM from the processing list, or
+     * XACK and XDEL of its stream entry.
+     */
+    void ack(const JobAck &ack);
+    /**
+     * @brief Length of a pending list (LLEN) or lane stream (XLEN).
+     * @return false if it cannot be read.
+     */
+    bool queueLength(const std::string &key, bool stream, uint64_t &length);
     bool hget(const std::string &key, const std::string &field, std::string &outValue);
+    bool get(const std::string &key, std::string &outValue);
     void set(const std::string &key, const std::string &value);
     bool expire(const std::string &key, int seconds);
 
+    /**
+     * @brief Stores a verdict with its expiry and acks the job on its
+     * intake (see ack()), as one MULTI/EXEC in a single round-trip. The same
+     * transaction PUBLISHes the publish time (epoch ms) on a channel named
+     * like `key` and appends key, jobId and publish time to the
+     * judge:verdicts stream, so consumers can wait for the verdict instead
+     * of polling the key.
+     * @return false if the transaction did not run, the job is then still
+     * unacked.
+     */
+    bool publishVerdict(const std::string &key, const std::string &value, int ttlSeconds, const JobAck &ack);
+
+    AsyncRedis::Stats stats() const;
+    void logStats() const;
+
 private:
-    RedisHandler(const char *host, int port);
+    RedisHandler(const char *host, int port, size_t connections);
+
+    /**
+     * @brief Runs one pipelined request on the async client and waits for it.
+     * @param read called on the event loop thread with the last reply (null
+     * if the connection failed), returns the result.
+     */
+    bool roundTrip(std::vector<AsyncRedis::Command> commands, const std::function<bool(redisReply *)> &read);
+
+    struct BlockingConnection
+    {
+        redisContext *context = nullptr;
+        // SHA1 of the claim scripts once SCRIPT LOAD has cached them on the server
+        std::string claimScriptSha;
+        std::string streamClaimScriptSha;
+    };
+
+    /** @brief The calling thread's blocking connection, opened on first use. */
+    BlockingConnection &blockingConnection();
+
+    /**
+     * @brief EVALSHA on a blocking connection, loading the script first and
+     * again after a NOSCRIPT (the script cache is lost when Redis restarts).
+     * The caller frees the reply.
+     */
+    static redisReply *evalScript(redisContext *context, const char *script, std::string &sha,
+                                  const std::vector<std::string> &keys, const std::vector<std::string> &args);
+    /**
+     * @brief Reads data, createdAt and deadline of `job` on a blocking
+     * connection and works out when it is due.
+     */
+    static void readJobHash(redisContext *context, ClaimedJob &job, const std::vector<uint64_t> &targetsMs);
+
+    // the commands that ack a job, queued inside or outside a transaction
+    static std::vector<AsyncRedis::Command> ackCommands(const JobAck &ack);
 
     ~RedisHandler();
     friend struct std::default_delete<RedisHandler>;
 
 private:
-    redisContext *blocking_context_;
-    redisContext *command_context_;
-
+    // BRPOP and XREADGROUP BLOCK park a connection for as long as the lanes
+    // are empty, so the intake keeps synchronous ones of its own: one per
+    // intake thread, or the sandbox and plagiarism intakes would wait on
+    // each other's parked reads
+    std::string host_;
+    int port_;
+    std::map<std::thread::id, std::unique_ptr<BlockingConnection>> blocking_;
     std::mutex blocking_mutex_;
-    std::mutex command_mutex_;
+
+    std::unique_ptr<AsyncRedis> async_;
+
+    // publishVerdict round-trips, and how many reached a subscriber
+    std::atomic<uint64_t> verdicts_{0};
+    std::atomic<uint64_t> verdictsPushed_{0};
+    std::atomic<uint64_t> verdictUs_{0};
+    std::atomic<uint64_t> maxVerdictUs_{0};
+    // claim script (claim and data fetch) and verdict transaction latency
+    Metrics::Histogram &claimSeconds_;
+    Metrics::Histogram &publishSeconds_;
 
     static std::unique_ptr<RedisHandler> instance_;
 };
@@ -0,0 +1,109 @@
+#ifndef REGRADER_H
+#define REGRADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "CompileCache.h"
+#include "SqlSnapshotCache.h"
+#include "FanoutLimiter.h"
+#include "JudgeConfig.h"
+#include "JudgeWorker.h"
+#include "SandboxExecutor.h"
+#include "SandboxPool.h"
+#include "TestSetStore.h"
+#include "WorkStealingExecutor.h"
+
+/**
+ * @class Regrader
+ * @brief Offline bulk re-judging, `judge --regrade`: submissions in as
+ * NDJSON, verdicts out as NDJSON, no Redis.
+ *
+ * Each input line is a job payload as the server would queue it, with its
+ * test cases inline, plus an `id` that is copied to the output. Each output
+ * line is `{"id": ..., "verdict": {...}}`, or `{"id": ..., "error": "..."}`
+ * for a line that could not be judged, in the order verdicts come out.
+ *
+ * Lines are read in windows of a few times the slot count and each window
+ * is judged sorted by language and test set, so the runner images' warm
+ * containers and the test set files are reused back to back. Test sets go
+ * through the TestSetStore like those of queued jobs, so identical test
+ * cases are stored once whatever the number of submissions; memory is
+ * bounded by the window, the jobs in flight and the test set budget, not
+ * by the input size.
+ */
+class Regrader
+{
+public:
+    struct Summary
+    {
+        uint64_t lines = 0;
+        uint64_t invalid = 0;
+        uint64_t verdicts = 0;
+        // accepted but no verdict (sandbox failure, no runner output)
+        uint64_t failed = 0;
+        std::map<std::string, uint64_t> statuses;
+        double seconds = 0;
+    };
+
+    explicit Regrader(const JudgeConfig &config);
+    ~Regrader();
+
+    /**
+     * @brief Judges every line of `in` and writes a line per input line to
+     * `outFd`. Returns once the last verdict is written.
+     */
+    Summary run(std::istream &in, int outFd);
+
+    /** @brief Throughput and outcome figures, for stderr. */
+    void printSummary(const Summary &summary, std::ostream &out) const;
+
+private:
+    struct Pending
+    {
+        std::string jobId;
+        nlohmann::json id;
+        std::string language;
+        // holds the set in the store until the job has it
+        std::shared_ptr<const TestSet> testSet;
+        std::string payload;
+    };
+
+    /** @brief Turns an input line into a job payload referring to its test set. */
+    bool prepare(const std::string &line, uint64_t number, Pending &pending, std::string &error);
+    void dispatch(Pending pending);
+    void writeLine(const nlohmann::json &line);
+
+    const JudgeConfig config_;
+    const size_t slots_;
+    int outFd_ = -1;
+
+    SandboxPool sandboxPool_;
+    std::unique_ptr<SandboxExecutor> executor_;
+    std::unique_ptr<CompileCache> compileCache_;
+    std::unique_ptr<SqlSnapshotCache> sqlSnapshots_;
+    TestSetStore testSets_;
+    FanoutLimiter fanoutLimiter_;
+    std::unique_ptr<JudgeWorker> judgeWorker_;
+
+    std::mutex mutex_;
+    std::condition_variable slotFreed_;
+    size_t inFlight_ = 0;
+    // output ids of the jobs in flight, by job id
+    std::map<std::string, nlohmann::json> ids_;
+    Summary summary_;
+    std::mutex outMutex_;
+
+    // destroyed first, so no task outlives what it uses
+    WorkStealingExecutor workers_;
+};
+
+#endif // REGRADER_H
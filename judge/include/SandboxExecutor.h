@@ -0,0 +1,170 @@
+#ifndef SANDBOX_EXECUTOR_H
+#define SANDBOX_EXECUTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+#include "CancellationToken.h"
+#include "ProcessSupervisor.h"
+
+struct JudgeConfig;
+class SandboxPool;
+
+/**
+ * @brief One runner invocation: the JSON document the runner reads on stdin,
+ * and which runner image to use.
+ *
+ * The document is written as `input` followed by `inputTail`, so the judge
+ * can append fields to a payload without copying it. Both views must stay
+ * valid until the run completes.
+ */
+struct SandboxRequest
+{
+    std::string image;
+    std::string_view input;
+    std::string_view inputTail;
+    // cancelling it kills the sandbox, the run then completes with what it
+    // had so far
+    const CancellationToken *cancel = nullptr;
+    // killed like a cancel once this passes; default: none
+    std::chrono::steady_clock::time_point deadline{};
+};
+
+struct SandboxResult
+{
+    // false if the sandbox could not be started at all (fork/clone failure,
+    // missing image); output is meaningless then
+    bool launched = false;
+    // runner exit code, or -1 if it was killed by a signal
+    int exitCode = -1;
+    std::string output;
+    // killed through SandboxRequest::cancel or its deadline; output is
+    // incomplete then
+    bool cancelled = false;
+
+    // time the spawn itself took on the launching thread (fork/clone and
+    // sandbox setup), time until the runner's entrypoint was exec'd (0 if
+    // the backend cannot tell, e.g. behind the docker CLI) and total time
+    // for the run
+    double spawnMs = 0;
+    double startupMs = 0;
+    double wallMs = 0;
+
+    // cgroup v2 accounting of the whole run, if the backend gave it a cgroup
+    // of its own (native; docker for cold runs, see
+    // DockerExecutor::enableAccounting): CPU time used, time held back by
+    // cpu.max and the memory high-water mark. All 0 and accounted false
+    // otherwise.
+    bool accounted = false;
+    double cpuMs = 0;
+    double throttledMs = 0;
+    uint64_t peakMemoryKb = 0;
+};
+
+/**
+ * @class SandboxExecutor
+ * @brief Backend that runs a language runner in an isolated sandbox.
+ *
+ * The docker backend shells out to the docker CLI (optionally through the
+ * warm SandboxPool); the native backend builds the sandbox itself out of
+ * namespaces, a cgroup v2 leaf and seccomp. Both keep the same limits so
+ * they can be compared on the same host.
+ *
+ * Runs are asynchronous: both backends hand the child to one shared
+ * ProcessSupervisor, so a sandbox in flight costs a few fds, not a thread.
+ */
+class SandboxExecutor
+{
+public:
+    using Completion = ProcessSupervisor::Completion;
+
+    struct Stats
+    {
+        uint64_t runs = 0;
+        uint64_t failures = 0;
+        double totalStartupMs = 0;
+        double totalWallMs = 0;
+    };
+
+    virtual ~SandboxExecutor() = default;
+
+    virtual const char *name() const = 0;
+
+    /**
+     * @brief Identifies the exact contents of a runner image, so caches keyed
+     * on it are invalidated when the image is rebuilt. Resolved once per image
+     * and kept until refreshImageDigests() sees it change.
+     * @return empty if the image cannot be resolved; callers must not cache
+     * anything in that case.
+     */
+    virtual std::string imageDigest(const std::string &image) = 0;
+
+    /**
+     * @brief Resolves the digests of the images seen so far again, so a
+     * rebuilt image gets new cache keys. Slow (it may shell out), the judge
+     * calls it from a background thread.
+     */
+    virtual void refreshImageDigests() {}
+
+    /**
+     * @brief Starts the request and returns without waiting for it. `done`
+     * runs exactly once, on the supervisor thread, so it must only hand the
+     * result on (e.g. submit a continuation to a worker pool).
+     */
+    void runAsync(const SandboxRequest &request, Completion done);
+
+    /**
+     * @brief Runs the request to completion. Blocks the calling thread.
+     */
+    SandboxResult run(const SandboxRequest &request);
+
+    /** @brief Sandboxes currently running. */
+    size_t running() const { return supervisor_.running(); }
+
+    Stats stats() const;
+
+protected:
+    /**
+     * @brief Backend part of runAsync(): sets the sandbox up, starts it
+     * through supervisor_ and tears it down again in the completion.
+     */
+    virtual void executeAsync(const SandboxRequest &request, Completion done) = 0;
+
+    ProcessSupervisor supervisor_;
+
+private:
+    std::atomic<uint64_t> runs_{0};
+    std::atomic<uint64_t> failures_{0};
+    std::atomic<uint64_t> startupUs_{0};
+    std::atomic<uint64_t> wallUs_{0};
+};
+
+/**
+ * @brief Builds the backend selected by JUDGE_SANDBOX ("docker", "native", or
+ * "stub" for load tests without any runner).
+ * Falls back to docker if the native backend cannot be initialised.
+ */
+std::unique_ptr<SandboxExecutor> makeSandboxExecutor(const JudgeConfig &config, SandboxPool &pool);
+
+/**
+ * @brief Runner image for a submission language.
+ */
+const char *imageForLanguage(const std::string &language);
+
+/**
+ * @brief Fills in what a run's cgroup accounted: cpu.stat usage_usec and
+ * throttled_usec, and memory.peak (Linux 5.19+, left 0 before that). The
+ * counters are hierarchical and outlive the processes, so this works after
+ * the run has exited, on its own cgroup until that is removed or on a parent
+ * that held nothing else.
+ * @param cgroupFd the cgroup's directory
+ */
+void readCgroupUsage(int cgroupFd, SandboxResult &result);
+
+#endif // SANDBOX_EXECUTOR_H
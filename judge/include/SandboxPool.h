@@ -0,0 +1,130 @@
+#ifndef SANDBOX_POOL_H
+#define SANDBOX_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Flags every sandbox container is started with, warm or cold.
+ *
+ * Kept in one place so the pooled containers can never drift from the
+ * lock-down applied to a one-shot `docker run --rm`.
+ * @param dataHostDir judge data directory as the docker daemon sees it,
+ * mounted read-only at /judge; empty to mount nothing.
+ */
+void appendSandboxLimits(std::vector<std::string> &args, const std::string &dataHostDir);
+
+/**
+ * @brief Runs a docker CLI command to completion without a shell.
+ * @param out If non-null, receives the command's stdout.
+ * @return true if docker exited with status 0.
+ */
+bool runDockerCommand(const std::vector<std::string> &args, std::string *out = nullptr);
+
+/**
+ * @class SandboxPool
+ * @brief Keeps pre-started, locked-down runner containers warm per image.
+ *
+ * A job that finds an idle container runs its runner through `docker exec`
+ * instead of paying for container creation and teardown. After use the
+ * container is handed back and a per-image maintenance thread resets it
+ * (kills every leftover process, wipes /tmp) or, once it has served
+ * poolMaxUses jobs or the reset fails, replaces it. A job that finds no idle
+ * container counts as a miss and falls back to a cold `docker run --rm`.
+ */
+class SandboxPool
+{
+public:
+    struct Lease
+    {
+        std::string image;
+        std::string container;
+        unsigned int uses = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t resets = 0;
+        uint64_t replacements = 0;
+        uint64_t startFailures = 0;
+        size_t idle = 0;
+        size_t target = 0;
+    };
+
+    SandboxPool(const std::map<std::string, size_t> &sizes, unsigned int maxUses,
+                const std::string &dataHostDir);
+    ~SandboxPool();
+
+    SandboxPool(const SandboxPool &) = delete;
+    SandboxPool &operator=(const SandboxPool &) = delete;
+
+    /**
+     * @brief Removes containers left over by a previous judge process and
+     * starts the maintenance threads that fill the pool.
+     */
+    void start();
+
+    /**
+     * @brief Takes an idle container for the image, if one is ready.
+     * Never blocks on container startup; a miss is recorded instead.
+     */
+    std::optional<Lease> acquire(const std::string &image);
+
+    /**
+     * @brief Returns a container after use.
+     * @param healthy false if the exec itself failed (daemon error, container
+     * gone), in which case the container is replaced rather than reset.
+     */
+    void release(Lease lease, bool healthy);
+
+    /**
+     * @brief Builds the `docker exec` argv that runs the image's runner
+     * entrypoint inside the leased container.
+     */
+    std::vector<std::string> execCommand(const Lease &lease) const;
+
+    Stats stats(const std::string &image) const;
+    void logStats() const;
+
+private:
+    struct ImagePool
+    {
+        std::string image;
+        size_t target = 0;
+        std::vector<std::string> entrypoint;
+
+        std::deque<Lease> idle;
+        std::deque<std::pair<Lease, bool>> returned;
+        size_t leased = 0;
+
+        Stats stats;
+        std::thread maintainer;
+    };
+
+    void maintain(ImagePool &pool);
+    bool startContainer(ImagePool &pool, Lease &out);
+    static bool resetContainer(const std::string &container);
+    static void removeContainer(const std::string &container);
+
+    std::map<std::string, std::unique_ptr<ImagePool>> pools_;
+    unsigned int maxUses_;
+    std::string dataHostDir_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> sequence_{0};
+};
+
+#endif // SANDBOX_POOL_H
@@ -0,0 +1,43 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class Sha256
+ * @brief Incremental SHA-256, used for content-addressed cache keys.
+ */
+class Sha256
+{
+public:
+    Sha256();
+
+    Sha256 &update(const void *data, size_t len);
+    Sha256 &update(const std::string &data) { return update(data.data(), data.size()); }
+
+    /**
+     * @brief Feeds a length-prefixed field, so that ("ab", "c") and
+     * ("a", "bc") hash differently when several fields make up one key.
+     */
+    Sha256 &field(const std::string &data);
+
+    /**
+     * @brief Finishes the hash and returns it as 64 lowercase hex characters.
+     * The object must not be updated afterwards.
+     */
+    std::string hexDigest();
+
+    static std::string hex(const std::string &data) { return Sha256().update(data).hexDigest(); }
+
+private:
+    void compress(const uint8_t *block);
+
+    uint32_t state_[8];
+    uint8_t buffer_[64];
+    size_t bufferLen_ = 0;
+    uint64_t totalLen_ = 0;
+};
+
+#endif // SHA256_H
@@ -0,0 +1,93 @@
+#ifndef SQL_SNAPSHOT_CACHE_H
+#define SQL_SNAPSHOT_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct JudgeConfig;
+
+/**
+ * @class SqlSnapshotCache
+ * @brief Bounded LRU of serialized SQLite databases on local disk, one per
+ * distinct setup script of the SQL tests.
+ *
+ * An entry is the database a test's setup SQL (its input) builds, as
+ * `sqlite3.Connection.serialize()` writes it, keyed by the SHA-256 of that
+ * script. The SQL runner builds each script it finds no entry for once per
+ * job and hands the image back; from then on every test of every job with
+ * that script starts from a deserialized copy instead of running it. The
+ * entries live under the judge data directory, which every sandbox sees
+ * read-only at /judge, in a traverse-only (0711) directory: a runner can
+ * open the entry of a script it has but cannot list the others.
+ */
+class SqlSnapshotCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t stores = 0;
+        uint64_t rejected = 0;
+        uint64_t evictions = 0;
+        uint64_t bytes = 0;
+        uint64_t entries = 0;
+    };
+
+    /**
+     * @param dataDir judge data directory as seen by the judge
+     * @param maxBytes size budget for the images
+     */
+    SqlSnapshotCache(const std::string &dataDir, uint64_t maxBytes);
+
+    /**
+     * @brief Creates the snapshot directory and indexes images left by a
+     * previous run, oldest first.
+     */
+    bool initialize();
+
+    /** @brief Where the runner finds `<key>.db` inside the sandbox. */
+    static std::string sandboxDir();
+
+    /** @brief Records that a runner started tests off the image for `key`. */
+    void touch(const std::string &key);
+
+    /**
+     * @brief Stores the image a runner built for `key`, which the caller has
+     * checked is the hash of one of that job's own setup scripts.
+     * @return false if it is not a SQLite database, larger than the whole
+     * budget, or cannot be written
+     */
+    bool store(const std::string &key, const std::string &image);
+
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    struct Node
+    {
+        std::list<std::string>::iterator position;
+        uint64_t bytes = 0;
+    };
+
+    void evictLocked();
+
+    std::string dir_;
+    uint64_t maxBytes_;
+
+    mutable std::mutex mutex_;
+    std::list<std::string> lru_; // most recently used at the front
+    std::unordered_map<std::string, Node> index_;
+    Stats stats_;
+};
+
+/**
+ * @brief The cache JUDGE_SQL_SNAPSHOT_MB asks for, initialized; null if it
+ * is disabled or cannot be used.
+ */
+std::unique_ptr<SqlSnapshotCache> makeSqlSnapshotCache(const JudgeConfig &config);
+
+#endif // SQL_SNAPSHOT_CACHE_H
@@ -0,0 +1,34 @@
+#ifndef STUB_EXECUTOR_H
+#define STUB_EXECUTOR_H
+
+#include "SandboxExecutor.h"
+
+#include <string>
+
+/**
+ * @class StubExecutor
+ * @brief Sandbox backend that runs no submission: every run is a shell that
+ * reads the payload, sleeps for a fixed time and prints an empty completed
+ * verdict.
+ *
+ * Selected with JUDGE_SANDBOX=stub, it lets the intake, scheduling and
+ * verdict paths be exercised (and several judges scaled out on one host, see
+ * scripts/scale_test.sh) without docker or runner images.
+ */
+class StubExecutor : public SandboxExecutor
+{
+public:
+    explicit StubExecutor(unsigned int runMs);
+
+    const char *name() const override { return "stub"; }
+    std::string imageDigest(const std::string &) override { return "stub"; }
+
+protected:
+    void executeAsync(const SandboxRequest &request, Completion done) override;
+
+private:
+    // argument to sleep(1)
+    std::string seconds_;
+};
+
+#endif // STUB_EXECUTOR_H
@@ -0,0 +1,64 @@
+#ifndef SUBMISSION_SCANNER_H
+#define SUBMISSION_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The few fields of a submission payload the judge itself acts on.
+ * Test case data is validated but not kept, except for the expected outputs
+ * when the judge compares outputs itself; the runner gets the payload bytes
+ * as they came from Redis.
+ */
+struct SubmissionHeader
+{
+    std::string language;
+    std::string mode;
+    std::string outputType = "text";
+    // kept for the compile cache key; small next to the test data
+    std::string code;
+    std::string libraryCode;
+    size_t testCaseCount = 0;
+    // SHA-256 of a test set in Redis that stands in for testCases, see
+    // TestSetStore; testCaseCount is then 0
+    std::string testSetRef;
+
+    // optional: how outputs are compared (see OutputComparator.h), and the
+    // tolerance for numbers in "tokens" mode
+    std::string compareMode;
+    double floatTolerance = 0;
+    // testCaseId and expected output (null as empty) of every test case, in
+    // order; only filled when asked for
+    std::vector<std::pair<int64_t, std::string>> expectedOutputs;
+};
+
+/**
+ * @brief Validates a submission payload in one streaming (SAX) pass and
+ * extracts its header.
+ *
+ * Accepts exactly what the runners accept: an object with string `code`,
+ * `language` and `mode`, optional string-or-null `libraryCode` and
+ * `outputType`, and a `testCases` array of objects with a numeric
+ * `testCaseId`, a boolean `isPublic` and string-or-null `input` and
+ * `expectedOutput`, and optional string `compareMode` and numeric
+ * `floatTolerance`. A string `testSetRef` may take the place of
+ * `testCases`. Unknown fields are ignored.
+ *
+ * @param error receives a description of the first problem found
+ * @param keepExpectedOutputs fill header.expectedOutputs; the strings are
+ * moved out of the parser, not copied again
+ */
+bool scanSubmission(const std::string &payload, SubmissionHeader &header, std::string &error,
+                    bool keepExpectedOutputs = false);
+
+/**
+ * @brief Validates a bare testCases array, a test set, the same way and
+ * fills in header.testCaseCount and, if asked, header.expectedOutputs.
+ */
+bool scanTestCases(const std::string &testCases, SubmissionHeader &header, std::string &error,
+                   bool keepExpectedOutputs = false);
+
+#endif // SUBMISSION_SCANNER_H
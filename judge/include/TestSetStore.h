@@ -0,0 +1,117 @@
+#ifndef TEST_SET_STORE_H
+#define TEST_SET_STORE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The test cases of a problem, shared by every job that refers to
+ * them by hash (`testSetRef`) instead of carrying them.
+ */
+struct TestSet
+{
+    std::string hash;
+    // the testCases array, as the server stored it in Redis
+    std::string testCases;
+    // the same bytes as a file inside the sandbox, empty if sandboxes have
+    // no data directory; the runner then gets testCases inline
+    std::string sandboxPath;
+    size_t count = 0;
+    // testCaseId and expected output of every test case, in order
+    std::vector<std::pair<int64_t, std::string>> expectedOutputs;
+};
+
+/**
+ * @class TestSetStore
+ * @brief Memory-bounded LRU of test sets, each fetched from Redis
+ * (judge:testset:<sha256>) once and checked against its hash.
+ *
+ * Every cached set is also written to the judge data directory, which
+ * sandboxes see read-only at /judge, so a job's runner reads its test cases
+ * from there instead of from its stdin. A set stays cached (and its file in
+ * place) while a job holds it, whatever the budget says: each fetch
+ * evicts least recently used sets that no job is using until the rest fits.
+ */
+class TestSetStore
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t failures = 0;
+        uint64_t evictions = 0;
+        uint64_t bytes = 0;
+        uint64_t entries = 0;
+    };
+
+    /**
+     * @param dataDir judge data directory as seen by the judge
+     * @param maxBytes memory budget for cached test sets, 0 to keep none
+     * beyond the jobs using them
+     */
+    TestSetStore(const std::string &dataDir, uint64_t maxBytes);
+
+    /**
+     * @brief Creates the test set directory and clears files left by a
+     * previous run. Without it the store still works, sets just go to the
+     * runners inline.
+     */
+    bool initialize();
+
+    /** @brief Where the server stores the set with this hash. */
+    static std::string redisKey(const std::string &hash);
+
+    /**
+     * @brief The test set with this hash, from the cache or else from Redis.
+     * Concurrent misses on one hash share a single fetch.
+     * @param error why there is none: not in Redis, hash mismatch, invalid
+     */
+    std::shared_ptr<const TestSet> acquire(const std::string &hash, std::string &error);
+
+    /**
+     * @brief Caches a test set that did not come from Redis (offline
+     * regrading), under the hash of its bytes. A later acquire() of that
+     * hash finds it as long as someone holds the returned pointer.
+     * @param error why the test cases are invalid
+     */
+    std::shared_ptr<const TestSet> add(std::string testCases, std::string &error);
+
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    struct Node
+    {
+        std::list<std::string>::iterator position;
+        std::shared_ptr<const TestSet> testSet;
+        uint64_t bytes = 0;
+    };
+
+    std::shared_ptr<const TestSet> fetch(const std::string &hash, std::string &error);
+    /** @brief Checks the test cases and writes their file. */
+    std::shared_ptr<const TestSet> load(const std::string &hash, std::string testCases, std::string &error);
+    void insertLocked(const std::shared_ptr<const TestSet> &testSet);
+    void evictLocked();
+
+    std::string dir_;
+    bool files_ = false;
+    uint64_t maxBytes_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable fetched_;
+    std::list<std::string> lru_; // most recently used at the front
+    std::unordered_map<std::string, Node> index_;
+    std::set<std::string> fetching_;
+    Stats stats_;
+};
+
+#endif // TEST_SET_STORE_H
@@ -8,6 +8,7 @@
 #include <condition_variable>
 #include <functional>
 #include <future>
+#include <type_traits>
 
 #include "Logger.h"
 
@@ -27,7 +28,7 @@ public:
      */
     template <class F, class... Args>
     auto enqueue(F &&f, Args &&...args)
-        -> std::future<typename std::result_of<F(Args...)>::type>;
+        -> std::future<std::invoke_result_t<F, Args...>>;
 
 private:
     std::vector<std::thread> workers_;
@@ -39,9 +40,9 @@ private:
 
 template <class F, class... Args>
 auto ThreadPool::enqueue(F &&f, Args &&...args)
-    -> std::future<typename std::result_of<F(Args...)>::type>
+    -> std::future<std::invoke_result_t<F, Args...>>
 {
-    using return_type = typename std::result_of<F(Args...)>::type;
+    using return_type = std::invoke_result_t<F, Args...>;
 
     auto task = std::make_shared<std::packaged_task<return_type()>>(
         std::bind(std::forward<F>(f), std::forward<Args>(args)...));
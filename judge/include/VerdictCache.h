@@ -0,0 +1,85 @@
+#ifndef VERDICT_CACHE_H
+#define VERDICT_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class VerdictCache
+ * @brief Memory-bounded LRU of published verdicts, so a job identical to
+ * one judged shortly before gets its verdict without a sandbox.
+ *
+ * Entries are keyed by a hash of what the verdict depends on: language,
+ * code, libraryCode, outputType, the test cases (by the hash of their set),
+ * how outputs are compared and the runner image digest, so a rebuilt image
+ * starts over. Not by mode: a Run and a Submit of the same code against the
+ * same tests share an entry, which holds the verdict before a submit
+ * verdict's outputs are cut down. Only verdicts of deterministic outcomes
+ * are stored, see JudgeWorker; a program that prints something different on
+ * every run still gets its first verdict again until the entry expires
+ * after `ttl`.
+ */
+class VerdictCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t stores = 0;
+        uint64_t expirations = 0;
+        uint64_t evictions = 0;
+        uint64_t bytes = 0;
+        uint64_t entries = 0;
+    };
+
+    /**
+     * @param maxBytes memory budget for cached verdicts
+     * @param ttl how long a verdict may be handed out after it was stored
+     */
+    VerdictCache(uint64_t maxBytes, std::chrono::seconds ttl);
+
+    /**
+     * @param testSetHash the job's testSetRef, or the SHA-256 of its inline
+     * testCases as the server would store them as a set
+     * @param compareOptions how the judge compares its outputs, any string
+     * that differs when they do
+     */
+    static std::string key(const std::string &language, const std::string &code, const std::string &libraryCode,
+                           const std::string &outputType, const std::string &testSetHash,
+                           const std::string &compareOptions, const std::string &imageDigest);
+
+    /** @brief The verdict stored under `key`, unless it expired. */
+    std::optional<std::string> lookup(const std::string &key);
+
+    void store(const std::string &key, std::string verdict);
+
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    struct Node
+    {
+        std::list<std::string>::iterator position;
+        std::string verdict;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    void removeLocked(std::unordered_map<std::string, Node>::iterator it);
+    void evictLocked();
+
+    uint64_t maxBytes_;
+    std::chrono::seconds ttl_;
+
+    mutable std::mutex mutex_;
+    std::list<std::string> lru_; // most recently used at the front
+    std::unordered_map<std::string, Node> index_;
+    Stats stats_;
+};
+
+#endif // VERDICT_CACHE_H
@@ -0,0 +1,200 @@
+#ifndef WORK_STEALING_EXECUTOR_H
+#define WORK_STEALING_EXECUTOR_H
+
+#include "CancellationToken.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @class Task
+ * @brief Move-only `void(const CancellationToken &)` callable stored inline.
+ *
+ * Unlike std::function there is never a heap allocation: a callable that
+ * does not fit INLINE_SIZE is a compile error, not a silent malloc per job.
+ */
+class Task
+{
+public:
+    static constexpr size_t INLINE_SIZE = 192;
+
+    Task() = default;
+
+    template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F &&f)
+    {
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= INLINE_SIZE, "task captures too much, capture a pointer instead");
+        static_assert(alignof(Fn) <= alignof(std::max_align_t), "over-aligned task");
+        static_assert(std::is_nothrow_move_constructible_v<Fn>, "task must be nothrow movable");
+        static_assert(std::is_invocable_v<Fn &, const CancellationToken &>,
+                      "task must be callable as void(const CancellationToken &)");
+
+        static const Ops ops = {
+            [](void *self, const CancellationToken &token)
+            { (*static_cast<Fn *>(self))(token); },
+            [](void *to, void *from) noexcept
+            {
+                new (to) Fn(std::move(*static_cast<Fn *>(from)));
+                static_cast<Fn *>(from)->~Fn();
+            },
+            [](void *self) noexcept
+            { static_cast<Fn *>(self)->~Fn(); },
+        };
+        new (storage_) Fn(std::forward<F>(f));
+        ops_ = &ops;
+    }
+
+    Task(Task &&other) noexcept { moveFrom(other); }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    void operator()(const CancellationToken &token) { ops_->invoke(storage_, token); }
+    explicit operator bool() const { return ops_ != nullptr; }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void *self, const CancellationToken &token);
+        void (*relocate)(void *to, void *from) noexcept;
+        void (*destroy)(void *self) noexcept;
+    };
+
+    void moveFrom(Task &other) noexcept
+    {
+        if (other.ops_)
+        {
+            other.ops_->relocate(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    void reset() noexcept
+    {
+        if (ops_)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[INLINE_SIZE];
+    const Ops *ops_ = nullptr;
+};
+
+/**
+ * @class WorkStealingExecutor
+ * @brief Fixed set of worker threads, each with its own task deque, that
+ * steal from each other when they run dry.
+ *
+ * Tasks submitted from outside are spread round robin, tasks submitted from
+ * a worker stay on its own deque. Both the owner and thieves take the oldest
+ * task, so jobs start in the order they were submitted (the intake claims
+ * them earliest-deadline-first). A task with a timeout is watched from the
+ * moment it starts: once it runs over, its CancellationToken is cancelled,
+ * which kills the sandbox it is waiting on and so gives its worker back.
+ */
+class WorkStealingExecutor
+{
+public:
+    struct Stats
+    {
+        uint64_t submitted = 0;
+        uint64_t executed = 0;
+        uint64_t stolen = 0;
+        uint64_t timedOut = 0;
+        size_t workers = 0;
+    };
+
+    explicit WorkStealingExecutor(size_t workers);
+    ~WorkStealingExecutor();
+
+    WorkStealingExecutor(const WorkStealingExecutor &) = delete;
+    WorkStealingExecutor &operator=(const WorkStealingExecutor &) = delete;
+
+    /**
+     * @param timeout wall-clock budget once the task starts, zero for none
+     * @return token the task receives, cancel it to stop the task early
+     */
+    CancellationToken submit(Task task, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    Stats stats() const;
+    void logStats() const;
+
+    /** @brief Tasks submitted and not started yet. */
+    size_t backlog() const { return pending_.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry
+    {
+        Task task;
+        CancellationToken token;
+        std::chrono::milliseconds timeout{0};
+    };
+
+    struct alignas(64) Worker
+    {
+        std::mutex mutex;
+        std::deque<Entry> tasks;
+
+        // what the watchdog looks at while this worker runs a timed task,
+        // guarded by watchdogMutex_
+        bool watched = false;
+        CancellationToken running;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void workerLoop(size_t index);
+    bool takeTask(size_t index, Entry &out);
+    void runTask(size_t index, Entry &entry);
+    void watchdogLoop();
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> nextWorker_{0};
+    std::atomic<size_t> pending_{0};
+    std::atomic<bool> stop_{false};
+
+    // workers with nothing to run or steal sleep here; submit() only takes
+    // the lock to wake one if any is asleep
+    std::mutex parkMutex_;
+    std::condition_variable parkCv_;
+    std::atomic<size_t> parked_{0};
+
+    std::mutex watchdogMutex_;
+    std::condition_variable watchdogCv_;
+    bool watchdogStop_ = false;
+    std::thread watchdog_;
+
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> executed_{0};
+    std::atomic<uint64_t> stolen_{0};
+    std::atomic<uint64_t> timedOut_{0};
+};
+
+#endif // WORK_STEALING_EXECUTOR_H
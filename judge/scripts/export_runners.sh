@@ -0,0 +1,45 @@
+set -euo pipefail
+
+# Unpacks the runner images into plain root filesystems for the native
+# sandbox backend (JUDGE_SANDBOX=native). Re-run after build_images.sh.
+#
+#   <dest>/<image>/rootfs        docker export of the image
+#   <dest>/<image>/config.json   image config (entrypoint, env, workdir)
+#   <dest>/<image>/seccomp.json  the runner's seccomp profile, if it has one
+#   <dest>/<image>/digest        image id, keys the judge's compile cache
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_ROOT="${SCRIPT_DIR}/.."
+DOCKER_BASE="${REPO_ROOT}/docker_images"
+DEST="${1:-${JUDGE_NATIVE_ROOT:-/var/lib/judge/runners}}"
+
+export_runner() {
+  local image="$1"
+  local profile="$2"
+  local dir="${DEST}/${image%%:*}"
+
+  echo "Exporting ${image} to ${dir}"
+  rm -rf "${dir}"
+  mkdir -p "${dir}/rootfs"
+
+  local cid
+  cid="$(docker create "${image}")"
+  docker export "${cid}" | tar -x -C "${dir}/rootfs"
+  docker rm "${cid}" > /dev/null
+
+  # mount points the sandbox needs, read-only rootfs can't grow them later
+  mkdir -p "${dir}/rootfs/tmp" "${dir}/rootfs/proc" "${dir}/rootfs/dev" "${dir}/rootfs/judge"
+
+  docker image inspect -f '{{json .Config}}' "${image}" > "${dir}/config.json"
+  docker image inspect -f '{{.Id}}' "${image}" > "${dir}/digest"
+  if [ -n "${profile}" ] && [ -f "${profile}" ]; then
+    cp "${profile}" "${dir}/seccomp.json"
+  fi
+}
+
+export_runner judge-cpp:latest ""
+export_runner judge-py:latest "${DOCKER_BASE}/python/security/seccomp-python.json"
+export_runner judge-js:latest "${DOCKER_BASE}/javascript\typescript/security/seccomp-js.json"
+export_runner judge-sql:latest ""
+
+echo "Success! Runners exported to ${DEST}."
@@ -0,0 +1,96 @@
+#!/bin/bash
+set -euo pipefail
+
+# Horizontal scaling check for the stream intake: queues JOBS jobs on a
+# throwaway redis-server, drains them with 1, 2 and 4 judge processes
+# (JUDGE_INTAKE=stream, stub sandboxes, so no docker is needed) and prints
+# the throughput of each round.
+#
+#   scripts/scale_test.sh [jobs] [stub ms] [processes...]
+#
+# With KILL_ONE=1 the first judge of each round is SIGKILLed halfway through;
+# its unacked entries must then be reclaimed by the others after
+# JUDGE_RECLAIM_IDLE_MS, so every round still ends with all verdicts.
+#
+# Needs redis-server and redis-cli on PATH and a built bin/judge.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_ROOT="${SCRIPT_DIR}/.."
+JUDGE="${JUDGE_BIN:-${REPO_ROOT}/bin/judge}"
+
+JOBS="${1:-400}"
+STUB_MS="${2:-200}"
+PROCESSES=(1 2 4)
+if [[ $# -gt 2 ]]; then
+  PROCESSES=("${@:3}")
+fi
+
+PORT="${SCALE_REDIS_PORT:-6390}"
+WORK="$(mktemp -d)"
+REDIS=(redis-cli -p "${PORT}")
+JUDGE_PIDS=()
+
+cleanup() {
+  for pid in "${JUDGE_PIDS[@]}"; do
+    kill -9 "${pid}" 2>/dev/null || true
+  done
+  "${REDIS[@]}" shutdown nosave >/dev/null 2>&1 || true
+  rm -rf "${WORK}"
+}
+trap cleanup EXIT
+
+redis-server --port "${PORT}" --save "" --appendonly no --daemonize yes \
+  --dir "${WORK}" --logfile "${WORK}/redis.log" >/dev/null
+until "${REDIS[@]}" ping >/dev/null 2>&1; do sleep 0.1; done
+
+now_ms() { date +%s%3N; }
+
+enqueue() {
+  local payload='{"language":"python","mode":"submit","code":"print(1)","testCases":[{"input":"","expectedOutput":"1"}]}'
+  local lanes=(judge:stream:quiz judge:stream:submit judge:stream:run)
+  local created
+  created="$(now_ms)"
+  for ((i = 0; i < JOBS; i++)); do
+    echo "HSET judge:scale-${i} data '${payload}' createdAt ${created}"
+    echo "XADD ${lanes[i % 3]} * jobId scale-${i}"
+  done | "${REDIS[@]}" >/dev/null
+}
+
+for n in "${PROCESSES[@]}"; do
+  "${REDIS[@]}" flushall >/dev/null
+  enqueue
+
+  JUDGE_PIDS=()
+  start="$(now_ms)"
+  for ((j = 0; j < n; j++)); do
+    REDIS_HOST=127.0.0.1 REDIS_PORT="${PORT}" \
+      JUDGE_INTAKE=stream JUDGE_CONSUMER="scale-${n}-${j}" \
+      JUDGE_SANDBOX=stub JUDGE_STUB_MS="${STUB_MS}" \
+      JUDGE_THREADS=1 JUDGE_MAX_SANDBOXES="${JUDGE_MAX_SANDBOXES:-8}" \
+      JUDGE_RECLAIM_IDLE_MS="${JUDGE_RECLAIM_IDLE_MS:-3000}" \
+      JUDGE_COMPILE_CACHE_MB=0 JUDGE_DATA_DIR="${WORK}" \
+      "${JUDGE}" >"${WORK}/judge-${n}-${j}.log" 2>&1 &
+    JUDGE_PIDS+=("$!")
+  done
+
+  killed=""
+  while true; do
+    done_jobs="$("${REDIS[@]}" xlen judge:verdicts)"
+    if [[ "${KILL_ONE:-0}" == "1" && -z "${killed}" && "${n}" -gt 1 && "${done_jobs}" -ge $((JOBS / 2)) ]]; then
+      { kill -9 "${JUDGE_PIDS[0]}" && wait "${JUDGE_PIDS[0]}"; } 2>/dev/null || true
+      killed=" (one judge killed at ${done_jobs})"
+    fi
+    [[ "${done_jobs}" -ge "${JOBS}" ]] && break
+    sleep 0.05
+  done
+  elapsed=$(($(now_ms) - start))
+
+  for pid in "${JUDGE_PIDS[@]}"; do
+    kill -9 "${pid}" 2>/dev/null || true
+  done
+  wait 2>/dev/null || true
+
+  pending="$("${REDIS[@]}" xpending judge:stream:run judge | head -1)"
+  echo "${n} judge(s): ${JOBS} jobs in ${elapsed} ms," \
+    "$((JOBS * 1000 / (elapsed > 0 ? elapsed : 1))) jobs/s, ${pending} left pending on run${killed}"
+done
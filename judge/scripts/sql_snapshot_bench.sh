@@ -0,0 +1,96 @@
+#!/bin/bash
+set -euo pipefail
+
+# Per-test latency of the SQL runner on a large seed dataset: one job of
+# TESTS tests sharing a setup script that inserts ROWS rows, run REPEATS
+# times without a snapshot directory (the script runs once per job) and
+# then with one holding the image the first run handed back (it does not
+# run at all, as for every job after the first with JUDGE_SQL_SNAPSHOT_MB).
+# Prints the first test's executionTime, the mean of the others and the
+# whole job's wall time.
+#
+#   scripts/sql_snapshot_bench.sh [rows] [tests] [repeats]
+#
+# Runs the judge-sql image built by build_images.sh with the sandbox's
+# usual CPU share, the snapshot directory mounted read-only at /judge.
+# RUNNER_LOCAL=1 runs the runner with the host's python3 instead.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_ROOT="${SCRIPT_DIR}/.."
+RUNNER_PY="${REPO_ROOT}/docker_images/sql/runner.py"
+
+ROWS="${1:-200000}"
+TESTS="${2:-20}"
+REPEATS="${3:-3}"
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "${WORK}"' EXIT
+mkdir -p "${WORK}/sql-snapshots"
+
+if [[ "${RUNNER_LOCAL:-0}" == 1 ]]; then
+  RUNNER=(python3 "${RUNNER_PY}")
+  SNAPSHOT_DIR="${WORK}/sql-snapshots"
+else
+  RUNNER=(docker run -i --rm --network none --cpus 1 --memory 512m -v "${WORK}:/judge:ro" judge-sql:latest)
+  SNAPSHOT_DIR=/judge/sql-snapshots
+fi
+
+job() {
+  python3 - "${ROWS}" "${TESTS}" "$1" <<'EOF'
+import json, sys
+rows, tests, snapshot_dir = int(sys.argv[1]), int(sys.argv[2]), sys.argv[3]
+setup = ["CREATE TABLE people(id INTEGER PRIMARY KEY, name TEXT, score INTEGER, city TEXT);"]
+for begin in range(0, rows, 1000):
+    values = ",".join(f"({i}, 'name{i}', {i * 7919 % 1000}, 'city{i % 50}')"
+                      for i in range(begin, min(rows, begin + 1000)))
+    setup.append(f"INSERT INTO people VALUES {values};")
+setup.append("CREATE INDEX people_city ON people(city);")
+job = {
+    "language": "sql",
+    "code": "SELECT city, count(*) AS n, sum(score) AS total FROM people WHERE city = 'city7' GROUP BY city;",
+    "testCases": [{"testCaseId": str(i), "input": "\n".join(setup), "expectedOutput": ""} for i in range(tests)],
+    "deferComparison": True,
+}
+if snapshot_dir:
+    job["sqlSnapshotDir"] = snapshot_dir
+print(json.dumps(job))
+EOF
+}
+
+run_mode() {
+  local label="$1"
+  : > "${WORK}/verdicts"
+  : > "${WORK}/walls"
+  for _ in $(seq "${REPEATS}"); do
+    start=$(date +%s%N)
+    "${RUNNER[@]}" < "${WORK}/job.json" >> "${WORK}/verdicts"
+    echo $(( ($(date +%s%N) - start) / 1000000 )) >> "${WORK}/walls"
+  done
+  python3 - "${label}" "${WORK}/verdicts" "${WORK}/walls" "${WORK}/sql-snapshots" <<'EOF'
+import base64, json, os, sys
+label, verdicts, walls, snapshot_dir = sys.argv[1:]
+first, rest, outputs = [], [], set()
+for line in open(verdicts):
+    verdict = json.loads(line)
+    times = [test["executionTime"] for test in verdict["testResults"]]
+    first.append(times[0])
+    rest.extend(times[1:])
+    outputs.update(test["actual"] for test in verdict["testResults"])
+    # stored the way the judge stores what the runner hands back
+    for key, image in verdict.get("snapshots", {}).items():
+        with open(os.path.join(snapshot_dir, key + ".db"), "wb") as f:
+            f.write(base64.b64decode(image))
+walls = [int(w) for w in open(walls)]
+print(f"{label:>18}: first test {sum(first) / len(first):.0f} ms, others mean "
+      f"{sum(rest) / max(1, len(rest)):.1f} ms; job {sum(walls) / len(walls):.0f} ms"
+      + ("" if len(outputs) == 1 else f"; {len(outputs)} different outputs"))
+EOF
+}
+
+echo "sql: ${ROWS} rows, ${TESTS} tests per job, ${REPEATS} jobs per mode, ${RUNNER[*]}"
+job "" > "${WORK}/job.json"
+run_mode "built per job"
+# one run to hand the image back, then every job finds it
+job "${SNAPSHOT_DIR}" > "${WORK}/job.json"
+REPEATS=1 run_mode "building snapshot" > /dev/null
+run_mode "from snapshot"
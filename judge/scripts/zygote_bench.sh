@@ -0,0 +1,93 @@
+#!/bin/bash
+set -euo pipefail
+
+# Per-test latency of the Python and JavaScript runners with and without
+# zygote mode (JUDGE_ZYGOTE): runs one job of TESTS short test cases through
+# the runner REPEATS times per mode and prints the mean and p90 of the
+# tests' executionTime, their mean CPU time and the whole job's wall time.
+#
+#   scripts/zygote_bench.sh [python|javascript] [tests] [repeats]
+#
+# Runs the runner image built by build_images.sh (judge-py, judge-js) with
+# the sandbox's usual CPU share. RUNNER_LOCAL=1 runs the runner with the
+# host's python3 / node instead, for javascript from a runner.js compiled
+# next to runner.ts.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_ROOT="${SCRIPT_DIR}/.."
+DOCKER_BASE="${REPO_ROOT}/docker_images"
+
+LANGUAGE="${1:-python}"
+TESTS="${2:-50}"
+REPEATS="${3:-5}"
+
+case "${LANGUAGE}" in
+  python)
+    IMAGE=judge-py:latest
+    LOCAL=(python3 "${DOCKER_BASE}/python/runner.py")
+    CODE='import sys
+print(sum(int(a) for a in sys.argv[1:]))'
+    ;;
+  javascript)
+    IMAGE=judge-js:latest
+    LOCAL=(node "${DOCKER_BASE}/javascript\typescript/runner.js")
+    CODE='console.log(process.argv.slice(2).reduce((s, a) => s + Number(a), 0));'
+    ;;
+  *)
+    echo "usage: $0 [python|javascript] [tests] [repeats]" >&2
+    exit 1
+    ;;
+esac
+
+if [[ "${RUNNER_LOCAL:-0}" == 1 ]]; then
+  RUNNER=("${LOCAL[@]}")
+else
+  RUNNER=(docker run -i --rm --network none --cpus 1 --memory 512m "${IMAGE}")
+fi
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "${WORK}"' EXIT
+
+job() {
+  python3 - "$1" "${TESTS}" "${LANGUAGE}" "${CODE}" <<'EOF'
+import json, sys
+zygote, tests, language, code = sys.argv[1] == "1", int(sys.argv[2]), sys.argv[3], sys.argv[4]
+print(json.dumps({
+    "language": language,
+    "code": code,
+    "testCases": [{"testCaseId": str(i), "input": f"{i} {i}", "expectedOutput": str(2 * i)}
+                  for i in range(tests)],
+    "zygote": zygote,
+}))
+EOF
+}
+
+echo "${LANGUAGE}: ${TESTS} tests per job, ${REPEATS} jobs per mode, ${RUNNER[*]}"
+for zygote in 0 1; do
+  job "${zygote}" > "${WORK}/job.json"
+  : > "${WORK}/verdicts"
+  : > "${WORK}/walls"
+  for _ in $(seq "${REPEATS}"); do
+    start=$(date +%s%N)
+    "${RUNNER[@]}" < "${WORK}/job.json" >> "${WORK}/verdicts"
+    echo $(( ($(date +%s%N) - start) / 1000000 )) >> "${WORK}/walls"
+  done
+  python3 - "${zygote}" "${WORK}/verdicts" "${WORK}/walls" <<'EOF'
+import json, sys
+mode = "zygote" if sys.argv[1] == "1" else "one interpreter per test"
+times, cpu, failed = [], [], 0
+for line in open(sys.argv[2]):
+    verdict = json.loads(line)
+    for test in verdict.get("testResults", []):
+        times.append(test["executionTime"])
+        cpu.append(test.get("cpuTimeMs") or 0)
+        failed += test["status"] != "passed"
+walls = [int(w) for w in open(sys.argv[3])]
+times.sort()
+if not times:
+    sys.exit(f"{mode}: no test results")
+print(f"{mode:>26}: per test mean {sum(times) / len(times):.1f} ms, p90 {times[int(0.9 * (len(times) - 1))]} ms, "
+      f"cpu {sum(cpu) / len(cpu):.1f} ms; job {sum(walls) / len(walls):.0f} ms"
+      + (f"; {failed} tests not passed" if failed else ""))
+EOF
+done
@@ -0,0 +1,349 @@
+#include "AsyncRedis.h"
+#include "Logger.h"
+
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace
+{
+    double msSince(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+}
+
+AsyncRedis::AsyncRedis(std::string host, int port, size_t connections)
+    : host_(std::move(host)), port_(port),
+      roundTripSeconds_(METRICS()->histogram("judge_redis_roundtrip_seconds",
+                                             "Async Redis request latency from write to reply.")),
+      sendWaitSeconds_(METRICS()->histogram("judge_redis_send_wait_seconds",
+                                            "Time async Redis requests wait to be written."))
+{
+    for (size_t i = 0; i < std::max<size_t>(connections, 1); ++i)
+    {
+        auto connection = std::make_unique<Connection>();
+        connection->owner = this;
+        connections_.push_back(std::move(connection));
+    }
+    stats_.connections = connections_.size();
+}
+
+AsyncRedis::~AsyncRedis()
+{
+    stop_ = true;
+    if (wakeFd_ >= 0)
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
+    if (loopThread_.joinable())
+    {
+        loopThread_.join();
+    }
+
+    // fails whatever is still pending, so no caller waits forever
+    for (auto &connection : connections_)
+    {
+        if (connection->context)
+            redisAsyncFree(connection->context);
+    }
+    for (auto &request : queue_)
+    {
+        complete(request.release(), nullptr);
+    }
+    if (wakeFd_ >= 0)
+        close(wakeFd_);
+    if (epollFd_ >= 0)
+        close(epollFd_);
+}
+
+bool AsyncRedis::start()
+{
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd_ < 0 || wakeFd_ < 0)
+    {
+        LOG_ERROR("Cannot set up Redis event loop: " << strerror(errno));
+        return false;
+    }
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // the wake-up eventfd
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+    size_t connected = 0;
+    for (auto &connection : connections_)
+    {
+        if (connect(*connection))
+            connected++;
+    }
+    if (connected == 0)
+    {
+        return false;
+    }
+
+    loopThread_ = std::thread([this]
+                              { loop(); });
+    return true;
+}
+
+void AsyncRedis::submit(std::vector<Command> commands, Callback done)
+{
+    auto request = std::make_unique<Request>();
+    request->commands = std::move(commands);
+    request->done = std::move(done);
+    request->submitted = std::chrono::steady_clock::now();
+    request->owner = this;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        queue_.push_back(std::move(request));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+    (void)ignored;
+}
+
+void AsyncRedis::loop()
+{
+    epoll_event events[16];
+    while (!stop_)
+    {
+        int n = epoll_wait(epollFd_, events, 16, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Redis event loop epoll_wait failed: " << strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.ptr == nullptr)
+            {
+                uint64_t count;
+                ssize_t ignored = read(wakeFd_, &count, sizeof(count));
+                (void)ignored;
+                drainSubmissions();
+                continue;
+            }
+
+            Connection *connection = static_cast<Connection *>(events[i].data.ptr);
+            // either handler may end in a disconnect that frees the context
+            if (connection->context && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+                redisAsyncHandleRead(connection->context);
+            if (connection->context && (events[i].events & EPOLLOUT))
+                redisAsyncHandleWrite(connection->context);
+        }
+    }
+}
+
+void AsyncRedis::drainSubmissions()
+{
+    std::deque<std::unique_ptr<Request>> pending;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        pending.swap(queue_);
+    }
+    for (auto &request : pending)
+    {
+        dispatch(std::move(request));
+    }
+}
+
+void AsyncRedis::dispatch(std::unique_ptr<Request> request)
+{
+    // round robin over live connections, reconnecting dead ones on the way
+    Connection *connection = nullptr;
+    for (size_t tries = 0; tries < connections_.size() && !connection; ++tries)
+    {
+        Connection &candidate = *connections_[nextConnection_++ % connections_.size()];
+        if (candidate.context)
+        {
+            connection = &candidate;
+        }
+        else if (connect(candidate))
+        {
+            connection = &candidate;
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            stats_.reconnects++;
+        }
+    }
+    if (!connection)
+    {
+        complete(request.release(), nullptr);
+        return;
+    }
+
+    request->sent = std::chrono::steady_clock::now();
+    Request *raw = request.release();
+    const size_t count = raw->commands.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Command &command = raw->commands[i];
+        std::vector<const char *> argv;
+        std::vector<size_t> argvlen;
+        for (const auto &arg : command)
+        {
+            argv.push_back(arg.data());
+            argvlen.push_back(arg.size());
+        }
+
+        // only the last reply is reported; hiredis discards the others
+        const bool last = i + 1 == count;
+        if (redisAsyncCommandArgv(connection->context, last ? &AsyncRedis::onReply : nullptr, last ? raw : nullptr,
+                                  static_cast<int>(argv.size()), argv.data(), argvlen.data()) != REDIS_OK)
+        {
+            complete(raw, nullptr);
+            return;
+        }
+    }
+}
+
+bool AsyncRedis::connect(Connection &connection)
+{
+    redisAsyncContext *context = redisAsyncConnect(host_.c_str(), port_);
+    if (!context || context->err)
+    {
+        LOG_ERROR("Redis async connection to " << host_ << ":" << port_ << " failed: "
+                                               << (context ? context->errstr : "out of memory"));
+        if (context)
+            redisAsyncFree(context);
+        return false;
+    }
+
+    connection.context = context;
+    connection.fd = context->c.fd;
+    connection.events = 0;
+    connection.registered = false;
+    context->data = &connection;
+    context->ev.data = &connection;
+    context->ev.addRead = &AsyncRedis::addRead;
+    context->ev.delRead = &AsyncRedis::delRead;
+    context->ev.addWrite = &AsyncRedis::addWrite;
+    context->ev.delWrite = &AsyncRedis::delWrite;
+    context->ev.cleanup = &AsyncRedis::cleanup;
+    redisAsyncSetDisconnectCallback(context, &AsyncRedis::onDisconnect);
+    // the non-blocking connect completes on the first writable event
+    updateEvents(connection, EPOLLOUT, 0);
+    return true;
+}
+
+void AsyncRedis::updateEvents(Connection &connection, uint32_t add, uint32_t remove)
+{
+    connection.events = (connection.events | add) & ~remove;
+    epoll_event ev = {};
+    ev.events = connection.events;
+    ev.data.ptr = &connection;
+    if (epoll_ctl(epollFd_, connection.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, connection.fd, &ev) == 0)
+    {
+        connection.registered = true;
+    }
+}
+
+void AsyncRedis::complete(Request *request, redisReply *reply)
+{
+    std::unique_ptr<Request> owned(request);
+    const auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        stats_.requests++;
+        stats_.commands += owned->commands.size();
+        if (!reply || reply->type == REDIS_REPLY_ERROR)
+            stats_.failures++;
+        if (owned->sent.time_since_epoch().count() != 0)
+        {
+            const double rtt = msSince(owned->sent, now);
+            const double wait = msSince(owned->submitted, owned->sent);
+            stats_.totalQueueWaitMs += wait;
+            stats_.totalRoundTripMs += rtt;
+            stats_.maxRoundTripMs = std::max(stats_.maxRoundTripMs, rtt);
+            roundTripSeconds_.observeMs(rtt);
+            sendWaitSeconds_.observeMs(wait);
+        }
+    }
+    if (owned->done)
+    {
+        owned->done(reply);
+    }
+}
+
+void AsyncRedis::addRead(void *privdata)
+{
+    Connection *c = static_cast<Connection *>(privdata);
+    c->owner->updateEvents(*c, EPOLLIN, 0);
+}
+
+void AsyncRedis::delRead(void *privdata)
+{
+    Connection *c = static_cast<Connection *>(privdata);
+    c->owner->updateEvents(*c, 0, EPOLLIN);
+}
+
+void AsyncRedis::addWrite(void *privdata)
+{
+    Connection *c = static_cast<Connection *>(privdata);
+    c->owner->updateEvents(*c, EPOLLOUT, 0);
+}
+
+void AsyncRedis::delWrite(void *privdata)
+{
+    Connection *c = static_cast<Connection *>(privdata);
+    c->owner->updateEvents(*c, 0, EPOLLOUT);
+}
+
+void AsyncRedis::cleanup(void *privdata)
+{
+    Connection *c = static_cast<Connection *>(privdata);
+    if (c->registered)
+    {
+        epoll_ctl(c->owner->epollFd_, EPOLL_CTL_DEL, c->fd, nullptr);
+    }
+    c->registered = false;
+    c->events = 0;
+}
+
+void AsyncRedis::onDisconnect(const redisAsyncContext *context, int status)
+{
+    Connection *c = static_cast<Connection *>(context->data);
+    if (status != REDIS_OK)
+    {
+        LOG_ERROR("Redis async connection lost: " << (context->errstr ? context->errstr : "unknown error"));
+    }
+    // hiredis frees the context after this returns; the next request to
+    // pick this slot reconnects it
+    c->context = nullptr;
+    c->fd = -1;
+}
+
+void AsyncRedis::onReply(redisAsyncContext *context, void *reply, void *privdata)
+{
+    (void)context;
+    Request *request = static_cast<Request *>(privdata);
+    request->owner->complete(request, static_cast<redisReply *>(reply));
+}
+
+AsyncRedis::Stats AsyncRedis::stats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return stats_;
+}
+
+void AsyncRedis::logStats() const
+{
+    const Stats s = stats();
+    LOG_INFO("Redis: connections=" << s.connections << " roundTrips=" << s.requests
+                                   << " commands=" << s.commands << " failures=" << s.failures
+                                   << " reconnects=" << s.reconnects
+                                   << " avgQueueWaitMs=" << (s.requests ? s.totalQueueWaitMs / s.requests : 0)
+                                   << " avgRoundTripMs=" << (s.requests ? s.totalRoundTripMs / s.requests : 0)
+                                   << " maxRoundTripMs=" << s.maxRoundTripMs);
+}
@@ -0,0 +1,70 @@
+#include "CancellationToken.h"
+
+CancellationToken::CancellationToken() : state_(std::make_shared<State>()) {}
+
+void CancellationToken::cancel() const
+{
+    // callbacks run under the lock, so a Registration being destroyed on
+    // another thread waits for them instead of racing them
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->cancelled.exchange(true))
+    {
+        return;
+    }
+    for (auto &[id, callback] : state_->callbacks)
+    {
+        callback();
+    }
+    state_->callbacks.clear();
+}
+
+bool CancellationToken::cancelled() const
+{
+    return state_->cancelled.load(std::memory_order_acquire);
+}
+
+CancellationToken::Registration CancellationToken::onCancel(std::function<void()> callback) const
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->cancelled)
+    {
+        callback();
+        return Registration();
+    }
+    const uint64_t id = state_->nextId++;
+    state_->callbacks.emplace(id, std::move(callback));
+    return Registration(state_, id);
+}
+
+CancellationToken::Registration::Registration(Registration &&other) noexcept
+    : state_(std::move(other.state_)), id_(other.id_)
+{
+    other.id_ = 0;
+}
+
+CancellationToken::Registration &CancellationToken::Registration::operator=(Registration &&other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        state_ = std::move(other.state_);
+        id_ = other.id_;
+        other.id_ = 0;
+    }
+    return *this;
+}
+
+CancellationToken::Registration::~Registration()
+{
+    reset();
+}
+
+void CancellationToken::Registration::reset()
+{
+    if (state_)
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->callbacks.erase(id_);
+        state_.reset();
+    }
+}
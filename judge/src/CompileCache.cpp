@@ -0,0 +1,305 @@
+#include "CompileCache.h"
+#include "JudgeConfig.h"
+#include "Logger.h"
+#include "Sha256.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    const char *BINARY_FILE = "main";
+    const char *ERROR_FILE = "compile_error.json";
+    // where the judge data directory is mounted inside every sandbox
+    const char *SANDBOX_DATA_DIR = "/judge";
+
+    bool isKey(const std::string &name)
+    {
+        return name.size() == 64 &&
+               std::all_of(name.begin(), name.end(), [](char c)
+                           { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+    }
+
+    bool ensureDir(const std::string &path, mode_t mode)
+    {
+        if (mkdir(path.c_str(), mode) != 0 && errno != EEXIST)
+        {
+            return false;
+        }
+        // mkdir honours the umask, the permission bits are the point here
+        return chmod(path.c_str(), mode) == 0;
+    }
+
+    bool writeWholeFile(const std::string &path, const std::string &content, mode_t mode)
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+        if (fd < 0)
+        {
+            return false;
+        }
+        size_t written = 0;
+        while (written < content.size())
+        {
+            ssize_t n = write(fd, content.data() + written, content.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                close(fd);
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        fchmod(fd, mode);
+        return close(fd) == 0;
+    }
+
+    void removeTree(const std::string &dir)
+    {
+        unlink((dir + "/" + BINARY_FILE).c_str());
+        unlink((dir + "/" + ERROR_FILE).c_str());
+        rmdir(dir.c_str());
+    }
+}
+
+CompileCache::CompileCache(const std::string &dataDir, uint64_t maxBytes)
+    : dir_(dataDir + "/binaries"), maxBytes_(maxBytes)
+{
+}
+
+bool CompileCache::initialize()
+{
+    const std::string dataDir = dir_.substr(0, dir_.rfind('/'));
+    if (!ensureDir(dataDir, 0711) || !ensureDir(dir_, 0711))
+    {
+        LOG_ERROR("Cannot create compile cache at " << dir_ << ": " << strerror(errno));
+        return false;
+    }
+
+    struct Found
+    {
+        std::string key;
+        time_t mtime;
+        uint64_t bytes;
+        bool compileError;
+    };
+    std::vector<Found> found;
+
+    DIR *dir = opendir(dir_.c_str());
+    if (!dir)
+    {
+        LOG_ERROR("Cannot read compile cache at " << dir_ << ": " << strerror(errno));
+        return false;
+    }
+    while (dirent *ent = readdir(dir))
+    {
+        const std::string name = ent->d_name;
+        if (name == "." || name == "..")
+            continue;
+        const std::string path = dir_ + "/" + name;
+        if (!isKey(name))
+        {
+            // half-written entry from a crash
+            removeTree(path);
+            continue;
+        }
+
+        struct stat st;
+        if (stat((path + "/" + BINARY_FILE).c_str(), &st) == 0)
+            found.push_back({name, st.st_mtime, static_cast<uint64_t>(st.st_size), false});
+        else if (stat((path + "/" + ERROR_FILE).c_str(), &st) == 0)
+            found.push_back({name, st.st_mtime, static_cast<uint64_t>(st.st_size), true});
+        else
+            removeTree(path);
+    }
+    closedir(dir);
+
+    std::sort(found.begin(), found.end(), [](const Found &a, const Found &b)
+              { return a.mtime < b.mtime; });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : found)
+    {
+        lru_.push_front(entry.key);
+        index_[entry.key] = {lru_.begin(), entry.bytes, entry.compileError};
+        stats_.bytes += entry.bytes;
+    }
+    stats_.entries = index_.size();
+    evictLocked();
+
+    LOG_INFO("Compile cache at " << dir_ << ": " << stats_.entries << " entries, "
+                                 << stats_.bytes / 1024 << " KiB of " << maxBytes_ / 1024 << " KiB.");
+    return true;
+}
+
+std::string CompileCache::key(const std::string &code, const std::string &libraryCode,
+                              const std::string &language, const std::string &compilerFlags,
+                              const std::string &imageDigest)
+{
+    return Sha256()
+        .field(code)
+        .field(libraryCode)
+        .field(language)
+        .field(compilerFlags)
+        .field(imageDigest)
+        .hexDigest();
+}
+
+std::optional<CompileCache::Entry> CompileCache::lookup(const std::string &key)
+{
+    bool compileError = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end())
+        {
+            stats_.misses++;
+            return std::nullopt;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second.position);
+        stats_.hits++;
+        compileError = it->second.compileError;
+    }
+
+    Entry entry;
+    if (compileError)
+    {
+        std::ifstream in(dir_ + "/" + key + "/" + ERROR_FILE);
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        entry.compileError = buffer.str();
+        if (entry.compileError.empty())
+        {
+            return std::nullopt;
+        }
+    }
+    else
+    {
+        // If the entry gets evicted before the sandbox starts, the runner
+        // finds no binary there and simply compiles again.
+        entry.binaryPath = binaryPath(key);
+    }
+    return entry;
+}
+
+std::string CompileCache::binaryPath(const std::string &key)
+{
+    return std::string(SANDBOX_DATA_DIR) + "/binaries/" + key + "/" + BINARY_FILE;
+}
+
+bool CompileCache::storeBinary(const std::string &key, const std::string &binary)
+{
+    return store(key, BINARY_FILE, binary, 0755);
+}
+
+bool CompileCache::storeCompileError(const std::string &key, const std::string &verdict)
+{
+    return store(key, ERROR_FILE, verdict, 0600);
+}
+
+bool CompileCache::store(const std::string &key, const std::string &fileName, const std::string &content, mode_t mode)
+{
+    if (!isKey(key) || content.empty())
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(key))
+            return true;
+    }
+
+    // Write into a private directory and rename it into place, so a sandbox
+    // can never observe a partially written executable.
+    static std::atomic<uint64_t> sequence{0};
+    const std::string tmp = dir_ + "/.tmp-" + std::to_string(getpid()) + "-" + std::to_string(sequence++);
+    const std::string target = dir_ + "/" + key;
+    if (!ensureDir(tmp, 0755) || !writeWholeFile(tmp + "/" + fileName, content, mode))
+    {
+        LOG_ERROR("Failed to write compile cache entry " << key << ": " << strerror(errno));
+        removeTree(tmp);
+        return false;
+    }
+    if (rename(tmp.c_str(), target.c_str()) != 0)
+    {
+        // another worker stored the same key first, theirs is identical
+        removeTree(tmp);
+        return errno == EEXIST || errno == ENOTEMPTY;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.count(key))
+        return true;
+    lru_.push_front(key);
+    index_[key] = {lru_.begin(), content.size(), fileName == ERROR_FILE};
+    stats_.bytes += content.size();
+    stats_.stores++;
+    evictLocked();
+    stats_.entries = index_.size();
+    return true;
+}
+
+void CompileCache::evictLocked()
+{
+    while (stats_.bytes > maxBytes_ && !lru_.empty())
+    {
+        const std::string victim = lru_.back();
+        lru_.pop_back();
+        auto it = index_.find(victim);
+        if (it != index_.end())
+        {
+            stats_.bytes -= it->second.bytes;
+            index_.erase(it);
+        }
+        removeEntry(victim);
+        stats_.evictions++;
+    }
+    stats_.entries = index_.size();
+}
+
+void CompileCache::removeEntry(const std::string &key)
+{
+    // a sandbox still running this binary keeps it open, unlinking is safe
+    removeTree(dir_ + "/" + key);
+}
+
+CompileCache::Stats CompileCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void CompileCache::logStats() const
+{
+    const Stats s = stats();
+    const uint64_t lookups = s.hits + s.misses;
+    LOG_INFO("Compile cache: entries=" << s.entries << " bytes=" << s.bytes << "/" << maxBytes_
+                                       << " hits=" << s.hits << " misses=" << s.misses
+                                       << " hitRate=" << (lookups ? (100 * s.hits / lookups) : 0) << "%"
+                                       << " evictions=" << s.evictions);
+}
+
+std::unique_ptr<CompileCache> makeCompileCache(const JudgeConfig &config)
+{
+    if (config.compileCacheBytes == 0)
+    {
+        LOG_INFO("Compile cache disabled.");
+        return nullptr;
+    }
+    auto cache = std::make_unique<CompileCache>(config.dataDir, config.compileCacheBytes);
+    if (!cache->initialize())
+    {
+        LOG_ERROR("Compile cache unavailable, C/C++ is compiled on every job.");
+        return nullptr;
+    }
+    return cache;
+}
@@ -0,0 +1,199 @@
+#include "ConcurrencyController.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    const char *RESOURCES[3] = {"cpu", "memory", "io"};
+
+    // the new latency's weight in the recent average (about two intervals)
+    // and in the baseline (about thirty)
+    const double RECENT_WEIGHT = 0.5;
+    const double BASELINE_WEIGHT = 0.03;
+
+    /** The `total=` of a PSI file's "some" line, microseconds stalled since boot. */
+    bool readStallTotal(const std::string &path, uint64_t &total)
+    {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.rfind("some ", 0) != 0)
+                continue;
+            const size_t at = line.find("total=");
+            if (at == std::string::npos)
+                return false;
+            total = std::strtoull(line.c_str() + at + 6, nullptr, 10);
+            return true;
+        }
+        return false;
+    }
+
+    void adjusted(const char *direction, const char *reason)
+    {
+        METRICS()->counter("judge_concurrency_adjustments_total", "Changes of the job slot limit, by direction and cause.",
+                           {{"direction", direction}, {"reason", reason}})
+            .inc();
+    }
+}
+
+ConcurrencyController::ConcurrencyController(const Options &options) : options_(options)
+{
+    stats_.limit = std::max<size_t>(1, (options_.min + options_.max) / 2);
+}
+
+bool ConcurrencyController::samplePressure(HostPressure &pressure)
+{
+    uint64_t totals[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!readStallTotal(options_.pressureDir + "/" + RESOURCES[i], totals[i]))
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stats_.pressureAvailable || !sampled_)
+            {
+                LOG_WARNING("No pressure stall information at " << options_.pressureDir << "/" << RESOURCES[i]
+                                                                << ", adapting concurrency to sandbox latency only.");
+            }
+            stats_.pressureAvailable = false;
+            sampled_ = true;
+            return false;
+        }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsedUs = std::chrono::duration<double, std::micro>(now - lastSample_).count();
+    const bool first = !sampled_;
+    pressure = HostPressure();
+    if (!first && elapsedUs > 0)
+    {
+        double *shares[3] = {&pressure.cpu, &pressure.memory, &pressure.io};
+        for (int i = 0; i < 3; ++i)
+        {
+            const uint64_t stalled = totals[i] > lastStallUs_[i] ? totals[i] - lastStallUs_[i] : 0;
+            *shares[i] = std::min(100.0, 100.0 * static_cast<double>(stalled) / elapsedUs);
+        }
+    }
+    std::copy(totals, totals + 3, lastStallUs_);
+    lastSample_ = now;
+    sampled_ = true;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.pressureAvailable = true;
+    stats_.pressure = pressure;
+    return true;
+}
+
+ConcurrencyController::Reason ConcurrencyController::overloaded(const HostPressure &pressure, bool sampled) const
+{
+    if (stats_.pressureAvailable)
+    {
+        if (pressure.memory > options_.memoryPressureLimit)
+            return Reason::Memory;
+        if (pressure.cpu > options_.cpuPressureLimit)
+            return Reason::Cpu;
+        if (pressure.io > options_.ioPressureLimit)
+            return Reason::Io;
+    }
+    if (sampled && stats_.baselineMs > 0 && recentMs_ > options_.latencyTolerance * stats_.baselineMs)
+        return Reason::Latency;
+    return Reason::None;
+}
+
+size_t ConcurrencyController::update(const HostPressure &pressure, double latencyMs, size_t inUse,
+                                     std::chrono::steady_clock::time_point now)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (latencyMs > 0)
+    {
+        if (stats_.baselineMs == 0)
+        {
+            stats_.baselineMs = latencyMs;
+            recentMs_ = latencyMs;
+        }
+        recentMs_ += RECENT_WEIGHT * (latencyMs - recentMs_);
+        stats_.baselineMs += BASELINE_WEIGHT * (latencyMs - stats_.baselineMs);
+    }
+    else
+    {
+        // Nothing finished, so nothing says sandboxes are still slow: an idle
+        // judge must not keep cutting its limit over the last busy interval.
+        recentMs_ += RECENT_WEIGHT * (stats_.baselineMs - recentMs_);
+    }
+    stats_.latencyMs = recentMs_;
+
+    const Reason reason = overloaded(pressure, latencyMs > 0);
+    const size_t before = stats_.limit;
+    if (reason != Reason::None)
+    {
+        // a cut shows in the signals only once running jobs finish, so
+        // give it that long before cutting again
+        if (stats_.decreases == 0 || now - lastDecrease_ >= options_.decreaseCooldown)
+        {
+            const size_t cut = std::max<size_t>(1, before / 4);
+            stats_.limit = before > options_.min + cut ? before - cut : options_.min;
+            lastDecrease_ = now;
+            if (stats_.limit != before)
+            {
+                stats_.decreases++;
+                stats_.lastDecrease = reason;
+                adjusted("decrease", reasonName(reason));
+                LOG_INFO("Job slots " << before << " -> " << stats_.limit << " (" << reasonName(reason)
+                                      << " pressure).");
+            }
+        }
+    }
+    else if (inUse >= before && before < options_.max)
+    {
+        // only grow a limit that is actually what holds jobs back
+        stats_.limit = before + 1;
+        stats_.increases++;
+        adjusted("increase", "headroom");
+    }
+    return stats_.limit;
+}
+
+size_t ConcurrencyController::limit() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_.limit;
+}
+
+ConcurrencyController::Stats ConcurrencyController::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ConcurrencyController::logStats() const
+{
+    const Stats s = stats();
+    LOG_INFO("Concurrency: limit=" << s.limit << " [" << options_.min << "," << options_.max << "]"
+                                   << " increases=" << s.increases << " decreases=" << s.decreases
+                                   << " lastCause=" << reasonName(s.lastDecrease)
+                                   << " psi=" << (s.pressureAvailable ? "" : "n/a ") << "cpu " << s.pressure.cpu
+                                   << "% memory " << s.pressure.memory << "% io " << s.pressure.io << "%"
+                                   << " latency=" << s.latencyMs << "ms baseline=" << s.baselineMs << "ms");
+}
+
+const char *ConcurrencyController::reasonName(Reason reason)
+{
+    switch (reason)
+    {
+    case Reason::Cpu:
+        return "cpu";
+    case Reason::Memory:
+        return "memory";
+    case Reason::Io:
+        return "io";
+    case Reason::Latency:
+        return "latency";
+    default:
+        return "none";
+    }
+}
@@ -0,0 +1,228 @@
+#include "DockerExecutor.h"
+#include "Logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <optional>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DockerExecutor::DockerExecutor(SandboxPool &pool, const std::string &dataHostDir)
+    : pool_(pool), dataHostDir_(dataHostDir) {}
+
+std::string DockerExecutor::imageDigest(const std::string &image)
+{
+    std::lock_guard<std::mutex> lock(digestMutex_);
+    auto it = digests_.find(image);
+    if (it != digests_.end())
+    {
+        return it->second;
+    }
+
+    std::string id;
+    if (!runDockerCommand({"docker", "image", "inspect", "-f", "{{.Id}}", image}, &id))
+    {
+        // not cached, so a rebuilt or late-pulled image is picked up next time
+        return "";
+    }
+    while (!id.empty() && (id.back() == '\n' || id.back() == ' '))
+        id.pop_back();
+    return digests_[image] = id;
+}
+
+void DockerExecutor::refreshImageDigests()
+{
+    std::vector<std::string> images;
+    {
+        std::lock_guard<std::mutex> lock(digestMutex_);
+        for (const auto &entry : digests_)
+            images.push_back(entry.first);
+    }
+    // inspected without the lock, jobs keep using the old digest meanwhile
+    for (const std::string &image : images)
+    {
+        std::string id;
+        const bool found = runDockerCommand({"docker", "image", "inspect", "-f", "{{.Id}}", image}, &id);
+        while (!id.empty() && (id.back() == '\n' || id.back() == ' '))
+            id.pop_back();
+
+        std::lock_guard<std::mutex> lock(digestMutex_);
+        auto it = digests_.find(image);
+        if (it == digests_.end() || it->second == id)
+            continue;
+        LOG_INFO("Runner image " << image << " changed (" << it->second << " -> " << (found ? id : "gone")
+                                 << "), caches keyed on it start over.");
+        if (found)
+            it->second = id;
+        else
+            digests_.erase(it);
+    }
+}
+
+bool DockerExecutor::enableAccounting(const std::string &parent, const std::string &mount)
+{
+    // With the systemd driver a parent has to be a slice, which systemd
+    // removes as soon as it is empty, counters and all.
+    std::string driver;
+    runDockerCommand({"docker", "info", "-f", "{{.CgroupDriver}} {{.CgroupVersion}}"}, &driver);
+    while (!driver.empty() && (driver.back() == '\n' || driver.back() == ' '))
+        driver.pop_back();
+    if (driver != "cgroupfs 2")
+    {
+        LOG_WARNING("Docker runs are not accounted: the daemon reports cgroup driver and version '"
+                    << driver << "', accounting needs 'cgroupfs 2'.");
+        return false;
+    }
+    if (access((mount + "/cgroup.controllers").c_str(), R_OK) != 0 || access(mount.c_str(), W_OK) != 0)
+    {
+        LOG_WARNING("Docker runs are not accounted: " << mount << " is not the host's cgroup v2 hierarchy, writable.");
+        return false;
+    }
+
+    cgroupParent_ = parent;
+    cgroupMount_ = mount;
+
+    // left by a judge that stopped while runs were in flight; runc creates
+    // the parent itself for the next run
+    const std::string dir = mount + parent;
+    const std::string prefix = "judge-run-" + std::to_string(getpid()) + "-";
+    if (DIR *entries = opendir(dir.c_str()))
+    {
+        while (dirent *ent = readdir(entries))
+        {
+            if (std::string(ent->d_name).rfind(prefix, 0) == 0)
+                rmdir((dir + "/" + ent->d_name).c_str());
+        }
+        closedir(entries);
+    }
+    LOG_INFO("Cold docker runs are accounted in cgroups under " << dir << ".");
+    return true;
+}
+
+void DockerExecutor::executeAsync(const SandboxRequest &request, Completion done)
+{
+    // A warm container from the pool only needs a `docker exec`; without
+    // one, fall back to creating a fresh container for this job.
+    std::optional<SandboxPool::Lease> lease = pool_.acquire(request.image);
+
+    std::vector<std::string> args;
+    std::string coldName;
+    if (lease)
+    {
+        args = pool_.execCommand(*lease);
+    }
+    else
+    {
+        coldName = "judge-run-" + std::to_string(getpid()) + "-" + std::to_string(sequence_++);
+        args = {"docker", "run", "--rm", "-i", "--name", coldName};
+        if (!cgroupParent_.empty())
+        {
+            args.push_back("--cgroup-parent");
+            args.push_back(cgroupParent_ + "/" + coldName);
+        }
+        appendSandboxLimits(args, dataHostDir_);
+        args.push_back(request.image);
+    }
+
+    supervisor_.launch(request, [&args](int inFd, int outFd, SandboxResult &) { return spawnDocker(args, inFd, outFd); },
+                       [this, lease = std::move(lease), coldName, done = std::move(done)](SandboxResult result) mutable
+                       {
+        // Killing the docker CLI leaves the container running: a cold one is
+        // removed by name here, a pooled one is replaced as unhealthy below.
+        if (result.cancelled && !lease)
+        {
+            removeDetached(coldName);
+        }
+        // a cancelled one's goes once removeDetached() is through
+        if (!lease && !result.cancelled && !cgroupParent_.empty())
+        {
+            // the container is gone, its usage stays in the parent
+            const std::string dir = cgroupMount_ + cgroupParent_ + "/" + coldName;
+            int cgroupFd = result.launched ? open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+            if (cgroupFd >= 0)
+            {
+                readCgroupUsage(cgroupFd, result);
+                close(cgroupFd);
+            }
+            removeCgroup(dir);
+        }
+
+        if (result.launched && result.exitCode != 0)
+        {
+            LOG_WARNING("Docker exited with status " << result.exitCode);
+        }
+
+        if (lease)
+        {
+            // 125-127 come from docker itself (daemon error, container gone,
+            // exec failed), not from the runner
+            const bool healthy = result.launched && result.exitCode >= 0 && result.exitCode < 125;
+            pool_.release(std::move(*lease), healthy);
+        }
+        done(std::move(result)); });
+}
+
+pid_t DockerExecutor::spawnDocker(std::vector<std::string> &args, int inFd, int outFd)
+{
+    std::vector<char *> argv;
+    for (auto &arg : args)
+    {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        LOG_ERROR("fork() failed: " << strerror(errno));
+        return -1;
+    }
+    if (pid == 0)
+    {
+        if (dup2(inFd, STDIN_FILENO) < 0 || dup2(outFd, STDOUT_FILENO) < 0)
+        {
+            _exit(1);
+        }
+
+        // exec() docker WITHOUT a shell
+        execvp(argv[0], argv.data());
+        _exit(1);
+    }
+    return pid;
+}
+
+void DockerExecutor::removeDetached(const std::string &container)
+{
+    // runs on the supervisor thread, so `docker rm` is supervised like a
+    // sandbox instead of waited for
+    SandboxRequest request;
+    std::vector<std::string> args = {"docker", "rm", "-f", container};
+    supervisor_.launch(request, [&args](int inFd, int outFd, SandboxResult &) { return spawnDocker(args, inFd, outFd); },
+                       [this, container](SandboxResult result)
+                       {
+        if (!result.launched || result.exitCode != 0)
+        {
+            LOG_WARNING("Could not remove cancelled container " << container);
+        }
+        if (!cgroupParent_.empty())
+        {
+            removeCgroup(cgroupMount_ + cgroupParent_ + "/" + container);
+        } });
+}
+
+void DockerExecutor::removeCgroup(const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(cgroupMutex_);
+    staleCgroups_.push_back(dir);
+    for (auto it = staleCgroups_.begin(); it != staleCgroups_.end();)
+    {
+        // busy while the container's own cgroup is still there, which
+        // `docker run --rm` normally waits out; anything else won't pass
+        if (rmdir(it->c_str()) == 0 || errno != EBUSY)
+            it = staleCgroups_.erase(it);
+        else
+            ++it;
+    }
+}
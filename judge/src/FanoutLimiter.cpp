@@ -0,0 +1,64 @@
+#include "FanoutLimiter.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+FanoutLimiter::Grant::Grant(Grant &&other) noexcept
+    : limiter_(other.limiter_), extra_(other.extra_)
+{
+    other.limiter_ = nullptr;
+    other.extra_ = 0;
+}
+
+FanoutLimiter::Grant::~Grant()
+{
+    if (limiter_ && extra_ > 0)
+    {
+        limiter_->release(extra_);
+    }
+}
+
+FanoutLimiter::FanoutLimiter(unsigned int perJob, unsigned int global)
+    : perJob_(perJob ? perJob : 1), global_(global)
+{
+    stats_.global = global_;
+}
+
+FanoutLimiter::Grant FanoutLimiter::acquire(unsigned int wanted)
+{
+    const unsigned int extraWanted = std::min(wanted, perJob_) > 1 ? std::min(wanted, perJob_) - 1 : 0;
+    if (extraWanted == 0)
+    {
+        return Grant(this, 0);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const unsigned int extra = std::min(extraWanted, global_ - stats_.inUse);
+    stats_.inUse += extra;
+    stats_.peakInUse = std::max(stats_.peakInUse, stats_.inUse);
+    if (extra > 0)
+        stats_.fannedOut++;
+    if (extra < extraWanted)
+        stats_.throttled++;
+    return Grant(this, extra);
+}
+
+void FanoutLimiter::release(unsigned int extra)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.inUse -= extra;
+}
+
+FanoutLimiter::Stats FanoutLimiter::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void FanoutLimiter::logStats() const
+{
+    const Stats s = stats();
+    LOG_INFO("Test fan-out: jobs=" << s.fannedOut << " throttled=" << s.throttled
+                                   << " inUse=" << s.inUse << "/" << s.global
+                                   << " peak=" << s.peakInUse);
+}
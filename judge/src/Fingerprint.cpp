@@ -0,0 +1,264 @@
+#include "Fingerprint.h"
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+
+namespace
+{
+    enum class Lexer
+    {
+        CLike,
+        Python,
+        Sql,
+    };
+
+    const std::unordered_set<std::string_view> &keywords(Lexer lexer)
+    {
+        static const std::unordered_set<std::string_view> cLike = {
+            // C and C++
+            "auto", "bool", "break", "case", "catch", "char", "class", "const", "constexpr", "continue",
+            "default", "delete", "do", "double", "else", "enum", "explicit", "extern", "false", "float", "for",
+            "friend", "goto", "if", "inline", "int", "long", "namespace", "new", "nullptr", "operator",
+            "private", "protected", "public", "return", "short", "signed", "sizeof", "static", "struct",
+            "switch", "template", "this", "throw", "true", "try", "typedef", "typename", "union", "unsigned",
+            "using", "virtual", "void", "volatile", "while",
+            // JavaScript and TypeScript on top
+            "async", "await", "function", "let", "var", "of", "in", "instanceof", "typeof", "null",
+            "undefined", "yield", "import", "export", "from", "extends", "implements", "interface", "type",
+        };
+        static const std::unordered_set<std::string_view> python = {
+            "False", "None", "True", "and", "as", "assert", "async", "await", "break", "class", "continue",
+            "def", "del", "elif", "else", "except", "finally", "for", "from", "global", "if", "import", "in",
+            "is", "lambda", "nonlocal", "not", "or", "pass", "raise", "return", "try", "while", "with", "yield",
+        };
+        // compared upper case, SQL keywords are not case sensitive
+        static const std::unordered_set<std::string_view> sql = {
+            "SELECT", "FROM", "WHERE", "GROUP", "BY", "HAVING", "ORDER", "ASC", "DESC", "LIMIT", "OFFSET",
+            "JOIN", "INNER", "LEFT", "RIGHT", "FULL", "OUTER", "CROSS", "ON", "USING", "AS", "AND", "OR",
+            "NOT", "IN", "IS", "NULL", "LIKE", "BETWEEN", "EXISTS", "CASE", "WHEN", "THEN", "ELSE", "END",
+            "DISTINCT", "UNION", "ALL", "INTERSECT", "EXCEPT", "INSERT", "INTO", "VALUES", "UPDATE", "SET",
+            "DELETE", "CREATE", "TABLE", "VIEW", "INDEX", "DROP", "ALTER", "WITH", "COUNT", "SUM", "AVG",
+            "MIN", "MAX", "COALESCE", "CAST", "OVER", "PARTITION",
+        };
+        return lexer == Lexer::Python ? python : lexer == Lexer::Sql ? sql : cLike;
+    }
+
+    // longest first, so ">>=" wins over ">>" and ">"
+    const char *const OPERATORS[] = {
+        ">>>=", "<<=", ">>=", ">>>", "===", "!==", "...", "**=", "//=", "->", "++", "--", "&&", "||", "==",
+        "!=", "<=", ">=", "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "<<", ">>", "::", "=>", "**", "//",
+        "<>", ":=",
+    };
+
+    bool isIdentifierStart(char c)
+    {
+        return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+    }
+
+    bool isIdentifierChar(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+    }
+
+    // past the closing quote of the string starting at `i`, or the end
+    size_t skipString(std::string_view code, size_t i, std::string_view quote)
+    {
+        i += quote.size();
+        while (i < code.size())
+        {
+            if (code[i] == '\\')
+            {
+                i += 2;
+                continue;
+            }
+            if (code.compare(i, quote.size(), quote) == 0)
+                return i + quote.size();
+            // single-quoted strings end at the line, an unterminated one
+            // must not swallow the rest of the file
+            if (code[i] == '\n' && quote.size() == 1 && quote[0] != '`')
+                return i;
+            i++;
+        }
+        return i;
+    }
+
+    // 32-bit FNV-1a
+    uint32_t hashToken(std::string_view token)
+    {
+        uint32_t hash = 2166136261u;
+        for (char c : token)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // murmur3's finalizer, so k-grams that differ in one token land far
+    // apart and the window minimum is not biased towards any token
+    uint32_t mix(uint32_t h)
+    {
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return h;
+    }
+}
+
+std::vector<std::string> tokenize(std::string_view code, const std::string &language)
+{
+    const Lexer lexer = language == "python" ? Lexer::Python : language == "sql" ? Lexer::Sql : Lexer::CLike;
+    const auto &words = keywords(lexer);
+
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    bool lineStart = true;
+    while (i < code.size())
+    {
+        const char c = code[i];
+        if (c == '\n')
+        {
+            lineStart = true;
+            i++;
+            continue;
+        }
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            i++;
+            continue;
+        }
+
+        // comments and, in C, preprocessor lines: #include lists and macros
+        // are boilerplate more than they are the solution
+        const bool lineComment = (lexer == Lexer::CLike && code.compare(i, 2, "//") == 0) ||
+                                 (lexer == Lexer::Python && c == '#') ||
+                                 (lexer == Lexer::Sql && code.compare(i, 2, "--") == 0) ||
+                                 (lexer == Lexer::CLike && c == '#' && lineStart);
+        if (lineComment)
+        {
+            const size_t end = code.find('\n', i);
+            i = end == std::string_view::npos ? code.size() : end;
+            continue;
+        }
+        if (lexer != Lexer::Python && code.compare(i, 2, "/*") == 0)
+        {
+            const size_t end = code.find("*/", i + 2);
+            i = end == std::string_view::npos ? code.size() : end + 2;
+            continue;
+        }
+        lineStart = false;
+
+        if (isIdentifierStart(c))
+        {
+            size_t end = i + 1;
+            while (end < code.size() && isIdentifierChar(code[end]))
+                end++;
+            std::string word(code.substr(i, end - i));
+            // Python string prefixes: r"", b'', f"""...
+            if (lexer == Lexer::Python && end < code.size() && (code[end] == '"' || code[end] == '\'') &&
+                word.size() <= 2 && word.find_first_not_of("rRbBfFuU") == std::string::npos)
+            {
+                i = end;
+                continue;
+            }
+            if (lexer == Lexer::Sql)
+            {
+                std::transform(word.begin(), word.end(), word.begin(),
+                               [](unsigned char ch)
+                               { return static_cast<char>(std::toupper(ch)); });
+            }
+            tokens.push_back(words.count(word) ? word : "V");
+            i = end;
+            continue;
+        }
+        if (std::isdigit(static_cast<unsigned char>(c)) ||
+            (c == '.' && i + 1 < code.size() && std::isdigit(static_cast<unsigned char>(code[i + 1]))))
+        {
+            size_t end = i + 1;
+            while (end < code.size() && (isIdentifierChar(code[end]) || code[end] == '.'))
+                end++;
+            tokens.push_back("N");
+            i = end;
+            continue;
+        }
+        if (c == '"' || c == '\'' || (c == '`' && lexer == Lexer::CLike))
+        {
+            std::string_view quote = code.substr(i, 1);
+            if (lexer == Lexer::Python && code.compare(i, 3, std::string(3, c)) == 0)
+                quote = code.substr(i, 3);
+            // a quoted SQL identifier is still an identifier
+            tokens.push_back(lexer == Lexer::Sql && c == '"' ? "V" : "S");
+            i = skipString(code, i, quote);
+            continue;
+        }
+
+        size_t length = 1;
+        for (const char *op : OPERATORS)
+        {
+            if (code.compare(i, std::char_traits<char>::length(op), op) == 0)
+            {
+                length = std::char_traits<char>::length(op);
+                break;
+            }
+        }
+        tokens.emplace_back(code.substr(i, length));
+        i += length;
+    }
+    return tokens;
+}
+
+Fingerprint fingerprintTokens(const std::vector<std::string> &tokens, size_t k, size_t window)
+{
+    Fingerprint selected;
+    if (tokens.empty() || k == 0 || window == 0)
+    {
+        return selected;
+    }
+    k = std::min(k, tokens.size());
+
+    // polynomial rolling hash of every k consecutive token hashes
+    const uint32_t base = 1000003u;
+    uint32_t power = 1;
+    for (size_t i = 1; i < k; ++i)
+        power *= base;
+    std::vector<uint32_t> grams;
+    grams.reserve(tokens.size() - k + 1);
+    uint32_t rolling = 0;
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        if (i >= k)
+            rolling -= hashToken(tokens[i - k]) * power;
+        rolling = rolling * base + hashToken(tokens[i]);
+        if (i + 1 >= k)
+            grams.push_back(mix(rolling) & 0x7fffffffu);
+    }
+
+    // the rightmost minimum of every window, each position only once
+    window = std::min(window, grams.size());
+    size_t last = grams.size();
+    for (size_t begin = 0; begin + window <= grams.size(); ++begin)
+    {
+        size_t min = begin;
+        for (size_t j = begin + 1; j < begin + window; ++j)
+        {
+            if (grams[j] <= grams[min])
+                min = j;
+        }
+        if (min != last)
+        {
+            selected.push_back(grams[min]);
+            last = min;
+        }
+    }
+    std::sort(selected.begin(), selected.end());
+    selected.erase(std::unique(selected.begin(), selected.end()), selected.end());
+    return selected;
+}
+
+Fingerprint fingerprint(std::string_view code, const std::string &language, size_t k, size_t window)
+{
+    return fingerprintTokens(tokenize(code, language), k, window);
+}
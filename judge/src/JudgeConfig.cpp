@@ -0,0 +1,163 @@
+#include "JudgeConfig.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    const char *envOrNull(const char *name)
+    {
+        const char *value = std::getenv(name);
+        return (value && *value) ? value : nullptr;
+    }
+
+    long envLong(const char *name, long fallback)
+    {
+        const char *value = envOrNull(name);
+        return value ? std::atol(value) : fallback;
+    }
+
+    double envDouble(const char *name, double fallback)
+    {
+        const char *value = envOrNull(name);
+        return value ? std::atof(value) : fallback;
+    }
+}
+
+JudgeConfig JudgeConfig::fromEnvironment()
+{
+    JudgeConfig config;
+
+    if (const char *host = envOrNull("REDIS_HOST"))
+        config.redisHost = host;
+    config.redisPort = static_cast<int>(envLong("REDIS_PORT", 6379));
+    const long connections = envLong("JUDGE_REDIS_CONNECTIONS", config.redisConnections);
+    config.redisConnections = connections > 0 ? static_cast<unsigned int>(connections) : 1;
+
+    const unsigned int cores = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 4;
+
+    // Sandboxes are watched by one supervisor thread, so worker threads only
+    // do CPU work and one per core is enough. The sandboxes themselves are
+    // bounded separately: their CPU is consumed by the --cpus=0.5 sandbox,
+    // not by the judge, so running 4x cores of them at once is the default.
+    const long threads = envLong("JUDGE_THREADS", cores);
+    config.numThreads = threads > 0 ? static_cast<unsigned int>(threads) : 1;
+    const long sandboxes = envLong("JUDGE_MAX_SANDBOXES", cores * 4);
+    config.maxSandboxes = sandboxes > 0 ? static_cast<unsigned int>(sandboxes) : 1;
+    if (const char *concurrency = envOrNull("JUDGE_CONCURRENCY"))
+        config.concurrencyMode = concurrency;
+    const long minSandboxes = envLong("JUDGE_MIN_SANDBOXES", config.minSandboxes);
+    config.minSandboxes = static_cast<unsigned int>(std::clamp<long>(minSandboxes, 1, config.maxSandboxes));
+    config.cpuPressureLimit = envDouble("JUDGE_PSI_CPU_PCT", config.cpuPressureLimit);
+    config.memoryPressureLimit = envDouble("JUDGE_PSI_MEMORY_PCT", config.memoryPressureLimit);
+    config.ioPressureLimit = envDouble("JUDGE_PSI_IO_PCT", config.ioPressureLimit);
+    const double tolerance = envDouble("JUDGE_LATENCY_TOLERANCE", config.latencyTolerance);
+    config.latencyTolerance = tolerance > 1 ? tolerance : config.latencyTolerance;
+    const long interval = envLong("JUDGE_CONCURRENCY_INTERVAL_MS", config.concurrencyIntervalMs);
+    config.concurrencyIntervalMs = interval >= 100 ? static_cast<unsigned int>(interval) : 100;
+    const long jobTimeout = envLong("JUDGE_JOB_TIMEOUT_SEC", config.jobTimeoutSec);
+    config.jobTimeoutSec = jobTimeout > 0 ? static_cast<unsigned int>(jobTimeout) : 0;
+
+    // JUDGE_POOL_SIZE sets the warm pool size for every runner image;
+    // JUDGE_POOL_<LANG> overrides it for a single image.
+    const long defaultPool = envLong("JUDGE_POOL_SIZE", 2);
+    const std::pair<const char *, const char *> pools[] = {
+        {"judge-cpp:latest", "JUDGE_POOL_CPP"},
+        {"judge-py:latest", "JUDGE_POOL_PY"},
+        {"judge-js:latest", "JUDGE_POOL_JS"},
+        {"judge-sql:latest", "JUDGE_POOL_SQL"},
+    };
+    for (const auto &[image, var] : pools)
+    {
+        const long size = envLong(var, defaultPool);
+        config.poolSizes[image] = size > 0 ? static_cast<size_t>(size) : 0;
+    }
+
+    const long maxUses = envLong("JUDGE_POOL_MAX_USES", config.poolMaxUses);
+    config.poolMaxUses = maxUses > 0 ? static_cast<unsigned int>(maxUses) : 1;
+
+    if (const char *backend = envOrNull("JUDGE_SANDBOX"))
+        config.sandboxBackend = backend;
+    const long stubMs = envLong("JUDGE_STUB_MS", config.stubRunMs);
+    config.stubRunMs = stubMs > 0 ? static_cast<unsigned int>(stubMs) : 0;
+    if (const char *root = envOrNull("JUDGE_NATIVE_ROOT"))
+        config.nativeRunnerRoot = root;
+    if (const char *cgroup = envOrNull("JUDGE_CGROUP_ROOT"))
+        config.cgroupRoot = cgroup;
+    if (const char *parent = envOrNull("JUDGE_DOCKER_CGROUP_PARENT"))
+        config.dockerCgroupParent = parent;
+    if (const char *mount = envOrNull("JUDGE_DOCKER_CGROUP_MOUNT"))
+        config.dockerCgroupMount = mount;
+
+    if (const char *dataDir = envOrNull("JUDGE_DATA_DIR"))
+        config.dataDir = dataDir;
+    const char *dataHostDir = envOrNull("JUDGE_DATA_HOST_DIR");
+    config.dataHostDir = dataHostDir ? dataHostDir : config.dataDir;
+    const long cacheMb = envLong("JUDGE_COMPILE_CACHE_MB", static_cast<long>(config.compileCacheBytes >> 20));
+    config.compileCacheBytes = cacheMb > 0 ? static_cast<uint64_t>(cacheMb) << 20 : 0;
+    const long sqlSnapshotMb = envLong("JUDGE_SQL_SNAPSHOT_MB", static_cast<long>(config.sqlSnapshotBytes >> 20));
+    config.sqlSnapshotBytes = sqlSnapshotMb > 0 ? static_cast<uint64_t>(sqlSnapshotMb) << 20 : 0;
+    const long testSetMb = envLong("JUDGE_TESTSET_CACHE_MB", static_cast<long>(config.testSetCacheBytes >> 20));
+    config.testSetCacheBytes = testSetMb > 0 ? static_cast<uint64_t>(testSetMb) << 20 : 0;
+    const long verdictMb = envLong("JUDGE_VERDICT_CACHE_MB", static_cast<long>(config.verdictCacheBytes >> 20));
+    config.verdictCacheBytes = verdictMb > 0 ? static_cast<uint64_t>(verdictMb) << 20 : 0;
+    const long verdictTtl = envLong("JUDGE_VERDICT_CACHE_TTL_SEC", config.verdictCacheTtlSec);
+    config.verdictCacheTtlSec = verdictTtl > 0 ? static_cast<unsigned int>(verdictTtl) : 1;
+    const long plagiarismMb = envLong("JUDGE_PLAGIARISM_MB", static_cast<long>(config.plagiarismIndexBytes >> 20));
+    config.plagiarismIndexBytes = plagiarismMb > 0 ? static_cast<uint64_t>(plagiarismMb) << 20 : 0;
+    const long plagiarismThreads = envLong("JUDGE_PLAGIARISM_THREADS", cores);
+    config.plagiarismThreads = plagiarismThreads > 0 ? static_cast<unsigned int>(plagiarismThreads) : 1;
+    const long plagiarismConcurrency = envLong("JUDGE_PLAGIARISM_CONCURRENCY", config.plagiarismConcurrency);
+    config.plagiarismConcurrency = plagiarismConcurrency > 0 ? static_cast<unsigned int>(plagiarismConcurrency) : 1;
+
+    const long perJob = envLong("JUDGE_FANOUT_PER_JOB", config.fanoutPerJob);
+    config.fanoutPerJob = perJob > 0 ? static_cast<unsigned int>(perJob) : 1;
+    // each extra sandbox gets --cpus=0.5, so one per core keeps the extra
+    // load from fan-out around half the machine
+    const long global = envLong("JUDGE_FANOUT_GLOBAL", cores);
+    config.fanoutGlobal = global > 0 ? static_cast<unsigned int>(global) : 0;
+
+    const std::pair<JobClass, const char *> targets[] = {
+        {JobClass::Quiz, "JUDGE_TARGET_QUIZ_MS"},
+        {JobClass::Submit, "JUDGE_TARGET_SUBMIT_MS"},
+        {JobClass::Run, "JUDGE_TARGET_RUN_MS"},
+    };
+    for (const auto &[jobClass, var] : targets)
+    {
+        uint64_t &target = config.queueTargetsMs[static_cast<size_t>(jobClass)];
+        const long value = envLong(var, static_cast<long>(target));
+        target = value > 0 ? static_cast<uint64_t>(value) : 0;
+    }
+
+    if (const char *intake = envOrNull("JUDGE_INTAKE"))
+        config.intakeMode = intake;
+    if (const char *consumer = envOrNull("JUDGE_CONSUMER"))
+    {
+        config.consumerName = consumer;
+    }
+    else
+    {
+        // the container hostname, plus the pid for several judges per host
+        char host[256] = {};
+        gethostname(host, sizeof(host) - 1);
+        config.consumerName = std::string(host) + "-" + std::to_string(getpid());
+    }
+    const long reclaimIdle = envLong("JUDGE_RECLAIM_IDLE_MS", static_cast<long>(config.reclaimIdleMs));
+    config.reclaimIdleMs = reclaimIdle > 0 ? static_cast<uint64_t>(reclaimIdle) : 1000;
+
+    if (const char *compare = envOrNull("JUDGE_COMPARE"))
+        config.compareInJudge = std::string(compare) != "runner";
+    if (const char *zygote = envOrNull("JUDGE_ZYGOTE"))
+        config.zygoteRunners = std::string(zygote) != "0";
+    if (const char *mode = envOrNull("JUDGE_COMPARE_MODE"))
+        config.compareMode = mode;
+    const long outputKb = envLong("JUDGE_VERDICT_OUTPUT_KB", static_cast<long>(config.verdictOutputBytes >> 10));
+    config.verdictOutputBytes = outputKb > 0 ? static_cast<size_t>(outputKb) << 10 : 0;
+
+    const long metricsPort = envLong("JUDGE_METRICS_PORT", config.metricsPort);
+    config.metricsPort = metricsPort > 0 && metricsPort < 65536 ? static_cast<int>(metricsPort) : 0;
+
+    return config;
+}
@@ -1,51 +1,654 @@
 #include "JudgeEngine.h"
 #include "Logger.h"
+#include "Metrics.h"
 #include "RedisHandler.h"
 
-JudgeEngine::JudgeEngine(const std::string &redisHost, int redisPort, size_t numThreads)
-    : judgeWorker_(),
-      threadPool_(numThreads)
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // upper bound on jobs claimed per round-trip, keeps the script short
+    const size_t MAX_CLAIM_BATCH = 32;
+    // longest an idle list-intake judge parks before looking at the queues
+    const int WAKE_TIMEOUT_SEC = 1;
+
+    std::unique_ptr<VerdictCache> makeVerdictCache(const JudgeConfig &config)
+    {
+        if (config.verdictCacheBytes == 0)
+        {
+            LOG_INFO("Verdict cache disabled.");
+            return nullptr;
+        }
+        return std::make_unique<VerdictCache>(config.verdictCacheBytes,
+                                              std::chrono::seconds(config.verdictCacheTtlSec));
+    }
+
+    std::unique_ptr<PlagiarismIndex> makePlagiarismIndex(const JudgeConfig &config)
+    {
+        if (config.plagiarismIndexBytes == 0)
+        {
+            LOG_INFO("Plagiarism jobs disabled.");
+            return nullptr;
+        }
+        return std::make_unique<PlagiarismIndex>(config.plagiarismIndexBytes, config.plagiarismThreads);
+    }
+
+    std::unique_ptr<ConcurrencyController> makeConcurrencyController(const JudgeConfig &config)
+    {
+        if (config.concurrencyMode != "adaptive")
+        {
+            if (config.concurrencyMode != "fixed")
+            {
+                LOG_WARNING("Unknown JUDGE_CONCURRENCY '" << config.concurrencyMode << "', using fixed.");
+            }
+            return nullptr;
+        }
+        ConcurrencyController::Options options;
+        options.max = config.maxSandboxes > 0 ? config.maxSandboxes : 1;
+        options.min = std::clamp<size_t>(config.minSandboxes, 1, options.max);
+        options.cpuPressureLimit = config.cpuPressureLimit;
+        options.memoryPressureLimit = config.memoryPressureLimit;
+        options.ioPressureLimit = config.ioPressureLimit;
+        options.latencyTolerance = config.latencyTolerance;
+        // long enough for the jobs running at a cut to finish, in intervals
+        options.decreaseCooldown = std::chrono::milliseconds(5 * config.concurrencyIntervalMs);
+        return std::make_unique<ConcurrencyController>(options);
+    }
+}
+
+JudgeEngine::JudgeEngine(const JudgeConfig &config, std::unique_ptr<SandboxExecutor> executor)
+    : sandboxPool_(config.sandboxBackend == "docker" ? config.poolSizes : std::map<std::string, size_t>{},
+                   config.poolMaxUses, config.dataHostDir),
+      executor_(executor ? std::move(executor) : makeSandboxExecutor(config, sandboxPool_)),
+      compileCache_(makeCompileCache(config)),
+      sqlSnapshots_(makeSqlSnapshotCache(config)),
+      verdictCache_(makeVerdictCache(config)),
+      testSets_(config.dataDir, config.testSetCacheBytes),
+      fanoutLimiter_(config.fanoutPerJob, config.fanoutGlobal),
+      judgeWorker_(*executor_, compileCache_.get(), sqlSnapshots_.get(), verdictCache_.get(), testSets_,
+                   fanoutLimiter_, workers_, JudgeWorker::outputChecks(config), config.zygoteRunners),
+      plagiarismIndex_(makePlagiarismIndex(config)),
+      plagiarismWorker_(plagiarismIndex_ ? std::make_unique<PlagiarismWorker>(*plagiarismIndex_) : nullptr),
+      slots_(config.maxSandboxes > 0 ? config.maxSandboxes : 1),
+      concurrency_(makeConcurrencyController(config)),
+      concurrencyInterval_(config.concurrencyIntervalMs),
+      queueTargetsMs_(config.queueTargetsMs.begin(), config.queueTargetsMs.end()),
+      streamIntake_(config.intakeMode == "stream"),
+      consumer_(config.consumerName),
+      reclaimIdle_(config.reclaimIdleMs),
+      plagiarismSlots_(config.plagiarismConcurrency),
+      workers_(config.numThreads),
+      plagiarismWorkers_(config.plagiarismConcurrency),
+      jobTimeout_(config.jobTimeoutSec)
+{
+    RedisHandler::initialize(config.redisHost.c_str(), config.redisPort, config.redisConnections);
+    if (!testSets_.initialize())
+    {
+        LOG_WARNING("Test sets go to the runners inline.");
+    }
+    sandboxPool_.start();
+    statsReporter_ = std::thread([this]
+                                 { reportStats(); });
+    if (concurrency_)
+    {
+        slots_ = concurrency_->limit();
+        concurrencyThread_ = std::thread([this]
+                                         { adjustConcurrency(); });
+    }
+    if (config.metricsPort > 0)
+    {
+        registerGauges();
+        metricsServer_ = std::make_unique<MetricsServer>(config.metricsPort);
+        if (!metricsServer_->start())
+        {
+            metricsServer_.reset();
+        }
+    }
+    if (streamIntake_)
+    {
+        heartbeat_ = std::thread([this]
+                                 { heartbeat(); });
+    }
+    else if (config.intakeMode != "list")
+    {
+        LOG_WARNING("Unknown JUDGE_INTAKE '" << config.intakeMode << "', using list.");
+    }
+    LOG_INFO("JudgeEngine initialized with " << config.numThreads << " threads, up to " << slots_
+                                             << " jobs in sandboxes" << (concurrency_ ? " (adaptive)" : "") << ", "
+                                             << executor_->name() << " sandbox backend.");
+}
+
+JudgeEngine::~JudgeEngine()
 {
-    RedisHandler::initialize(redisHost.c_str(), redisPort);
-    LOG_INFO("JudgeEngine initialized with " << numThreads << " threads.");
+    // the gauges read this engine
+    metricsServer_.reset();
+
+    // Jobs in flight post their next step to workers_ when a sandbox
+    // completes, so they have to be done before it goes away.
+    {
+        std::unique_lock<std::mutex> lock(slotsMutex_);
+        slotsCv_.wait(lock, [this]
+                      { return busySlots_ == 0 && busyPlagiarism_ == 0; });
+    }
+
+    stop_ = true;
+    statsCv_.notify_all();
+    if (statsReporter_.joinable())
+    {
+        statsReporter_.join();
+    }
+    if (heartbeat_.joinable())
+    {
+        heartbeat_.join();
+    }
+    if (concurrencyThread_.joinable())
+    {
+        concurrencyThread_.join();
+    }
+}
+
+void JudgeEngine::reportStats()
+{
+    uint64_t lastRuns = 0;
+    std::unique_lock<std::mutex> lock(statsMutex_);
+    while (!statsCv_.wait_for(lock, std::chrono::seconds(60), [this]
+                              { return stop_.load(); }))
+    {
+        // statsMutex_ only wakes the periodic threads up to stop; holding it
+        // through a docker inspect per image would hold up the concurrency
+        // controller's next sample
+        lock.unlock();
+
+        // a rebuilt runner image must not keep getting verdicts and
+        // binaries cached for the old one
+        executor_->refreshImageDigests();
+
+        // stay quiet while the judge is idle
+        const uint64_t runs = executor_->stats().runs;
+        if (runs != lastRuns)
+        {
+            lastRuns = runs;
+            sandboxPool_.logStats();
+            if (compileCache_)
+                compileCache_->logStats();
+            if (sqlSnapshots_)
+                sqlSnapshots_->logStats();
+            if (verdictCache_)
+                verdictCache_->logStats();
+            if (plagiarismIndex_)
+                plagiarismIndex_->logStats();
+            testSets_.logStats();
+            fanoutLimiter_.logStats();
+            if (concurrency_)
+                concurrency_->logStats();
+            workers_.logStats();
+            REDIS()->logStats();
+            queueWaitStats_.logStats();
+        }
+
+        lock.lock();
+    }
+}
+
+void JudgeEngine::registerGauges()
+{
+    METRICS()->gauge("judge_job_slots", "Jobs that may be in sandboxes at once.", {}, [this]
+                     {
+        std::lock_guard<std::mutex> lock(slotsMutex_);
+        return static_cast<double>(slots_); });
+    if (concurrency_)
+    {
+        METRICS()->gauge("judge_host_pressure", "Percent of time some task stalled on the resource (PSI), as the concurrency controller last saw it.",
+                         {{"resource", "cpu"}}, [this]
+                         { return concurrency_->stats().pressure.cpu; });
+        METRICS()->gauge("judge_host_pressure", "Percent of time some task stalled on the resource (PSI), as the concurrency controller last saw it.",
+                         {{"resource", "memory"}}, [this]
+                         { return concurrency_->stats().pressure.memory; });
+        METRICS()->gauge("judge_host_pressure", "Percent of time some task stalled on the resource (PSI), as the concurrency controller last saw it.",
+                         {{"resource", "io"}}, [this]
+                         { return concurrency_->stats().pressure.io; });
+        METRICS()->gauge("judge_sandbox_latency_ratio", "Recent mean sandbox latency over its usual level.", {}, [this]
+                         {
+            const auto stats = concurrency_->stats();
+            return stats.baselineMs > 0 ? stats.latencyMs / stats.baselineMs : NAN; });
+    }
+    METRICS()->gauge("judge_jobs_in_flight", "Jobs started and not finished yet.", {}, [this]
+                     {
+        std::lock_guard<std::mutex> lock(slotsMutex_);
+        return static_cast<double>(busySlots_); });
+    METRICS()->gauge("judge_sandboxes_running", "Sandboxes currently running.", {}, [this]
+                     { return static_cast<double>(executor_->running()); });
+    METRICS()->gauge("judge_executor_backlog", "Job steps waiting for a worker thread.", {}, [this]
+                     { return static_cast<double>(workers_.backlog()); });
+    METRICS()->gauge("judge_testset_cache_bytes", "Bytes of test sets held in memory.", {}, [this]
+                     { return static_cast<double>(testSets_.stats().bytes); });
+    if (verdictCache_)
+    {
+        METRICS()->gauge("judge_verdict_cache_bytes", "Bytes of verdicts held for identical jobs.", {}, [this]
+                         { return static_cast<double>(verdictCache_->stats().bytes); });
+    }
+    if (plagiarismIndex_)
+    {
+        METRICS()->gauge("judge_plagiarism_index_bytes", "Bytes of plagiarism fingerprints and postings held in memory.", {}, [this]
+                         { return static_cast<double>(plagiarismIndex_->stats().bytes); });
+        METRICS()->gauge("judge_plagiarism_jobs_in_flight", "Plagiarism jobs started and not finished yet.", {}, [this]
+                         {
+            std::lock_guard<std::mutex> lock(slotsMutex_);
+            return static_cast<double>(busyPlagiarism_); });
+        const std::string key = streamIntake_ ? PLAGIARISM_STREAM : PLAGIARISM_QUEUE;
+        METRICS()->gauge("judge_queue_depth",
+                         "Jobs waiting in Redis per class (stream intake: also those running, until acked).",
+                         {{"class", "plagiarism"}}, [this, key]
+                         {
+            uint64_t length = 0;
+            return REDIS()->queueLength(key, streamIntake_, length) ? static_cast<double>(length) : NAN; });
+    }
+
+    for (JobClass jobClass : {JobClass::Quiz, JobClass::Submit, JobClass::Run})
+    {
+        const std::string key = streamIntake_ ? jobClassStream(jobClass) : jobClassQueue(jobClass);
+        METRICS()->gauge("judge_queue_depth",
+                         "Jobs waiting in Redis per class (stream intake: also those running, until acked).",
+                         {{"class", jobClassName(jobClass)}}, [this, key]
+                         {
+            uint64_t length = 0;
+            return REDIS()->queueLength(key, streamIntake_, length) ? static_cast<double>(length) : NAN; });
+    }
 }
 
 void JudgeEngine::start()
 {
-    LOG_INFO("JudgeEngine starting main loop and listening for jobs.");
+    LOG_INFO("JudgeEngine starting main loop and listening for jobs on the "
+             << (streamIntake_ ? "streams as " + consumer_ : std::string("lists")) << ".");
+    // Plagiarism jobs wait on their own lane for their own slots, so a
+    // backlog of checks never holds up a sandbox job or the other way round.
+    // Without an index they stay queued for judges that have one.
+    if (plagiarismWorker_)
+    {
+        LOG_INFO("Answering up to " << plagiarismSlots_ << " plagiarism jobs at once.");
+        plagiarismIntake_ = std::thread([this]
+                                        {
+            if (streamIntake_)
+            {
+                runStreamIntake(intakeLanes(true));
+            }
+            else
+            {
+                runListIntake(intakeLanes(true));
+            } });
+    }
+    if (streamIntake_)
+    {
+        runStreamIntake(intakeLanes(false));
+    }
+    else
+    {
+        runListIntake(intakeLanes(false));
+    }
+    if (plagiarismIntake_.joinable())
+    {
+        plagiarismIntake_.join();
+    }
+}
+
+void JudgeEngine::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        stopIntake_ = true;
+    }
+    statsCv_.notify_all();
+}
 
-    const std::string QUEUE_PENDING = "judge:queue";
+void JudgeEngine::backOff()
+{
+    std::unique_lock<std::mutex> lock(statsMutex_);
+    statsCv_.wait_for(lock, std::chrono::seconds(1), [this]
+                      { return stopIntake_.load(); });
+}
+
+JudgeEngine::Lanes JudgeEngine::intakeLanes(bool plagiarism) const
+{
+    Lanes lanes;
+    lanes.plagiarism = plagiarism;
+    if (plagiarism)
+    {
+        lanes.keys = {streamIntake_ ? PLAGIARISM_STREAM : PLAGIARISM_QUEUE};
+        lanes.targetsMs = {0};
+        lanes.wakeKey = PLAGIARISM_WAKE_KEY;
+        return lanes;
+    }
+    // one lane per priority class, in JobClass order
+    for (JobClass jobClass : {JobClass::Quiz, JobClass::Submit, JobClass::Run})
+    {
+        lanes.keys.push_back(streamIntake_ ? jobClassStream(jobClass) : jobClassQueue(jobClass));
+    }
+    lanes.targetsMs = queueTargetsMs_;
+    lanes.wakeKey = JOB_WAKE_KEY;
+    return lanes;
+}
+
+void JudgeEngine::runListIntake(const Lanes &lanes)
+{
     const std::string QUEUE_PROCESSING = "judge:processing_queue";
 
-    while (true)
+    while (!stopIntake_)
     {
-        std::string jobId;
+        // Only claim what can start right away: the rest of a burst stays
+        // in Redis, where other judge nodes can take it and where a later
+        // quiz job can still overtake it.
+        const size_t free = waitForFreeSlots(lanes.plagiarism);
 
-        if (!REDIS()->brpoplpush(QUEUE_PENDING, QUEUE_PROCESSING, 0, jobId))
+        std::vector<ClaimedJob> jobs;
+        if (!REDIS()->claimJobs(lanes.keys, QUEUE_PROCESSING, lanes.targetsMs, std::min(free, MAX_CLAIM_BATCH), jobs))
         {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            backOff();
             continue;
         }
 
-        std::string submissionData;
-        if (!REDIS()->hget("judge:" + jobId, "data", submissionData))
+        if (jobs.empty())
         {
-            LOG_ERROR("Job " << jobId << " exists in queue but data missing in Hash!");
-            // edge case Data missing. Remove from processing to prevent clog?
-            // Or move to 'judge:failed'?
-            // For now, we remove it.
-            REDIS()->lrem(QUEUE_PROCESSING, 1, jobId);
+            // Nothing queued: park until the server signals a job, then claim
+            // again. The timeout covers wake-ups another judge took and
+            // servers that do not send them.
+            if (!REDIS()->waitForWakeUp(lanes.wakeKey, WAKE_TIMEOUT_SEC))
+            {
+                backOff();
+            }
             continue;
         }
+        LOG_DEBUG("Claimed " << jobs.size() << " jobs with " << free << " free slots.");
 
-        LOG_INFO("Job " << jobId << " moved to processing queue.");
+        // claimed earliest due first, so the workers start them in that order
+        for (auto &job : jobs)
+        {
+            JobAck ack{job.jobId, QUEUE_PROCESSING, "", ""};
+            dispatch(std::move(job), std::move(ack));
+        }
+    }
+}
+
+void JudgeEngine::runStreamIntake(const Lanes &lanes)
+{
+    const std::vector<std::string> &streams = lanes.keys;
+
+    // Entries pending longer than reclaimIdle_ belong to a judge that is
+    // gone, live ones refresh theirs every third of it. Looking for them
+    // every third of it too bounds how long such a job waits, and the
+    // blocking read never outlasts the interval so the check still runs
+    // while the lanes are empty.
+    const auto reclaimEvery = reclaimIdle_ / 3;
+    auto nextReclaim = std::chrono::steady_clock::now();
+    bool groupsReady = false;
+
+    while (!stopIntake_)
+    {
+        if (!groupsReady)
+        {
+            // also after errors: a restarted Redis without persistence has
+            // lost the groups, and XREADGROUP then fails with NOGROUP
+            groupsReady = REDIS()->createStreamGroups(streams);
+            if (!groupsReady)
+            {
+                backOff();
+                continue;
+            }
+        }
+
+        const size_t free = waitForFreeSlots(lanes.plagiarism);
+        const size_t max = std::min(free, MAX_CLAIM_BATCH);
+
+        std::vector<ClaimedJob> jobs;
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= nextReclaim)
+        {
+            nextReclaim = now + reclaimEvery;
+            // a failure here only delays the takeover to the next round
+            REDIS()->reclaimStreamJobs(streams, consumer_, lanes.targetsMs,
+                                       static_cast<uint64_t>(reclaimIdle_.count()), max, jobs);
+        }
+
+        bool ok = true;
+        if (jobs.empty())
+        {
+            ok = REDIS()->claimStreamJobs(streams, consumer_, lanes.targetsMs, max, jobs);
+        }
+        if (ok && jobs.empty())
+        {
+            // Nothing new, park on the lanes. This takes up to one entry per
+            // lane, so when several lanes fill at once a job or two more
+            // than `free` may start; the next round then waits longer for a
+            // slot.
+            const auto blockMs = std::chrono::duration_cast<std::chrono::milliseconds>(nextReclaim - now);
+            ok = REDIS()->waitForStreamJobs(streams, consumer_, lanes.targetsMs,
+                                            static_cast<int>(std::max<int64_t>(blockMs.count(), 1)), jobs);
+        }
+        if (!ok)
+        {
+            groupsReady = false;
+            backOff();
+            continue;
+        }
 
-        threadPool_.enqueue([this, jobId, submissionData, QUEUE_PROCESSING]
-                            { 
-            this->judgeWorker_.processSubmission(jobId, submissionData); 
-            
-            REDIS()->lrem(QUEUE_PROCESSING, 1, jobId);
-            
-            LOG_INFO("Job " << jobId << " completed and removed from processing queue."); });
+        if (jobs.size() > 1)
+        {
+            LOG_DEBUG("Claimed " << jobs.size() << " stream jobs with " << free << " free slots.");
+        }
+        for (auto &job : jobs)
+        {
+            JobAck ack{job.jobId, "", streams[std::min(job.queue, streams.size() - 1)], job.entryId};
+            {
+                // reclaiming can hand back an entry of this very consumer if
+                // a heartbeat was late; it is already running
+                std::lock_guard<std::mutex> lock(inFlightMutex_);
+                if (!inFlight_[ack.stream].insert(ack.entryId).second)
+                {
+                    continue;
+                }
+            }
+            dispatch(std::move(job), std::move(ack));
+        }
     }
-}
\ No newline at end of file
+}
+
+void JudgeEngine::heartbeat()
+{
+    const auto every = reclaimIdle_ / 3;
+    std::unique_lock<std::mutex> lock(statsMutex_);
+    while (!statsCv_.wait_for(lock, every, [this]
+                              { return stop_.load(); }))
+    {
+        // not held over Redis round trips, see reportStats()
+        lock.unlock();
+        std::map<std::string, std::vector<std::string>> entries;
+        {
+            std::lock_guard<std::mutex> inFlightLock(inFlightMutex_);
+            for (const auto &[stream, ids] : inFlight_)
+            {
+                entries[stream].assign(ids.begin(), ids.end());
+            }
+        }
+        for (const auto &[stream, ids] : entries)
+        {
+            REDIS()->touchStreamJobs(stream, consumer_, ids);
+        }
+        lock.lock();
+    }
+}
+
+void JudgeEngine::adjustConcurrency()
+{
+    SandboxExecutor::Stats last = executor_->stats();
+    HostPressure pressure;
+    // the first sample only sets the starting point
+    concurrency_->samplePressure(pressure);
+
+    std::unique_lock<std::mutex> lock(statsMutex_);
+    while (!statsCv_.wait_for(lock, concurrencyInterval_, [this]
+                              { return stop_.load(); }))
+    {
+        lock.unlock();
+        if (!concurrency_->samplePressure(pressure))
+        {
+            pressure = HostPressure();
+        }
+        const SandboxExecutor::Stats now = executor_->stats();
+        const uint64_t runs = now.runs - last.runs;
+        const double latencyMs = runs > 0 ? (now.totalWallMs - last.totalWallMs) / static_cast<double>(runs) : 0;
+        last = now;
+
+        size_t inUse;
+        {
+            std::lock_guard<std::mutex> slotsLock(slotsMutex_);
+            inUse = busySlots_;
+        }
+        const size_t limit = concurrency_->update(pressure, latencyMs, inUse);
+        bool grew;
+        {
+            std::lock_guard<std::mutex> slotsLock(slotsMutex_);
+            grew = limit > slots_;
+            slots_ = limit;
+        }
+        // a smaller limit needs nothing: jobs running over it finish, and
+        // the intake waits for busySlots_ to drop below it
+        if (grew)
+        {
+            slotsCv_.notify_all();
+        }
+        lock.lock();
+    }
+}
+
+size_t JudgeEngine::waitForFreeSlots(bool plagiarism)
+{
+    std::unique_lock<std::mutex> lock(slotsMutex_);
+    if (plagiarism)
+    {
+        slotsCv_.wait(lock, [this]
+                      { return busyPlagiarism_ < plagiarismSlots_; });
+        return plagiarismSlots_ - busyPlagiarism_;
+    }
+    slotsCv_.wait(lock, [this]
+                  { return busySlots_ < slots_; });
+    return slots_ - busySlots_;
+}
+
+void JudgeEngine::dispatch(ClaimedJob job, JobAck ack)
+{
+    if (job.jobId.empty() || !job.hasData)
+    {
+        if (job.jobId.empty())
+        {
+            LOG_ERROR("Stream entry " << ack.entryId << " on " << ack.stream << " carries no jobId, dropping it.");
+        }
+        else
+        {
+            LOG_ERROR("Job " << job.jobId << " exists in queue but data missing in Hash!");
+        }
+        // Nothing to judge; ack it so it does not clog the processing list or
+        // get reclaimed forever. Moving it to a 'judge:failed' list would
+        // keep it for inspection.
+        REDIS()->ack(ack);
+        forgetEntry(ack);
+        return;
+    }
+
+    LOG_INFO("Job " << job.jobId << " claimed.");
+
+    // also those queued on the run lane by servers that predate the
+    // plagiarism lane
+    const bool plagiarism = PlagiarismWorker::handles(job.jobId);
+    {
+        std::unique_lock<std::mutex> lock(slotsMutex_);
+        if (plagiarism)
+        {
+            // The plagiarism intake waited for this slot already, but one
+            // from the main lanes was claimed against a sandbox slot: it
+            // holds up that intake until a plagiarism slot is free, so
+            // JUDGE_PLAGIARISM_CONCURRENCY stays a bound.
+            slotsCv_.wait(lock, [this]
+                          { return busyPlagiarism_ < plagiarismSlots_; });
+            busyPlagiarism_++;
+        }
+        else
+        {
+            busySlots_++;
+        }
+    }
+    // too big to capture by value in a task
+    auto claimed = std::make_unique<std::pair<ClaimedJob, JobAck>>(std::move(job), std::move(ack));
+    if (plagiarism)
+    {
+        plagiarismWorkers_.submit([this, claimed = std::move(claimed)](const CancellationToken &) mutable
+                                  {
+            ClaimedJob &job = claimed->first;
+            const uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                           std::chrono::system_clock::now().time_since_epoch())
+                                                           .count());
+            METRICS()->histogram("judge_queue_wait_seconds", "Time from being queued to starting on a worker.",
+                                 {{"class", "plagiarism"}})
+                .observeMs(static_cast<double>(now > job.createdAtMs ? now - job.createdAtMs : 0));
+            auto done = [this, ack = claimed->second](bool acked)
+            { finish(ack, acked, true); };
+            if (!plagiarismWorker_)
+            {
+                LOG_ERROR("Job " << job.jobId << " is a plagiarism job and JUDGE_PLAGIARISM_MB is 0, dropping it.");
+                done(false);
+                return;
+            }
+            plagiarismWorker_->processJob(job.jobId, job.data, claimed->second, std::move(done)); });
+        return;
+    }
+    workers_.submit([this, claimed = std::move(claimed)](const CancellationToken &) mutable
+                    {
+        ClaimedJob &job = claimed->first;
+        const uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                       std::chrono::system_clock::now().time_since_epoch())
+                                                       .count());
+        const JobClass jobClass = static_cast<JobClass>(std::min(job.queue, JOB_CLASS_COUNT - 1));
+        const uint64_t waitMs = now > job.createdAtMs ? now - job.createdAtMs : 0;
+        const bool missed = job.dueMs > 0 && now > job.dueMs;
+        queueWaitStats_.record(jobClass, waitMs, missed);
+        const Metrics::Labels labels = {{"class", jobClassName(jobClass)}};
+        METRICS()->histogram("judge_queue_wait_seconds", "Time from being queued to starting on a worker.", labels)
+            .observeMs(static_cast<double>(waitMs));
+        if (missed)
+        {
+            METRICS()->counter("judge_jobs_started_late_total", "Jobs that started after they were due.", labels).inc();
+        }
+
+        // The budget covers the whole job, however many sandboxes it takes;
+        // the supervisor kills whatever is still running when it is up.
+        const auto deadline = jobTimeout_.count() > 0 ? std::chrono::steady_clock::now() + jobTimeout_
+                                                      : std::chrono::steady_clock::time_point();
+        auto done = [this, ack = claimed->second](bool acked)
+        { finish(ack, acked, false); };
+        judgeWorker_.processSubmission(job.jobId, std::move(job.data), claimed->second, deadline, std::move(done)); });
+}
+
+void JudgeEngine::finish(const JobAck &ack, bool acked, bool plagiarism)
+{
+    // a published verdict already acked the job
+    if (!acked)
+    {
+        REDIS()->ack(ack);
+    }
+    forgetEntry(ack);
+
+    LOG_INFO("Job " << ack.jobId << " completed and acked.");
+
+    {
+        std::lock_guard<std::mutex> lock(slotsMutex_);
+        (plagiarism ? busyPlagiarism_ : busySlots_)--;
+    }
+    slotsCv_.notify_all();
+}
+
+void JudgeEngine::forgetEntry(const JobAck &ack)
+{
+    if (ack.entryId.empty())
+        return;
+    std::lock_guard<std::mutex> lock(inFlightMutex_);
+    inFlight_[ack.stream].erase(ack.entryId);
+}
@@ -1,172 +1,934 @@
 #include <nlohmann/json.hpp>
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <sys/wait.h>
-#include <fcntl.h>
+#include <atomic>
+#include <optional>
+#include <unordered_set>
 
 #include "JudgeWorker.h"
+#include "JudgeConfig.h"
 #include "Logger.h"
+#include "Metrics.h"
 #include "RedisHandler.h"
-#include "ScopedTempFile.h"
+#include "Sha256.h"
 
 using json = nlohmann::json;
 
-JudgeWorker::JudgeWorker() {}
+namespace
+{
+    // Splitting below this many tests per sandbox costs more in sandbox
+    // startup than it saves.
+    const size_t MIN_TESTS_PER_CHUNK = 2;
+
+    // Mirrors the compile command in the c/cpp runner.py; part of the compile
+    // cache key together with the image digest.
+    std::string compilerFlags(const std::string &language)
+    {
+        return language == "c" ? "gcc -std=c11 -Wall -Wextra -O2 -lpng"
+                               : "g++ -std=c++17 -Wall -Wextra -O2 -lpng";
+    }
+
+    double msSince(std::chrono::steady_clock::time_point begin)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // latency per stage of a job, by runner language and mode
+    Metrics::Histogram &stageSeconds(const char *stage, const char *language, const char *mode)
+    {
+        return METRICS()->histogram("judge_stage_seconds", "Time spent in each stage of judging a job.",
+                                    {{"stage", stage}, {"language", language}, {"mode", mode}});
+    }
+
+    // job payload sizes, 1 KiB to 64 MiB
+    const std::vector<double> &payloadBounds()
+    {
+        static const std::vector<double> bounds = {1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10,
+                                                   1 << 20, 4 << 20, 16 << 20, 64 << 20};
+        return bounds;
+    }
+
+    // peak memory of a sandbox, 1 MiB to 256 MiB (the memory limit)
+    const std::vector<double> &memoryBounds()
+    {
+        static const std::vector<double> bounds = {1 << 20, 4 << 20, 16 << 20, 32 << 20, 64 << 20,
+                                                   128 << 20, 192 << 20, 256 << 20};
+        return bounds;
+    }
+
+    void recordUsage(const SandboxResult &sandboxResult, const char *stage, const char *language, const char *mode)
+    {
+        const Metrics::Labels labels = {{"stage", stage}, {"language", language}, {"mode", mode}};
+        METRICS()->histogram("judge_sandbox_cpu_seconds", "CPU time a sandbox's cgroup used.", labels)
+            .observeMs(sandboxResult.cpuMs);
+        METRICS()->histogram("judge_sandbox_throttled_seconds", "Time a sandbox was held back by its CPU quota.", labels)
+            .observeMs(sandboxResult.throttledMs);
+        if (sandboxResult.peakMemoryKb > 0)
+        {
+            METRICS()->histogram("judge_sandbox_peak_memory_bytes", "Memory high-water mark of a sandbox's cgroup.",
+                                 labels, memoryBounds())
+                .observe(static_cast<double>(sandboxResult.peakMemoryKb) * 1024);
+        }
+    }
+
+    // shaped like the runners' own "error" verdicts
+    json cancelledVerdict()
+    {
+        return {{"status", "error"}, {"error", "Judging was cancelled after running over its time limit."}};
+    }
+
+    // what a submission asks for, or the judge's default
+    CompareOptions compareOptions(const SubmissionHeader &submission, CompareMode defaultMode)
+    {
+        CompareOptions options;
+        options.mode = defaultMode;
+        if (!submission.compareMode.empty() && !parseCompareMode(submission.compareMode, options.mode))
+        {
+            LOG_WARNING("Unknown compareMode '" << submission.compareMode << "', using the default.");
+        }
+        if (submission.floatTolerance > 0)
+        {
+            // a tolerance only means something for numbers
+            if (submission.compareMode.empty())
+                options.mode = CompareMode::Tokens;
+            options.absTolerance = submission.floatTolerance;
+            options.relTolerance = submission.floatTolerance;
+        }
+        return options;
+    }
+
+    // Cuts a string field down to `max` bytes, on a UTF-8 character boundary,
+    // and says how much was cut. Images (data: URLs) are left whole.
+    void truncateOutput(json &field, size_t max)
+    {
+        if (max == 0 || !field.is_string())
+            return;
+        std::string &text = field.get_ref<std::string &>();
+        if (text.size() <= max || text.rfind("data:image/", 0) == 0)
+            return;
+        size_t cut = max;
+        while (cut > 0 && (static_cast<unsigned char>(text[cut]) & 0xc0) == 0x80)
+            cut--;
+        const size_t dropped = text.size() - cut;
+        text.resize(cut);
+        text += "\n... (" + std::to_string(dropped) + " more bytes)";
+    }
+
+    // Cuts every test's outputs in a verdict down to `max` bytes, see
+    // truncateOutput().
+    void truncateOutputs(json &results, size_t max)
+    {
+        if (max == 0 || !results.contains("testResults") || !results["testResults"].is_array())
+            return;
+        for (json &result : results["testResults"])
+        {
+            for (const char *field : {"actual", "expectedOutput"})
+            {
+                if (result.is_object() && result.contains(field))
+                    truncateOutput(result[field], max);
+            }
+        }
+    }
+
+    // The test cases of an inline job as the server's JSON.stringify() writes
+    // them, hashed the way it names a test set: the same tests get the same
+    // hash whether a job carries them or refers to them by testSetRef.
+    // Empty if the payload has none.
+    std::string inlineTestSetHash(const std::string &payload)
+    {
+        const nlohmann::ordered_json parsed = nlohmann::ordered_json::parse(payload, nullptr, false);
+        if (!parsed.is_object() || !parsed.contains("testCases"))
+            return "";
+        return Sha256::hex(parsed["testCases"].dump());
+    }
+
+    // Whether running the job again would give the same verdict: every test
+    // passed, failed or crashed on its own account. Timeouts and errors can
+    // be the host's doing (load, a runner failing), so they are judged again.
+    bool deterministic(const json &results)
+    {
+        const std::string status = results.value("status", std::string());
+        if (status == "compile_error")
+            return true;
+        if (status != "completed" || !results.contains("testResults") || !results["testResults"].is_array())
+            return false;
+        for (const json &result : results["testResults"])
+        {
+            const json testStatus = result.value("status", json());
+            if (testStatus != "passed" && testStatus != "failed" && testStatus != "runtime_error")
+                return false;
+        }
+        return true;
+    }
+
+    // The snapshot keys an SQL job's runner may report: the SHA-256 of each
+    // distinct setup script (test input) among its test cases, as the runner
+    // computes it.
+    std::unordered_set<std::string> sqlSetupKeys(const json &testCases)
+    {
+        std::unordered_set<std::string> keys;
+        if (!testCases.is_array())
+            return keys;
+        for (const json &testCase : testCases)
+        {
+            if (!testCase.is_object())
+                continue;
+            const auto input = testCase.find("input");
+            if (input != testCase.end() && input->is_string())
+                keys.insert(Sha256::hex(input->get_ref<const std::string &>()));
+        }
+        return keys;
+    }
+
+    std::string decodeBase64(const std::string &in)
+    {
+        static const std::string alphabet =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string out;
+        out.reserve(in.size() / 4 * 3);
+        uint32_t buffer = 0;
+        int bits = 0;
+        for (char c : in)
+        {
+            if (c == '=')
+                break;
+            size_t value = alphabet.find(c);
+            if (value == std::string::npos)
+                return "";
+            buffer = (buffer << 6) | static_cast<uint32_t>(value);
+            bits += 6;
+            if (bits >= 8)
+            {
+                bits -= 8;
+                out.push_back(static_cast<char>((buffer >> bits) & 0xff));
+            }
+        }
+        return out;
+    }
+}
+
+struct JudgeWorker::Job
+{
+    std::string jobId;
+    std::string payload;
+    JobAck ack;
+    std::chrono::steady_clock::time_point deadline;
+    Done done;
+    std::atomic<bool> finished{false};
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    // metric labels, from a fixed set
+    const char *language = "other";
+    const char *mode = "other";
+
+    SubmissionHeader submission;
+    // its test cases, if it refers to them by testSetRef; holding it keeps
+    // the set's file in place for the sandboxes
+    std::shared_ptr<const TestSet> testSet;
+    CompareOptions compare;
+    std::string image;
+    // fields added to the payload for the runner, e.g. binaryPath
+    json extraFields = json::object();
+    // SQL snapshots its runner may store or use, see sqlSetupKeys()
+    std::unordered_set<std::string> sqlSetupKeys;
+    std::string cacheKey;
+    // where its verdict goes in the verdict cache, empty if it doesn't
+    std::string verdictKey;
+    // released with the job, after its last sandbox
+    std::optional<FanoutLimiter::Grant> grant;
+
+    // sandbox inputs, owned here until the runs reading them complete
+    std::string compileInput;
+    std::string inputTail;
+    std::vector<std::string> chunkInputs;
+    std::vector<std::optional<json>> parts;
+    std::atomic<unsigned int> pendingChunks{0};
+
+    // one of its sandboxes was killed at the deadline
+    std::atomic<bool> timedOut{false};
+
+    // cgroup accounting of its execute sandboxes, if the backend has it:
+    // CPU and throttled time summed over chunks, the largest peak memory
+    std::atomic<bool> accounted{false};
+    std::atomic<uint64_t> cpuUs{0};
+    std::atomic<uint64_t> throttledUs{0};
+    std::atomic<uint64_t> peakMemoryKb{0};
+};
 
-void JudgeWorker::processSubmission(const std::string &jobId,
-                                    const std::string &jsonSubmissionData)
+JudgeWorker::JudgeWorker(SandboxExecutor &executor, CompileCache *compileCache, SqlSnapshotCache *sqlSnapshots,
+                         VerdictCache *verdictCache, TestSetStore &testSets, FanoutLimiter &fanout,
+                         WorkStealingExecutor &continuations, OutputChecks outputChecks, bool zygote, Publish publish)
+    : executor_(executor), compileCache_(compileCache), sqlSnapshots_(sqlSnapshots), verdictCache_(verdictCache),
+      testSets_(testSets),
+      fanout_(fanout), continuations_(continuations), outputChecks_(outputChecks), zygote_(zygote),
+      publish_(std::move(publish)) {}
+
+JudgeWorker::OutputChecks JudgeWorker::outputChecks(const JudgeConfig &config)
+{
+    OutputChecks checks;
+    checks.inJudge = config.compareInJudge;
+    if (!parseCompareMode(config.compareMode, checks.defaultMode))
+    {
+        LOG_WARNING("Unknown JUDGE_COMPARE_MODE '" << config.compareMode << "', using lines.");
+    }
+    checks.maxVerdictBytes = config.verdictOutputBytes;
+    return checks;
+}
+
+void JudgeWorker::processSubmission(const std::string &jobId, std::string jsonSubmissionData,
+                                    const JobAck &ack, std::chrono::steady_clock::time_point deadline,
+                                    Done done)
 {
-    // not used
-    Submission submission = parseSubmission(jsonSubmissionData);
+    auto job = std::make_shared<Job>();
+    job->jobId = jobId;
+    job->payload = std::move(jsonSubmissionData);
+    job->ack = ack;
+    job->deadline = deadline;
+    job->done = std::move(done);
+
+    // Only the routing fields are pulled out; the payload itself goes to the
+    // runner as it came from Redis.
+    std::string error;
+    if (!scanSubmission(job->payload, job->submission, error, outputChecks_.inJudge))
+    {
+        LOG_ERROR("Job " << jobId << " has an invalid payload: " << error);
+        finish(*job, false);
+        return;
+    }
+    job->language = metricLabel(job->submission.language, {"c", "cpp", "python", "javascript", "typescript", "sql"});
+    job->mode = metricLabel(job->submission.mode, {"submit", "run"});
     LOG_INFO("Processing job " << jobId);
 
-    // The input is a json,meaning my parsing is useless.
-    json inputJson;
-    inputJson["language"] = submission.language;
-    inputJson["code"] = submission.code;
-    inputJson["libraryCode"] = submission.libraryCode;
-    inputJson["outputType"] = submission.outputType;
-    inputJson["testCases"] = json::array();
-    for (const auto &tc : submission.testCases)
+    const bool byRef = !job->submission.testSetRef.empty();
+    METRICS()->histogram("judge_job_payload_bytes", "Size of job payloads as read from Redis.",
+                         {{"tests", byRef ? "testset" : "inline"}}, payloadBounds())
+        .observe(static_cast<double>(job->payload.size()));
+
+    // images are not compared, the runner just hands them on
+    if (outputChecks_.inJudge && job->submission.outputType != "image")
+    {
+        job->compare = compareOptions(job->submission, outputChecks_.defaultMode);
+        job->extraFields["deferComparison"] = true;
+    }
+    else
+    {
+        job->submission.expectedOutputs.clear();
+    }
+
+    // before fetching the test set: a hit needs nothing but the payload
+    job->verdictKey = verdictCacheKey(*job);
+    if (!job->verdictKey.empty())
+    {
+        if (auto cached = verdictCache_->lookup(job->verdictKey))
+        {
+            LOG_INFO("Job " << jobId << " hit a cached verdict.");
+            job->verdictKey.clear();
+            // entries hold the whole outputs, whichever mode stored them
+            if (outputLimit(*job) > 0)
+            {
+                json verdict = json::parse(*cached);
+                truncateOutputs(verdict, outputLimit(*job));
+                *cached = verdict.dump();
+            }
+            finish(*job, publishVerdict(*job, "cached", *cached));
+            return;
+        }
+    }
+
+    if (byRef)
+    {
+        job->testSet = testSets_.acquire(job->submission.testSetRef, error);
+        if (!job->testSet)
+        {
+            LOG_ERROR("Job " << jobId << " has no test cases: " << error);
+            finish(*job, publishVerdict(*job, {{"status", "error"},
+                                               {"error", "The test cases for this problem are not available, please submit again."}}));
+            return;
+        }
+        job->submission.testCaseCount = job->testSet->count;
+        // otherwise runTests() passes them inline
+        if (!job->testSet->sandboxPath.empty())
+        {
+            job->extraFields["testCasesPath"] = job->testSet->sandboxPath;
+        }
+    }
+    const std::string &language = job->submission.language;
+    if (zygote_ && (language == "python" || language == "javascript" || language == "typescript"))
+    {
+        job->extraFields["zygote"] = true;
+    }
+    if (sqlSnapshots_ && language == "sql")
     {
-        json tcJson;
-        tcJson["testCaseId"] = tc.test_case_id;
-        tcJson["input"] = tc.input;
-        tcJson["expectedOutput"] = tc.expected_output;
-        tcJson["isPublic"] = tc.is_public;
-        inputJson["testCases"].push_back(tcJson);
+        job->extraFields["sqlSnapshotDir"] = SqlSnapshotCache::sandboxDir();
+        if (job->testSet)
+        {
+            job->sqlSetupKeys = sqlSetupKeys(json::parse(job->testSet->testCases, nullptr, false));
+        }
+        else
+        {
+            const json payload = json::parse(job->payload, nullptr, false);
+            if (payload.is_object() && payload.contains("testCases"))
+                job->sqlSetupKeys = sqlSetupKeys(payload["testCases"]);
+        }
     }
-    std::string inputStr = inputJson.dump();
 
     try
     {
-        std::cout << "inputStr: " << inputStr;
+        const SubmissionHeader &submission = job->submission;
+        if (auto cachedError = useCompileCache(submission, job->extraFields, job->cacheKey))
+        {
+            LOG_INFO("Job " << jobId << " hit a cached compile error.");
+            finish(*job, publishVerdict(*job, *cachedError));
+            return;
+        }
 
-        ScopedTempFile inputFile("/tmp/judge_input_XXXXXX");
-        ScopedTempFile outputFile("/tmp/judge_output_XXXXXX");
+        job->image = imageForLanguage(submission.language);
 
-        inputFile.write(inputStr);
+        // Compiled code is only split if every chunk can run one binary from
+        // the compile cache; without the cache each chunk would compile it
+        // again, so such jobs run in one sandbox.
+        const bool compiled = submission.language == "c" || submission.language == "cpp";
+        const bool canSplit = !compiled || job->extraFields.contains("binaryPath") || !job->cacheKey.empty();
+        job->grant.emplace(fanout_.acquire(
+            canSplit ? static_cast<unsigned int>(submission.testCaseCount / MIN_TESTS_PER_CHUNK) : 1));
 
-        pid_t pid = fork();
-        if (pid < 0)
+        if (job->grant->chunks() > 1 && compiled && !job->extraFields.contains("binaryPath"))
         {
-            LOG_ERROR("fork() failed: " << strerror(errno));
+            // compile once, with no tests, before fanning out
+            json compileInput = {
+                {"language", submission.language},
+                {"code", submission.code},
+                {"libraryCode", submission.libraryCode},
+                {"outputType", submission.outputType},
+                {"testCases", json::array()},
+                {"emitBinary", true},
+            };
+            job->compileInput = compileInput.dump();
+            runSandbox(job, job->compileInput, "", "compile", [this, job](std::optional<json> results)
+                       { this->compiled(job, std::move(results)); });
             return;
         }
-        else if (pid == 0)
-        {
-            int inFd = open(inputFile.getPath().c_str(), O_RDONLY);
-            int outFd = open(outputFile.getPath().c_str(), O_WRONLY | O_TRUNC);
+        runTests(job);
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR("System error in JudgeWorker: " << e.what());
+        finish(*job, false);
+    }
+}
+
+void JudgeWorker::runSandbox(const JobPtr &job, std::string_view input, std::string_view inputTail, const char *stage,
+                             Next next)
+{
+    SandboxRequest request;
+    request.image = job->image;
+    request.input = input;
+    request.inputTail = inputTail;
+    request.deadline = job->deadline;
 
-            if (dup2(inFd, STDIN_FILENO) < 0 || dup2(outFd, STDOUT_FILENO) < 0)
+    executor_.runAsync(request, [this, job, stage, next = std::move(next)](SandboxResult sandboxResult) mutable
+                       {
+        // the supervisor thread only hands the result on
+        continuations_.submit([this, job, stage, next = std::move(next), sandboxResult = std::move(sandboxResult)](const CancellationToken &) mutable
+                              {
+            try
             {
-                std::cerr << "open() failed: " << strerror(errno) << "\n";
-                _exit(1);
+                stageSeconds("spawn", job->language, job->mode).observeMs(sandboxResult.spawnMs);
+                if (sandboxResult.startupMs > 0)
+                {
+                    stageSeconds("startup", job->language, job->mode).observeMs(sandboxResult.startupMs);
+                }
+                if (sandboxResult.launched)
+                {
+                    stageSeconds(stage, job->language, job->mode).observeMs(sandboxResult.wallMs);
+                }
+                if (sandboxResult.accounted)
+                {
+                    recordUsage(sandboxResult, stage, job->language, job->mode);
+                    // the verdict reports what the submission's tests used,
+                    // not the compiler
+                    if (std::string_view(stage) == "execute")
+                    {
+                        job->accounted = true;
+                        job->cpuUs += static_cast<uint64_t>(sandboxResult.cpuMs * 1000);
+                        job->throttledUs += static_cast<uint64_t>(sandboxResult.throttledMs * 1000);
+                        uint64_t peak = job->peakMemoryKb.load();
+                        while (peak < sandboxResult.peakMemoryKb &&
+                               !job->peakMemoryKb.compare_exchange_weak(peak, sandboxResult.peakMemoryKb))
+                        {
+                        }
+                    }
+                }
+
+                const auto parseBegin = std::chrono::steady_clock::now();
+                std::optional<json> results;
+                if (sandboxResult.cancelled)
+                {
+                    job->timedOut = true;
+                }
+                else if (!sandboxResult.launched)
+                {
+                    LOG_ERROR("Could not start sandbox for job " << job->jobId);
+                }
+                else
+                {
+                    try
+                    {
+                        results = json::parse(sandboxResult.output);
+                    }
+                    catch (const json::parse_error &e)
+                    {
+                        LOG_ERROR("Result parsing failed for job " << job->jobId << ": " << e.what()
+                                                                   << ". Raw output: " << sandboxResult.output);
+                    }
+                    stageSeconds("parse", job->language, job->mode).observeMs(msSince(parseBegin));
+                }
+                next(std::move(results));
             }
-            close(inFd);
-            close(outFd);
-
-            const char *image = "judge-cpp:latest";
-            if (submission.language == "python")
-                image = "judge-py:latest";
-            else if (submission.language == "javascript" || submission.language == "typescript")
-                image = "judge-js:latest";
-            else if (submission.language == "c")
-                image = "judge-cpp:latest";
-            else if (submission.language == "sql")
-                image = "judge-sql:latest";
-
-            // exec() docker WITHOUT a shell
-            execlp("docker", "docker", "run",
-                   "--rm",
-                   "-i",
-                   "--read-only",
-                   "--network", "none",
-                   "--pids-limit", "64",
-                   "--tmpfs", "/tmp:exec",
-                   "--memory=256m",
-                   "--memory-swap", "256m",
-                   "--cpus=0.5",
-                   "--tmpfs", "/tmp:exec",
-                   image,
-                   (char *)nullptr);
-
-            std::cerr << "execlp(docker) failed: " << strerror(errno) << "\n";
-            _exit(1);
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("System error in JudgeWorker: " << e.what());
+                finish(*job, false);
+            } }); });
+}
+
+void JudgeWorker::compiled(const JobPtr &job, std::optional<json> results)
+{
+    if (job->timedOut)
+    {
+        complete(job, std::nullopt);
+        return;
+    }
+    if (!results)
+    {
+        finish(*job, false);
+        return;
+    }
+    storeCompileResult(job->cacheKey, *results);
+    if (results->value("status", std::string()) != "completed")
+    {
+        finish(*job, publishVerdict(*job, std::move(*results)));
+        return;
+    }
+    job->extraFields.erase("emitBinary");
+    job->extraFields["binaryPath"] = CompileCache::binaryPath(job->cacheKey);
+    job->cacheKey.clear();
+    runTests(job);
+}
+
+void JudgeWorker::runTests(const JobPtr &job)
+{
+    auto then = [this, job](std::optional<json> results)
+    { complete(job, std::move(results)); };
+
+    if (job->grant->chunks() > 1)
+    {
+        runChunks(job);
+    }
+    else if (job->extraFields.empty() && !job->testSet)
+    {
+        runSandbox(job, job->payload, "", "execute", then);
+    }
+    else
+    {
+        // Append the extra fields in place of the closing brace. Later
+        // keys win in both Python's and JavaScript's JSON parsers, so a
+        // payload can never override them.
+        const size_t close = job->payload.find_last_of('}');
+        const std::string extra = job->extraFields.dump();
+        job->inputTail.clear();
+        if (job->testSet && job->testSet->sandboxPath.empty())
+        {
+            // no file for the runner to read, the set goes inline
+            job->inputTail = ",\"testCases\":" + job->testSet->testCases;
         }
-        else
+        job->inputTail += extra.size() > 2 ? "," + extra.substr(1) : "}";
+        runSandbox(job, std::string_view(job->payload).substr(0, close), job->inputTail, "execute", then);
+    }
+}
+
+void JudgeWorker::runChunks(const JobPtr &job)
+{
+    const unsigned int chunks = job->grant->chunks();
+
+    // The only path that needs the payload as a DOM: the test cases are
+    // moved out of it into the chunks, everything else is shared.
+    json base = json::parse(job->payload);
+    base.update(job->extraFields);
+    // each chunk carries its own slice, never the whole set's file
+    json testCases = job->testSet ? json::parse(job->testSet->testCases) : std::move(base["testCases"]);
+    base.erase("testCases");
+    base.erase("testCasesPath");
+    const size_t total = testCases.size();
+
+    // Contiguous slices, so concatenating the results keeps the original
+    // test order.
+    job->chunkInputs.resize(chunks);
+    size_t begin = 0;
+    for (unsigned int i = 0; i < chunks; ++i)
+    {
+        const size_t end = begin + total / chunks + (i < total % chunks ? 1 : 0);
+        json chunk = base;
+        chunk["testCases"] = json::array();
+        for (size_t t = begin; t < end; ++t)
+        {
+            chunk["testCases"].push_back(std::move(testCases[t]));
+        }
+        job->chunkInputs[i] = chunk.dump();
+        begin = end;
+    }
+    LOG_INFO("Job " << job->jobId << " split into " << chunks << " chunks of ~" << total / chunks << " tests.");
+
+    // all chunks run at once, the extra ones were paid for by the fan-out
+    // grant; whichever finishes last merges
+    job->parts.resize(chunks);
+    job->pendingChunks = chunks;
+    for (unsigned int i = 0; i < chunks; ++i)
+    {
+        runSandbox(job, job->chunkInputs[i], "", "execute", [this, job, i](std::optional<json> results)
+                   {
+            if (results)
+                storeSqlSnapshots(*job, *results);
+            job->parts[i] = std::move(results);
+            if (job->pendingChunks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                complete(job, mergeChunks(*job));
+            } });
+    }
+}
+
+std::optional<json> JudgeWorker::mergeChunks(Job &job)
+{
+    json merged;
+    merged["status"] = "completed";
+    merged["testResults"] = json::array();
+    int passed = 0;
+    long totalRuntime = 0;
+    for (auto &part : job.parts)
+    {
+        if (!part)
+        {
+            return std::nullopt;
+        }
+        // compile errors and runner failures apply to the whole submission
+        if (part->value("status", std::string()) != "completed")
+        {
+            return part;
+        }
+        for (auto &result : (*part)["testResults"])
+        {
+            if (result.value("status", json()) == "passed")
+                passed++;
+            if (result.contains("executionTime") && result["executionTime"].is_number())
+                totalRuntime += result["executionTime"].get<long>();
+            merged["testResults"].push_back(std::move(result));
+        }
+    }
+
+    const size_t count = merged["testResults"].size();
+    merged["metrics"] = {
+        {"passedTests", passed},
+        {"totalTests", count},
+        {"averageRuntime", count > 0 ? totalRuntime / static_cast<long>(count) : 0},
+    };
+    return merged;
+}
+
+void JudgeWorker::complete(const JobPtr &job, std::optional<json> results)
+{
+    // whatever a killed runner printed is partial, never cache it
+    if (job->timedOut)
+    {
+        LOG_WARNING("Job " << job->jobId << " was cancelled.");
+        finish(*job, publishVerdict(*job, cancelledVerdict()));
+        return;
+    }
+    if (!results)
+    {
+        finish(*job, false);
+        return;
+    }
+    if (!job->cacheKey.empty())
+    {
+        storeCompileResult(job->cacheKey, *results);
+    }
+    storeSqlSnapshots(*job, *results);
+    if (results->value("status", std::string()) == "completed")
+    {
+        checkOutputs(*job, *results);
+        if (job->accounted)
+        {
+            // the runners' per-test figures cover the program alone; these
+            // cover the whole sandbox, runner included
+            json &metrics = (*results)["metrics"];
+            metrics["sandboxCpuTimeMs"] = job->cpuUs / 1000;
+            metrics["sandboxThrottledMs"] = job->throttledUs / 1000;
+            if (job->peakMemoryKb > 0)
+                metrics["sandboxPeakMemoryKb"] = job->peakMemoryKb.load();
+        }
+    }
+    if (job->verdictKey.empty() || !deterministic(*results))
+    {
+        finish(*job, publishVerdict(*job, std::move(*results)));
+        return;
+    }
+    // cached whole, so a job of the other mode can get it too
+    std::string verdict = results->dump();
+    const bool published = outputLimit(*job) > 0
+                               ? publishVerdict(*job, std::move(*results))
+                               : publishVerdict(*job, results->value("status", std::string("unknown")), verdict);
+    verdictCache_->store(job->verdictKey, std::move(verdict));
+    finish(*job, published);
+}
+
+void JudgeWorker::finish(Job &job, bool acked)
+{
+    // a throwing step may race a sibling chunk to get here
+    if (!job.finished.exchange(true))
+    {
+        const char *outcome = job.timedOut ? "timeout" : acked ? "verdict" : "error";
+        const Metrics::Labels labels = {{"language", job.language}, {"mode", job.mode}, {"outcome", outcome}};
+        METRICS()->histogram("judge_job_seconds", "Time from a job starting on a worker to its verdict.", labels)
+            .observeMs(msSince(job.started));
+        METRICS()->counter("judge_jobs_total", "Jobs finished, by outcome.", labels).inc();
+        job.done(acked);
+    }
+}
+
+std::optional<json> JudgeWorker::useCompileCache(const SubmissionHeader &submission, json &extraFields,
+                                                std::string &cacheKey)
+{
+    if (!compileCache_ || (submission.language != "c" && submission.language != "cpp"))
+    {
+        return std::nullopt;
+    }
+
+    // a runner image we cannot identify could hand out binaries built by a
+    // different compiler, so don't cache at all then
+    const std::string digest = executor_.imageDigest(imageForLanguage(submission.language));
+    if (digest.empty())
+    {
+        return std::nullopt;
+    }
+
+    const std::string key = CompileCache::key(submission.code, submission.libraryCode, submission.language,
+                                              compilerFlags(submission.language), digest);
+    if (auto cached = compileCache_->lookup(key))
+    {
+        if (!cached->compileError.empty())
+        {
+            return json::parse(cached->compileError);
+        }
+        extraFields["binaryPath"] = cached->binaryPath;
+        return std::nullopt;
+    }
+
+    extraFields["emitBinary"] = true;
+    cacheKey = key;
+    return std::nullopt;
+}
+
+void JudgeWorker::storeCompileResult(const std::string &cacheKey, json &results)
+{
+    const std::string status = results.value("status", std::string());
+    if (status == "compile_error")
+    {
+        compileCache_->storeCompileError(cacheKey, results.dump());
+    }
+    else if (results.contains("binary"))
+    {
+        if (results["binary"].is_string())
+        {
+            compileCache_->storeBinary(cacheKey, decodeBase64(results["binary"].get<std::string>()));
+        }
+        // never part of the verdict the server sees
+        results.erase("binary");
+    }
+}
+
+void JudgeWorker::storeSqlSnapshots(const Job &job, json &results)
+{
+    // Only an SQL job's runner was given the snapshot directory, and only
+    // its own setup scripts are its to report: anything else would let a
+    // forged verdict plant a database under another problem's script.
+    if (!sqlSnapshots_ || job.submission.language != "sql")
+    {
+        return;
+    }
+    auto used = results.find("snapshotHits");
+    if (used != results.end())
+    {
+        if (used->is_array())
         {
-            int status = 0;
-            if (waitpid(pid, &status, 0) < 0)
+            for (const json &key : *used)
             {
-                LOG_ERROR("waitpid() failed: " << strerror(errno));
+                if (key.is_string() && job.sqlSetupKeys.count(key.get<std::string>()))
+                    sqlSnapshots_->touch(key.get<std::string>());
             }
-            else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        }
+        results.erase(used);
+    }
+    auto built = results.find("snapshots");
+    if (built != results.end())
+    {
+        if (built->is_object())
+        {
+            for (const auto &[key, image] : built->items())
             {
-                LOG_WARNING("Docker exited with status "
-                            << (WIFEXITED(status)
-                                    ? WEXITSTATUS(status)
-                                    : -1));
+                if (!job.sqlSetupKeys.count(key))
+                {
+                    LOG_WARNING("Job " << job.jobId << " reported a snapshot for a setup script it does not have: "
+                                       << key.substr(0, 64) << ", dropped.");
+                    continue;
+                }
+                if (image.is_string())
+                    sqlSnapshots_->store(key, decodeBase64(image.get<std::string>()));
             }
         }
+        // never part of the verdict the server sees
+        results.erase(built);
+    }
+}
 
-        std::ifstream outputStream(outputFile.getPath());
-        std::string outputStr((std::istreambuf_iterator<char>(outputStream)),
-                              std::istreambuf_iterator<char>());
+void JudgeWorker::checkOutputs(Job &job, json &results)
+{
+    if (!results.contains("testResults") || !results["testResults"].is_array())
+    {
+        return;
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    const auto &expectedOutputs = job.testSet ? job.testSet->expectedOutputs : job.submission.expectedOutputs;
 
-        try
+    int passed = 0;
+    size_t index = 0;
+    for (json &result : results["testResults"])
+    {
+        if (result.value("status", json()) == "unchecked")
         {
-            auto results = json::parse(outputStr);
-            LOG_INFO("Job " << jobId << " processed with results: " << results.dump(4));
-            std::string prefix;
-            if (submission.mode == "submit")
+            // results come back in test order, so the index nearly always
+            // finds it; chunks keep that order too
+            const int64_t id = result.value("testCaseId", json()).is_number() ? result["testCaseId"].get<int64_t>() : -1;
+            const std::string *expected = nullptr;
+            if (index < expectedOutputs.size() && expectedOutputs[index].first == id)
             {
-                prefix = "judge:submit:verdict:";
+                expected = &expectedOutputs[index].second;
             }
-            else if (submission.mode == "run")
+            else
+            {
+                for (const auto &[testCaseId, output] : expectedOutputs)
+                {
+                    if (testCaseId == id)
+                    {
+                        expected = &output;
+                        break;
+                    }
+                }
+            }
+
+            // null when the program printed nothing
+            const auto actual = result.find("actual");
+            const std::string_view actualText = actual != result.end() && actual->is_string()
+                                                    ? std::string_view(actual->get_ref<const std::string &>())
+                                                    : std::string_view();
+            if (!expected)
             {
-                prefix = "judge:run:verdict:";
+                result["status"] = "error";
+                result["error"] = "No expected output for this test case.";
             }
             else
             {
-                LOG_ERROR("Unknown submission mode for job " << jobId << ": " << submission.mode);
-                return;
+                const CompareResult compared = compareOutputs(*expected, actualText, job.compare);
+                result["status"] = compared.equal ? "passed" : "failed";
+                if (!compared.equal)
+                {
+                    result["error"] = "Wrong output at " + compared.summary();
+                    result["firstDifference"] = {{"line", compared.line}, {"column", compared.column}};
+                }
+                result["expectedOutput"] = *expected;
             }
-
-            std::string verdictKey = prefix + jobId;
-            REDIS()->set(verdictKey, results.dump());
-            REDIS()->expire(verdictKey, 3600);
-            LOG_INFO("DONE");
         }
-        catch (const json::parse_error &e)
+        if (result.value("status", json()) == "passed")
         {
-            LOG_ERROR("Result parsing failed for job " << jobId << ": " << e.what() << ". Raw output: " << outputStr);
+            passed++;
         }
+        index++;
     }
-    catch (const std::exception &e)
+    results["metrics"]["passedTests"] = passed;
+    stageSeconds("compare", job.language, job.mode).observeMs(msSince(begin));
+}
+
+std::string JudgeWorker::verdictCacheKey(const Job &job)
+{
+    if (!verdictCache_)
     {
-        LOG_ERROR("System error in JudgeWorker: " << e.what());
+        return "";
+    }
+    // a verdict from an image we cannot identify might not be what the
+    // current one gives
+    const std::string digest = executor_.imageDigest(imageForLanguage(job.submission.language));
+    if (digest.empty())
+    {
+        return "";
     }
+    const SubmissionHeader &submission = job.submission;
+    const std::string testSetHash =
+        submission.testSetRef.empty() ? inlineTestSetHash(job.payload) : submission.testSetRef;
+    if (testSetHash.empty())
+    {
+        return "";
+    }
+    // the runner compares when the judge does not, by its own rules
+    std::string compare = "runner";
+    if (job.extraFields.contains("deferComparison"))
+    {
+        compare = "judge " + std::to_string(static_cast<int>(job.compare.mode)) + " " +
+                  std::to_string(job.compare.absTolerance) + " " + std::to_string(job.compare.relTolerance);
+    }
+    return VerdictCache::key(submission.language, submission.code, submission.libraryCode, submission.outputType,
+                             testSetHash, compare, digest);
 }
 
-Submission JudgeWorker::parseSubmission(const std::string &jsonSubmissionData)
+size_t JudgeWorker::outputLimit(const Job &job) const
 {
-    auto j = json::parse(jsonSubmissionData);
+    // only submit verdicts are trimmed: a run verdict's output is what an
+    // instructor turns into a test case's expected output
+    return job.submission.mode == "submit" ? outputChecks_.maxVerdictBytes : 0;
+}
+
+bool JudgeWorker::publishVerdict(const Job &job, json results)
+{
+    truncateOutputs(results, outputLimit(job));
+    return publishVerdict(job, results.value("status", std::string("unknown")), results.dump());
+}
 
-    std::string libraryCode;
-    if (j.contains("libraryCode") && !j["libraryCode"].is_null())
+bool JudgeWorker::publishVerdict(const Job &job, const std::string &status, const std::string &verdict)
+{
+    const std::string &jobId = job.jobId;
+    const std::string &mode = job.submission.mode;
+    LOG_INFO("Job processed" << kv("jobId", jobId) << kv("mode", mode) << kv("status", status));
+    LOG_DEBUG("Job " << jobId << " results: " << verdict);
+    std::string prefix;
+    if (mode == "submit")
     {
-        libraryCode = j["libraryCode"].get<std::string>();
+        prefix = "judge:submit:verdict:";
+    }
+    else if (mode == "run")
+    {
+        prefix = "judge:run:verdict:";
+    }
+    else
+    {
+        LOG_ERROR("Unknown submission mode for job " << jobId << ": " << mode);
+        return false;
     }
 
-    std::string outputType = j.value("outputType", std::string("text"));
-
-    return {
-        j["code"].get<std::string>(),
-        j["language"].get<std::string>(),
-        j["testCases"].get<std::vector<TestCase>>(),
-        j["mode"].get<std::string>(),
-        libraryCode,
-        outputType};
+    std::string verdictKey = prefix + jobId;
+    const auto begin = std::chrono::steady_clock::now();
+    const bool published = publish_ ? publish_(jobId, status, verdict)
+                                    : REDIS()->publishVerdict(verdictKey, verdict, 3600, job.ack);
+    stageSeconds("publish", job.language, job.mode).observeMs(msSince(begin));
+    if (!published)
+    {
+        return false;
+    }
+    LOG_INFO("DONE");
+    return true;
 }
@@ -0,0 +1,436 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+    // per thread; a line longer than a quarter of it is cut
+    const size_t RING_BYTES = 256 * 1024;
+    const size_t MAX_LINE = RING_BYTES / 4;
+    // how long the writer sleeps when nothing wakes it earlier
+    const auto WRITER_IDLE = std::chrono::milliseconds(20);
+
+    struct RecordHeader
+    {
+        uint64_t timeUs;
+        uint32_t length;
+        LogLevel level;
+    };
+
+    /**
+     * Single-producer single-consumer byte ring: the owning thread appends
+     * records, the writer thread consumes them. head and tail only grow and
+     * are reduced modulo the capacity on access.
+     */
+    struct Ring
+    {
+        std::unique_ptr<char[]> data{new char[RING_BYTES]};
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        // set when the owning thread exits; the writer drops the ring once
+        // it is empty
+        std::atomic<bool> closed{false};
+
+        void copyIn(uint64_t at, const void *from, size_t size)
+        {
+            const size_t offset = at % RING_BYTES;
+            const size_t first = std::min(size, RING_BYTES - offset);
+            std::memcpy(data.get() + offset, from, first);
+            std::memcpy(data.get(), static_cast<const char *>(from) + first, size - first);
+        }
+
+        void copyOut(uint64_t at, void *to, size_t size) const
+        {
+            const size_t offset = at % RING_BYTES;
+            const size_t first = std::min(size, RING_BYTES - offset);
+            std::memcpy(to, data.get() + offset, first);
+            std::memcpy(static_cast<char *>(to) + first, data.get(), size - first);
+        }
+    };
+
+    class LineBuffer : public std::streambuf
+    {
+    public:
+        std::string line;
+
+    protected:
+        int_type overflow(int_type c) override
+        {
+            if (c != traits_type::eof())
+                line.push_back(static_cast<char>(c));
+            return c;
+        }
+
+        std::streamsize xsputn(const char *s, std::streamsize n) override
+        {
+            line.append(s, static_cast<size_t>(n));
+            return n;
+        }
+    };
+
+    class Writer
+    {
+    public:
+        static Writer &instance()
+        {
+            // never destroyed: threads may still log while statics are torn
+            // down, shutdown() at exit switches them to direct writes
+            static Writer *writer = []
+            {
+                auto *w = new Writer();
+                std::atexit([]
+                            { Logger::shutdown(); });
+                return w;
+            }();
+            return *writer;
+        }
+
+        std::shared_ptr<Ring> attach()
+        {
+            auto ring = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!started_ && !stopped_)
+            {
+                started_ = true;
+                thread_ = std::thread([this]
+                                      { run(); });
+            }
+            rings_.push_back(ring);
+            return ring;
+        }
+
+        bool running() const { return !stopped_.load(std::memory_order_acquire); }
+
+        void wake()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                wakeRequested_ = true;
+            }
+            cv_.notify_one();
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stopped_)
+                    return;
+                stopped_ = true;
+                wakeRequested_ = true;
+            }
+            cv_.notify_one();
+            if (thread_.joinable())
+                thread_.join();
+        }
+
+        // direct path once the writer is gone, or for a line too big to queue
+        void writeNow(LogLevel level, uint64_t timeUs, std::string_view message)
+        {
+            std::lock_guard<std::mutex> lock(directMutex_);
+            std::string line;
+            format(line, level, timeUs, message);
+            writeAll(level >= LogLevel::Warning ? STDERR_FILENO : STDOUT_FILENO, line);
+        }
+
+    private:
+        void run()
+        {
+            while (true)
+            {
+                bool stopping;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stopping = stopped_;
+                }
+                if (drain())
+                    continue;
+                if (stopping)
+                    break;
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait_for(lock, WRITER_IDLE, [this]
+                             { return wakeRequested_; });
+                wakeRequested_ = false;
+            }
+            // lines queued by threads that had not yet seen stopped_
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            drain();
+        }
+
+        // writes out what the rings hold, returns whether there was anything
+        bool drain()
+        {
+            std::vector<std::shared_ptr<Ring>> rings;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                // rings of exited threads go once they are drained
+                rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<Ring> &ring)
+                                            { return ring->closed && ring->head == ring->tail; }),
+                             rings_.end());
+                rings = rings_;
+            }
+
+            bool any = false;
+            for (auto &ring : rings)
+            {
+                uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+                const uint64_t head = ring->head.load(std::memory_order_acquire);
+                while (tail < head)
+                {
+                    RecordHeader header;
+                    ring->copyOut(tail, &header, sizeof(header));
+                    message_.resize(header.length);
+                    ring->copyOut(tail + sizeof(header), message_.data(), header.length);
+                    tail += sizeof(header) + header.length;
+                    format(header.level >= LogLevel::Warning ? err_ : out_, header.level, header.timeUs,
+                           std::string_view(message_.data(), message_.size()));
+                    any = true;
+                }
+                ring->tail.store(tail, std::memory_order_release);
+            }
+
+            writeAll(STDOUT_FILENO, out_);
+            writeAll(STDERR_FILENO, err_);
+            out_.clear();
+            err_.clear();
+            return any;
+        }
+
+        void format(std::string &to, LogLevel level, uint64_t timeUs, std::string_view message)
+        {
+            // the writer's last round can overlap direct writes
+            std::lock_guard<std::mutex> lock(timeMutex_);
+            const time_t seconds = static_cast<time_t>(timeUs / 1000000);
+            if (seconds != cachedSecond_)
+            {
+                std::tm local{};
+                localtime_r(&seconds, &local);
+                char date[32];
+                std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &local);
+                cachedDate_ = date;
+                cachedSecond_ = seconds;
+            }
+            char millis[8];
+            std::snprintf(millis, sizeof(millis), ".%03u", static_cast<unsigned>(timeUs / 1000 % 1000));
+
+            to += '[';
+            to += cachedDate_;
+            to += millis;
+            to += "] ";
+            to += Logger::levelName(level);
+            to += ": ";
+            to.append(message.data(), message.size());
+            to += '\n';
+        }
+
+        static void writeAll(int fd, const std::string &data)
+        {
+            size_t written = 0;
+            while (written < data.size())
+            {
+                const ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return;
+                written += static_cast<size_t>(n);
+            }
+        }
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool wakeRequested_ = false;
+        bool started_ = false;
+        std::atomic<bool> stopped_{false};
+        std::vector<std::shared_ptr<Ring>> rings_;
+        std::thread thread_;
+
+        // only touched by the writer thread
+        std::string out_;
+        std::string err_;
+        std::vector<char> message_;
+
+        std::mutex directMutex_;
+        std::mutex timeMutex_;
+        time_t cachedSecond_ = -1;
+        std::string cachedDate_;
+    };
+
+    struct ThreadState
+    {
+        LineBuffer buffer;
+        std::ostream stream{&buffer};
+        std::shared_ptr<Ring> ring;
+
+        ~ThreadState()
+        {
+            if (ring)
+                ring->closed = true;
+        }
+    };
+
+    ThreadState &threadState()
+    {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    uint64_t nowUs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                         std::chrono::system_clock::now().time_since_epoch())
+                                         .count());
+    }
+}
+
+std::atomic<int> Logger::level_{Logger::initialLevel()};
+
+int Logger::initialLevel()
+{
+    LogLevel level = LogLevel::Info;
+    const char *name = std::getenv("JUDGE_LOG_LEVEL");
+    if (name && *name && !parseLevel(name, level))
+    {
+        level = LogLevel::Info;
+    }
+    return static_cast<int>(level);
+}
+
+void Logger::setLevel(LogLevel level)
+{
+    level_.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+const char *Logger::levelName(LogLevel level)
+{
+    switch (level)
+    {
+    case LogLevel::Debug:
+        return "DEBUG";
+    case LogLevel::Info:
+        return "INFO";
+    case LogLevel::Warning:
+        return "WARNING";
+    case LogLevel::Error:
+        return "ERROR";
+    default:
+        return "OFF";
+    }
+}
+
+bool Logger::parseLevel(std::string_view name, LogLevel &level)
+{
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+    if (lower == "debug")
+        level = LogLevel::Debug;
+    else if (lower == "info")
+        level = LogLevel::Info;
+    else if (lower == "warning" || lower == "warn")
+        level = LogLevel::Warning;
+    else if (lower == "error")
+        level = LogLevel::Error;
+    else if (lower == "off")
+        level = LogLevel::Off;
+    else
+        return false;
+    return true;
+}
+
+std::ostream &Logger::begin()
+{
+    ThreadState &state = threadState();
+    state.buffer.line.clear();
+    // a previous line may have left std::hex or a precision behind
+    state.stream.flags(std::ios_base::dec | std::ios_base::skipws);
+    state.stream.precision(6);
+    state.stream.fill(' ');
+    return state.stream;
+}
+
+void Logger::commit(LogLevel level)
+{
+    ThreadState &state = threadState();
+    std::string &line = state.buffer.line;
+    const uint64_t timeUs = nowUs();
+    if (line.size() > MAX_LINE)
+    {
+        const size_t cut = line.size() - MAX_LINE;
+        line.resize(MAX_LINE);
+        line += " ... (" + std::to_string(cut) + " more bytes)";
+    }
+
+    Writer &writer = Writer::instance();
+    if (!writer.running())
+    {
+        writer.writeNow(level, timeUs, line);
+        return;
+    }
+    if (!state.ring)
+    {
+        state.ring = writer.attach();
+    }
+
+    Ring &ring = *state.ring;
+    const RecordHeader header{timeUs, static_cast<uint32_t>(line.size()), level};
+    const size_t size = sizeof(header) + line.size();
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    // a full ring means the output cannot keep up; wait rather than drop
+    while (head + size - ring.tail.load(std::memory_order_acquire) > RING_BYTES)
+    {
+        if (!writer.running())
+        {
+            writer.writeNow(level, timeUs, line);
+            return;
+        }
+        writer.wake();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    ring.copyIn(head, &header, sizeof(header));
+    ring.copyIn(head + sizeof(header), line.data(), line.size());
+    ring.head.store(head + size, std::memory_order_release);
+
+    // errors go out promptly, the rest with the writer's next round
+    if (level >= LogLevel::Error || head + size - ring.tail.load(std::memory_order_relaxed) > RING_BYTES / 2)
+    {
+        writer.wake();
+    }
+}
+
+void Logger::shutdown()
+{
+    Writer::instance().stop();
+}
+
+void writeLogValue(std::ostream &out, std::string_view value)
+{
+    const bool quote = value.empty() || value.find_first_of(" \t\n\"=") != std::string_view::npos;
+    if (!quote)
+    {
+        out << value;
+        return;
+    }
+    out << '"';
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c == '\n')
+            out << "\\n";
+        else
+            out << c;
+    }
+    out << '"';
+}
@@ -0,0 +1,264 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <sstream>
+
+namespace
+{
+    size_t shardIndex()
+    {
+        static std::atomic<size_t> next{0};
+        thread_local const size_t index = next.fetch_add(1, std::memory_order_relaxed) % Metrics::SHARDS;
+        return index;
+    }
+
+    std::string escape(const std::string &value)
+    {
+        std::string out;
+        out.reserve(value.size());
+        for (char c : value)
+        {
+            if (c == '\\' || c == '"')
+                out += '\\';
+            if (c == '\n')
+            {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    std::string renderLabels(const Metrics::Labels &labels)
+    {
+        if (labels.empty())
+            return "";
+        std::string out = "{";
+        for (size_t i = 0; i < labels.size(); ++i)
+        {
+            if (i > 0)
+                out += ',';
+            out += labels[i].first + "=\"" + escape(labels[i].second) + "\"";
+        }
+        return out + "}";
+    }
+
+    // adds one more label to a rendered label set
+    std::string withLabel(const std::string &labels, const std::string &name, const std::string &value)
+    {
+        const std::string label = name + "=\"" + value + "\"";
+        if (labels.empty())
+            return "{" + label + "}";
+        return labels.substr(0, labels.size() - 1) + "," + label + "}";
+    }
+
+    void writeNumber(std::ostringstream &out, double value)
+    {
+        if (std::isnan(value))
+            out << "NaN";
+        else if (std::isinf(value))
+            out << (value > 0 ? "+Inf" : "-Inf");
+        else
+            out << value;
+    }
+}
+
+void Metrics::Counter::inc(uint64_t n)
+{
+    shards_[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Counter::value() const
+{
+    uint64_t total = 0;
+    for (const auto &shard : shards_)
+    {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+Metrics::Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds))
+{
+    for (auto &shard : shards_)
+    {
+        shard.buckets.reset(new std::atomic<uint64_t>[bounds_.size() + 1]);
+        for (size_t i = 0; i <= bounds_.size(); ++i)
+        {
+            shard.buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Metrics::Histogram::observe(double value)
+{
+    const size_t bucket = static_cast<size_t>(
+        std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin());
+    Shard &shard = shards_[shardIndex()];
+    shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sumMicros.fetch_add(static_cast<uint64_t>(std::max(value, 0.0) * 1e6), std::memory_order_relaxed);
+}
+
+Metrics::Histogram::Snapshot Metrics::Histogram::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.cumulative.assign(bounds_.size() + 1, 0);
+    uint64_t sumMicros = 0;
+    for (const auto &shard : shards_)
+    {
+        for (size_t i = 0; i <= bounds_.size(); ++i)
+        {
+            snapshot.cumulative[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+        sumMicros += shard.sumMicros.load(std::memory_order_relaxed);
+    }
+    // the count is the +Inf bucket, so it always agrees with the buckets
+    // even while writers keep adding
+    for (size_t i = 1; i < snapshot.cumulative.size(); ++i)
+    {
+        snapshot.cumulative[i] += snapshot.cumulative[i - 1];
+    }
+    snapshot.count = snapshot.cumulative.back();
+    snapshot.sum = static_cast<double>(sumMicros) / 1e6;
+    return snapshot;
+}
+
+const std::vector<double> &Metrics::latencyBounds()
+{
+    static const std::vector<double> bounds = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25,
+                                               0.5, 1, 2.5, 5, 10, 30, 60, 120};
+    return bounds;
+}
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Family &Metrics::family(const std::string &name, const std::string &help, const char *type)
+{
+    Family &family = families_[name];
+    if (family.help.empty())
+    {
+        family.help = help;
+        family.type = type;
+    }
+    return family;
+}
+
+Metrics::Counter &Metrics::counter(const std::string &name, const std::string &help, const Labels &labels)
+{
+    const std::string key = renderLabels(labels);
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = families_.find(name);
+        if (it != families_.end())
+        {
+            auto series = it->second.counters.find(key);
+            if (series != it->second.counters.end())
+                return *series->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto &series = family(name, help, "counter").counters[key];
+    if (!series)
+        series = std::make_unique<Counter>();
+    return *series;
+}
+
+Metrics::Histogram &Metrics::histogram(const std::string &name, const std::string &help, const Labels &labels,
+                                       const std::vector<double> &bounds)
+{
+    const std::string key = renderLabels(labels);
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = families_.find(name);
+        if (it != families_.end())
+        {
+            auto series = it->second.histograms.find(key);
+            if (series != it->second.histograms.end())
+                return *series->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto &series = family(name, help, "histogram").histograms[key];
+    if (!series)
+        series = std::make_unique<Histogram>(bounds);
+    return *series;
+}
+
+void Metrics::gauge(const std::string &name, const std::string &help, const Labels &labels, std::function<double()> read)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    family(name, help, "gauge").gauges[renderLabels(labels)] = std::move(read);
+}
+
+std::string Metrics::render() const
+{
+    // Gauges may ask Redis, so they are read before taking the lock that
+    // registering a new series waits on.
+    std::vector<std::pair<std::string, std::function<double()>>> reads;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto &[name, family] : families_)
+        {
+            for (const auto &[labels, read] : family.gauges)
+            {
+                reads.emplace_back(name + labels, read);
+            }
+        }
+    }
+    std::map<std::string, double> gauges;
+    for (const auto &[series, read] : reads)
+    {
+        gauges[series] = read();
+    }
+
+    std::ostringstream out;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    for (const auto &[name, family] : families_)
+    {
+        out << "# HELP " << name << ' ' << family.help << '\n';
+        out << "# TYPE " << name << ' ' << family.type << '\n';
+        for (const auto &[labels, counter] : family.counters)
+        {
+            out << name << labels << ' ' << counter->value() << '\n';
+        }
+        for (const auto &[labels, read] : family.gauges)
+        {
+            auto value = gauges.find(name + labels);
+            out << name << labels << ' ';
+            writeNumber(out, value != gauges.end() ? value->second : NAN);
+            out << '\n';
+        }
+        for (const auto &[labels, histogram] : family.histograms)
+        {
+            const Histogram::Snapshot snapshot = histogram->snapshot();
+            const auto &bounds = histogram->bounds();
+            for (size_t i = 0; i < snapshot.cumulative.size(); ++i)
+            {
+                std::ostringstream le;
+                writeNumber(le, i < bounds.size() ? bounds[i] : INFINITY);
+                out << name << "_bucket" << withLabel(labels, "le", le.str()) << ' ' << snapshot.cumulative[i] << '\n';
+            }
+            out << name << "_sum" << labels << ' ' << snapshot.sum << '\n';
+            out << name << "_count" << labels << ' ' << snapshot.count << '\n';
+        }
+    }
+    return out.str();
+}
+
+const char *metricLabel(const std::string &value, std::initializer_list<const char *> known)
+{
+    for (const char *label : known)
+    {
+        if (value == label)
+            return label;
+    }
+    return "other";
+}
@@ -0,0 +1,202 @@
+#include "MetricsServer.h"
+#include "Metrics.h"
+#include "Logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace
+{
+    // a scrape request is a single short GET
+    const size_t MAX_REQUEST = 8192;
+
+    void writeAll(int fd, const std::string &data)
+    {
+        size_t written = 0;
+        while (written < data.size())
+        {
+            const ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return;
+            written += static_cast<size_t>(n);
+        }
+    }
+
+    std::string response(const char *status, const char *contentType, const std::string &body)
+    {
+        return std::string("HTTP/1.1 ") + status + "\r\nContent-Type: " + contentType +
+               "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    }
+}
+
+MetricsServer::MetricsServer(int port)
+    : port_(port)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop_ = true;
+    if (wakeFd_ >= 0)
+    {
+        const uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+    if (listenFd_ >= 0)
+        close(listenFd_);
+    if (wakeFd_ >= 0)
+        close(wakeFd_);
+}
+
+bool MetricsServer::start()
+{
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (listenFd_ < 0 || wakeFd_ < 0)
+    {
+        LOG_ERROR("Metrics endpoint: socket() failed: " << strerror(errno));
+        return false;
+    }
+    const int yes = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port_));
+    if (bind(listenFd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(listenFd_, 16) < 0)
+    {
+        LOG_ERROR("Metrics endpoint: cannot listen on port " << port_ << ": " << strerror(errno));
+        return false;
+    }
+
+    thread_ = std::thread([this]
+                          { loop(); });
+    LOG_INFO("Metrics endpoint listening on :" << port_ << "/metrics");
+    return true;
+}
+
+void MetricsServer::loop()
+{
+    pollfd fds[2] = {{listenFd_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+    while (!stop_)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Metrics endpoint: poll() failed: " << strerror(errno));
+            return;
+        }
+        if (fds[1].revents)
+            return;
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        const int client = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+        serve(client);
+        close(client);
+    }
+}
+
+void MetricsServer::serve(int client)
+{
+    // a stalled client must not hold the only serving thread for long
+    timeval timeout{2, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST)
+    {
+        const ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        request.append(buffer, static_cast<size_t>(n));
+    }
+
+    // request line: METHOD SP target SP version
+    const size_t methodEnd = request.find(' ');
+    const size_t targetEnd = methodEnd == std::string::npos ? std::string::npos : request.find(' ', methodEnd + 1);
+    if (targetEnd == std::string::npos)
+    {
+        writeAll(client, response("400 Bad Request", "text/plain", "bad request\n"));
+        return;
+    }
+    const std::string method = request.substr(0, methodEnd);
+    std::string target = request.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+    const size_t queryStart = target.find('?');
+    const std::string query = queryStart == std::string::npos ? "" : target.substr(queryStart + 1);
+    target = target.substr(0, queryStart);
+
+    if (target == "/loglevel")
+    {
+        serveLogLevel(client, method, query);
+    }
+    else if (method != "GET")
+    {
+        writeAll(client, response("405 Method Not Allowed", "text/plain", "GET only\n"));
+    }
+    else if (target != "/metrics")
+    {
+        writeAll(client, response("404 Not Found", "text/plain", "metrics are at /metrics\n"));
+    }
+    else
+    {
+        writeAll(client, response("200 OK", "text/plain; version=0.0.4; charset=utf-8", METRICS()->render()));
+    }
+}
+
+void MetricsServer::serveLogLevel(int client, const std::string &method, const std::string &query)
+{
+    if (method == "GET")
+    {
+        writeAll(client, response("200 OK", "text/plain", std::string(Logger::levelName(Logger::level())) + "\n"));
+        return;
+    }
+    if (method != "PUT" && method != "POST")
+    {
+        writeAll(client, response("405 Method Not Allowed", "text/plain", "GET or PUT only\n"));
+        return;
+    }
+
+    // PUT /loglevel?level=debug
+    const std::string key = "level=";
+    size_t at = 0;
+    while (at < query.size() && query.compare(at, key.size(), key) != 0)
+    {
+        at = query.find('&', at);
+        at = at == std::string::npos ? query.size() : at + 1;
+    }
+    LogLevel level;
+    if (at >= query.size() ||
+        !Logger::parseLevel(std::string_view(query).substr(at + key.size(), query.find('&', at) - at - key.size()), level))
+    {
+        writeAll(client, response("400 Bad Request", "text/plain", "expected ?level=debug|info|warning|error|off\n"));
+        return;
+    }
+
+    // logged before the change, so turning logging down still leaves a trace
+    LOG_WARNING("Log level changed" << kv("from", Logger::levelName(Logger::level())) << kv("to", Logger::levelName(level)));
+    Logger::setLevel(level);
+    writeAll(client, response("200 OK", "text/plain", std::string(Logger::levelName(level)) + "\n"));
+}
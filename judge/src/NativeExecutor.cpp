@@ -0,0 +1,720 @@
+#include "NativeExecutor.h"
+#include "Logger.h"
+#include "Sha256.h"
+
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/capability.h>
+#include <linux/close_range.h>
+#include <linux/sched.h>
+#include <linux/seccomp.h>
+#include <linux/securebits.h>
+#include <signal.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef JUDGE_HAVE_SECCOMP
+#include <seccomp.h>
+#include <sys/mman.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace
+{
+    // Same limits as the docker backend's --memory=256m --memory-swap 256m
+    // --pids-limit 64 --cpus=0.5
+    const char *MEMORY_MAX = "268435456";
+    const char *SWAP_MAX = "0";
+    const char *PIDS_MAX = "64";
+    const char *CPU_MAX = "50000 100000";
+
+    // Used as the sandbox's outside identity when the judge itself runs as
+    // root, so that namespace-root never maps to real root.
+    const uid_t NOBODY = 65534;
+
+    bool writeFile(const std::string &path, const std::string &content)
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        ssize_t written = write(fd, content.data(), content.size());
+        int savedErrno = errno;
+        close(fd);
+        errno = savedErrno;
+        return written == static_cast<ssize_t>(content.size());
+    }
+
+    bool isExecutable(const std::string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && (st.st_mode & 0111);
+    }
+
+#ifdef JUDGE_HAVE_SECCOMP
+    uint32_t seccompAction(const std::string &name, int errnoRet)
+    {
+        if (name == "SCMP_ACT_ALLOW")
+            return SCMP_ACT_ALLOW;
+        if (name == "SCMP_ACT_KILL" || name == "SCMP_ACT_KILL_THREAD")
+            return SCMP_ACT_KILL;
+        if (name == "SCMP_ACT_KILL_PROCESS")
+            return SCMP_ACT_KILL_PROCESS;
+        if (name == "SCMP_ACT_TRAP")
+            return SCMP_ACT_TRAP;
+        if (name == "SCMP_ACT_LOG")
+            return SCMP_ACT_LOG;
+        return SCMP_ACT_ERRNO(errnoRet);
+    }
+
+    bool seccompCompare(const std::string &name, scmp_compare &op)
+    {
+        static const std::pair<const char *, scmp_compare> ops[] = {
+            {"SCMP_CMP_NE", SCMP_CMP_NE}, {"SCMP_CMP_LT", SCMP_CMP_LT}, {"SCMP_CMP_LE", SCMP_CMP_LE},
+            {"SCMP_CMP_EQ", SCMP_CMP_EQ}, {"SCMP_CMP_GE", SCMP_CMP_GE}, {"SCMP_CMP_GT", SCMP_CMP_GT},
+            {"SCMP_CMP_MASKED_EQ", SCMP_CMP_MASKED_EQ},
+        };
+        for (const auto &[opName, value] : ops)
+        {
+            if (name == opName)
+            {
+                op = value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Compiles a docker-format seccomp profile to a BPF program once, up
+     * front, so the sandbox child only has to hand it to the kernel.
+     */
+    bool compileSeccompProfile(const std::string &path, std::vector<sock_filter> &out)
+    {
+        std::ifstream in(path);
+        json profile;
+        try
+        {
+            profile = json::parse(in);
+        }
+        catch (const json::exception &e)
+        {
+            LOG_ERROR("Invalid seccomp profile " << path << ": " << e.what());
+            return false;
+        }
+
+        const uint32_t defaultAction = seccompAction(profile.value("defaultAction", std::string("SCMP_ACT_ERRNO")),
+                                                     profile.value("defaultErrnoRet", EPERM));
+        scmp_filter_ctx ctx = seccomp_init(defaultAction);
+        if (!ctx)
+        {
+            LOG_ERROR("seccomp_init failed for " << path);
+            return false;
+        }
+
+        for (const auto &rule : profile.value("syscalls", json::array()))
+        {
+            const uint32_t action = seccompAction(rule.value("action", std::string("SCMP_ACT_ALLOW")),
+                                                  rule.value("errnoRet", EPERM));
+            if (action == defaultAction)
+                continue;
+            // a rule whose conditions were dropped would allow more than it
+            // says, so a condition that cannot be expressed fails the profile
+            std::vector<scmp_arg_cmp> conditions;
+            for (const auto &arg : rule.value("args", json::array()))
+            {
+                scmp_compare op;
+                if (!seccompCompare(arg.value("op", std::string()), op))
+                {
+                    LOG_ERROR("Seccomp profile " << path << " has an unknown comparison " << arg.value("op", json()));
+                    seccomp_release(ctx);
+                    return false;
+                }
+                conditions.push_back({arg.value("index", 0u), op, arg.value("value", uint64_t(0)),
+                                      arg.value("valueTwo", uint64_t(0))});
+            }
+            for (const auto &name : rule.value("names", json::array()))
+            {
+                int nr = seccomp_syscall_resolve_name(name.get<std::string>().c_str());
+                if (nr == __NR_SCMP_ERROR)
+                {
+                    LOG_WARNING("Seccomp profile " << path << " names unknown syscall " << name);
+                    continue;
+                }
+                if (seccomp_rule_add_array(ctx, action, nr, static_cast<unsigned int>(conditions.size()),
+                                           conditions.data()) != 0)
+                {
+                    LOG_WARNING("Could not add seccomp rule for " << name << " from " << path);
+                }
+            }
+        }
+
+        int fd = memfd_create("judge-seccomp", MFD_CLOEXEC);
+        bool ok = fd >= 0 && seccomp_export_bpf(ctx, fd) == 0;
+        seccomp_release(ctx);
+        if (ok)
+        {
+            off_t size = lseek(fd, 0, SEEK_END);
+            out.resize(static_cast<size_t>(size) / sizeof(sock_filter));
+            ok = pread(fd, out.data(), out.size() * sizeof(sock_filter), 0) == static_cast<ssize_t>(out.size() * sizeof(sock_filter));
+        }
+        if (fd >= 0)
+            close(fd);
+        if (!ok || out.empty())
+        {
+            LOG_ERROR("Failed to export seccomp filter for " << path);
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    struct ChildContext
+    {
+        int inFd;
+        int outFd;
+        int syncFd;
+        int errFd;
+        const char *rootfs;
+        const char *tmpDir;
+        const char *procDir;
+        const char *devDir;
+        const char *dataDir;
+        const char *dataMount;
+        unsigned long dataLockedFlags;
+        const std::vector<std::pair<std::string, std::string>> *devNodes;
+        const std::vector<std::pair<std::string, std::string>> *devLinks;
+        unsigned long lockedMountFlags;
+        const char *workdir;
+        const char *executable;
+        char *const *argv;
+        char *const *envp;
+        const std::vector<sock_filter> *seccomp;
+    };
+
+    [[noreturn]] void failChild(int errFd, int step)
+    {
+        int report[2] = {step, errno};
+        ssize_t ignored = write(errFd, report, sizeof(report));
+        (void)ignored;
+        _exit(127);
+    }
+
+    /**
+     * Runs in the clone3() child, which is pid 1 of its namespace. Only
+     * async-signal-safe calls from here on: every path and argv was prepared
+     * by the parent before cloning.
+     */
+    [[noreturn]] void sandboxChild(const ChildContext &ctx)
+    {
+        // wait for the parent to write our uid/gid maps
+        char go;
+        if (read(ctx.syncFd, &go, 1) != 1)
+            failChild(ctx.errFd, 1);
+        // become the namespace's root so our ids are mapped for the mounts
+        // below; raw syscalls, glibc's setxid broadcast would wait on the
+        // parent's threads, which don't exist in this clone
+        if (syscall(SYS_setresgid, 0, 0, 0) != 0 || syscall(SYS_setresuid, 0, 0, 0) != 0)
+            failChild(ctx.errFd, 1);
+
+        if (mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0)
+            failChild(ctx.errFd, 2);
+        if (mount(ctx.rootfs, ctx.rootfs, nullptr, MS_BIND | MS_REC, nullptr) != 0)
+            failChild(ctx.errFd, 3);
+        if (mount("tmpfs", ctx.tmpDir, "tmpfs", MS_NOSUID | MS_NODEV, "mode=1777,size=64m") != 0)
+            failChild(ctx.errFd, 4);
+        if (mount("proc", ctx.procDir, "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC, nullptr) != 0)
+            failChild(ctx.errFd, 5);
+        if (mount("tmpfs", ctx.devDir, "tmpfs", MS_NOSUID | MS_NOEXEC, "mode=755,size=64k") != 0)
+            failChild(ctx.errFd, 6);
+        for (const auto &[host, target] : *ctx.devNodes)
+        {
+            int fd = open(target.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0666);
+            if (fd < 0)
+                failChild(ctx.errFd, 7);
+            close(fd);
+            if (mount(host.c_str(), target.c_str(), nullptr, MS_BIND, nullptr) != 0)
+                failChild(ctx.errFd, 7);
+        }
+        for (const auto &[target, link] : *ctx.devLinks)
+        {
+            if (symlink(target.c_str(), link.c_str()) != 0)
+                failChild(ctx.errFd, 8);
+        }
+        if (*ctx.dataMount)
+        {
+            if (mount(ctx.dataDir, ctx.dataMount, nullptr, MS_BIND, nullptr) != 0 ||
+                mount(nullptr, ctx.dataMount, nullptr,
+                      MS_REMOUNT | MS_BIND | MS_RDONLY | MS_NOSUID | MS_NODEV | ctx.dataLockedFlags, nullptr) != 0)
+                failChild(ctx.errFd, 18);
+        }
+        if (mount(nullptr, ctx.rootfs, nullptr, MS_REMOUNT | MS_BIND | MS_RDONLY | ctx.lockedMountFlags, nullptr) != 0)
+            failChild(ctx.errFd, 9);
+
+        if (chdir(ctx.rootfs) != 0 || syscall(SYS_pivot_root, ".", ".") != 0 || umount2(".", MNT_DETACH) != 0)
+            failChild(ctx.errFd, 10);
+        if (chdir(ctx.workdir) != 0 && chdir("/") != 0)
+            failChild(ctx.errFd, 11);
+        sethostname("sandbox", 7);
+
+        if (dup2(ctx.inFd, STDIN_FILENO) < 0 || dup2(ctx.outFd, STDOUT_FILENO) < 0)
+            failChild(ctx.errFd, 12);
+        // nothing the judge has open (redis sockets, other jobs' pipes) may
+        // leak past exec
+        syscall(SYS_close_range, 3, ~0U, CLOSE_RANGE_CLOEXEC);
+
+        // namespace-root keeps no capabilities, and exec must not give them back
+        if (prctl(PR_SET_SECUREBITS, SECBIT_NOROOT | SECBIT_NOROOT_LOCKED | SECBIT_NO_SETUID_FIXUP |
+                                         SECBIT_NO_SETUID_FIXUP_LOCKED | SECBIT_KEEP_CAPS_LOCKED) != 0)
+            failChild(ctx.errFd, 13);
+        for (int cap = 0; cap <= CAP_LAST_CAP; ++cap)
+        {
+            prctl(PR_CAPBSET_DROP, cap, 0, 0, 0);
+        }
+        prctl(PR_CAP_AMBIENT, PR_CAP_AMBIENT_CLEAR_ALL, 0, 0, 0);
+        __user_cap_header_struct capHeader = {_LINUX_CAPABILITY_VERSION_3, 0};
+        __user_cap_data_struct capData[2] = {};
+        if (syscall(SYS_capset, &capHeader, capData) != 0)
+            failChild(ctx.errFd, 14);
+
+        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0)
+            failChild(ctx.errFd, 15);
+        if (!ctx.seccomp->empty())
+        {
+            sock_fprog prog = {static_cast<unsigned short>(ctx.seccomp->size()),
+                               const_cast<sock_filter *>(ctx.seccomp->data())};
+            if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog, 0, 0) != 0)
+                failChild(ctx.errFd, 16);
+        }
+
+        execve(ctx.executable, ctx.argv, ctx.envp);
+        failChild(ctx.errFd, 17);
+    }
+}
+
+NativeExecutor::NativeExecutor(std::string runnerRoot, std::string cgroupRoot, std::string dataDir)
+    : runnerRoot_(std::move(runnerRoot)), cgroupRoot_(std::move(cgroupRoot)), dataDir_(std::move(dataDir))
+{
+    outerUid_ = geteuid() == 0 ? NOBODY : geteuid();
+    outerGid_ = geteuid() == 0 ? NOBODY : getegid();
+}
+
+bool NativeExecutor::initialize()
+{
+    if (mkdir(cgroupRoot_.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        LOG_ERROR("Cannot create cgroup root " << cgroupRoot_ << ": " << strerror(errno));
+        return false;
+    }
+    if (!writeFile(cgroupRoot_ + "/cgroup.subtree_control", "+cpu +memory +pids"))
+    {
+        LOG_ERROR("Cannot enable cpu/memory/pids controllers under " << cgroupRoot_ << ": " << strerror(errno)
+                                                                     << " (is it a delegated cgroup v2 subtree?)");
+        return false;
+    }
+
+    // the judge fills it later (compile cache), it only has to exist now
+    if (!dataDir_.empty())
+        mkdir(dataDir_.c_str(), 0711);
+    struct statvfs dataFs;
+    if (!dataDir_.empty() && statvfs(dataDir_.c_str(), &dataFs) == 0)
+    {
+        if (dataFs.f_flag & ST_NOEXEC)
+            dataLockedFlags_ |= MS_NOEXEC;
+    }
+    else if (!dataDir_.empty())
+    {
+        LOG_WARNING("Judge data directory " << dataDir_ << " missing, sandboxes get no /judge.");
+        dataDir_.clear();
+    }
+
+    for (const char *image : {"judge-cpp:latest", "judge-py:latest", "judge-js:latest", "judge-sql:latest"})
+    {
+        Runner runner;
+        if (loadRunner(image, runner))
+        {
+            runners_.emplace(image, std::move(runner));
+        }
+    }
+
+    if (runners_.empty())
+    {
+        LOG_ERROR("No unpacked runners found under " << runnerRoot_ << ", run scripts/export_runners.sh.");
+        return false;
+    }
+    LOG_INFO("Native sandbox ready with " << runners_.size() << " runners, cgroups under " << cgroupRoot_);
+    return true;
+}
+
+bool NativeExecutor::loadRunner(const std::string &image, Runner &runner)
+{
+    const std::string dir = runnerRoot_ + "/" + image.substr(0, image.find(':'));
+    runner.image = image;
+    runner.rootfs = dir + "/rootfs";
+    runner.tmpDir = runner.rootfs + "/tmp";
+    runner.procDir = runner.rootfs + "/proc";
+    runner.devDir = runner.rootfs + "/dev";
+    for (const char *node : {"null", "zero", "random", "urandom"})
+    {
+        runner.devNodes.emplace_back(std::string("/dev/") + node, runner.devDir + "/" + node);
+    }
+    runner.devLinks = {
+        {"/proc/self/fd", runner.devDir + "/fd"},
+        {"/proc/self/fd/0", runner.devDir + "/stdin"},
+        {"/proc/self/fd/1", runner.devDir + "/stdout"},
+        {"/proc/self/fd/2", runner.devDir + "/stderr"},
+    };
+
+    struct statvfs fs;
+    if (statvfs(runner.rootfs.c_str(), &fs) != 0)
+    {
+        LOG_WARNING("No unpacked rootfs for " << image << " at " << runner.rootfs);
+        return false;
+    }
+    // a read-only bind remount inside a user namespace must keep whatever
+    // flags the host mount already locks in
+    if (fs.f_flag & ST_NOSUID)
+        runner.lockedMountFlags |= MS_NOSUID;
+    if (fs.f_flag & ST_NODEV)
+        runner.lockedMountFlags |= MS_NODEV;
+    if (fs.f_flag & ST_NOEXEC)
+        runner.lockedMountFlags |= MS_NOEXEC;
+
+    json config;
+    try
+    {
+        std::ifstream in(dir + "/config.json");
+        config = json::parse(in);
+    }
+    catch (const json::exception &e)
+    {
+        LOG_ERROR("Invalid runner config for " << image << ": " << e.what());
+        return false;
+    }
+
+    if (config.contains("Entrypoint") && config["Entrypoint"].is_array())
+        runner.args = config["Entrypoint"].get<std::vector<std::string>>();
+    if (config.contains("Cmd") && config["Cmd"].is_array())
+    {
+        auto cmd = config["Cmd"].get<std::vector<std::string>>();
+        runner.args.insert(runner.args.end(), cmd.begin(), cmd.end());
+    }
+    if (config.contains("Env") && config["Env"].is_array())
+        runner.env = config["Env"].get<std::vector<std::string>>();
+    runner.workdir = config.value("WorkingDir", std::string("/"));
+    if (runner.workdir.empty())
+        runner.workdir = "/";
+
+    if (runner.args.empty())
+    {
+        LOG_ERROR("Runner " << image << " has no entrypoint.");
+        return false;
+    }
+
+    // execve() does no PATH lookup, so resolve the entrypoint against the
+    // image's own PATH now
+    runner.executable = runner.args[0];
+    if (runner.executable.find('/') == std::string::npos)
+    {
+        std::string path = "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin";
+        for (const auto &var : runner.env)
+        {
+            if (var.rfind("PATH=", 0) == 0)
+                path = var.substr(5);
+        }
+        runner.executable.clear();
+        size_t begin = 0;
+        while (begin <= path.size() && runner.executable.empty())
+        {
+            size_t end = path.find(':', begin);
+            if (end == std::string::npos)
+                end = path.size();
+            std::string candidate = path.substr(begin, end - begin) + "/" + runner.args[0];
+            if (isExecutable(runner.rootfs + candidate))
+                runner.executable = candidate;
+            begin = end + 1;
+        }
+        if (runner.executable.empty())
+        {
+            LOG_ERROR("Entrypoint " << runner.args[0] << " not found in " << runner.rootfs);
+            return false;
+        }
+    }
+
+    // the read-only rootfs cannot grow a mount point later, export_runners.sh
+    // creates it
+    struct stat st;
+    if (!dataDir_.empty() && stat((runner.rootfs + "/judge").c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        runner.dataMount = runner.rootfs + "/judge";
+    else if (!dataDir_.empty())
+        LOG_WARNING("Runner " << image << " has no /judge mount point, re-run export_runners.sh.");
+
+    std::ifstream digest(dir + "/digest");
+    if (!std::getline(digest, runner.digest) || runner.digest.empty())
+    {
+        // exported by an older script: the config still changes whenever
+        // the image's entrypoint or environment does
+        std::ifstream configIn(dir + "/config.json");
+        std::stringstream raw;
+        raw << configIn.rdbuf();
+        runner.digest = "config:" + Sha256::hex(raw.str());
+    }
+
+    const std::string profile = dir + "/seccomp.json";
+    if (access(profile.c_str(), R_OK) == 0)
+    {
+#ifdef JUDGE_HAVE_SECCOMP
+        if (!compileSeccompProfile(profile, runner.seccomp))
+            return false;
+#else
+        LOG_ERROR("Runner " << image << " has a seccomp profile but the judge was built without libseccomp.");
+        return false;
+#endif
+    }
+    else
+    {
+        LOG_WARNING("No seccomp profile for " << image << ", it runs without a syscall filter.");
+    }
+
+    LOG_INFO("Loaded native runner " << image << " (" << runner.executable << ")");
+    return true;
+}
+
+std::string NativeExecutor::imageDigest(const std::string &image)
+{
+    auto it = runners_.find(image);
+    if (it == runners_.end())
+        return "";
+    std::lock_guard<std::mutex> lock(digestMutex_);
+    return it->second.digest;
+}
+
+void NativeExecutor::refreshImageDigests()
+{
+    // export_runners.sh replaces the rootfs in place, which running jobs
+    // see at once; the digest file says when that happened
+    for (auto &[image, runner] : runners_)
+    {
+        std::ifstream in(runnerRoot_ + "/" + image.substr(0, image.find(':')) + "/digest");
+        std::string digest;
+        if (!std::getline(in, digest) || digest.empty())
+            continue;
+        std::lock_guard<std::mutex> lock(digestMutex_);
+        if (digest != runner.digest)
+        {
+            LOG_INFO("Runner " << image << " was re-exported (" << runner.digest << " -> " << digest
+                               << "), caches keyed on it start over.");
+            runner.digest = digest;
+        }
+    }
+}
+
+std::string NativeExecutor::createCgroup()
+{
+    sweepCgroups();
+    const std::string path = cgroupRoot_ + "/run-" + std::to_string(getpid()) + "-" + std::to_string(sequence_++);
+    if (mkdir(path.c_str(), 0755) != 0)
+    {
+        LOG_ERROR("Cannot create cgroup " << path << ": " << strerror(errno));
+        return "";
+    }
+    if (!writeFile(path + "/memory.max", MEMORY_MAX) ||
+        !writeFile(path + "/pids.max", PIDS_MAX) ||
+        !writeFile(path + "/cpu.max", CPU_MAX))
+    {
+        LOG_ERROR("Cannot apply limits to cgroup " << path << ": " << strerror(errno));
+        rmdir(path.c_str());
+        return "";
+    }
+    // no swap accounting on some hosts, which is fine: nothing to limit then
+    writeFile(path + "/memory.swap.max", SWAP_MAX);
+    return path;
+}
+
+void NativeExecutor::destroyCgroup(const std::string &path)
+{
+    // pid 1 of the sandbox is gone, so the kernel is already killing the
+    // rest of its namespace; cgroup.kill makes sure. This runs on the
+    // supervisor thread, so a cgroup that is not empty yet is left for the
+    // next sweep instead of waited out.
+    writeFile(path + "/cgroup.kill", "1");
+    if (rmdir(path.c_str()) == 0 || errno == ENOENT)
+        return;
+    if (errno != EBUSY)
+    {
+        LOG_WARNING("Could not remove cgroup " << path << ": " << strerror(errno));
+        return;
+    }
+    std::lock_guard<std::mutex> lock(staleMutex_);
+    staleCgroups_.push_back(path);
+}
+
+void NativeExecutor::sweepCgroups()
+{
+    std::vector<std::string> stale;
+    {
+        std::lock_guard<std::mutex> lock(staleMutex_);
+        stale.swap(staleCgroups_);
+    }
+    for (const auto &path : stale)
+    {
+        if (rmdir(path.c_str()) == 0 || errno == ENOENT)
+            continue;
+        if (errno != EBUSY)
+        {
+            LOG_WARNING("Could not remove cgroup " << path << ": " << strerror(errno));
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(staleMutex_);
+        staleCgroups_.push_back(path);
+    }
+}
+
+void NativeExecutor::executeAsync(const SandboxRequest &request, Completion done)
+{
+    auto it = runners_.find(request.image);
+    if (it == runners_.end())
+    {
+        LOG_ERROR("No native runner for image " << request.image);
+        done(SandboxResult());
+        return;
+    }
+    const Runner &runner = it->second;
+
+    const std::string cgroup = createCgroup();
+    if (cgroup.empty())
+    {
+        done(SandboxResult());
+        return;
+    }
+    int cgroupFd = open(cgroup.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+    if (cgroupFd < 0)
+    {
+        LOG_ERROR("Cannot open cgroup " << cgroup << ": " << strerror(errno));
+        destroyCgroup(cgroup);
+        done(SandboxResult());
+        return;
+    }
+
+    std::vector<char *> argv;
+    for (const auto &arg : runner.args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+    std::vector<char *> envp;
+    for (const auto &var : runner.env)
+        envp.push_back(const_cast<char *>(var.c_str()));
+    envp.push_back(nullptr);
+
+    const std::string uidMap = "0 " + std::to_string(outerUid_) + " 1";
+    const std::string gidMap = "0 " + std::to_string(outerGid_) + " 1";
+
+    // The spawn runs on this thread and returns once the runner has been
+    // exec'd; everything after that is the supervisor's.
+    auto spawn = [&](int inFd, int outFd, SandboxResult &result) -> pid_t
+    {
+        int syncPipe[2];
+        int errPipe[2];
+        if (pipe2(syncPipe, O_CLOEXEC) != 0)
+        {
+            LOG_ERROR("pipe() failed: " << strerror(errno));
+            return -1;
+        }
+        if (pipe2(errPipe, O_CLOEXEC) != 0)
+        {
+            LOG_ERROR("pipe() failed: " << strerror(errno));
+            close(syncPipe[0]);
+            close(syncPipe[1]);
+            return -1;
+        }
+
+        ChildContext ctx{inFd, outFd, syncPipe[0], errPipe[1],
+                         runner.rootfs.c_str(), runner.tmpDir.c_str(), runner.procDir.c_str(), runner.devDir.c_str(),
+                         dataDir_.c_str(), runner.dataMount.c_str(), dataLockedFlags_,
+                         &runner.devNodes, &runner.devLinks, runner.lockedMountFlags,
+                         runner.workdir.c_str(), runner.executable.c_str(), argv.data(), envp.data(),
+                         &runner.seccomp};
+
+        clone_args args = {};
+        args.flags = CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWPID | CLONE_NEWNET | CLONE_NEWIPC |
+                     CLONE_NEWUTS | CLONE_NEWCGROUP | CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = static_cast<uint64_t>(cgroupFd);
+
+        const auto begin = std::chrono::steady_clock::now();
+        pid_t pid = static_cast<pid_t>(syscall(SYS_clone3, &args, sizeof(args)));
+        if (pid == 0)
+        {
+            close(syncPipe[1]);
+            close(errPipe[0]);
+            sandboxChild(ctx);
+        }
+        close(syncPipe[0]);
+        close(errPipe[1]);
+        if (pid < 0)
+        {
+            LOG_ERROR("clone3() failed: " << strerror(errno));
+            close(syncPipe[1]);
+            close(errPipe[0]);
+            return -1;
+        }
+
+        const std::string proc = "/proc/" + std::to_string(pid);
+        if (!writeFile(proc + "/setgroups", "deny") ||
+            !writeFile(proc + "/uid_map", uidMap) ||
+            !writeFile(proc + "/gid_map", gidMap))
+        {
+            LOG_ERROR("Cannot write id maps for sandbox " << pid << ": " << strerror(errno));
+            kill(pid, SIGKILL);
+        }
+        else if (write(syncPipe[1], "x", 1) != 1)
+        {
+            kill(pid, SIGKILL);
+        }
+        close(syncPipe[1]);
+
+        // the error pipe closes on a successful execve(), or carries the
+        // setup step that failed
+        int report[2] = {0, 0};
+        ssize_t n;
+        while ((n = read(errPipe[0], report, sizeof(report))) < 0 && errno == EINTR)
+        {
+        }
+        close(errPipe[0]);
+        if (n == 0)
+        {
+            result.startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        }
+        else if (n == sizeof(report))
+        {
+            LOG_ERROR("Sandbox setup failed for " << runner.image << " at step " << report[0] << ": " << strerror(report[1]));
+        }
+        return pid;
+    };
+
+    supervisor_.launch(request, spawn, [this, cgroupFd, cgroup, done = std::move(done)](SandboxResult result)
+                       {
+        if (result.launched)
+        {
+            readCgroupUsage(cgroupFd, result);
+        }
+        close(cgroupFd);
+        destroyCgroup(cgroup);
+
+        if (result.launched && result.exitCode != 0)
+        {
+            LOG_WARNING("Native sandbox exited with status " << result.exitCode);
+        }
+        done(std::move(result)); });
+}
@@ -0,0 +1,335 @@
+#include "OutputComparator.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // longest excerpt of each output in a summary
+    const size_t EXCERPT_BYTES = 40;
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    bool isLineBreak(char c)
+    {
+        return c == '\n' || c == '\r';
+    }
+
+    /**
+     * Length of the common prefix of a and b (both at least n long). With
+     * textOnly it also stops at the first byte at or below ' ', so callers
+     * can deal with whitespace themselves.
+     */
+    size_t commonPrefix(const char *a, const char *b, size_t n, bool textOnly)
+    {
+        size_t i = 0;
+#ifdef __SSE2__
+        const __m128i above = _mm_set1_epi8(' ' + 1);
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+            __m128i ok = _mm_cmpeq_epi8(va, vb);
+            if (textOnly)
+            {
+                // unsigned va >= ' ' + 1
+                ok = _mm_and_si128(ok, _mm_cmpeq_epi8(_mm_max_epu8(va, above), va));
+            }
+            const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ok));
+            if (mask != 0xffff)
+            {
+                return i + static_cast<size_t>(__builtin_ctz(~mask));
+            }
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            if (a[i] != b[i] || (textOnly && static_cast<unsigned char>(a[i]) <= ' '))
+                break;
+        }
+        return i;
+    }
+
+    /** Offset of the first byte at or below ' ' in [from, size), or size. */
+    size_t findControl(std::string_view s, size_t from)
+    {
+        size_t i = from;
+#ifdef __SSE2__
+        const __m128i above = _mm_set1_epi8(' ' + 1);
+        for (; i + 16 <= s.size(); i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i));
+            const unsigned text = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, above), v)));
+            if (text != 0xffff)
+            {
+                return i + static_cast<size_t>(__builtin_ctz(~text));
+            }
+        }
+#endif
+        for (; i < s.size(); ++i)
+        {
+            if (static_cast<unsigned char>(s[i]) <= ' ')
+                break;
+        }
+        return i;
+    }
+
+    size_t skipSpace(std::string_view s, size_t from)
+    {
+        while (from < s.size() && isSpace(s[from]))
+            from++;
+        return from;
+    }
+
+    size_t tokenEnd(std::string_view s, size_t from)
+    {
+        size_t i = from;
+        while (true)
+        {
+            i = findControl(s, i);
+            if (i == s.size() || isSpace(s[i]))
+                return i;
+            // another control character, part of the token
+            i++;
+        }
+    }
+
+    /**
+     * A whitespace run as Lines mode sees it: line breaks (\r\n counts as
+     * one) and whatever follows the last of them, i.e. the next line's
+     * indentation. Whitespace before a line break is dropped, and a run that
+     * ends the output counts for nothing.
+     */
+    struct Run
+    {
+        size_t end = 0;
+        size_t breaks = 0;
+        // verbatim part: the indentation after the last break, or the whole
+        // run if it has no break
+        size_t keptBegin = 0;
+        bool atEnd = false;
+    };
+
+    Run readRun(std::string_view s, size_t from)
+    {
+        Run run;
+        run.keptBegin = from;
+        size_t i = from;
+        while (i < s.size() && isSpace(s[i]))
+        {
+            if (isLineBreak(s[i]))
+            {
+                if (s[i] == '\r' && i + 1 < s.size() && s[i + 1] == '\n')
+                    i++;
+                run.breaks++;
+                run.keptBegin = i + 1;
+            }
+            i++;
+        }
+        run.end = i;
+        run.atEnd = i == s.size();
+        return run;
+    }
+
+    bool sameRun(std::string_view a, const Run &ra, std::string_view b, const Run &rb)
+    {
+        if (ra.atEnd || rb.atEnd)
+            return ra.atEnd && rb.atEnd;
+        return ra.breaks == rb.breaks && a.substr(ra.keptBegin, ra.end - ra.keptBegin) == b.substr(rb.keptBegin, rb.end - rb.keptBegin);
+    }
+
+    bool parseNumber(std::string_view token, double &value)
+    {
+        const char *begin = token.data();
+        const char *end = token.data() + token.size();
+        if (begin != end && *begin == '+')
+            begin++;
+        const auto parsed = std::from_chars(begin, end, value);
+        return parsed.ec == std::errc() && parsed.ptr == end && std::isfinite(value);
+    }
+
+    bool sameToken(std::string_view expected, std::string_view actual, const CompareOptions &options)
+    {
+        if (expected == actual)
+            return true;
+        if (options.absTolerance <= 0 && options.relTolerance <= 0)
+            return false;
+        double e = 0;
+        double a = 0;
+        if (!parseNumber(expected, e) || !parseNumber(actual, a))
+            return false;
+        const double difference = std::fabs(a - e);
+        return difference <= options.absTolerance || difference <= options.relTolerance * std::fabs(e);
+    }
+
+    std::string excerpt(std::string_view s, size_t at)
+    {
+        if (at >= s.size())
+            return "";
+        size_t end = std::min(s.size(), at + EXCERPT_BYTES);
+        const size_t lineBreak = s.substr(at, end - at).find_first_of("\r\n");
+        if (lineBreak != std::string_view::npos && lineBreak > 0)
+            end = at + lineBreak;
+        // never split a UTF-8 sequence; the excerpt goes into a JSON verdict
+        while (end < s.size() && end > at && (static_cast<unsigned char>(s[end]) & 0xc0) == 0x80)
+            end--;
+        size_t begin = at;
+        while (begin > 0 && begin < end && (static_cast<unsigned char>(s[begin]) & 0xc0) == 0x80)
+            begin--;
+        return std::string(s.substr(begin, end - begin));
+    }
+
+    CompareResult difference(std::string_view expected, size_t e, std::string_view actual, size_t a)
+    {
+        CompareResult result;
+        result.equal = false;
+        result.expectedOffset = e;
+        result.actualOffset = a;
+        const std::string_view before = expected.substr(0, e);
+        result.line = 1 + static_cast<size_t>(std::count(before.begin(), before.end(), '\n'));
+        const size_t lineStart = before.find_last_of('\n');
+        result.column = lineStart == std::string_view::npos ? e + 1 : e - lineStart;
+        result.expectedExcerpt = excerpt(expected, e);
+        result.actualExcerpt = excerpt(actual, a);
+        return result;
+    }
+
+    CompareResult compareExact(std::string_view expected, std::string_view actual)
+    {
+        const size_t n = std::min(expected.size(), actual.size());
+        const size_t i = commonPrefix(expected.data(), actual.data(), n, false);
+        if (i == n && expected.size() == actual.size())
+            return CompareResult();
+        return difference(expected, i, actual, i);
+    }
+
+    CompareResult compareLines(std::string_view expected, std::string_view actual)
+    {
+        size_t e = skipSpace(expected, 0);
+        size_t a = skipSpace(actual, 0);
+        while (true)
+        {
+            const size_t n = std::min(expected.size() - e, actual.size() - a);
+            const size_t same = commonPrefix(expected.data() + e, actual.data() + a, n, true);
+            e += same;
+            a += same;
+
+            const bool expectedDone = e == expected.size();
+            const bool actualDone = a == actual.size();
+            if (expectedDone && actualDone)
+                return CompareResult();
+
+            const bool expectedSpace = !expectedDone && isSpace(expected[e]);
+            const bool actualSpace = !actualDone && isSpace(actual[a]);
+            if (expectedSpace || actualSpace)
+            {
+                const Run re = readRun(expected, e);
+                const Run ra = readRun(actual, a);
+                if (!sameRun(expected, re, actual, ra))
+                    return difference(expected, e, actual, a);
+                e = re.end;
+                a = ra.end;
+                continue;
+            }
+            // a control character that is not whitespace, compared as text
+            if (!expectedDone && !actualDone && expected[e] == actual[a])
+            {
+                e++;
+                a++;
+                continue;
+            }
+            return difference(expected, e, actual, a);
+        }
+    }
+
+    CompareResult compareTokens(std::string_view expected, std::string_view actual, const CompareOptions &options)
+    {
+        size_t e = skipSpace(expected, 0);
+        size_t a = skipSpace(actual, 0);
+        while (e < expected.size() && a < actual.size())
+        {
+            const size_t eEnd = tokenEnd(expected, e);
+            const size_t aEnd = tokenEnd(actual, a);
+            if (!sameToken(expected.substr(e, eEnd - e), actual.substr(a, aEnd - a), options))
+                return difference(expected, e, actual, a);
+            e = skipSpace(expected, eEnd);
+            a = skipSpace(actual, aEnd);
+        }
+        if (e < expected.size() || a < actual.size())
+            return difference(expected, e, actual, a);
+        return CompareResult();
+    }
+
+    void appendQuoted(std::string &out, const std::string &text)
+    {
+        out += '"';
+        for (char c : text)
+        {
+            if (c == '\n')
+                out += "\\n";
+            else if (c == '\r')
+                out += "\\r";
+            else if (c == '\t')
+                out += "\\t";
+            else
+            {
+                if (c == '"' || c == '\\')
+                    out += '\\';
+                out += c;
+            }
+        }
+        out += '"';
+    }
+}
+
+bool parseCompareMode(std::string_view name, CompareMode &mode)
+{
+    if (name == "exact")
+        mode = CompareMode::Exact;
+    else if (name == "lines")
+        mode = CompareMode::Lines;
+    else if (name == "tokens")
+        mode = CompareMode::Tokens;
+    else
+        return false;
+    return true;
+}
+
+std::string CompareResult::summary() const
+{
+    if (equal)
+        return "";
+    std::string out = "line " + std::to_string(line) + ", column " + std::to_string(column) + ": expected ";
+    if (expectedExcerpt.empty())
+        out += "end of output";
+    else
+        appendQuoted(out, expectedExcerpt);
+    out += ", got ";
+    if (actualExcerpt.empty())
+        out += "end of output";
+    else
+        appendQuoted(out, actualExcerpt);
+    return out;
+}
+
+CompareResult compareOutputs(std::string_view expected, std::string_view actual, const CompareOptions &options)
+{
+    switch (options.mode)
+    {
+    case CompareMode::Exact:
+        return compareExact(expected, actual);
+    case CompareMode::Tokens:
+        return compareTokens(expected, actual, options);
+    default:
+        return compareLines(expected, actual);
+    }
+}
@@ -0,0 +1,297 @@
+#include "PlagiarismIndex.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <limits>
+#include <tuple>
+
+namespace
+{
+    // rough footprint of an indexed submission: its hashes, their posting
+    // entries and the nodes holding them
+    uint64_t entryBytes(const Fingerprint &fingerprint)
+    {
+        return 64 + fingerprint.size() * (sizeof(uint32_t) + sizeof(int64_t) + 16);
+    }
+
+    double dice(size_t shared, size_t a, size_t b)
+    {
+        return a + b > 0 ? 2.0 * static_cast<double>(shared) / static_cast<double>(a + b) : 0.0;
+    }
+}
+
+PlagiarismIndex::PlagiarismIndex(uint64_t maxBytes, size_t threads, double commonShare)
+    : maxBytes_(maxBytes), commonShare_(commonShare), workers_(std::max<size_t>(1, threads))
+{
+}
+
+PlagiarismIndex::AssignmentPtr PlagiarismIndex::assignment(int64_t assignmentId, bool create)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = assignments_.find(assignmentId);
+    if (it != assignments_.end())
+    {
+        lru_.splice(lru_.begin(), lru_, it->second->position);
+        return it->second;
+    }
+    if (!create)
+    {
+        return nullptr;
+    }
+    auto created = std::make_shared<Assignment>();
+    lru_.push_front(assignmentId);
+    created->position = lru_.begin();
+    assignments_[assignmentId] = created;
+    stats_.assignments = assignments_.size();
+    return created;
+}
+
+size_t PlagiarismIndex::commonLimit(const Assignment &a) const
+{
+    const size_t submissions = a.fingerprints.size();
+    if (submissions < MIN_FOR_COMMON)
+    {
+        return std::numeric_limits<size_t>::max();
+    }
+    return std::max<size_t>(2, static_cast<size_t>(commonShare_ * static_cast<double>(submissions)));
+}
+
+void PlagiarismIndex::add(int64_t assignmentId, int64_t submissionId, Fingerprint fingerprint)
+{
+    AssignmentPtr a = assignment(assignmentId, true);
+    int64_t delta = 0;
+    bool added = false;
+    {
+        std::unique_lock<std::shared_mutex> lock(a->mutex);
+        auto existing = a->fingerprints.find(submissionId);
+        if (existing != a->fingerprints.end())
+        {
+            for (uint32_t hash : existing->second)
+            {
+                auto &list = a->postings[hash];
+                list.erase(std::remove(list.begin(), list.end(), submissionId), list.end());
+                if (list.empty())
+                    a->postings.erase(hash);
+            }
+            delta -= static_cast<int64_t>(entryBytes(existing->second));
+        }
+        else
+        {
+            added = true;
+        }
+        for (uint32_t hash : fingerprint)
+        {
+            a->postings[hash].push_back(submissionId);
+        }
+        delta += static_cast<int64_t>(entryBytes(fingerprint));
+        a->bytes = static_cast<uint64_t>(static_cast<int64_t>(a->bytes) + delta);
+        a->fingerprints[submissionId] = std::move(fingerprint);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.bytes = static_cast<uint64_t>(static_cast<int64_t>(stats_.bytes) + delta);
+    if (added)
+        stats_.submissions++;
+    evictLocked();
+}
+
+bool PlagiarismIndex::contains(int64_t assignmentId, int64_t submissionId) const
+{
+    AssignmentPtr a;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = assignments_.find(assignmentId);
+        if (it == assignments_.end())
+            return false;
+        a = it->second;
+    }
+    std::shared_lock<std::shared_mutex> lock(a->mutex);
+    return a->fingerprints.count(submissionId) > 0;
+}
+
+std::vector<PlagiarismIndex::Match> PlagiarismIndex::query(int64_t assignmentId, const Fingerprint &fingerprint,
+                                                           int64_t exclude, double minSimilarity)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.queries++;
+    }
+    std::vector<Match> matches;
+    AssignmentPtr a = assignment(assignmentId, false);
+    if (!a)
+    {
+        return matches;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(a->mutex);
+    const size_t limit = commonLimit(*a);
+    std::unordered_map<int64_t, size_t> shared;
+    size_t size = 0;
+    for (uint32_t hash : fingerprint)
+    {
+        auto it = a->postings.find(hash);
+        if (it != a->postings.end() && it->second.size() > limit)
+            continue;
+        size++;
+        if (it == a->postings.end())
+            continue;
+        for (int64_t submissionId : it->second)
+        {
+            if (submissionId != exclude)
+                shared[submissionId]++;
+        }
+    }
+
+    for (const auto &[submissionId, count] : shared)
+    {
+        // the other has at least `count` hashes, which bounds the similarity
+        // without counting its common ones
+        if (dice(count, size, count) < minSimilarity)
+            continue;
+        const Fingerprint &other = a->fingerprints.at(submissionId);
+        size_t otherSize = other.size();
+        if (limit != std::numeric_limits<size_t>::max())
+        {
+            otherSize = static_cast<size_t>(std::count_if(other.begin(), other.end(), [&](uint32_t hash)
+                                                          { return a->postings.at(hash).size() <= limit; }));
+        }
+        const double similarity = dice(count, size, otherSize);
+        if (similarity >= minSimilarity)
+            matches.push_back({submissionId, similarity});
+    }
+    std::sort(matches.begin(), matches.end(), [](const Match &x, const Match &y)
+              { return x.similarity > y.similarity || (x.similarity == y.similarity && x.submissionId < y.submissionId); });
+    return matches;
+}
+
+std::vector<PlagiarismIndex::Pair> PlagiarismIndex::allPairs(int64_t assignmentId, double minSimilarity)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.reports++;
+    }
+    std::vector<Pair> pairs;
+    AssignmentPtr a = assignment(assignmentId, false);
+    if (!a)
+    {
+        return pairs;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(a->mutex);
+    const size_t limit = commonLimit(*a);
+
+    // submissions numbered in id order, and postings in those numbers
+    // without the common hashes, each list ascending
+    std::vector<int64_t> ids;
+    ids.reserve(a->fingerprints.size());
+    for (const auto &entry : a->fingerprints)
+        ids.push_back(entry.first);
+    std::sort(ids.begin(), ids.end());
+    const size_t n = ids.size();
+    std::vector<std::vector<uint32_t>> hashes(n);
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        for (uint32_t hash : a->fingerprints.at(ids[i]))
+        {
+            if (a->postings.at(hash).size() > limit)
+                continue;
+            hashes[i].push_back(hash);
+            postings[hash].push_back(i);
+        }
+    }
+
+    // Each task takes a slice of first submissions and counts, through the
+    // postings, what every later one shares with it.
+    struct Report
+    {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t pending = 0;
+        std::vector<Pair> pairs;
+    } report;
+    const size_t slices = std::min<size_t>(n, workers_.stats().workers * 8);
+    const size_t sliceSize = slices > 0 ? (n + slices - 1) / slices : 0;
+    for (size_t begin = 0; begin < n; begin += sliceSize)
+    {
+        const size_t end = std::min(n, begin + sliceSize);
+        {
+            std::lock_guard<std::mutex> reportLock(report.mutex);
+            report.pending++;
+        }
+        workers_.submit([&, begin, end](const CancellationToken &)
+                        {
+            std::vector<Pair> found;
+            std::vector<uint32_t> shared(n, 0);
+            std::vector<uint32_t> touched;
+            for (size_t i = begin; i < end; ++i)
+            {
+                for (uint32_t hash : hashes[i])
+                {
+                    const std::vector<uint32_t> &list = postings.at(hash);
+                    for (auto j = std::upper_bound(list.begin(), list.end(), static_cast<uint32_t>(i)); j != list.end(); ++j)
+                    {
+                        if (shared[*j]++ == 0)
+                            touched.push_back(*j);
+                    }
+                }
+                for (uint32_t j : touched)
+                {
+                    const double similarity = dice(shared[j], hashes[i].size(), hashes[j].size());
+                    if (similarity >= minSimilarity)
+                        found.push_back({ids[i], ids[j], similarity});
+                    shared[j] = 0;
+                }
+                touched.clear();
+            }
+            std::lock_guard<std::mutex> reportLock(report.mutex);
+            report.pairs.insert(report.pairs.end(), found.begin(), found.end());
+            if (--report.pending == 0)
+                report.done.notify_all(); });
+    }
+    {
+        std::unique_lock<std::mutex> reportLock(report.mutex);
+        report.done.wait(reportLock, [&]
+                         { return report.pending == 0; });
+    }
+
+    pairs = std::move(report.pairs);
+    std::sort(pairs.begin(), pairs.end(), [](const Pair &x, const Pair &y)
+              { return x.similarity > y.similarity ||
+                       (x.similarity == y.similarity && std::tie(x.first, x.second) < std::tie(y.first, y.second)); });
+    return pairs;
+}
+
+void PlagiarismIndex::evictLocked()
+{
+    auto it = lru_.end();
+    while (stats_.bytes > maxBytes_ && it != lru_.begin())
+    {
+        --it;
+        auto node = assignments_.find(*it);
+        // a query or report is using it
+        if (node->second.use_count() > 1)
+            continue;
+        stats_.bytes -= node->second->bytes;
+        stats_.submissions -= node->second->fingerprints.size();
+        assignments_.erase(node);
+        it = lru_.erase(it);
+        stats_.evictions++;
+    }
+    stats_.assignments = assignments_.size();
+}
+
+PlagiarismIndex::Stats PlagiarismIndex::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void PlagiarismIndex::logStats() const
+{
+    const Stats s = stats();
+    LOG_INFO("Plagiarism index: assignments=" << s.assignments << " submissions=" << s.submissions
+                                              << " bytes=" << s.bytes << "/" << maxBytes_ << " queries=" << s.queries
+                                              << " reports=" << s.reports << " evictions=" << s.evictions);
+}
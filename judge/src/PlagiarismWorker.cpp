@@ -0,0 +1,179 @@
+#include "PlagiarismWorker.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+
+using json = nlohmann::json;
+
+namespace
+{
+    bool readId(const json &object, const char *key, int64_t &id)
+    {
+        auto it = object.find(key);
+        if (it == object.end() || !it->is_number_integer())
+            return false;
+        id = it->get<int64_t>();
+        return true;
+    }
+
+    double minSimilarity(const json &job, double fallback)
+    {
+        auto it = job.find("minSimilarity");
+        return it != job.end() && it->is_number() ? it->get<double>() : fallback;
+    }
+
+    json error(const std::string &message)
+    {
+        return {{"status", "error"}, {"message", message}};
+    }
+}
+
+bool PlagiarismWorker::handles(const std::string &jobId)
+{
+    return jobId.compare(0, std::char_traits<char>::length(JOB_PREFIX), JOB_PREFIX) == 0;
+}
+
+PlagiarismWorker::PlagiarismWorker(PlagiarismIndex &index) : index_(index)
+{
+}
+
+void PlagiarismWorker::processJob(const std::string &jobId, const std::string &payload, const JobAck &ack, Done done)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    const json job = json::parse(payload, nullptr, false);
+    std::string action = "invalid";
+    json answer;
+    if (!job.is_object())
+    {
+        answer = error("Payload is not a JSON object.");
+    }
+    else
+    {
+        action = job.value("action", std::string("check"));
+        if (action == "check")
+            answer = check(job);
+        else if (action == "report")
+            answer = report(job);
+        else
+            answer = error("Unknown action '" + action + "'.");
+    }
+
+    const std::string status = answer.value("status", std::string("error"));
+    if (status == "error")
+    {
+        LOG_WARNING("Plagiarism job " << jobId << ": " << answer.value("message", std::string()));
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    METRICS()->counter("judge_plagiarism_jobs_total", "Plagiarism jobs answered.", {{"action", action}, {"status", status}}).inc();
+    METRICS()->histogram("judge_plagiarism_seconds", "Time to answer a plagiarism job.", {{"action", action}})
+        .observeMs(ms);
+    LOG_INFO("Job processed" << kv("jobId", jobId) << kv("mode", "plagiarism") << kv("action", action)
+                             << kv("status", status) << kv("ms", ms));
+
+    const bool published = REDIS()->publishVerdict("judge:plagiarism:verdict:" + jobId, answer.dump(), 3600, ack);
+    done(published);
+}
+
+json PlagiarismWorker::check(const json &job)
+{
+    int64_t assignmentId = 0;
+    int64_t submissionId = 0;
+    if (!readId(job, "assignmentId", assignmentId) || !readId(job, "submissionId", submissionId))
+    {
+        return error("assignmentId and submissionId must be integers.");
+    }
+    auto code = job.find("code");
+    if (code == job.end() || !code->is_string())
+    {
+        return error("No code to check.");
+    }
+
+    auto existing = job.find("existing");
+    if (existing != job.end() && existing->is_array())
+    {
+        for (const json &prior : *existing)
+        {
+            int64_t priorId = 0;
+            if (!prior.is_object() || !readId(prior, "id", priorId) || index_.contains(assignmentId, priorId))
+                continue;
+            addSubmission(assignmentId, prior);
+        }
+    }
+
+    const Fingerprint own = fingerprint(code->get_ref<const std::string &>(), job.value("language", std::string("cpp")));
+    index_.add(assignmentId, submissionId, own);
+    json results = json::array();
+    for (const PlagiarismIndex::Match &match : index_.query(assignmentId, own, submissionId, minSimilarity(job, 0)))
+    {
+        results.push_back({{"compared_submission", match.submissionId}, {"similarity", match.similarity}});
+    }
+    return {{"status", "completed"}, {"fingerprint", own}, {"results", std::move(results)}};
+}
+
+json PlagiarismWorker::report(const json &job)
+{
+    int64_t assignmentId = 0;
+    if (!readId(job, "assignmentId", assignmentId))
+    {
+        return error("assignmentId must be an integer.");
+    }
+    size_t skipped = 0;
+    auto submissions = job.find("submissions");
+    if (submissions != job.end() && submissions->is_array())
+    {
+        for (const json &submission : *submissions)
+        {
+            if (!submission.is_object() || !addSubmission(assignmentId, submission))
+                skipped++;
+        }
+    }
+    if (skipped > 0)
+    {
+        LOG_WARNING("Plagiarism report for assignment " << assignmentId << " skipped " << skipped
+                                                        << " submissions without an id and code or fingerprint.");
+    }
+
+    const auto pairs = index_.allPairs(assignmentId, minSimilarity(job, 0.3));
+    json answer = {{"status", "completed"}, {"skipped", skipped}, {"pairs", json::array()}};
+    json &list = answer["pairs"];
+    for (const PlagiarismIndex::Pair &pair : pairs)
+    {
+        list.push_back({{"first", pair.first}, {"second", pair.second}, {"similarity", pair.similarity}});
+    }
+    return answer;
+}
+
+bool PlagiarismWorker::addSubmission(int64_t assignmentId, const json &submission)
+{
+    int64_t id = 0;
+    if (!readId(submission, "id", id))
+    {
+        return false;
+    }
+    auto code = submission.find("code");
+    if (code != submission.end() && code->is_string())
+    {
+        index_.add(assignmentId, id,
+                   fingerprint(code->get_ref<const std::string &>(), submission.value("language", std::string("cpp"))));
+        return true;
+    }
+    auto stored = submission.find("fingerprint");
+    if (stored == submission.end() || !stored->is_array())
+    {
+        return false;
+    }
+    Fingerprint hashes;
+    hashes.reserve(stored->size());
+    for (const json &hash : *stored)
+    {
+        if (hash.is_number_unsigned() || hash.is_number_integer())
+            hashes.push_back(static_cast<uint32_t>(hash.get<int64_t>()));
+    }
+    // as the server stored it: sorted and unique, unless it came from elsewhere
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    index_.add(assignmentId, id, std::move(hashes));
+    return true;
+}
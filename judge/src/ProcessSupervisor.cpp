@@ -0,0 +1,476 @@
+#include "ProcessSupervisor.h"
+#include "SandboxExecutor.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+namespace
+{
+    // largest pipe a non-root judge may ask for by default
+    // (/proc/sys/fs/pipe-max-size)
+    const int MAX_PIPE_SIZE = 1 << 20;
+    const size_t READ_CHUNK = 64 * 1024;
+    const int MAX_EVENTS = 64;
+
+    // what an epoll event refers to, kept in the low bits of its data
+    enum Kind : uint64_t
+    {
+        KIND_WAKE = 0,
+        KIND_OUTPUT = 1,
+        KIND_INPUT = 2,
+        KIND_EXIT = 3,
+    };
+
+    void closeFd(int &fd)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    // Dropped from epoll explicitly: a sibling forked in the meantime may
+    // still hold a copy of the fd until it execs, which would keep the
+    // registration alive past close().
+    void unwatch(int epollFd, int &fd)
+    {
+        if (fd >= 0)
+        {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            closeFd(fd);
+        }
+    }
+
+    int pidfdOpen(pid_t pid)
+    {
+        return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    }
+
+    // unlike kill(), can never hit a recycled pid
+    void pidfdKill(int pidFd)
+    {
+        syscall(SYS_pidfd_send_signal, pidFd, SIGKILL, nullptr, 0);
+    }
+
+    /**
+     * Pushes as much of the input as the pipe takes without blocking.
+     * vmsplice() hands the pages to the pipe instead of copying them; the
+     * input outlives the child, so the reader can never see them change.
+     * Falls back to writev() where vmsplice is refused.
+     * @param offset bytes of head + tail already written
+     * @return false once the reader is gone (EPIPE) or on a hard error.
+     */
+    bool pushInput(int fd, std::string_view head, std::string_view tail, size_t &offset, bool &useVmsplice)
+    {
+        while (offset < head.size() + tail.size())
+        {
+            iovec iov[2];
+            int count = 0;
+            if (offset < head.size())
+                iov[count++] = {const_cast<char *>(head.data()) + offset, head.size() - offset};
+            const size_t tailOffset = offset > head.size() ? offset - head.size() : 0;
+            if (tailOffset < tail.size())
+                iov[count++] = {const_cast<char *>(tail.data()) + tailOffset, tail.size() - tailOffset};
+
+            ssize_t n;
+            if (useVmsplice)
+            {
+                n = vmsplice(fd, iov, count, SPLICE_F_NONBLOCK);
+                if (n < 0 && (errno == EINVAL || errno == ENOSYS || errno == EPERM))
+                {
+                    useVmsplice = false;
+                    continue;
+                }
+            }
+            else
+            {
+                n = writev(fd, iov, count);
+            }
+
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return errno == EAGAIN;
+            }
+            offset += static_cast<size_t>(n);
+        }
+        return true;
+    }
+}
+
+struct ProcessSupervisor::Child
+{
+    uint64_t id = 0;
+    pid_t pid = -1;
+    int pidFd = -1;
+    int inFd = -1;
+    int outFd = -1;
+
+    std::string_view input;
+    std::string_view inputTail;
+    size_t offset = 0;
+    bool useVmsplice = true;
+
+    const CancellationToken *cancel = nullptr;
+    CancellationToken::Registration killOnCancel;
+    bool hasDeadline = false;
+    std::multimap<std::chrono::steady_clock::time_point, uint64_t>::iterator deadline;
+    bool timedOut = false;
+
+    SandboxResult result;
+    Completion done;
+};
+
+ProcessSupervisor::ProcessSupervisor()
+{
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd_ < 0 || wakeFd_ < 0)
+    {
+        LOG_ERROR("Cannot create the sandbox supervisor loop: " << strerror(errno));
+        return;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = KIND_WAKE;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+    thread_ = std::thread(&ProcessSupervisor::loop, this);
+}
+
+ProcessSupervisor::~ProcessSupervisor()
+{
+    stop_ = true;
+    if (wakeFd_ >= 0)
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+
+    // only at shutdown: nothing is left to hand a result to
+    if (!children_.empty())
+    {
+        LOG_WARNING("Killing " << children_.size() << " sandboxes still running at shutdown.");
+    }
+    for (auto &entry : children_)
+    {
+        Child &child = *entry.second;
+        child.killOnCancel = CancellationToken::Registration();
+        pidfdKill(child.pidFd);
+        siginfo_t info{};
+        waitid(static_cast<idtype_t>(P_PIDFD), static_cast<id_t>(child.pidFd), &info, WEXITED);
+        closeFd(child.pidFd);
+        closeFd(child.inFd);
+        closeFd(child.outFd);
+    }
+    children_.clear();
+
+    closeFd(epollFd_);
+    closeFd(wakeFd_);
+}
+
+void ProcessSupervisor::launch(const SandboxRequest &request, const Spawn &spawn, Completion done)
+{
+    auto child = std::make_unique<Child>();
+    child->input = request.input;
+    child->inputTail = request.inputTail;
+    child->cancel = request.cancel;
+    child->done = std::move(done);
+
+    auto fail = [&child]
+    {
+        Completion done = std::move(child->done);
+        SandboxResult result = std::move(child->result);
+        result.launched = false;
+        done(std::move(result));
+    };
+
+    if (epollFd_ < 0)
+    {
+        fail();
+        return;
+    }
+
+    // O_CLOEXEC: sandboxes started concurrently by other threads must not
+    // inherit this one's pipe ends
+    int inPipe[2] = {-1, -1};
+    int outPipe[2] = {-1, -1};
+    if (pipe2(inPipe, O_CLOEXEC) != 0 || pipe2(outPipe, O_CLOEXEC) != 0)
+    {
+        LOG_ERROR("pipe() failed: " << strerror(errno));
+        closeFd(inPipe[0]);
+        closeFd(inPipe[1]);
+        fail();
+        return;
+    }
+
+    const size_t inputSize = request.input.size() + request.inputTail.size();
+    // a pipe that holds the whole input lets the first vmsplice hand it all
+    // over in one call
+    if (inputSize > 65536)
+    {
+        fcntl(inPipe[1], F_SETPIPE_SZ, static_cast<int>(std::min<size_t>(inputSize, MAX_PIPE_SIZE)));
+    }
+
+    const auto spawnBegin = std::chrono::steady_clock::now();
+    child->pid = spawn(inPipe[0], outPipe[1], child->result);
+    child->result.spawnMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - spawnBegin).count();
+    closeFd(inPipe[0]);
+    closeFd(outPipe[1]);
+    if (child->pid < 0)
+    {
+        closeFd(inPipe[1]);
+        closeFd(outPipe[0]);
+        fail();
+        return;
+    }
+
+    child->pidFd = pidfdOpen(child->pid);
+    if (child->pidFd < 0)
+    {
+        // pidfds need Linux 5.3; without one the exit cannot be watched
+        LOG_ERROR("pidfd_open() failed: " << strerror(errno));
+        kill(child->pid, SIGKILL);
+        while (waitpid(child->pid, nullptr, 0) < 0 && errno == EINTR)
+        {
+        }
+        closeFd(inPipe[1]);
+        closeFd(outPipe[0]);
+        fail();
+        return;
+    }
+    child->result.launched = true;
+
+    child->inFd = inPipe[1];
+    child->outFd = outPipe[0];
+    fcntl(child->inFd, F_SETFL, O_NONBLOCK);
+    fcntl(child->outFd, F_SETFL, O_NONBLOCK);
+    if (inputSize == 0)
+    {
+        closeFd(child->inFd);
+    }
+    child->result.output.reserve(outputSizeHint_);
+
+    if (request.cancel)
+    {
+        // the pid fd stays open until the registration is gone, see finish()
+        child->killOnCancel = request.cancel->onCancel([pidFd = child->pidFd]
+                                                       { pidfdKill(pidFd); });
+    }
+
+    // Registered last, so the loop never sees a half set-up child; the loop
+    // only looks children up under the mutex.
+    Child *raw = child.get();
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        raw->id = nextId_++;
+        if (request.deadline != std::chrono::steady_clock::time_point())
+        {
+            wake = deadlines_.empty() || request.deadline < deadlines_.begin()->first;
+            raw->deadline = deadlines_.emplace(request.deadline, raw->id);
+            raw->hasDeadline = true;
+        }
+        children_.emplace(raw->id, std::move(child));
+        running_++;
+
+        auto watch = [this, raw](int fd, uint32_t events, uint64_t kind)
+        {
+            epoll_event event{};
+            event.events = events;
+            event.data.u64 = (raw->id << 2) | kind;
+            return epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == 0;
+        };
+        watch(raw->pidFd, EPOLLIN, KIND_EXIT);
+        watch(raw->outFd, EPOLLIN, KIND_OUTPUT);
+        if (raw->inFd >= 0)
+        {
+            watch(raw->inFd, EPOLLOUT, KIND_INPUT);
+        }
+    }
+
+    // an earlier deadline than the one the loop is sleeping towards
+    if (wake)
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+int ProcessSupervisor::nextTimeoutMs()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (deadlines_.empty())
+    {
+        return -1;
+    }
+    const auto left = deadlines_.begin()->first - std::chrono::steady_clock::now();
+    // rounded up, so the loop never wakes just before the deadline
+    const auto ms = std::chrono::ceil<std::chrono::milliseconds>(left).count();
+    return static_cast<int>(std::clamp<long long>(ms, 0, 60000));
+}
+
+void ProcessSupervisor::loop()
+{
+    epoll_event events[MAX_EVENTS];
+    while (!stop_)
+    {
+        const int count = epoll_wait(epollFd_, events, MAX_EVENTS, nextTimeoutMs());
+        if (count < 0 && errno != EINTR)
+        {
+            LOG_ERROR("epoll_wait() failed: " << strerror(errno));
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            const uint64_t kind = events[i].data.u64 & 3;
+            const uint64_t id = events[i].data.u64 >> 2;
+            if (kind == KIND_WAKE)
+            {
+                uint64_t ignored;
+                while (read(wakeFd_, &ignored, sizeof(ignored)) > 0)
+                {
+                }
+                continue;
+            }
+
+            Child *child = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = children_.find(id);
+                if (it != children_.end())
+                    child = it->second.get();
+            }
+            // a stale event for a child finished earlier in this batch
+            if (child)
+            {
+                handle(*child, static_cast<int>(kind), events[i].events);
+            }
+        }
+
+        // Deadlines are only enforced here: the kill makes the pid fd
+        // readable, and the child is finished like any other exit.
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto now = std::chrono::steady_clock::now();
+        while (!deadlines_.empty() && deadlines_.begin()->first <= now)
+        {
+            Child &child = *children_.at(deadlines_.begin()->second);
+            deadlines_.erase(deadlines_.begin());
+            child.hasDeadline = false;
+            child.timedOut = true;
+            pidfdKill(child.pidFd);
+        }
+    }
+}
+
+void ProcessSupervisor::handle(Child &child, int kind, uint32_t events)
+{
+    if (kind == KIND_INPUT)
+    {
+        // EPOLLERR/EPOLLHUP: the runner closed stdin or died, the rest of
+        // the input is not wanted
+        if (!(events & EPOLLOUT) ||
+            !pushInput(child.inFd, child.input, child.inputTail, child.offset, child.useVmsplice) ||
+            child.offset == child.input.size() + child.inputTail.size())
+        {
+            unwatch(epollFd_, child.inFd);
+        }
+    }
+    else if (kind == KIND_OUTPUT)
+    {
+        drainOutput(child);
+    }
+    else if (kind == KIND_EXIT)
+    {
+        // Whatever the child wrote is in the pipe by now. Anything it left
+        // running that still holds the pipe is not waited for.
+        drainOutput(child);
+        finish(child.id);
+    }
+}
+
+void ProcessSupervisor::drainOutput(Child &child)
+{
+    while (child.outFd >= 0)
+    {
+        std::string &output = child.result.output;
+        const size_t used = output.size();
+        output.resize(used + READ_CHUNK);
+        ssize_t n = read(child.outFd, &output[used], READ_CHUNK);
+        output.resize(used + (n > 0 ? static_cast<size_t>(n) : 0));
+        if (n > 0)
+            continue;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0 || errno != EAGAIN)
+        {
+            unwatch(epollFd_, child.outFd);
+        }
+        return;
+    }
+}
+
+void ProcessSupervisor::finish(uint64_t id)
+{
+    std::unique_ptr<Child> child;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = children_.find(id);
+        child = std::move(it->second);
+        children_.erase(it);
+        if (child->hasDeadline)
+        {
+            deadlines_.erase(child->deadline);
+        }
+    }
+
+    // Deregistered while the child is not reaped yet, so a late cancel()
+    // still signals the right process.
+    child->killOnCancel = CancellationToken::Registration();
+    unwatch(epollFd_, child->inFd);
+    unwatch(epollFd_, child->outFd);
+
+    SandboxResult &result = child->result;
+    result.cancelled = child->timedOut || (child->cancel && child->cancel->cancelled());
+
+    siginfo_t info{};
+    while (waitid(static_cast<idtype_t>(P_PIDFD), static_cast<id_t>(child->pidFd), &info, WEXITED) < 0)
+    {
+        if (errno != EINTR)
+        {
+            LOG_ERROR("waitid() failed: " << strerror(errno));
+            break;
+        }
+    }
+    result.exitCode = info.si_code == CLD_EXITED ? info.si_status : -1;
+    unwatch(epollFd_, child->pidFd);
+
+    outputSizeHint_ = std::max(READ_CHUNK, result.output.size() + READ_CHUNK);
+    running_--;
+    child->done(std::move(result));
+}
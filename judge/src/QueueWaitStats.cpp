@@ -0,0 +1,63 @@
+#include "QueueWaitStats.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+constexpr std::array<uint64_t, 12> QueueWaitStats::BOUNDS_MS;
+
+uint64_t QueueWaitStats::Histogram::percentileMs(double quantile) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    const uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BOUNDS_MS.size(); ++i)
+    {
+        seen += buckets[i];
+        if (seen > rank || seen == count)
+        {
+            return std::min(BOUNDS_MS[i], maxMs);
+        }
+    }
+    return maxMs;
+}
+
+void QueueWaitStats::record(JobClass jobClass, uint64_t waitMs, bool missedDeadline)
+{
+    const size_t bucket = static_cast<size_t>(
+        std::lower_bound(BOUNDS_MS.begin(), BOUNDS_MS.end(), waitMs) - BOUNDS_MS.begin());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Histogram &h = histograms_[static_cast<size_t>(jobClass)];
+    h.buckets[bucket]++;
+    h.count++;
+    h.totalMs += waitMs;
+    h.maxMs = std::max(h.maxMs, waitMs);
+    if (missedDeadline)
+        h.missedDeadline++;
+}
+
+QueueWaitStats::Histogram QueueWaitStats::histogram(JobClass jobClass) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return histograms_[static_cast<size_t>(jobClass)];
+}
+
+void QueueWaitStats::logStats() const
+{
+    for (JobClass jobClass : {JobClass::Quiz, JobClass::Submit, JobClass::Run})
+    {
+        const Histogram h = histogram(jobClass);
+        if (h.count == 0)
+            continue;
+        LOG_INFO("Queue wait " << jobClassName(jobClass) << ": jobs=" << h.count
+                               << " avgMs=" << h.totalMs / h.count
+                               << " p50Ms<=" << h.percentileMs(0.5)
+                               << " p95Ms<=" << h.percentileMs(0.95)
+                               << " p99Ms<=" << h.percentileMs(0.99)
+                               << " maxMs=" << h.maxMs
+                               << " missedDeadline=" << h.missedDeadline);
+    }
+}
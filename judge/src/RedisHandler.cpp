@@ -1,14 +1,197 @@
 #include "RedisHandler.h"
 #include "Logger.h"
 #include <hiredis/hiredis.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <future>
 
 std::unique_ptr<RedisHandler> RedisHandler::instance_ = nullptr;
 
-void RedisHandler::initialize(const char *host, int port)
+namespace
+{
+    // KEYS[1..n-1] pending queues, KEYS[n] processing queue.
+    // ARGV[1] max jobs, ARGV[2] now (ms), ARGV[2 + i] latency target of
+    // queue i (ms).
+    //
+    // Each queue is FIFO, so only the oldest job of each competes: a job is
+    // due at createdAt + its queue's target, or at its own deadline if that
+    // is earlier, and the earliest due is claimed first. A low-priority job
+    // that keeps losing ages until it wins, so no queue starves.
+    //
+    // Returns id, data, queue index, createdAt, due for each job; data is
+    // false (nil) if the hash has none.
+    const char *CLAIM_SCRIPT = R"lua(
+local processing = KEYS[#KEYS]
+local now = tonumber(ARGV[2])
+
+local function due(i)
+    local id = redis.call('LINDEX', KEYS[i], -1)
+    if not id then return nil end
+    local meta = redis.call('HMGET', 'judge:' .. id, 'createdAt', 'deadline')
+    local created = tonumber(meta[1]) or now
+    local at = created + tonumber(ARGV[2 + i])
+    local deadline = tonumber(meta[2])
+    if deadline and deadline < at then at = deadline end
+    return {at, created}
+end
+
+local heads = {}
+for i = 1, #KEYS - 1 do heads[i] = due(i) end
+
+local claimed = {}
+for n = 1, tonumber(ARGV[1]) do
+    local best = nil
+    for i = 1, #KEYS - 1 do
+        if heads[i] and (not best or heads[i][1] < heads[best][1]) then best = i end
+    end
+    if not best then break end
+
+    local id = redis.call('RPOPLPUSH', KEYS[best], processing)
+    claimed[#claimed + 1] = id
+    claimed[#claimed + 1] = redis.call('HGET', 'judge:' .. id, 'data')
+    claimed[#claimed + 1] = best - 1
+    claimed[#claimed + 1] = heads[best][2]
+    claimed[#claimed + 1] = heads[best][1]
+    heads[best] = due(best)
+end
+return claimed
+)lua";
+
+    // Stream intake: KEYS[1..n] lane streams.
+    // ARGV[1] group, ARGV[2] consumer, ARGV[3] max jobs, ARGV[4] now (ms),
+    // ARGV[4 + i] latency target of lane i (ms).
+    //
+    // Same earliest-due-first choice as CLAIM_SCRIPT, where the head of a
+    // lane is the entry the group would deliver next. The chosen entries are
+    // read with XREADGROUP, so they become pending for the consumer.
+    //
+    // Returns entry id, jobId, data, lane index, createdAt, due for each
+    // job; jobId is empty if the entry has none, data is false (nil) if the
+    // hash has none.
+    const char *STREAM_CLAIM_SCRIPT = R"lua(
+local group, consumer = ARGV[1], ARGV[2]
+local now = tonumber(ARGV[4])
+
+local function field(fields, name)
+    for j = 1, #fields, 2 do
+        if fields[j] == name then return fields[j + 1] end
+    end
+    return nil
+end
+
+-- the entry the group would deliver next: the first one after its
+-- last-delivered-id
+local function due(i)
+    local last
+    for _, info in ipairs(redis.call('XINFO', 'GROUPS', KEYS[i])) do
+        if field(info, 'name') == group then last = field(info, 'last-delivered-id') end
+    end
+    if not last then return nil end
+    local entries = redis.call('XRANGE', KEYS[i], '(' .. last, '+', 'COUNT', 1)
+    if #entries == 0 then return nil end
+    local id = field(entries[1][2], 'jobId') or ''
+    local created, deadline = now, nil
+    if id ~= '' then
+        local meta = redis.call('HMGET', 'judge:' .. id, 'createdAt', 'deadline')
+        created = tonumber(meta[1]) or now
+        deadline = tonumber(meta[2])
+    end
+    local at = created + tonumber(ARGV[4 + i])
+    if deadline and deadline < at then at = deadline end
+    return {at, created}
+end
+
+local heads = {}
+for i = 1, #KEYS do heads[i] = due(i) end
+
+local claimed = {}
+for _ = 1, tonumber(ARGV[3]) do
+    local best
+    for i = 1, #KEYS do
+        if heads[i] and (not best or heads[i][1] < heads[best][1]) then best = i end
+    end
+    if not best then break end
+    local read = redis.call('XREADGROUP', 'GROUP', group, consumer, 'COUNT', 1, 'STREAMS', KEYS[best], '>')
+    local entry = read[1][2][1]
+    local id = field(entry[2], 'jobId') or ''
+    claimed[#claimed + 1] = entry[1]
+    claimed[#claimed + 1] = id
+    claimed[#claimed + 1] = id ~= '' and redis.call('HGET', 'judge:' .. id, 'data') or false
+    claimed[#claimed + 1] = best - 1
+    claimed[#claimed + 1] = heads[best][2]
+    claimed[#claimed + 1] = heads[best][1]
+    heads[best] = due(best)
+end
+return claimed
+)lua";
+
+    // the consumer group every judge reads the lane streams through
+    const char *STREAM_GROUP = "judge";
+
+    // every verdict is also announced here, for consumers that follow all
+    // of them (XREAD) rather than one job; trimmed approximately, so XADD
+    // stays O(1)
+    const char *VERDICT_STREAM = "judge:verdicts";
+    const char *VERDICT_STREAM_MAXLEN = "10000";
+
+    uint64_t nowMs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::system_clock::now().time_since_epoch())
+                                         .count());
+    }
+
+    redisReply *commandArgv(redisContext *context, const std::vector<std::string> &args)
+    {
+        std::vector<const char *> argv;
+        std::vector<size_t> argvlen;
+        for (const auto &arg : args)
+        {
+            argv.push_back(arg.data());
+            argvlen.push_back(arg.size());
+        }
+        return static_cast<redisReply *>(
+            redisCommandArgv(context, static_cast<int>(argv.size()), argv.data(), argvlen.data()));
+    }
+
+    std::string replyError(const redisReply *reply)
+    {
+        return reply && reply->type == REDIS_REPLY_ERROR ? std::string(": ") + reply->str : "";
+    }
+
+    // a stream entry is [id, [field, value, ...]]; jobId stays empty if the
+    // entry has none
+    void readEntry(const redisReply *entry, size_t lane, ClaimedJob &job)
+    {
+        job = ClaimedJob();
+        job.queue = lane;
+        if (entry->type != REDIS_REPLY_ARRAY || entry->elements != 2)
+        {
+            return;
+        }
+        job.entryId.assign(entry->element[0]->str, entry->element[0]->len);
+        const redisReply *fields = entry->element[1];
+        if (fields->type != REDIS_REPLY_ARRAY)
+        {
+            return;
+        }
+        for (size_t i = 0; i + 1 < fields->elements; i += 2)
+        {
+            if (strcmp(fields->element[i]->str, "jobId") == 0)
+            {
+                job.jobId.assign(fields->element[i + 1]->str, fields->element[i + 1]->len);
+            }
+        }
+    }
+}
+
+void RedisHandler::initialize(const char *host, int port, size_t connections)
 {
     if (!instance_)
     {
-        instance_.reset(new RedisHandler(host, port));
+        instance_.reset(new RedisHandler(host, port, connections));
     }
 }
 
@@ -22,131 +205,231 @@ RedisHandler &RedisHandler::getInstance()
     return *instance_;
 }
 
-RedisHandler::RedisHandler(const char *host, int port)
-    : blocking_context_(nullptr), command_context_(nullptr)
+RedisHandler::RedisHandler(const char *host, int port, size_t connections)
+    : host_(host),
+      port_(port),
+      claimSeconds_(METRICS()->histogram("judge_redis_command_seconds", "Latency of judge Redis operations.",
+                                         {{"command", "claim"}})),
+      publishSeconds_(METRICS()->histogram("judge_redis_command_seconds", "Latency of judge Redis operations.",
+                                           {{"command", "publish_verdict"}}))
 {
-    LOG_INFO("Connecting to Redis at " << host << ":" << port << " with 2 connections.");
+    LOG_INFO("Connecting to Redis at " << host << ":" << port << " with a blocking connection per intake and "
+                                       << connections << " async connections.");
 
-    blocking_context_ = redisConnect(host, port);
-    if (blocking_context_ == nullptr || blocking_context_->err)
+    // this thread's, which is usually the one the intake runs on
+    redisContext *blocking = blockingConnection().context;
+    if (blocking == nullptr || blocking->err)
     {
-        if (blocking_context_)
-        {
-            LOG_ERROR("Redis blocking connection error: " << blocking_context_->errstr);
-        }
-        else
-        {
-            LOG_ERROR("Failed to allocate Redis blocking context");
-        }
         exit(1);
     }
 
-    command_context_ = redisConnect(host, port);
-    if (command_context_ == nullptr || command_context_->err)
+    async_ = std::make_unique<AsyncRedis>(host, port, connections);
+    if (!async_->start())
     {
-        if (command_context_)
-        {
-            LOG_ERROR("Redis command connection error: " << command_context_->errstr);
-        }
-        else
-        {
-            LOG_ERROR("Failed to allocate Redis command context");
-        }
+        LOG_ERROR("Failed to open any async Redis connection");
         exit(1);
     }
-    LOG_INFO("Successfully connected to Redis with both connections.");
+    LOG_INFO("Successfully connected to Redis.");
 }
 
 RedisHandler::~RedisHandler()
 {
     LOG_INFO("Closing Redis connections.");
-    if (blocking_context_)
+    async_.reset();
+    for (auto &[thread, connection] : blocking_)
     {
-        redisFree(blocking_context_);
+        if (connection->context)
+        {
+            redisFree(connection->context);
+        }
     }
-    if (command_context_)
+}
+
+RedisHandler::BlockingConnection &RedisHandler::blockingConnection()
+{
+    std::lock_guard<std::mutex> lock(blocking_mutex_);
+    auto &connection = blocking_[std::this_thread::get_id()];
+    if (!connection)
     {
-        redisFree(command_context_);
+        connection = std::make_unique<BlockingConnection>();
+        connection->context = redisConnect(host_.c_str(), port_);
+        if (connection->context == nullptr)
+        {
+            LOG_ERROR("Failed to allocate Redis blocking context");
+        }
+        else if (connection->context->err)
+        {
+            LOG_ERROR("Redis blocking connection error: " << connection->context->errstr);
+        }
     }
+    return *connection;
+}
+
+bool RedisHandler::roundTrip(std::vector<AsyncRedis::Command> commands, const std::function<bool(redisReply *)> &read)
+{
+    std::promise<bool> done;
+    std::future<bool> result = done.get_future();
+    async_->submit(std::move(commands), [&done, &read](redisReply *reply)
+                   { done.set_value(read(reply)); });
+    return result.get();
 }
 
 void RedisHandler::set(const std::string &key, const std::string &value)
 {
-    std::lock_guard<std::mutex> lock(command_mutex_);
-    LOG_DEBUG("SET on command connection. Key: " << key);
-    redisReply *reply = static_cast<redisReply *>(
-        redisCommand(command_context_, "SET %b %b", key.data(), key.size(), value.data(), value.size()));
-    if (reply)
-    {
-        if (reply->type == REDIS_REPLY_ERROR)
+    LOG_DEBUG("SET on async connection. Key: " << key);
+    // nobody waits on the reply, errors are only logged
+    async_->submit({{"SET", key, value}}, [](redisReply *reply)
+                   {
+        if (reply && reply->type == REDIS_REPLY_ERROR)
         {
             LOG_ERROR("Redis SET failed: " << reply->str);
+        } });
+}
+
+bool RedisHandler::expire(const std::string &key, int seconds)
+{
+    LOG_DEBUG("EXPIRE on async connection. Key: " << key);
+    return roundTrip({{"EXPIRE", key, std::to_string(seconds)}}, [](redisReply *reply)
+                     {
+        if (!reply)
+        {
+            LOG_ERROR("Redis EXPIRE command failed: no reply");
+            return false;
         }
-        freeReplyObject(reply);
+        if (reply->type == REDIS_REPLY_ERROR)
+        {
+            LOG_ERROR("Redis EXPIRE failed: " << reply->str);
+        }
+        return reply->type == REDIS_REPLY_INTEGER && reply->integer == 1; });
+}
+
+std::vector<AsyncRedis::Command> RedisHandler::ackCommands(const JobAck &ack)
+{
+    if (!ack.entryId.empty())
+    {
+        // the entry is no use once acked, so drop it and keep the stream short
+        return {{"XACK", ack.stream, STREAM_GROUP, ack.entryId},
+                {"XDEL", ack.stream, ack.entryId}};
     }
+    return {{"LREM", ack.processingQueue, "1", ack.jobId}};
 }
 
-bool RedisHandler::expire(const std::string &key, int seconds)
+void RedisHandler::ack(const JobAck &ack)
 {
-    std::lock_guard<std::mutex> lock(command_mutex_);
-    LOG_DEBUG("EXPIRE on command connection. Key: " << key);
-    redisReply *reply = static_cast<redisReply *>(
-        redisCommand(command_context_, "EXPIRE %s %d", key.c_str(), seconds));
-    if (!reply)
+    async_->submit(ackCommands(ack));
+}
+
+bool RedisHandler::publishVerdict(const std::string &key, const std::string &value, int ttlSeconds, const JobAck &ack)
+{
+    LOG_DEBUG("Publishing verdict " << key << " and acking job " << ack.jobId);
+    const auto begin = std::chrono::steady_clock::now();
+    const std::string publishedAt = std::to_string(nowMs());
+    long long listeners = 0;
+
+    // The key stays the source of truth; the PUBLISH on a channel named
+    // after it and the stream entry only say it is there. Both carry the
+    // publish time, so consumers can measure delivery latency.
+    std::vector<AsyncRedis::Command> commands = {{"MULTI"},
+                                                 {"SET", key, value, "EX", std::to_string(ttlSeconds)},
+                                                 {"PUBLISH", key, publishedAt},
+                                                 {"XADD", VERDICT_STREAM, "MAXLEN", "~", VERDICT_STREAM_MAXLEN, "*",
+                                                  "key", key, "jobId", ack.jobId, "publishedAt", publishedAt}};
+    for (auto &command : ackCommands(ack))
     {
-        LOG_ERROR("Redis EXPIRE command failed: no reply");
-        return false;
+        commands.push_back(std::move(command));
     }
-    bool success = (reply->type == REDIS_REPLY_INTEGER && reply->integer == 1);
-    if (!success && reply->type == REDIS_REPLY_ERROR)
+    commands.push_back({"EXEC"});
+    const size_t queued = commands.size() - 2;
+
+    const bool ok = roundTrip(std::move(commands), [&key, &listeners, queued](redisReply *reply)
+                              {
+        // EXEC answers with one reply per queued command, or nil/error if
+        // the transaction was discarded
+        if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements != queued)
+        {
+            LOG_ERROR("Redis verdict transaction for " << key << " failed"
+                      << (reply && reply->type == REDIS_REPLY_ERROR ? std::string(": ") + reply->str : ""));
+            return false;
+        }
+        if (reply->element[0]->type == REDIS_REPLY_ERROR)
+        {
+            LOG_ERROR("Redis SET failed: " << reply->element[0]->str);
+            return false;
+        }
+        // the key is written, a failed notification only costs a poll
+        if (reply->element[2]->type == REDIS_REPLY_ERROR)
+        {
+            LOG_WARNING("Redis XADD for " << key << " failed: " << reply->element[2]->str);
+        }
+        if (reply->element[1]->type == REDIS_REPLY_INTEGER)
+        {
+            listeners = reply->element[1]->integer;
+        }
+        return true; });
+
+    const uint64_t us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count());
+    publishSeconds_.observe(us / 1e6);
+    if (ok)
     {
-        LOG_ERROR("Redis EXPIRE failed: " << reply->str);
+        verdicts_++;
+        verdictUs_ += us;
+        uint64_t max = maxVerdictUs_.load();
+        while (us > max && !maxVerdictUs_.compare_exchange_weak(max, us))
+        {
+        }
+        if (listeners > 0)
+        {
+            verdictsPushed_++;
+        }
     }
-    freeReplyObject(reply);
-    return success;
+    return ok;
 }
 
-bool RedisHandler::brpop(std::string &jobId, std::string &value)
+AsyncRedis::Stats RedisHandler::stats() const
 {
-    std::lock_guard<std::mutex> lock(blocking_mutex_);
-    LOG_DEBUG("BRPOP on blocking connection.");
-    redisReply *reply = static_cast<redisReply *>(
-        redisCommand(blocking_context_, "BRPOP judge:queue 0"));
-    if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2)
+    return async_->stats();
+}
+
+void RedisHandler::logStats() const
+{
+    async_->logStats();
+    const uint64_t verdicts = verdicts_;
+    LOG_INFO("Verdicts: published=" << verdicts << " pushedToWaiters=" << verdictsPushed_
+                                    << " avgPublishMs=" << (verdicts ? verdictUs_ / 1000.0 / verdicts : 0)
+                                    << " maxPublishMs=" << maxVerdictUs_ / 1000.0);
+}
+
+bool RedisHandler::waitForWakeUp(const std::string &wakeKey, int timeoutSec)
+{
+    redisContext *context = blockingConnection().context;
+    if (!context)
+        return false;
+    LOG_DEBUG("BRPOP " << wakeKey << " on blocking connection.");
+
+    // Only a token is popped here, never a job: losing it to a crash costs
+    // nothing but a wake-up.
+    redisReply *reply = commandArgv(context, {"BRPOP", wakeKey, std::to_string(timeoutSec)});
+    if (!reply || (reply->type != REDIS_REPLY_ARRAY && reply->type != REDIS_REPLY_NIL))
     {
-        LOG_ERROR("BRPOP command failed or returned unexpected result");
+        LOG_ERROR("BRPOP on " << wakeKey << " failed" << replyError(reply));
         if (reply)
             freeReplyObject(reply);
         return false;
     }
-
-    jobId = reply->element[1]->str;
     freeReplyObject(reply);
-
-    // HGET can also use the blocking connection since it follows BRPOP sequentially
-    std::string hashKey = "judge:" + jobId;
-    reply = static_cast<redisReply *>(
-        redisCommand(blocking_context_, "HGET %s data", hashKey.c_str()));
-    if (reply && reply->type == REDIS_REPLY_STRING)
-    {
-        value = reply->str;
-        freeReplyObject(reply);
-        LOG_INFO("Received new submission from queue with jobId: " << jobId);
-        return true;
-    }
-
-    if (reply)
-        freeReplyObject(reply);
-    return false;
+    return true;
 }
 
 bool RedisHandler::brpoplpush(const std::string &source, const std::string &destination, int timeout, std::string &outValue)
 {
-    std::lock_guard<std::mutex> lock(blocking_mutex_);
+    redisContext *context = blockingConnection().context;
+    if (!context)
+        return false;
     // LOG_DEBUG("BRPOPLPUSH " << source << " -> " << destination);
 
     redisReply *reply = static_cast<redisReply *>(
-        redisCommand(blocking_context_, "BRPOPLPUSH %s %s %d",
+        redisCommand(context, "BRPOPLPUSH %s %s %d",
                      source.c_str(), destination.c_str(), timeout));
 
     if (!reply)
@@ -175,29 +458,333 @@ bool RedisHandler::brpoplpush(const std::string &source, const std::string &dest
     return success;
 }
 
-void RedisHandler::lrem(const std::string &key, int count, const std::string &value)
+bool RedisHandler::claimJobs(const std::vector<std::string> &queues, const std::string &processingQueue,
+                             const std::vector<uint64_t> &targetsMs, size_t max, std::vector<ClaimedJob> &jobs)
 {
-    std::lock_guard<std::mutex> lock(command_mutex_);
-    redisReply *reply = static_cast<redisReply *>(
-        redisCommand(command_context_, "LREM %s %d %b", key.c_str(), count, value.data(), value.size()));
+    BlockingConnection &connection = blockingConnection();
+    jobs.clear();
+    if (!connection.context)
+        return false;
 
-    if (reply)
-        freeReplyObject(reply);
+    std::vector<std::string> keys = queues;
+    keys.push_back(processingQueue);
+    std::vector<std::string> args = {std::to_string(max), std::to_string(nowMs())};
+    for (size_t i = 0; i < queues.size(); ++i)
+    {
+        args.push_back(std::to_string(i < targetsMs.size() ? targetsMs[i] : 0));
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    redisReply *reply = evalScript(connection.context, CLAIM_SCRIPT, connection.claimScriptSha, keys, args);
+    claimSeconds_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    if (!reply || reply->type != REDIS_REPLY_ARRAY)
+    {
+        LOG_ERROR("Job claim failed" << replyError(reply));
+        if (reply)
+            freeReplyObject(reply);
+        return false;
+    }
+
+    for (size_t i = 0; i + 4 < reply->elements; i += 5)
+    {
+        redisReply **fields = reply->element + i;
+        ClaimedJob job;
+        job.jobId.assign(fields[0]->str, fields[0]->len);
+        if (fields[1]->type == REDIS_REPLY_STRING)
+        {
+            job.data.assign(fields[1]->str, fields[1]->len);
+            job.hasData = true;
+        }
+        job.queue = static_cast<size_t>(fields[2]->integer);
+        job.createdAtMs = static_cast<uint64_t>(fields[3]->integer);
+        job.dueMs = static_cast<uint64_t>(fields[4]->integer);
+        jobs.push_back(std::move(job));
+    }
+    freeReplyObject(reply);
+    return true;
 }
 
-bool RedisHandler::hget(const std::string &key, const std::string &field, std::string &outValue)
+redisReply *RedisHandler::evalScript(redisContext *context, const char *script, std::string &sha,
+                                     const std::vector<std::string> &keys, const std::vector<std::string> &args)
 {
-    std::lock_guard<std::mutex> lock(command_mutex_);
-    redisReply *reply = static_cast<redisReply *>(
-        redisCommand(command_context_, "HGET %s %s", key.c_str(), field.c_str()));
+    redisReply *reply = nullptr;
+    // the script cache is lost when Redis restarts, so load it again once
+    // on NOSCRIPT
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (sha.empty())
+        {
+            redisReply *loaded = commandArgv(context, {"SCRIPT", "LOAD", script});
+            if (!loaded || loaded->type != REDIS_REPLY_STRING)
+            {
+                LOG_ERROR("Loading a job claim script failed" << replyError(loaded));
+                if (loaded)
+                    freeReplyObject(loaded);
+                return nullptr;
+            }
+            sha.assign(loaded->str, loaded->len);
+            freeReplyObject(loaded);
+        }
 
-    if (reply && reply->type == REDIS_REPLY_STRING)
+        std::vector<std::string> argv = {"EVALSHA", sha, std::to_string(keys.size())};
+        argv.insert(argv.end(), keys.begin(), keys.end());
+        argv.insert(argv.end(), args.begin(), args.end());
+        reply = commandArgv(context, argv);
+        if (reply && reply->type == REDIS_REPLY_ERROR && strncmp(reply->str, "NOSCRIPT", 8) == 0)
+        {
+            freeReplyObject(reply);
+            reply = nullptr;
+            sha.clear();
+            continue;
+        }
+        break;
+    }
+    return reply;
+}
+
+void RedisHandler::readJobHash(redisContext *context, ClaimedJob &job, const std::vector<uint64_t> &targetsMs)
+{
+    redisReply *reply = commandArgv(context, {"HMGET", "judge:" + job.jobId, "data", "createdAt", "deadline"});
+    if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements != 3)
+    {
+        if (reply)
+            freeReplyObject(reply);
+        return;
+    }
+    if (reply->element[0]->type == REDIS_REPLY_STRING)
+    {
+        job.data.assign(reply->element[0]->str, reply->element[0]->len);
+        job.hasData = true;
+    }
+    const uint64_t now = nowMs();
+    job.createdAtMs = reply->element[1]->type == REDIS_REPLY_STRING ? std::strtoull(reply->element[1]->str, nullptr, 10) : now;
+    job.dueMs = job.createdAtMs + (job.queue < targetsMs.size() ? targetsMs[job.queue] : 0);
+    if (reply->element[2]->type == REDIS_REPLY_STRING)
+    {
+        job.dueMs = std::min<uint64_t>(job.dueMs, std::strtoull(reply->element[2]->str, nullptr, 10));
+    }
+    freeReplyObject(reply);
+}
+
+bool RedisHandler::createStreamGroups(const std::vector<std::string> &streams)
+{
+    redisContext *context = blockingConnection().context;
+    if (!context)
+        return false;
+    for (const auto &stream : streams)
+    {
+        redisReply *reply = commandArgv(context, {"XGROUP", "CREATE", stream, STREAM_GROUP, "0", "MKSTREAM"});
+        // BUSYGROUP: another judge (or an earlier run) created it
+        const bool ok = reply && (reply->type == REDIS_REPLY_STATUS ||
+                                  (reply->type == REDIS_REPLY_ERROR && strncmp(reply->str, "BUSYGROUP", 9) == 0));
+        if (!ok)
+        {
+            LOG_ERROR("Creating consumer group on " << stream << " failed" << replyError(reply));
+        }
+        if (reply)
+            freeReplyObject(reply);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+bool RedisHandler::claimStreamJobs(const std::vector<std::string> &streams, const std::string &consumer,
+                                   const std::vector<uint64_t> &targetsMs, size_t max, std::vector<ClaimedJob> &jobs)
+{
+    BlockingConnection &connection = blockingConnection();
+    jobs.clear();
+    if (!connection.context)
+        return false;
+
+    std::vector<std::string> args = {STREAM_GROUP, consumer, std::to_string(max), std::to_string(nowMs())};
+    for (size_t i = 0; i < streams.size(); ++i)
+    {
+        args.push_back(std::to_string(i < targetsMs.size() ? targetsMs[i] : 0));
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    redisReply *reply = evalScript(connection.context, STREAM_CLAIM_SCRIPT, connection.streamClaimScriptSha, streams, args);
+    claimSeconds_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    if (!reply || reply->type != REDIS_REPLY_ARRAY)
+    {
+        LOG_ERROR("Stream job claim failed" << replyError(reply));
+        if (reply)
+            freeReplyObject(reply);
+        return false;
+    }
+
+    for (size_t i = 0; i + 5 < reply->elements; i += 6)
+    {
+        redisReply **fields = reply->element + i;
+        ClaimedJob job;
+        job.entryId.assign(fields[0]->str, fields[0]->len);
+        job.jobId.assign(fields[1]->str, fields[1]->len);
+        if (fields[2]->type == REDIS_REPLY_STRING)
+        {
+            job.data.assign(fields[2]->str, fields[2]->len);
+            job.hasData = true;
+        }
+        job.queue = static_cast<size_t>(fields[3]->integer);
+        job.createdAtMs = static_cast<uint64_t>(fields[4]->integer);
+        job.dueMs = static_cast<uint64_t>(fields[5]->integer);
+        jobs.push_back(std::move(job));
+    }
+    freeReplyObject(reply);
+    return true;
+}
+
+bool RedisHandler::waitForStreamJobs(const std::vector<std::string> &streams, const std::string &consumer,
+                                     const std::vector<uint64_t> &targetsMs, int blockMs, std::vector<ClaimedJob> &jobs)
+{
+    redisContext *context = blockingConnection().context;
+    jobs.clear();
+    if (!context)
+        return false;
+
+    // COUNT applies per stream
+    std::vector<std::string> args = {"XREADGROUP", "GROUP", STREAM_GROUP, consumer,
+                                     "COUNT", "1", "BLOCK", std::to_string(blockMs), "STREAMS"};
+    args.insert(args.end(), streams.begin(), streams.end());
+    args.insert(args.end(), streams.size(), ">");
+    redisReply *reply = commandArgv(context, args);
+    if (reply && reply->type == REDIS_REPLY_NIL)
     {
-        outValue = std::string(reply->str, reply->len);
         freeReplyObject(reply);
         return true;
     }
-    if (reply)
+    if (!reply || reply->type != REDIS_REPLY_ARRAY)
+    {
+        LOG_ERROR("XREADGROUP failed" << replyError(reply));
+        if (reply)
+            freeReplyObject(reply);
+        return false;
+    }
+
+    // [[stream, [entry, ...]], ...]
+    for (size_t i = 0; i < reply->elements; ++i)
+    {
+        const redisReply *lane = reply->element[i];
+        if (lane->type != REDIS_REPLY_ARRAY || lane->elements != 2 || lane->element[1]->type != REDIS_REPLY_ARRAY)
+            continue;
+        const std::string stream(lane->element[0]->str, lane->element[0]->len);
+        const size_t index = static_cast<size_t>(std::find(streams.begin(), streams.end(), stream) - streams.begin());
+        for (size_t j = 0; j < lane->element[1]->elements; ++j)
+        {
+            ClaimedJob job;
+            readEntry(lane->element[1]->element[j], index, job);
+            jobs.push_back(std::move(job));
+        }
+    }
+    freeReplyObject(reply);
+
+    for (auto &job : jobs)
+    {
+        if (!job.jobId.empty())
+        {
+            readJobHash(context, job, targetsMs);
+            LOG_INFO("Received new submission from stream with jobId: " << job.jobId);
+        }
+    }
+    return true;
+}
+
+bool RedisHandler::reclaimStreamJobs(const std::vector<std::string> &streams, const std::string &consumer,
+                                     const std::vector<uint64_t> &targetsMs, uint64_t minIdleMs, size_t max,
+                                     std::vector<ClaimedJob> &jobs)
+{
+    redisContext *context = blockingConnection().context;
+    jobs.clear();
+    if (!context)
+        return false;
+
+    for (size_t lane = 0; lane < streams.size() && jobs.size() < max; ++lane)
+    {
+        redisReply *reply = commandArgv(context, {"XAUTOCLAIM", streams[lane], STREAM_GROUP, consumer,
+                                                  std::to_string(minIdleMs), "0-0",
+                                                  "COUNT", std::to_string(max - jobs.size())});
+        // [next cursor, [entry, ...], [deleted id, ...]] (the last since 7.0)
+        if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements < 2 ||
+            reply->element[1]->type != REDIS_REPLY_ARRAY)
+        {
+            LOG_ERROR("XAUTOCLAIM on " << streams[lane] << " failed" << replyError(reply));
+            if (reply)
+                freeReplyObject(reply);
+            return false;
+        }
+        for (size_t i = 0; i < reply->element[1]->elements; ++i)
+        {
+            ClaimedJob job;
+            readEntry(reply->element[1]->element[i], lane, job);
+            // before 7.0 an entry deleted while pending comes back as nil,
+            // without even its id (7.0 drops it from the pending list);
+            // acks XACK before XDEL, so only a manual XDEL leaves one
+            if (!job.entryId.empty())
+            {
+                jobs.push_back(std::move(job));
+            }
+        }
         freeReplyObject(reply);
-    return false;
-}
\ No newline at end of file
+    }
+
+    for (auto &job : jobs)
+    {
+        if (!job.jobId.empty())
+        {
+            readJobHash(context, job, targetsMs);
+            LOG_WARNING("Reclaimed job " << job.jobId << " left pending by another judge");
+        }
+    }
+    return true;
+}
+
+void RedisHandler::touchStreamJobs(const std::string &stream, const std::string &consumer, const std::vector<std::string> &entryIds)
+{
+    if (entryIds.empty())
+        return;
+    // XCLAIM to the owner itself only resets the idle time; JUSTID keeps it
+    // from bumping the delivery count
+    AsyncRedis::Command command = {"XCLAIM", stream, STREAM_GROUP, consumer, "0"};
+    command.insert(command.end(), entryIds.begin(), entryIds.end());
+    command.push_back("JUSTID");
+    async_->submit({std::move(command)});
+}
+
+bool RedisHandler::queueLength(const std::string &key, bool stream, uint64_t &length)
+{
+    return roundTrip({{stream ? "XLEN" : "LLEN", key}}, [&length](redisReply *reply)
+                     {
+        if (reply && reply->type == REDIS_REPLY_INTEGER)
+        {
+            length = static_cast<uint64_t>(reply->integer);
+            return true;
+        }
+        return false; });
+}
+
+void RedisHandler::lrem(const std::string &key, int count, const std::string &value)
+{
+    async_->submit({{"LREM", key, std::to_string(count), value}});
+}
+
+bool RedisHandler::hget(const std::string &key, const std::string &field, std::string &outValue)
+{
+    return roundTrip({{"HGET", key, field}}, [&outValue](redisReply *reply)
+                     {
+        if (reply && reply->type == REDIS_REPLY_STRING)
+        {
+            outValue = std::string(reply->str, reply->len);
+            return true;
+        }
+        return false; });
+}
+
+bool RedisHandler::get(const std::string &key, std::string &outValue)
+{
+    return roundTrip({{"GET", key}}, [&outValue](redisReply *reply)
+                     {
+        if (reply && reply->type == REDIS_REPLY_STRING)
+        {
+            outValue = std::string(reply->str, reply->len);
+            return true;
+        }
+        return false; });
+}
@@ -0,0 +1,241 @@
+#include "Regrader.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <iomanip>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace
+{
+    // lines read and sorted at a time, per job slot
+    const size_t WINDOW_PER_SLOT = 8;
+
+    bool writeAll(int fd, const std::string &data)
+    {
+        size_t written = 0;
+        while (written < data.size())
+        {
+            const ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+}
+
+Regrader::Regrader(const JudgeConfig &config)
+    : config_(config), slots_(config.maxSandboxes > 0 ? config.maxSandboxes : 1),
+      sandboxPool_(config.sandboxBackend == "docker" ? config.poolSizes : std::map<std::string, size_t>{},
+                   config.poolMaxUses, config.dataHostDir),
+      executor_(makeSandboxExecutor(config, sandboxPool_)),
+      compileCache_(makeCompileCache(config)),
+      sqlSnapshots_(makeSqlSnapshotCache(config)),
+      testSets_(config.dataDir, config.testSetCacheBytes),
+      fanoutLimiter_(config.fanoutPerJob, config.fanoutGlobal),
+      workers_(config.numThreads)
+{
+    if (!testSets_.initialize())
+    {
+        LOG_WARNING("Test sets go to the runners inline.");
+    }
+    // Identical jobs are rare in a regrade and each one is wanted, so
+    // there is no verdict cache; verdicts go to the output, not Redis.
+    judgeWorker_ = std::make_unique<JudgeWorker>(
+        *executor_, compileCache_.get(), sqlSnapshots_.get(), nullptr, testSets_, fanoutLimiter_, workers_,
+        JudgeWorker::outputChecks(config), config.zygoteRunners,
+        [this](const std::string &jobId, const std::string &status, const std::string &verdict)
+        {
+            json id;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                id = ids_[jobId];
+                summary_.verdicts++;
+                summary_.statuses[status]++;
+            }
+            // spliced in as it is, the verdict is not parsed again
+            const std::string line = "{\"id\":" + id.dump() + ",\"verdict\":" + verdict + "}\n";
+            std::lock_guard<std::mutex> lock(outMutex_);
+            return writeAll(outFd_, line);
+        });
+    sandboxPool_.start();
+}
+
+Regrader::~Regrader() = default;
+
+Regrader::Summary Regrader::run(std::istream &in, int outFd)
+{
+    outFd_ = outFd;
+    const auto begin = std::chrono::steady_clock::now();
+    const size_t window = WINDOW_PER_SLOT * slots_;
+
+    std::string line;
+    uint64_t number = 0;
+    bool more = true;
+    while (more)
+    {
+        std::vector<Pending> batch;
+        while (batch.size() < window && (more = static_cast<bool>(std::getline(in, line))))
+        {
+            number++;
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            Pending pending;
+            std::string error;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                summary_.lines++;
+            }
+            if (!prepare(line, number, pending, error))
+            {
+                LOG_WARNING("Line " << number << ": " << error);
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    summary_.invalid++;
+                }
+                writeLine({{"id", pending.id}, {"line", number}, {"error", error}});
+                continue;
+            }
+            batch.push_back(std::move(pending));
+        }
+
+        // one language's image and one set's file at a time; stable, so
+        // submissions otherwise keep the order they came in
+        std::stable_sort(batch.begin(), batch.end(), [](const Pending &a, const Pending &b)
+                         { return std::tie(a.language, a.testSet->hash) < std::tie(b.language, b.testSet->hash); });
+        for (Pending &pending : batch)
+        {
+            dispatch(std::move(pending));
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    slotFreed_.wait(lock, [this]
+                    { return inFlight_ == 0; });
+    summary_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return summary_;
+}
+
+bool Regrader::prepare(const std::string &line, uint64_t number, Pending &pending, std::string &error)
+{
+    json payload = json::parse(line, nullptr, false);
+    if (!payload.is_object())
+    {
+        error = "not a JSON object";
+        return false;
+    }
+    if (payload.contains("id"))
+    {
+        pending.id = std::move(payload["id"]);
+        payload.erase("id");
+    }
+    auto testCases = payload.find("testCases");
+    if (testCases == payload.end() || !testCases->is_array())
+    {
+        // a regrade is about new test cases, which the input has to bring
+        error = payload.contains("testSetRef") ? "testSetRef needs Redis, give the test cases inline"
+                                               : "no testCases array";
+        return false;
+    }
+    pending.testSet = testSets_.add(testCases->dump(), error);
+    if (!pending.testSet)
+    {
+        return false;
+    }
+    payload.erase(testCases);
+    payload["testSetRef"] = pending.testSet->hash;
+    // a regrade replaces graded verdicts
+    if (!payload.contains("mode"))
+    {
+        payload["mode"] = "submit";
+    }
+    pending.language = payload.value("language", std::string());
+    pending.jobId = "regrade-" + std::to_string(number);
+    pending.payload = payload.dump();
+    return true;
+}
+
+void Regrader::dispatch(Pending pending)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        slotFreed_.wait(lock, [this]
+                        { return inFlight_ < slots_; });
+        inFlight_++;
+        ids_[pending.jobId] = pending.id;
+    }
+
+    // too big to capture by value in a task
+    auto job = std::make_shared<Pending>(std::move(pending));
+    workers_.submit([this, job](const CancellationToken &)
+                    {
+        const auto deadline = config_.jobTimeoutSec > 0
+                                  ? std::chrono::steady_clock::now() + std::chrono::seconds(config_.jobTimeoutSec)
+                                  : std::chrono::steady_clock::time_point();
+        JobAck ack;
+        ack.jobId = job->jobId;
+        judgeWorker_->processSubmission(job->jobId, std::move(job->payload), ack, deadline,
+                                        [this, jobId = job->jobId](bool published)
+                                        {
+            json id;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = ids_.find(jobId);
+                id = std::move(it->second);
+                ids_.erase(it);
+                if (!published)
+                    summary_.failed++;
+            }
+            if (!published)
+            {
+                writeLine({{"id", id}, {"error", "No verdict, see the judge log."}});
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                inFlight_--;
+            }
+            slotFreed_.notify_all(); }); });
+}
+
+void Regrader::writeLine(const json &line)
+{
+    std::lock_guard<std::mutex> lock(outMutex_);
+    writeAll(outFd_, line.dump() + "\n");
+}
+
+void Regrader::printSummary(const Summary &summary, std::ostream &out) const
+{
+    const SandboxExecutor::Stats sandboxes = executor_->stats();
+    const TestSetStore::Stats testSets = testSets_.stats();
+    const double judged = static_cast<double>(summary.verdicts + summary.failed);
+    out << std::fixed << std::setprecision(1) << "Regraded " << summary.lines << " submissions in "
+        << summary.seconds << "s (" << (summary.seconds > 0 ? judged / summary.seconds : 0) << "/s): "
+        << summary.verdicts << " verdicts, " << summary.failed << " failed, " << summary.invalid << " invalid\n"
+        << "  verdicts:";
+    for (const auto &[status, count] : summary.statuses)
+    {
+        out << " " << status << "=" << count;
+    }
+    out << "\n  sandboxes: " << sandboxes.runs << " runs (" << sandboxes.failures << " failed to start), mean "
+        << (sandboxes.runs ? sandboxes.totalWallMs / sandboxes.runs : 0) << "ms, "
+        << (summary.seconds > 0 ? sandboxes.runs / summary.seconds : 0) << "/s\n"
+        << "  test sets: " << testSets.entries << " in memory, " << testSets.bytes / 1024 << " KiB\n";
+    if (compileCache_)
+    {
+        const CompileCache::Stats compiles = compileCache_->stats();
+        out << "  compile cache: " << compiles.hits << " hits, " << compiles.misses << " misses\n";
+    }
+    if (sqlSnapshots_)
+    {
+        const SqlSnapshotCache::Stats snapshots = sqlSnapshots_->stats();
+        out << "  sql snapshots: " << snapshots.hits << " hits, " << snapshots.stores << " built\n";
+    }
+    out << std::defaultfloat;
+}
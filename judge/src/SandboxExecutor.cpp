@@ -0,0 +1,138 @@
+#include "SandboxExecutor.h"
+#include "DockerExecutor.h"
+#include "NativeExecutor.h"
+#include "StubExecutor.h"
+#include "JudgeConfig.h"
+#include "Logger.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <future>
+#include <sstream>
+#include <unistd.h>
+
+namespace
+{
+    // a small cgroup interface file, relative to the cgroup's directory fd
+    bool readCgroupFile(int cgroupFd, const char *name, std::string &content)
+    {
+        int fd = openat(cgroupFd, name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        char buffer[512];
+        ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (n <= 0)
+        {
+            return false;
+        }
+        content.assign(buffer, static_cast<size_t>(n));
+        return true;
+    }
+}
+
+void readCgroupUsage(int cgroupFd, SandboxResult &result)
+{
+    std::string content;
+    if (!readCgroupFile(cgroupFd, "cpu.stat", content))
+    {
+        return;
+    }
+    std::istringstream stat(content);
+    std::string key;
+    uint64_t value = 0;
+    while (stat >> key >> value)
+    {
+        if (key == "usage_usec")
+            result.cpuMs = value / 1000.0;
+        else if (key == "throttled_usec")
+            result.throttledMs = value / 1000.0;
+    }
+    result.accounted = true;
+
+    if (readCgroupFile(cgroupFd, "memory.peak", content))
+    {
+        result.peakMemoryKb = std::strtoull(content.c_str(), nullptr, 10) / 1024;
+    }
+}
+
+const char *imageForLanguage(const std::string &language)
+{
+    if (language == "python")
+        return "judge-py:latest";
+    if (language == "javascript" || language == "typescript")
+        return "judge-js:latest";
+    if (language == "sql")
+        return "judge-sql:latest";
+    // c and cpp share the gcc image
+    return "judge-cpp:latest";
+}
+
+void SandboxExecutor::runAsync(const SandboxRequest &request, Completion done)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    executeAsync(request, [this, begin, image = request.image, done = std::move(done)](SandboxResult result)
+                 {
+        result.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+        runs_++;
+        if (!result.launched)
+        {
+            failures_++;
+        }
+        startupUs_ += static_cast<uint64_t>(result.startupMs * 1000);
+        wallUs_ += static_cast<uint64_t>(result.wallMs * 1000);
+
+        LOG_DEBUG("Sandbox " << name() << " " << image << ": startup " << result.startupMs
+                             << "ms, wall " << result.wallMs << "ms, exit " << result.exitCode);
+        done(std::move(result)); });
+}
+
+SandboxResult SandboxExecutor::run(const SandboxRequest &request)
+{
+    std::promise<SandboxResult> promise;
+    std::future<SandboxResult> result = promise.get_future();
+    runAsync(request, [&promise](SandboxResult done)
+             { promise.set_value(std::move(done)); });
+    return result.get();
+}
+
+SandboxExecutor::Stats SandboxExecutor::stats() const
+{
+    Stats stats;
+    stats.runs = runs_;
+    stats.failures = failures_;
+    stats.totalStartupMs = startupUs_ / 1000.0;
+    stats.totalWallMs = wallUs_ / 1000.0;
+    return stats;
+}
+
+std::unique_ptr<SandboxExecutor> makeSandboxExecutor(const JudgeConfig &config, SandboxPool &pool)
+{
+    if (config.sandboxBackend == "native")
+    {
+        auto native = std::make_unique<NativeExecutor>(config.nativeRunnerRoot, config.cgroupRoot, config.dataDir);
+        if (native->initialize())
+        {
+            return native;
+        }
+        LOG_ERROR("Native sandbox backend unavailable, falling back to docker.");
+    }
+    else if (config.sandboxBackend == "stub")
+    {
+        return std::make_unique<StubExecutor>(config.stubRunMs);
+    }
+    else if (config.sandboxBackend != "docker")
+    {
+        LOG_WARNING("Unknown JUDGE_SANDBOX '" << config.sandboxBackend << "', using docker.");
+    }
+    auto docker = std::make_unique<DockerExecutor>(pool, config.dataHostDir);
+    if (!config.dockerCgroupParent.empty())
+    {
+        docker->enableAccounting(config.dockerCgroupParent, config.dockerCgroupMount);
+    }
+    return docker;
+}
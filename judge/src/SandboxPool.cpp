@@ -0,0 +1,424 @@
+#include "SandboxPool.h"
+#include "Logger.h"
+
+#include <nlohmann/json.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+namespace
+{
+    const char *POOL_LABEL = "codeclass.judge.pool";
+
+    std::string hostLabel()
+    {
+        char host[256] = {0};
+        if (gethostname(host, sizeof(host) - 1) != 0)
+        {
+            return "judge";
+        }
+        return host;
+    }
+
+    // "judge-cpp:latest" -> "judge-cpp", usable in a container name
+    std::string shortName(const std::string &image)
+    {
+        std::string name = image.substr(0, image.find(':'));
+        for (char &c : name)
+        {
+            if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_')
+                c = '-';
+        }
+        return name;
+    }
+}
+
+void appendSandboxLimits(std::vector<std::string> &args, const std::string &dataHostDir)
+{
+    const char *limits[] = {
+        "--read-only",
+        "--network", "none",
+        "--pids-limit", "64",
+        "--tmpfs", "/tmp:exec",
+        // an IPC namespace of its own, never shared with another container,
+        // and a small /dev/shm; both are wiped before a pooled container is
+        // reused (resetContainer)
+        "--ipc", "private",
+        "--shm-size", "16m",
+        "--memory=256m",
+        "--memory-swap", "256m",
+        "--cpus=0.5",
+    };
+    args.insert(args.end(), std::begin(limits), std::end(limits));
+
+    if (!dataHostDir.empty())
+    {
+        args.push_back("-v");
+        args.push_back(dataHostDir + ":/judge:ro");
+    }
+}
+
+bool runDockerCommand(const std::vector<std::string> &args, std::string *out)
+{
+    // build argv before fork(), allocating in the child of a threaded
+    // process is not safe
+    std::vector<char *> argv;
+    argv.reserve(args.size() + 1);
+    for (const auto &arg : args)
+    {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    int pipeFds[2] = {-1, -1};
+    if (out && pipe2(pipeFds, O_CLOEXEC) != 0)
+    {
+        LOG_ERROR("pipe() failed: " << strerror(errno));
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        LOG_ERROR("fork() failed: " << strerror(errno));
+        if (out)
+        {
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+        }
+        return false;
+    }
+    if (pid == 0)
+    {
+        int devNull = open("/dev/null", O_RDWR);
+        dup2(devNull, STDIN_FILENO);
+        dup2(out ? pipeFds[1] : devNull, STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+
+    if (out)
+    {
+        close(pipeFds[1]);
+        out->clear();
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(pipeFds[0], buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+        {
+            if (n > 0)
+                out->append(buf, static_cast<size_t>(n));
+        }
+        close(pipeFds[0]);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            LOG_ERROR("waitpid() failed: " << strerror(errno));
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+SandboxPool::SandboxPool(const std::map<std::string, size_t> &sizes, unsigned int maxUses,
+                         const std::string &dataHostDir)
+    : maxUses_(maxUses ? maxUses : 1), dataHostDir_(dataHostDir)
+{
+    for (const auto &[image, size] : sizes)
+    {
+        if (size == 0)
+            continue;
+        auto pool = std::make_unique<ImagePool>();
+        pool->image = image;
+        pool->target = size;
+        pool->stats.target = size;
+        pools_.emplace(image, std::move(pool));
+    }
+}
+
+SandboxPool::~SandboxPool()
+{
+    stop_ = true;
+    cv_.notify_all();
+    for (auto &[image, pool] : pools_)
+    {
+        if (pool->maintainer.joinable())
+        {
+            pool->maintainer.join();
+        }
+    }
+
+    for (auto &[image, pool] : pools_)
+    {
+        for (const auto &lease : pool->idle)
+            removeContainer(lease.container);
+        for (const auto &returned : pool->returned)
+            removeContainer(returned.first.container);
+    }
+}
+
+void SandboxPool::start()
+{
+    if (pools_.empty())
+    {
+        LOG_INFO("Sandbox pool disabled, every job takes a cold docker run.");
+        return;
+    }
+
+    // Containers from a previous run of this judge (crash, restart) are
+    // still sitting there running `tail -f /dev/null`, clear them first.
+    std::string stale;
+    if (runDockerCommand({"docker", "ps", "-aq", "--filter",
+                          std::string("label=") + POOL_LABEL + "=" + hostLabel()},
+                         &stale) &&
+        !stale.empty())
+    {
+        std::vector<std::string> rm = {"docker", "rm", "-f"};
+        size_t begin = 0;
+        while (begin < stale.size())
+        {
+            size_t end = stale.find('\n', begin);
+            if (end == std::string::npos)
+                end = stale.size();
+            if (end > begin)
+                rm.push_back(stale.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        LOG_INFO("Removing " << rm.size() - 3 << " stale pool containers.");
+        runDockerCommand(rm);
+    }
+
+    for (auto &[image, pool] : pools_)
+    {
+        // The pooled container runs `tail -f /dev/null` as its entrypoint,
+        // so the runner's real entrypoint has to come from the image itself.
+        std::string raw;
+        if (runDockerCommand({"docker", "image", "inspect", "-f", "{{json .Config.Entrypoint}}", image}, &raw))
+        {
+            try
+            {
+                auto entrypoint = json::parse(raw);
+                if (entrypoint.is_array())
+                    pool->entrypoint = entrypoint.get<std::vector<std::string>>();
+            }
+            catch (const json::exception &e)
+            {
+                LOG_ERROR("Could not parse entrypoint of " << image << ": " << e.what());
+            }
+        }
+
+        if (pool->entrypoint.empty())
+        {
+            LOG_WARNING("No entrypoint found for " << image << ", pool disabled for this image.");
+            pool->target = 0;
+            pool->stats.target = 0;
+            continue;
+        }
+
+        LOG_INFO("Warming " << pool->target << " containers for " << image << ".");
+        pool->maintainer = std::thread([this, p = pool.get()]
+                                       { maintain(*p); });
+    }
+}
+
+std::optional<SandboxPool::Lease> SandboxPool::acquire(const std::string &image)
+{
+    auto it = pools_.find(image);
+    if (it == pools_.end())
+    {
+        return std::nullopt;
+    }
+
+    ImagePool &pool = *it->second;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pool.idle.empty())
+    {
+        pool.stats.misses++;
+        cv_.notify_all();
+        return std::nullopt;
+    }
+
+    Lease lease = std::move(pool.idle.front());
+    pool.idle.pop_front();
+    pool.leased++;
+    pool.stats.hits++;
+    lease.uses++;
+    return lease;
+}
+
+void SandboxPool::release(Lease lease, bool healthy)
+{
+    auto it = pools_.find(lease.image);
+    if (it == pools_.end())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ImagePool &pool = *it->second;
+        pool.leased--;
+        pool.returned.emplace_back(std::move(lease), healthy);
+    }
+    cv_.notify_all();
+}
+
+std::vector<std::string> SandboxPool::execCommand(const Lease &lease) const
+{
+    std::vector<std::string> args = {"docker", "exec", "-i", lease.container};
+    auto it = pools_.find(lease.image);
+    if (it != pools_.end())
+    {
+        args.insert(args.end(), it->second->entrypoint.begin(), it->second->entrypoint.end());
+    }
+    return args;
+}
+
+SandboxPool::Stats SandboxPool::stats(const std::string &image) const
+{
+    auto it = pools_.find(image);
+    if (it == pools_.end())
+    {
+        return {};
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = it->second->stats;
+    stats.idle = it->second->idle.size();
+    return stats;
+}
+
+void SandboxPool::logStats() const
+{
+    for (const auto &[image, pool] : pools_)
+    {
+        Stats s = stats(image);
+        const uint64_t lookups = s.hits + s.misses;
+        LOG_INFO("Sandbox pool " << image
+                                 << ": idle=" << s.idle << "/" << s.target
+                                 << " hits=" << s.hits << " misses=" << s.misses
+                                 << " hitRate=" << (lookups ? (100 * s.hits / lookups) : 0) << "%"
+                                 << " resets=" << s.resets << " replacements=" << s.replacements
+                                 << " startFailures=" << s.startFailures);
+    }
+}
+
+void SandboxPool::maintain(ImagePool &pool)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stop_)
+    {
+        if (!pool.returned.empty())
+        {
+            auto [lease, healthy] = std::move(pool.returned.front());
+            pool.returned.pop_front();
+            lock.unlock();
+
+            bool reused = false;
+            if (healthy && lease.uses < maxUses_)
+            {
+                reused = resetContainer(lease.container);
+            }
+            if (!reused)
+            {
+                removeContainer(lease.container);
+            }
+
+            lock.lock();
+            if (reused)
+            {
+                pool.idle.push_back(std::move(lease));
+                pool.stats.resets++;
+            }
+            else
+            {
+                pool.stats.replacements++;
+            }
+            continue;
+        }
+
+        if (pool.idle.size() + pool.leased + pool.returned.size() < pool.target)
+        {
+            lock.unlock();
+            Lease lease;
+            bool started = startContainer(pool, lease);
+            lock.lock();
+
+            if (started)
+            {
+                pool.idle.push_back(std::move(lease));
+            }
+            else
+            {
+                pool.stats.startFailures++;
+                // image missing or daemon unhappy, don't hammer it
+                cv_.wait_for(lock, std::chrono::seconds(5), [this]
+                             { return stop_.load(); });
+            }
+            continue;
+        }
+
+        cv_.wait(lock, [this, &pool]
+                 { return stop_ || !pool.returned.empty() ||
+                          pool.idle.size() + pool.leased < pool.target; });
+    }
+}
+
+bool SandboxPool::startContainer(ImagePool &pool, Lease &out)
+{
+    std::string name = "judge-pool-" + shortName(pool.image) + "-" +
+                       std::to_string(getpid()) + "-" + std::to_string(sequence_++);
+
+    std::vector<std::string> args = {"docker", "run", "-d", "--rm",
+                                     "--name", name,
+                                     "--label", std::string(POOL_LABEL) + "=" + hostLabel()};
+    appendSandboxLimits(args, dataHostDir_);
+    args.insert(args.end(), {"--entrypoint", "tail", pool.image, "-f", "/dev/null"});
+
+    if (!runDockerCommand(args))
+    {
+        LOG_ERROR("Failed to start pool container for " << pool.image);
+        return false;
+    }
+
+    out.image = pool.image;
+    out.container = std::move(name);
+    out.uses = 0;
+    return true;
+}
+
+bool SandboxPool::resetContainer(const std::string &container)
+{
+    // As root inside the container: kill(-1) reaches every process but the
+    // namespace init (our tail), which takes out anything the submission
+    // left running. Then wipe everything a job can leave for the next one
+    // outside a process: the tmpfs, /dev/shm, POSIX message queues and the
+    // SysV shared memory, semaphores and message queues of the container's
+    // IPC namespace. If anything is left the reset fails and the container
+    // is replaced instead of reused.
+    static const char *script =
+        "kill -9 -1 2>/dev/null; "
+        "rm -rf /tmp/* /tmp/.[!.]* /dev/shm/* /dev/shm/.[!.]* /dev/mqueue/* 2>/dev/null; "
+        "for t in m:shm s:sem q:msg; do "
+        "tail -n +2 /proc/sysvipc/${t#*:} | while read -r key id rest; do ipcrm -${t%%:*} $id; done; "
+        "done 2>/dev/null; "
+        "[ -z \"$(find /tmp /dev/shm /dev/mqueue -mindepth 1 2>/dev/null | head -n 1)\" ] && "
+        "[ \"$(cat /proc/sysvipc/shm /proc/sysvipc/sem /proc/sysvipc/msg | wc -l)\" -eq 3 ]";
+    return runDockerCommand({"docker", "exec", "-u", "0", container, "sh", "-c", script});
+}
+
+void SandboxPool::removeContainer(const std::string &container)
+{
+    if (!runDockerCommand({"docker", "rm", "-f", container}))
+    {
+        LOG_WARNING("Failed to remove pool container " << container);
+    }
+}
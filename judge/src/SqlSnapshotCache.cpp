@@ -0,0 +1,233 @@
+#include "SqlSnapshotCache.h"
+#include "JudgeConfig.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    const char *SUFFIX = ".db";
+    // where the judge data directory is mounted inside every sandbox
+    const char *SANDBOX_DATA_DIR = "/judge";
+    // first bytes of every SQLite database file
+    const char SQLITE_HEADER[] = "SQLite format 3";
+
+    bool isKey(const std::string &name)
+    {
+        return name.size() == 64 &&
+               std::all_of(name.begin(), name.end(), [](char c)
+                           { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+    }
+
+    bool ensureDir(const std::string &path, mode_t mode)
+    {
+        if (mkdir(path.c_str(), mode) != 0 && errno != EEXIST)
+        {
+            return false;
+        }
+        // mkdir honours the umask, the permission bits are the point here
+        return chmod(path.c_str(), mode) == 0;
+    }
+
+    bool writeWholeFile(const std::string &path, const std::string &content, mode_t mode)
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+        if (fd < 0)
+        {
+            return false;
+        }
+        size_t written = 0;
+        while (written < content.size())
+        {
+            ssize_t n = write(fd, content.data() + written, content.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                close(fd);
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        fchmod(fd, mode);
+        return close(fd) == 0;
+    }
+}
+
+SqlSnapshotCache::SqlSnapshotCache(const std::string &dataDir, uint64_t maxBytes)
+    : dir_(dataDir + "/sql-snapshots"), maxBytes_(maxBytes)
+{
+}
+
+bool SqlSnapshotCache::initialize()
+{
+    const std::string dataDir = dir_.substr(0, dir_.rfind('/'));
+    if (!ensureDir(dataDir, 0711) || !ensureDir(dir_, 0711))
+    {
+        LOG_ERROR("Cannot create SQL snapshot cache at " << dir_ << ": " << strerror(errno));
+        return false;
+    }
+
+    struct Found
+    {
+        std::string key;
+        time_t mtime;
+        uint64_t bytes;
+    };
+    std::vector<Found> found;
+
+    DIR *dir = opendir(dir_.c_str());
+    if (!dir)
+    {
+        LOG_ERROR("Cannot read SQL snapshot cache at " << dir_ << ": " << strerror(errno));
+        return false;
+    }
+    const size_t suffixLength = strlen(SUFFIX);
+    while (dirent *ent = readdir(dir))
+    {
+        const std::string name = ent->d_name;
+        if (name == "." || name == "..")
+            continue;
+        const std::string path = dir_ + "/" + name;
+        const std::string key = name.size() > suffixLength ? name.substr(0, name.size() - suffixLength) : "";
+        struct stat st;
+        if (!isKey(key) || name.compare(key.size(), std::string::npos, SUFFIX) != 0 || stat(path.c_str(), &st) != 0)
+        {
+            // half-written image from a crash
+            unlink(path.c_str());
+            continue;
+        }
+        found.push_back({key, st.st_mtime, static_cast<uint64_t>(st.st_size)});
+    }
+    closedir(dir);
+
+    std::sort(found.begin(), found.end(), [](const Found &a, const Found &b)
+              { return a.mtime < b.mtime; });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : found)
+    {
+        lru_.push_front(entry.key);
+        index_[entry.key] = {lru_.begin(), entry.bytes};
+        stats_.bytes += entry.bytes;
+    }
+    stats_.entries = index_.size();
+    evictLocked();
+
+    LOG_INFO("SQL snapshot cache at " << dir_ << ": " << stats_.entries << " entries, "
+                                      << stats_.bytes / 1024 << " KiB of " << maxBytes_ / 1024 << " KiB.");
+    return true;
+}
+
+std::string SqlSnapshotCache::sandboxDir()
+{
+    return std::string(SANDBOX_DATA_DIR) + "/sql-snapshots";
+}
+
+void SqlSnapshotCache::touch(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end())
+    {
+        return;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.position);
+    stats_.hits++;
+}
+
+bool SqlSnapshotCache::store(const std::string &key, const std::string &image)
+{
+    // the caller checked the key is the hash of one of the job's setup
+    // scripts; the file at least has to be a database
+    if (!isKey(key) || image.compare(0, sizeof(SQLITE_HEADER), SQLITE_HEADER, sizeof(SQLITE_HEADER)) != 0 ||
+        image.size() > maxBytes_)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.rejected++;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(key))
+            return true;
+    }
+
+    // Written aside and renamed into place, so a runner never reads half an
+    // image.
+    static std::atomic<uint64_t> sequence{0};
+    const std::string tmp = dir_ + "/.tmp-" + std::to_string(getpid()) + "-" + std::to_string(sequence++);
+    if (!writeWholeFile(tmp, image, 0644) || rename(tmp.c_str(), (dir_ + "/" + key + SUFFIX).c_str()) != 0)
+    {
+        LOG_ERROR("Failed to write SQL snapshot " << key << ": " << strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.count(key))
+        return true;
+    lru_.push_front(key);
+    index_[key] = {lru_.begin(), image.size()};
+    stats_.bytes += image.size();
+    stats_.stores++;
+    evictLocked();
+    return true;
+}
+
+void SqlSnapshotCache::evictLocked()
+{
+    while (stats_.bytes > maxBytes_ && !lru_.empty())
+    {
+        const std::string victim = lru_.back();
+        lru_.pop_back();
+        auto it = index_.find(victim);
+        if (it != index_.end())
+        {
+            stats_.bytes -= it->second.bytes;
+            index_.erase(it);
+        }
+        // a runner reads the whole image at once, unlinking is safe
+        unlink((dir_ + "/" + victim + SUFFIX).c_str());
+        stats_.evictions++;
+    }
+    stats_.entries = index_.size();
+}
+
+SqlSnapshotCache::Stats SqlSnapshotCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void SqlSnapshotCache::logStats() const
+{
+    const Stats s = stats();
+    LOG_INFO("SQL snapshot cache: entries=" << s.entries << " bytes=" << s.bytes << "/" << maxBytes_
+                                            << " hits=" << s.hits << " stores=" << s.stores
+                                            << " rejected=" << s.rejected << " evictions=" << s.evictions);
+}
+
+std::unique_ptr<SqlSnapshotCache> makeSqlSnapshotCache(const JudgeConfig &config)
+{
+    if (config.sqlSnapshotBytes == 0)
+    {
+        LOG_INFO("SQL snapshot cache disabled.");
+        return nullptr;
+    }
+    auto cache = std::make_unique<SqlSnapshotCache>(config.dataDir, config.sqlSnapshotBytes);
+    if (!cache->initialize())
+    {
+        LOG_ERROR("SQL snapshot cache unavailable, SQL tests run their setup script every time.");
+        return nullptr;
+    }
+    return cache;
+}
@@ -0,0 +1,43 @@
+#include "StubExecutor.h"
+#include "Logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace
+{
+    const char *STUB_VERDICT =
+        R"({"status":"completed","testResults":[],"metrics":{"passedTests":0,"totalTests":0,"averageRuntime":0}})";
+}
+
+StubExecutor::StubExecutor(unsigned int runMs)
+    : seconds_(std::to_string(runMs / 1000) + "." + std::to_string(1000 + runMs % 1000).substr(1))
+{
+}
+
+void StubExecutor::executeAsync(const SandboxRequest &request, Completion done)
+{
+    supervisor_.launch(request, [this](int inFd, int outFd, SandboxResult &) -> pid_t
+                       {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            LOG_ERROR("fork() failed: " << strerror(errno));
+            return -1;
+        }
+        if (pid == 0)
+        {
+            if (dup2(inFd, STDIN_FILENO) < 0 || dup2(outFd, STDOUT_FILENO) < 0)
+            {
+                _exit(1);
+            }
+            // consume the payload like a runner would, so the supervisor's
+            // input path is exercised too
+            execl("/bin/sh", "sh", "-c", "cat >/dev/null; sleep \"$0\"; printf %s \"$1\"",
+                  seconds_.c_str(), STUB_VERDICT, static_cast<char *>(nullptr));
+            _exit(1);
+        }
+        return pid; },
+                       std::move(done));
+}
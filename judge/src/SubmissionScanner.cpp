@@ -0,0 +1,284 @@
+#include "SubmissionScanner.h"
+
+#include <nlohmann/json.hpp>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace
+{
+    enum class Kind
+    {
+        Null,
+        Boolean,
+        Number,
+        String,
+        Object,
+        Array,
+    };
+
+    /**
+     * SAX handler that tracks just enough of its position to check the
+     * top-level fields and the shape of every test case. Values nested
+     * deeper than a test case's fields are skipped without being looked at.
+     */
+    class Scanner
+    {
+    public:
+        using number_integer_t = json::number_integer_t;
+        using number_unsigned_t = json::number_unsigned_t;
+        using number_float_t = json::number_float_t;
+        using string_t = json::string_t;
+        using binary_t = json::binary_t;
+
+        /**
+         * @param testSet the document is a bare testCases array, scanned as
+         * if it sat under the key in a payload
+         */
+        Scanner(SubmissionHeader &header, bool keepExpected, bool testSet)
+            : header_(header), keepExpected_(keepExpected), testSet_(testSet) {}
+
+        bool null() { return value(Kind::Null, nullptr); }
+        bool boolean(bool) { return value(Kind::Boolean, nullptr); }
+        bool number_integer(number_integer_t val) { return number(static_cast<double>(val)); }
+        bool number_unsigned(number_unsigned_t val) { return number(static_cast<double>(val)); }
+        bool number_float(number_float_t val, const string_t &) { return number(val); }
+        bool string(string_t &val) { return value(Kind::String, &val); }
+        bool binary(binary_t &) { return fail("unexpected binary value"); }
+
+        bool start_object(std::size_t)
+        {
+            if (!value(Kind::Object, nullptr))
+                return false;
+            stack_.push_back(Kind::Object);
+            if (depth() == 3 && inTestCases_)
+            {
+                testCaseSeen_ = 0;
+                testCaseId_ = 0;
+                expected_.clear();
+            }
+            return true;
+        }
+
+        bool end_object()
+        {
+            if (depth() == 3 && inTestCases_)
+            {
+                if (!(testCaseSeen_ & SEEN_ID))
+                    return fail("test case without testCaseId");
+                if (!(testCaseSeen_ & SEEN_PUBLIC))
+                    return fail("test case without isPublic");
+                header_.testCaseCount++;
+                if (keepExpected_)
+                    header_.expectedOutputs.emplace_back(testCaseId_, std::move(expected_));
+            }
+            if (depth() == 1)
+            {
+                if (!(topSeen_ & SEEN_CODE))
+                    return fail("missing code");
+                if (!(topSeen_ & SEEN_LANGUAGE))
+                    return fail("missing language");
+                if (!(topSeen_ & SEEN_MODE))
+                    return fail("missing mode");
+                if (!(topSeen_ & SEEN_TESTS))
+                    return fail("missing testCases");
+                if ((topSeen_ & SEEN_TESTS) == SEEN_TESTS)
+                    return fail("both testCases and testSetRef");
+            }
+            stack_.pop_back();
+            return true;
+        }
+
+        bool start_array(std::size_t)
+        {
+            if (!value(Kind::Array, nullptr))
+                return false;
+            stack_.push_back(Kind::Array);
+            return true;
+        }
+
+        bool end_array()
+        {
+            if (depth() == 2)
+                inTestCases_ = false;
+            stack_.pop_back();
+            return true;
+        }
+
+        bool key(string_t &val)
+        {
+            if (depth() == 1)
+                topKey_ = val;
+            else if (depth() == 3 && inTestCases_)
+                testCaseKey_ = val;
+            return true;
+        }
+
+        bool parse_error(std::size_t position, const std::string &, const nlohmann::detail::exception &e)
+        {
+            error_ = "invalid JSON at byte " + std::to_string(position) + ": " + e.what();
+            return false;
+        }
+
+        const std::string &error() const { return error_; }
+
+    private:
+        static constexpr unsigned SEEN_CODE = 1, SEEN_LANGUAGE = 2, SEEN_MODE = 4;
+        static constexpr unsigned SEEN_CASES = 8, SEEN_REF = 16, SEEN_TESTS = SEEN_CASES | SEEN_REF;
+        static constexpr unsigned SEEN_ID = 1, SEEN_PUBLIC = 2;
+
+        // a test set's array is at the depth of a payload's testCases
+        size_t depth() const { return stack_.size() + (testSet_ ? 1 : 0); }
+
+        bool number(double val)
+        {
+            number_ = val;
+            return value(Kind::Number, nullptr);
+        }
+
+        bool fail(const std::string &message)
+        {
+            if (error_.empty())
+                error_ = message;
+            return false;
+        }
+
+        bool value(Kind kind, string_t *str)
+        {
+            switch (depth())
+            {
+            case 0:
+                return kind == Kind::Object || fail("payload is not an object");
+            case 1:
+                if (testSet_)
+                {
+                    inTestCases_ = true;
+                    return kind == Kind::Array || fail("test set is not an array");
+                }
+                return topLevel(kind, str);
+            case 2:
+                return !inTestCases_ || kind == Kind::Object || fail("test case is not an object");
+            case 3:
+                return !inTestCases_ || testCaseField(kind, str);
+            default:
+                return true;
+            }
+        }
+
+        bool topLevel(Kind kind, string_t *str)
+        {
+            if (topKey_ == "testCases")
+            {
+                if (kind != Kind::Array)
+                    return fail("testCases is not an array");
+                inTestCases_ = true;
+                topSeen_ |= SEEN_CASES;
+                return true;
+            }
+
+            if (topKey_ == "floatTolerance")
+            {
+                if (kind != Kind::Number && kind != Kind::Null)
+                    return fail("floatTolerance is not a number");
+                header_.floatTolerance = kind == Kind::Number ? number_ : 0;
+                return true;
+            }
+
+            std::string *target = nullptr;
+            unsigned seen = 0;
+            bool nullable = false;
+            if (topKey_ == "code")
+                target = &header_.code, seen = SEEN_CODE;
+            else if (topKey_ == "language")
+                target = &header_.language, seen = SEEN_LANGUAGE;
+            else if (topKey_ == "mode")
+                target = &header_.mode, seen = SEEN_MODE;
+            else if (topKey_ == "libraryCode")
+                target = &header_.libraryCode, nullable = true;
+            else if (topKey_ == "outputType")
+                target = &header_.outputType, nullable = true;
+            else if (topKey_ == "compareMode")
+                target = &header_.compareMode, nullable = true;
+            else if (topKey_ == "testSetRef")
+                target = &header_.testSetRef, seen = SEEN_REF;
+            else
+                return true;
+
+            if (kind == Kind::Null && nullable)
+                return true;
+            if (kind != Kind::String)
+                return fail(topKey_ + " is not a string");
+            *target = std::move(*str);
+            topSeen_ |= seen;
+            return true;
+        }
+
+        bool testCaseField(Kind kind, string_t *str)
+        {
+            if (testCaseKey_ == "testCaseId")
+            {
+                if (kind != Kind::Number)
+                    return fail("testCaseId is not a number");
+                testCaseId_ = static_cast<int64_t>(number_);
+                testCaseSeen_ |= SEEN_ID;
+            }
+            else if (testCaseKey_ == "isPublic")
+            {
+                if (kind != Kind::Boolean)
+                    return fail("isPublic is not a boolean");
+                testCaseSeen_ |= SEEN_PUBLIC;
+            }
+            else if (testCaseKey_ == "input" || testCaseKey_ == "expectedOutput")
+            {
+                // SQL NULL arrives as JSON null, see the runners
+                if (kind != Kind::String && kind != Kind::Null)
+                    return fail(testCaseKey_ + " is not a string");
+                if (keepExpected_ && str && testCaseKey_ == "expectedOutput")
+                    expected_ = std::move(*str);
+            }
+            return true;
+        }
+
+        SubmissionHeader &header_;
+        const bool keepExpected_;
+        const bool testSet_;
+        std::vector<Kind> stack_;
+        std::string topKey_;
+        std::string testCaseKey_;
+        bool inTestCases_ = false;
+        unsigned topSeen_ = 0;
+        unsigned testCaseSeen_ = 0;
+        // the last number seen, and the test case being read
+        double number_ = 0;
+        int64_t testCaseId_ = 0;
+        std::string expected_;
+        std::string error_;
+    };
+}
+
+bool scanSubmission(const std::string &payload, SubmissionHeader &header, std::string &error,
+                    bool keepExpectedOutputs)
+{
+    header = SubmissionHeader();
+    Scanner scanner(header, keepExpectedOutputs, false);
+    if (!json::sax_parse(payload, &scanner))
+    {
+        error = scanner.error().empty() ? "invalid submission" : scanner.error();
+        return false;
+    }
+    return true;
+}
+
+bool scanTestCases(const std::string &testCases, SubmissionHeader &header, std::string &error,
+                   bool keepExpectedOutputs)
+{
+    header.testCaseCount = 0;
+    header.expectedOutputs.clear();
+    Scanner scanner(header, keepExpectedOutputs, true);
+    if (!json::sax_parse(testCases, &scanner))
+    {
+        error = scanner.error().empty() ? "invalid test set" : scanner.error();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,268 @@
+#include "TestSetStore.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "RedisHandler.h"
+#include "Sha256.h"
+#include "SubmissionScanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // where the judge data directory is mounted inside every sandbox
+    const char *SANDBOX_DATA_DIR = "/judge";
+
+    bool isHash(const std::string &hash)
+    {
+        return hash.size() == 64 &&
+               std::all_of(hash.begin(), hash.end(), [](char c)
+                           { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+    }
+
+    bool ensureDir(const std::string &path, mode_t mode)
+    {
+        if (mkdir(path.c_str(), mode) != 0 && errno != EEXIST)
+        {
+            return false;
+        }
+        return chmod(path.c_str(), mode) == 0;
+    }
+
+    Metrics::Counter &lookups(const char *result)
+    {
+        return METRICS()->counter("judge_testset_lookups_total", "Test set lookups by jobs, by result.",
+                                  {{"result", result}});
+    }
+}
+
+TestSetStore::TestSetStore(const std::string &dataDir, uint64_t maxBytes)
+    : dir_(dataDir + "/testsets"), maxBytes_(maxBytes)
+{
+}
+
+bool TestSetStore::initialize()
+{
+    const std::string dataDir = dir_.substr(0, dir_.rfind('/'));
+    // traverse-only like the compile cache: a sandbox can open the set it
+    // was pointed at but not list the others
+    if (!ensureDir(dataDir, 0711) || !ensureDir(dir_, 0711))
+    {
+        LOG_ERROR("Cannot create test set directory " << dir_ << ": " << strerror(errno));
+        return false;
+    }
+
+    // the index is in memory only, so whatever is here is from a previous run
+    DIR *dir = opendir(dir_.c_str());
+    if (!dir)
+    {
+        LOG_ERROR("Cannot read test set directory " << dir_ << ": " << strerror(errno));
+        return false;
+    }
+    while (dirent *ent = readdir(dir))
+    {
+        const std::string name = ent->d_name;
+        if (name != "." && name != "..")
+            unlink((dir_ + "/" + name).c_str());
+    }
+    closedir(dir);
+
+    files_ = true;
+    LOG_INFO("Test sets at " << dir_ << ", " << maxBytes_ / 1024 << " KiB in memory.");
+    return true;
+}
+
+std::string TestSetStore::redisKey(const std::string &hash)
+{
+    return "judge:testset:" + hash;
+}
+
+std::shared_ptr<const TestSet> TestSetStore::acquire(const std::string &hash, std::string &error)
+{
+    if (!isHash(hash))
+    {
+        error = "testSetRef is not a SHA-256 hash";
+        return nullptr;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            auto it = index_.find(hash);
+            if (it != index_.end())
+            {
+                lru_.splice(lru_.begin(), lru_, it->second.position);
+                stats_.hits++;
+                lookups("hit").inc();
+                return it->second.testSet;
+            }
+            if (!fetching_.count(hash))
+                break;
+            // another job is fetching it, take theirs
+            fetched_.wait(lock);
+        }
+        fetching_.insert(hash);
+        stats_.misses++;
+    }
+    lookups("miss").inc();
+
+    std::shared_ptr<const TestSet> testSet = fetch(hash, error);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fetching_.erase(hash);
+        if (testSet)
+        {
+            insertLocked(testSet);
+        }
+        else
+        {
+            stats_.failures++;
+        }
+    }
+    fetched_.notify_all();
+    if (!testSet)
+    {
+        lookups("error").inc();
+    }
+    return testSet;
+}
+
+std::shared_ptr<const TestSet> TestSetStore::add(std::string testCases, std::string &error)
+{
+    const std::string hash = Sha256::hex(testCases);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(hash);
+        if (it != index_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second.position);
+            return it->second.testSet;
+        }
+    }
+
+    std::shared_ptr<const TestSet> testSet = load(hash, std::move(testCases), error);
+    if (!testSet)
+    {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(hash);
+    // added by another thread meanwhile, theirs is the one with the file
+    if (it != index_.end())
+    {
+        return it->second.testSet;
+    }
+    insertLocked(testSet);
+    return testSet;
+}
+
+std::shared_ptr<const TestSet> TestSetStore::fetch(const std::string &hash, std::string &error)
+{
+    std::string testCases;
+    if (!REDIS()->get(redisKey(hash), testCases))
+    {
+        error = "test set " + hash + " is not in Redis";
+        return nullptr;
+    }
+    if (Sha256::hex(testCases) != hash)
+    {
+        error = "test set " + hash + " does not match its hash";
+        return nullptr;
+    }
+    return load(hash, std::move(testCases), error);
+}
+
+std::shared_ptr<const TestSet> TestSetStore::load(const std::string &hash, std::string testCases, std::string &error)
+{
+    auto testSet = std::make_shared<TestSet>();
+    testSet->hash = hash;
+    testSet->testCases = std::move(testCases);
+
+    SubmissionHeader header;
+    if (!scanTestCases(testSet->testCases, header, error, true))
+    {
+        error = "test set " + hash + ": " + error;
+        return nullptr;
+    }
+    testSet->count = header.testCaseCount;
+    testSet->expectedOutputs = std::move(header.expectedOutputs);
+
+    if (files_)
+    {
+        // written aside and renamed into place, so a runner never reads half a set
+        static std::atomic<uint64_t> sequence{0};
+        const std::string tmp = dir_ + "/.tmp-" + std::to_string(getpid()) + "-" + std::to_string(sequence++);
+        const std::string file = hash + ".json";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(testSet->testCases.data(), static_cast<std::streamsize>(testSet->testCases.size()));
+        out.close();
+        if (!out || chmod(tmp.c_str(), 0644) != 0 || rename(tmp.c_str(), (dir_ + "/" + file).c_str()) != 0)
+        {
+            LOG_ERROR("Failed to write test set " << hash << ": " << strerror(errno) << ", passing it inline.");
+            unlink(tmp.c_str());
+        }
+        else
+        {
+            testSet->sandboxPath = std::string(SANDBOX_DATA_DIR) + "/testsets/" + file;
+        }
+    }
+    LOG_INFO("Loaded test set " << hash << ": " << testSet->count << " tests, " << testSet->testCases.size()
+                                 << " bytes.");
+    return testSet;
+}
+
+void TestSetStore::insertLocked(const std::shared_ptr<const TestSet> &testSet)
+{
+    uint64_t bytes = testSet->testCases.size();
+    for (const auto &expected : testSet->expectedOutputs)
+        bytes += expected.second.size();
+    lru_.push_front(testSet->hash);
+    index_[testSet->hash] = {lru_.begin(), testSet, bytes};
+    stats_.bytes += bytes;
+    // pinned by the caller until its job is done, so it survives this
+    evictLocked();
+}
+
+void TestSetStore::evictLocked()
+{
+    auto it = lru_.end();
+    while (stats_.bytes > maxBytes_ && it != lru_.begin())
+    {
+        --it;
+        auto node = index_.find(*it);
+        // only the cache holds it, no job is using it
+        if (node->second.testSet.use_count() > 1)
+            continue;
+        if (!node->second.testSet->sandboxPath.empty())
+            unlink((dir_ + "/" + *it + ".json").c_str());
+        stats_.bytes -= node->second.bytes;
+        index_.erase(node);
+        it = lru_.erase(it);
+        stats_.evictions++;
+    }
+    stats_.entries = index_.size();
+}
+
+TestSetStore::Stats TestSetStore::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void TestSetStore::logStats() const
+{
+    const Stats s = stats();
+    const uint64_t lookups = s.hits + s.misses;
+    LOG_INFO("Test sets: entries=" << s.entries << " bytes=" << s.bytes << "/" << maxBytes_
+                                   << " hits=" << s.hits << " misses=" << s.misses
+                                   << " hitRate=" << (lookups ? (100 * s.hits / lookups) : 0) << "%"
+                                   << " failures=" << s.failures << " evictions=" << s.evictions);
+}
@@ -0,0 +1,117 @@
+#include "VerdictCache.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Sha256.h"
+
+namespace
+{
+    Metrics::Counter &lookups(const char *result)
+    {
+        return METRICS()->counter("judge_verdict_cache_lookups_total", "Verdict cache lookups by jobs, by result.",
+                                  {{"result", result}});
+    }
+
+    // what an entry costs beyond its verdict: key in the index and the LRU
+    uint64_t entryBytes(const std::string &verdict)
+    {
+        return verdict.size() + 2 * 64;
+    }
+}
+
+VerdictCache::VerdictCache(uint64_t maxBytes, std::chrono::seconds ttl) : maxBytes_(maxBytes), ttl_(ttl)
+{
+}
+
+std::string VerdictCache::key(const std::string &language, const std::string &code, const std::string &libraryCode,
+                              const std::string &outputType, const std::string &testSetHash,
+                              const std::string &compareOptions, const std::string &imageDigest)
+{
+    return Sha256()
+        .field(language)
+        .field(code)
+        .field(libraryCode)
+        .field(outputType)
+        .field(testSetHash)
+        .field(compareOptions)
+        .field(imageDigest)
+        .hexDigest();
+}
+
+std::optional<std::string> VerdictCache::lookup(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end())
+    {
+        stats_.misses++;
+        lookups("miss").inc();
+        return std::nullopt;
+    }
+    if (std::chrono::steady_clock::now() >= it->second.expires)
+    {
+        removeLocked(it);
+        stats_.expirations++;
+        stats_.misses++;
+        lookups("expired").inc();
+        return std::nullopt;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.position);
+    stats_.hits++;
+    lookups("hit").inc();
+    return it->second.verdict;
+}
+
+void VerdictCache::store(const std::string &key, std::string verdict)
+{
+    if (entryBytes(verdict) > maxBytes_)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end())
+    {
+        // a second job with the same key was judged before the first stored
+        removeLocked(it);
+    }
+    lru_.push_front(key);
+    stats_.bytes += entryBytes(verdict);
+    index_[key] = {lru_.begin(), std::move(verdict), std::chrono::steady_clock::now() + ttl_};
+    stats_.entries = index_.size();
+    stats_.stores++;
+    evictLocked();
+}
+
+void VerdictCache::removeLocked(std::unordered_map<std::string, Node>::iterator it)
+{
+    stats_.bytes -= entryBytes(it->second.verdict);
+    lru_.erase(it->second.position);
+    index_.erase(it);
+    stats_.entries = index_.size();
+}
+
+void VerdictCache::evictLocked()
+{
+    while (stats_.bytes > maxBytes_ && !lru_.empty())
+    {
+        removeLocked(index_.find(lru_.back()));
+        stats_.evictions++;
+    }
+}
+
+VerdictCache::Stats VerdictCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void VerdictCache::logStats() const
+{
+    const Stats s = stats();
+    const uint64_t lookups = s.hits + s.misses;
+    LOG_INFO("Verdict cache: entries=" << s.entries << " bytes=" << s.bytes << "/" << maxBytes_
+                                       << " hits=" << s.hits << " misses=" << s.misses
+                                       << " hitRate=" << (lookups ? (100 * s.hits / lookups) : 0) << "%"
+                                       << " stores=" << s.stores << " expirations=" << s.expirations
+                                       << " evictions=" << s.evictions);
+}
@@ -0,0 +1,247 @@
+#include "WorkStealingExecutor.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+namespace
+{
+    // lets submit() from inside a task go to the submitting worker's own deque
+    thread_local const WorkStealingExecutor *currentExecutor = nullptr;
+    thread_local size_t currentWorker = 0;
+
+    // xorshift, only used to pick which worker to steal from first
+    size_t randomIndex(size_t bound)
+    {
+        thread_local uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<size_t>(state % bound);
+    }
+}
+
+WorkStealingExecutor::WorkStealingExecutor(size_t workers)
+{
+    const size_t count = std::max<size_t>(workers, 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        threads_.emplace_back([this, i]
+                              { workerLoop(i); });
+    }
+    watchdog_ = std::thread([this]
+                            { watchdogLoop(); });
+}
+
+WorkStealingExecutor::~WorkStealingExecutor()
+{
+    // workers finish everything already queued before they exit
+    {
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        stop_ = true;
+    }
+    parkCv_.notify_all();
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(watchdogMutex_);
+        watchdogStop_ = true;
+    }
+    watchdogCv_.notify_all();
+    watchdog_.join();
+}
+
+CancellationToken WorkStealingExecutor::submit(Task task, std::chrono::milliseconds timeout)
+{
+    Entry entry;
+    entry.task = std::move(task);
+    entry.timeout = timeout;
+    CancellationToken token = entry.token;
+
+    const size_t target = currentExecutor == this ? currentWorker
+                                                  : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    // counted before it is visible, so a worker that takes it never sees
+    // pending_ go below zero
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+        workers_[target]->tasks.push_back(std::move(entry));
+    }
+    submitted_++;
+
+    // pending_ is raised before parked_ is read and a parking worker raises
+    // parked_ before it reads pending_, so one of the two always sees the
+    // other and no wake-up is lost
+    if (parked_.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(parkMutex_);
+        }
+        parkCv_.notify_one();
+    }
+    return token;
+}
+
+void WorkStealingExecutor::workerLoop(size_t index)
+{
+    currentExecutor = this;
+    currentWorker = index;
+
+    while (true)
+    {
+        Entry entry;
+        if (takeTask(index, entry))
+        {
+            pending_.fetch_sub(1);
+            runTask(index, entry);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(parkMutex_);
+        parked_.fetch_add(1);
+        parkCv_.wait(lock, [this]
+                     { return stop_ || pending_.load() > 0; });
+        parked_.fetch_sub(1);
+        if (stop_ && pending_.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+bool WorkStealingExecutor::takeTask(size_t index, Entry &out)
+{
+    {
+        Worker &own = *workers_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            out = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    const size_t count = workers_.size();
+    const size_t start = randomIndex(count);
+    for (size_t k = 0; k < count; ++k)
+    {
+        const size_t victim = (start + k) % count;
+        if (victim == index)
+            continue;
+        Worker &other = *workers_[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty())
+        {
+            out = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            stolen_++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingExecutor::runTask(size_t index, Entry &entry)
+{
+    Worker &worker = *workers_[index];
+    const bool watched = entry.timeout.count() > 0;
+    if (watched)
+    {
+        {
+            std::lock_guard<std::mutex> lock(watchdogMutex_);
+            worker.watched = true;
+            worker.running = entry.token;
+            worker.deadline = std::chrono::steady_clock::now() + entry.timeout;
+        }
+        watchdogCv_.notify_one();
+    }
+
+    try
+    {
+        entry.task(entry.token);
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR("Exception caught in executor task: " << e.what());
+    }
+    catch (...)
+    {
+        LOG_ERROR("Unknown exception caught in executor task.");
+    }
+
+    if (watched)
+    {
+        std::lock_guard<std::mutex> lock(watchdogMutex_);
+        worker.watched = false;
+    }
+    executed_++;
+}
+
+void WorkStealingExecutor::watchdogLoop()
+{
+    std::unique_lock<std::mutex> lock(watchdogMutex_);
+    while (!watchdogStop_)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        std::vector<CancellationToken> expired;
+        for (auto &worker : workers_)
+        {
+            if (!worker->watched)
+                continue;
+            if (worker->deadline <= now)
+            {
+                worker->watched = false;
+                expired.push_back(worker->running);
+            }
+            else
+            {
+                next = std::min(next, worker->deadline);
+            }
+        }
+
+        if (!expired.empty())
+        {
+            // cancelling kills sandboxes, don't hold up the workers meanwhile
+            lock.unlock();
+            for (const auto &token : expired)
+            {
+                token.cancel();
+            }
+            timedOut_ += expired.size();
+            LOG_WARNING("Watchdog cancelled " << expired.size() << " task(s) that ran over their timeout.");
+            lock.lock();
+            continue;
+        }
+
+        if (next == std::chrono::steady_clock::time_point::max())
+            watchdogCv_.wait(lock);
+        else
+            watchdogCv_.wait_until(lock, next);
+    }
+}
+
+WorkStealingExecutor::Stats WorkStealingExecutor::stats() const
+{
+    Stats stats;
+    stats.submitted = submitted_;
+    stats.executed = executed_;
+    stats.stolen = stolen_;
+    stats.timedOut = timedOut_;
+    stats.workers = workers_.size();
+    return stats;
+}
+
+void WorkStealingExecutor::logStats() const
+{
+    const Stats s = stats();
+    LOG_INFO("Executor: workers=" << s.workers << " submitted=" << s.submitted << " executed=" << s.executed
+                                  << " stolen=" << s.stolen << " timedOut=" << s.timedOut);
+}
@@ -1,28 +1,178 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
 #include <thread>
+#include <unistd.h>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "JudgeConfig.h"
 #include "JudgeEngine.h"
 #include "Logger.h"
+#include "Regrader.h"
+#include "SandboxExecutor.h"
+#include "SandboxPool.h"
+
+namespace
+{
+    /**
+     * `judge --sandbox-bench <language> [runs] [concurrency]`
+     *
+     * Pushes a trivial one-test submission through the configured sandbox
+     * backend (JUDGE_SANDBOX) without Redis, so docker and native startup
+     * latency and throughput can be compared on the same host.
+     */
+    int runSandboxBench(const JudgeConfig &config, const std::string &language, int runs, int concurrency)
+    {
+        SandboxPool pool(config.sandboxBackend == "docker" ? config.poolSizes : std::map<std::string, size_t>{},
+                         config.poolMaxUses, config.dataHostDir);
+        std::unique_ptr<SandboxExecutor> executor = makeSandboxExecutor(config, pool);
+        pool.start();
+        // give the pool a moment to warm up so we measure hits, not misses
+        std::this_thread::sleep_for(std::chrono::seconds(config.sandboxBackend == "docker" ? 5 : 0));
+
+        std::string code = "int main(){return 0;}";
+        if (language == "python")
+            code = "print(1)";
+        else if (language == "javascript" || language == "typescript")
+            code = "console.log(1)";
+        else if (language == "sql")
+            code = "SELECT 1;";
+
+        const std::string input = nlohmann::json{
+            {"language", language},
+            {"code", code},
+            {"libraryCode", ""},
+            {"outputType", "text"},
+            {"testCases", {{{"testCaseId", 1}, {"input", ""}, {"expectedOutput", "1"}, {"isPublic", true}}}},
+        }.dump();
+
+        std::mutex mutex;
+        std::vector<double> wall;
+        std::vector<double> startup;
+        std::atomic<int> next{0};
+        std::atomic<int> failures{0};
+
+        const auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < concurrency; ++t)
+        {
+            threads.emplace_back([&]
+                                 {
+                while (next++ < runs)
+                {
+                    SandboxRequest request;
+                    request.image = imageForLanguage(language);
+                    request.input = input;
+                    SandboxResult result = executor->run(request);
+                    if (!result.launched || result.exitCode != 0)
+                        failures++;
+                    std::lock_guard<std::mutex> lock(mutex);
+                    wall.push_back(result.wallMs);
+                    startup.push_back(result.startupMs);
+                } });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        auto percentile = [](std::vector<double> values, double p)
+        {
+            if (values.empty())
+                return 0.0;
+            std::sort(values.begin(), values.end());
+            return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+        };
+
+        std::cout << "backend=" << executor->name() << " language=" << language
+                  << " runs=" << runs << " concurrency=" << concurrency << " failures=" << failures << "\n"
+                  << "  throughput " << runs / seconds << " runs/s\n"
+                  << "  wall    p50 " << percentile(wall, 0.50) << "ms  p99 " << percentile(wall, 0.99) << "ms\n"
+                  << "  startup p50 " << percentile(startup, 0.50) << "ms  p99 " << percentile(startup, 0.99) << "ms\n";
+        pool.logStats();
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /**
+     * `judge --regrade <in.ndjson|-> [out.ndjson|-]`
+     *
+     * Judges every submission in the input through the configured sandbox
+     * backend without Redis and writes the verdicts as NDJSON, see
+     * Regrader. Logs go to stderr (warnings and up unless JUDGE_LOG_LEVEL
+     * says otherwise) so stdout carries nothing but verdicts; a summary
+     * follows at the end.
+     */
+    int runRegrade(const JudgeConfig &config, const std::string &inPath, const std::string &outPath)
+    {
+        if (!std::getenv("JUDGE_LOG_LEVEL"))
+        {
+            Logger::setLevel(LogLevel::Warning);
+        }
+        std::ifstream inFile;
+        if (inPath != "-")
+        {
+            inFile.open(inPath);
+            if (!inFile)
+            {
+                std::cerr << "cannot open " << inPath << ": " << strerror(errno) << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        int outFd = -1;
+        if (outPath == "-")
+        {
+            // keep the real stdout for verdicts, the log writer gets stderr
+            outFd = dup(STDOUT_FILENO);
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+        }
+        else
+        {
+            outFd = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        }
+        if (outFd < 0)
+        {
+            std::cerr << "cannot open " << outPath << ": " << strerror(errno) << "\n";
+            return EXIT_FAILURE;
+        }
+
+        Regrader regrader(config);
+        const Regrader::Summary summary = regrader.run(inPath == "-" ? std::cin : inFile, outFd);
+        close(outFd);
+        regrader.printSummary(summary, std::cerr);
+        return summary.invalid == 0 && summary.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
 
 int main(int argc, char *argv[])
 {
-    const char *HOST = std::getenv("REDIS_HOST") ? std::getenv("REDIS_HOST") : "127.0.0.1";
-    const char *portEnv = std::getenv("REDIS_PORT");
-    int PORT = portEnv ? std::atoi(portEnv) : 6379;
+    const JudgeConfig config = JudgeConfig::fromEnvironment();
+
+    // A runner that exits without reading all of its stdin must surface as
+    // EPIPE on that write, not kill the judge.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (argc >= 3 && std::strcmp(argv[1], "--sandbox-bench") == 0)
+    {
+        const int runs = argc >= 4 ? std::max(1, std::atoi(argv[3])) : 20;
+        const int concurrency = argc >= 5 ? std::max(1, std::atoi(argv[4])) : 1;
+        return runSandboxBench(config, argv[2], runs, concurrency);
+    }
+    if (argc >= 3 && std::strcmp(argv[1], "--regrade") == 0)
+    {
+        return runRegrade(config, argv[2], argc >= 4 ? argv[3] : "-");
+    }
 
     const unsigned int cores = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 4;
 
-    // Each worker thread mostly blocks on waitpid() for its sandboxed docker
-    // container rather than spinning CPU itself, so oversubscribing cores is
-    // expected and beneficial here as the actual CPU is consumed by the
-    // spawned --cpus=0.5 sandbox container, not this coordinating thread.
-    // Default to 4x cores, override via JUDGE_THREADS for tuning without a
-    // rebuild.
-    const char *threadsEnv = std::getenv("JUDGE_THREADS");
-    const unsigned int numThreads = threadsEnv ? static_cast<unsigned int>(std::atoi(threadsEnv)) : cores * 4;
-
-    LOG_INFO("Initializing Judge Engine with " << numThreads << " threads (host has " << cores << " cores).");
-    JudgeEngine engine(HOST, PORT, numThreads);
+    LOG_INFO("Initializing Judge Engine with " << config.numThreads << " threads (host has " << cores << " cores).");
+    JudgeEngine engine(config);
     engine.start();
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
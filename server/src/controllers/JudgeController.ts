@@ -13,6 +13,8 @@ import { systemEventEmitter } from '../services/statistics/emitter';
 import { SubmissionCompletedEvent, SubmissionCreatedEvent } from '../services/statistics/events';
 import { getRemainingAttempts, getSubmissionAttemptCount } from '../models/AssignmentModel';
 import { calculateGrade } from '../services/grading/Grader';
+import { enqueueJudgeJob } from '../services/judge/JudgeQueue';
+import { readVerdict, verdictWaitMs } from '../services/judge/VerdictWaiter';
 
 
 interface RunCodeRequest {
@@ -81,12 +83,11 @@ export const runCodeHandler = async (req: Request, res: Response): Promise<void>
     }
 
     const mode = "run";
-    await redisClient.hSet(`judge:${jobId}`, {
-      data: JSON.stringify({ code, language, testCases, mode, outputType: outputType || 'text', libraryCode }),
-      createdAt: Date.now().toString(),
-    });
-
-    await redisClient.lPush('judge:queue', jobId);
+    await enqueueJudgeJob(
+      jobId,
+      { code, language, testCases, mode, outputType: outputType || 'text', libraryCode },
+      { priority: 'run' }
+    );
 
     const duration = Date.now() - startTime;
     logger.info(
@@ -130,7 +131,7 @@ export const getRunStatusHandler = async (req: Request, res: Response): Promise<
   }
 
   try {
-    const raw = await redisClient.get(`judge:run:verdict:${jobId}`);
+    const raw = await readVerdict(`judge:run:verdict:${jobId}`, verdictWaitMs(req.query.wait));
     
     if (raw === null) {
       const verdict: JudgeVerdict = { status: 'pending' };
@@ -355,11 +356,11 @@ export const submitHandler = async (req: Request, res: Response): Promise<void>
   }
 
   try {
-    await redisClient.hSet(`judge:${submissionId}`, {
-      data: JSON.stringify({ code, language, testCases, mode: "submit", libraryCode, outputType }),
-      createdAt: Date.now().toString(),
-    });
-    await redisClient.lPush("judge:queue", submissionId.toString());
+    await enqueueJudgeJob(
+      submissionId.toString(),
+      { code, language, testCases, mode: "submit", libraryCode, outputType },
+      { priority: "submit" }
+    );
     logger.info(
       { fn: functionName, submissionId },
       `Enqueued job ${submissionId} for submission ${submissionId}`
@@ -417,7 +418,7 @@ export const getSubmitStatusHandler = async (
   try {
     await updateSubmissionStatus(submissionId, "running");
 
-    const raw = await redisClient.get(`judge:submit:verdict:${submissionId}`);
+    const raw = await readVerdict(`judge:submit:verdict:${submissionId}`, verdictWaitMs(req.query.wait));
 
     if (raw === null) {
       const verdict: JudgeVerdict = { status: "pending" };
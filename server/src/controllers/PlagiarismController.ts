@@ -7,6 +7,8 @@ import { getSubmissionById, getSubmissionsFingerprintsByAssignment } from "../mo
 import { getAssignmentById } from '../models/AssignmentModel';
 import pool from '../config/db';
 import { systemEventEmitter } from '../services/statistics/emitter';
+import { enqueueJudgeJob } from '../services/judge/JudgeQueue';
+import { readVerdict } from '../services/judge/VerdictWaiter';
 export interface PlagiarismDetectedEvent {
   type: 'PLAGIARISM_DETECTED';
   timestamp: string;
@@ -22,6 +24,63 @@ export interface PlagiarismDetectedEvent {
 }
 
 const PLAGIARISM_URL = process.env.PLAGIARISM_URL || 'http://localhost:8001'
+// "http" (the default) calls the plagiarism microservice at PLAGIARISM_URL;
+// "judge" queues checks as judge jobs, answered from the judge's in-memory
+// fingerprint index. Fingerprints from one are not comparable with the
+// other's, and stored ones carry no tag saying which made them, so the judge
+// is opt-in: switching an installation that already has fingerprints over
+// compares new submissions against hashes it cannot match.
+const PLAGIARISM_ENGINE = process.env.PLAGIARISM_ENGINE === 'judge' ? 'judge' : 'http';
+// a check is background work, queued on the judge's plagiarism lane
+const PLAGIARISM_WAIT_MS = 120000;
+
+interface PlagiarismCheckResponse {
+  fingerprint?: number[];
+  results?: { compared_submission: number; similarity: number }[];
+}
+
+/**
+ * Fingerprints a submission and compares it with the assignment's prior
+ * ones, on the engine PLAGIARISM_ENGINE picks. The judge indexes `existing`
+ * fingerprints it does not hold yet, e.g. after a restart.
+ */
+async function requestPlagiarismCheck(
+  submissionId: number,
+  assignmentId: number,
+  language: string,
+  code: string,
+  existing: { id: number; fingerprint: number[] }[]
+): Promise<{ data: PlagiarismCheckResponse }> {
+  if (PLAGIARISM_ENGINE === 'http') {
+    return axios.post(`${PLAGIARISM_URL}/plagiarism/check`, {
+      submission_id: submissionId,
+      assignment_id: assignmentId,
+      language,
+      code,
+      existing_submissions: existing
+    });
+  }
+
+  // unique per check, a resubmission is checked again
+  const jobId = `plagiarism-${submissionId}-${Date.now()}`;
+  await enqueueJudgeJob(jobId, {
+    action: "check",
+    assignmentId,
+    submissionId,
+    language,
+    code,
+    existing
+  }, { priority: "plagiarism" });
+  const raw = await readVerdict(`judge:plagiarism:verdict:${jobId}`, PLAGIARISM_WAIT_MS);
+  if (raw === null) {
+    throw new Error(`No answer to plagiarism job ${jobId} within ${PLAGIARISM_WAIT_MS}ms`);
+  }
+  const verdict = JSON.parse(raw);
+  if (verdict.status !== "completed") {
+    throw new Error(`Plagiarism job ${jobId} failed: ${verdict.message}`);
+  }
+  return { data: verdict };
+}
 
 
 // TODO: deal with submissions done by the same user.
@@ -140,11 +199,11 @@ export async function runPlagiarismCheck(submissionId: number): Promise<void> {
     logger.info(
       {
         fn,
-        plagiarismUrl: PLAGIARISM_URL,
+        plagiarismEngine: PLAGIARISM_ENGINE,
         submissionId,
         assignmentId: assignment_id
       },
-      `Calling plagiarism microservice at ${PLAGIARISM_URL}`
+      `Requesting plagiarism check from ${PLAGIARISM_ENGINE === 'http' ? PLAGIARISM_URL : 'the judge'}`
     );
     logger.debug(
       {
@@ -155,13 +214,13 @@ export async function runPlagiarismCheck(submissionId: number): Promise<void> {
       `Request details: submissionId=${submissionId}, assignmentId=${assignment_id}`
     );
     await debugPlagiarismRequest(submissionId, assignment_id, code, formattedSubmissions);
-    const response = await axios.post(`${PLAGIARISM_URL}/plagiarism/check`, {
-      submission_id: submissionId,
+    const response = await requestPlagiarismCheck(
+      submissionId,
       assignment_id,
-      language: "cpp",
+      submission.language ?? "cpp",
       code,
-      existing_submissions: formattedSubmissions
-    });
+      formattedSubmissions
+    );
 
     if (response.data.fingerprint && Array.isArray(response.data.fingerprint)) {
       logger.info(
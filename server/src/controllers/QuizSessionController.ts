@@ -3,7 +3,9 @@ import redisClient from "../config/redis";
 import pool from "../config/db";
 import logger from "../config/logger";
 import { JudgeVerdict, TestResult } from "../types";
-import { startSession, getSession, submitSession, getMySession } from "../models/QuizSessionModel";
+import { startSession, getSession, submitSession, getMySession, getSessionDeadline } from "../models/QuizSessionModel";
+import { enqueueJudgeJob } from "../services/judge/JudgeQueue";
+import { readVerdict, verdictWaitMs } from "../services/judge/VerdictWaiter";
 import {
   createQuizSubmission,
   getQuizProblemTestCases,
@@ -139,11 +141,12 @@ export const submitProblemController = async (req: Request, res: Response): Prom
 
     const submissionId = await createQuizSubmission(sessionId, quizProblemId, languageId, code);
 
-    await redisClient.hSet(`judge:${submissionId}`, {
-      data: JSON.stringify({ code, language, testCases, mode: "submit" }),
-      createdAt: Date.now().toString(),
-    });
-    await redisClient.lPush("judge:queue", submissionId.toString());
+    const deadline = await getSessionDeadline(sessionId);
+    await enqueueJudgeJob(
+      submissionId.toString(),
+      { code, language, testCases, mode: "submit" },
+      { priority: "quiz", deadline }
+    );
 
     logger.info({ fn, submissionId, sessionId, quizProblemId }, "Quiz problem enqueued");
     res.status(202).json({
@@ -175,7 +178,7 @@ export const getQuizSubmitStatusController = async (req: Request, res: Response)
       return;
     }
 
-    const raw = await redisClient.get(`judge:submit:verdict:${submissionId}`);
+    const raw = await readVerdict(`judge:submit:verdict:${submissionId}`, verdictWaitMs(req.query.wait));
     if (raw === null) {
       res.status(200).json({ status: "pending" } as JudgeVerdict);
       return;
@@ -171,3 +171,29 @@ export const submitSession = async (sessionId: number, studentId: number) => {
   );
   logger.info({ fn, sessionId }, "Session marked as submitted");
 };
+
+/**
+ * When the session's time runs out (time limit or the quiz's end date,
+ * whichever comes first) as epoch ms, or null if neither applies. The judge
+ * schedules quiz submissions by it.
+ */
+export const getSessionDeadline = async (sessionId: number): Promise<number | null> => {
+  const result = await pool.query(
+    `SELECT qs.start_time, q.time_limit_minutes, q.end_date
+     FROM quiz_sessions qs
+     JOIN quizzes q ON q.quiz_id = qs.quiz_id
+     WHERE qs.session_id = $1`,
+    [sessionId]
+  );
+  if (result.rowCount === 0) return null;
+  const { start_time, time_limit_minutes, end_date } = result.rows[0];
+
+  const candidates: number[] = [];
+  if (time_limit_minutes) {
+    candidates.push(new Date(start_time).getTime() + time_limit_minutes * 60000);
+  }
+  if (end_date) {
+    candidates.push(new Date(end_date).getTime());
+  }
+  return candidates.length > 0 ? Math.min(...candidates) : null;
+};
@@ -137,9 +137,10 @@ export const createSubmission = async ({
     const fn = "getSubmissionById";
     logger.info({ fn, submissionId }, `Fetching submission ${submissionId}`);
     const { rows, rowCount } = await pool.query<SubmissionRecord>(
-      `SELECT submission_id, assignment_id, code
-         FROM submissions
-        WHERE submission_id = $1`,
+      `SELECT s.submission_id, s.assignment_id, s.code, l.name AS language
+         FROM submissions s
+         LEFT JOIN languages l ON l.language_id = s.language_id
+        WHERE s.submission_id = $1`,
       [submissionId]
     );
     if (rowCount === 0) {
@@ -502,6 +503,7 @@ export function saveSubmissionResults(
         passedArray.push(result.status === "passed");
         actualOutputs.push(result.actual ?? null);
         executionTimes.push(result.executionTime ?? null);
+        memoryUsages.push(result.peakMemoryKb ?? null);
         errorMessages.push(result.errorMessage ?? null);
       }
 
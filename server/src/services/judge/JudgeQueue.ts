@@ -0,0 +1,111 @@
+import { createHash } from "crypto";
+import redisClient from "../../config/redis";
+
+/**
+ * Priority classes the judge schedules by, most urgent first. Each class has
+ * its own Redis list; "run" keeps the original judge:queue so judges that
+ * predate the lanes still drain it. "plagiarism" is no class of its own: the
+ * judge claims those jobs through a separate intake, with its own
+ * concurrency limit and without taking a sandbox slot.
+ */
+export type JudgePriority = "quiz" | "submit" | "run" | "plagiarism";
+
+const JUDGE_LANES: Record<JudgePriority, string> = {
+  quiz: "judge:queue:quiz",
+  submit: "judge:queue:submit",
+  run: "judge:queue",
+  plagiarism: "judge:queue:plagiarism",
+};
+
+/**
+ * The same lanes as streams, read by judges started with JUDGE_INTAKE=stream
+ * through a consumer group; see the judge's JobClass.h.
+ */
+const JUDGE_STREAMS: Record<JudgePriority, string> = {
+  quiz: "judge:stream:quiz",
+  submit: "judge:stream:submit",
+  run: "judge:stream:run",
+  plagiarism: "judge:stream:plagiarism",
+};
+
+const useStreams = process.env.JUDGE_INTAKE === "stream";
+
+/**
+ * Idle list-intake judges park on this list and claim through their claim
+ * script once a token arrives, so a job never leaves its lane except onto
+ * the processing queue. Trimmed: one token per idle judge is all it takes.
+ */
+const JUDGE_WAKE_KEY = "judge:queue:wake";
+// the plagiarism intake parks on its own
+const JUDGE_PLAGIARISM_WAKE_KEY = "judge:queue:plagiarism:wake";
+const JUDGE_WAKE_TOKENS = 64;
+
+/**
+ * Graded jobs refer to their problem's test cases by content hash
+ * (testSetRef) instead of carrying them; the set itself is stored once under
+ * judge:testset:<sha256> and every judge keeps the sets it has fetched.
+ * Run jobs bring their own test cases and stay inline. JUDGE_TEST_SETS=inline
+ * sends every job's test cases inline, for judges that predate test sets.
+ */
+const useTestSets = process.env.JUDGE_TEST_SETS !== "inline";
+// well past any assignment's grading window, pushed out on every use
+const TEST_SET_TTL_SECONDS = 14 * 24 * 3600;
+
+interface EnqueueOptions {
+  priority: JudgePriority;
+  // epoch ms by which the verdict is needed, e.g. the end of a quiz session.
+  // The judge schedules earliest deadline first within its latency targets.
+  deadline?: number | null;
+}
+
+/**
+ * Makes sure the test set is in Redis for at least TEST_SET_TTL_SECONDS and
+ * returns its hash. Only the first job after it expired uploads it.
+ */
+const storeTestSet = async (testCases: unknown[]): Promise<string> => {
+  const json = JSON.stringify(testCases);
+  const hash = createHash("sha256").update(json).digest("hex");
+  const key = `judge:testset:${hash}`;
+  if (!(await redisClient.expire(key, TEST_SET_TTL_SECONDS))) {
+    await redisClient.set(key, json, { EX: TEST_SET_TTL_SECONDS });
+  }
+  return hash;
+};
+
+/**
+ * Stores a judge job's hash and queues it on its priority lane in one
+ * MULTI, so a judge never pops an id whose data is not there yet. The test
+ * set of a graded job is stored before that, see useTestSets.
+ */
+export const enqueueJudgeJob = async (
+  jobId: string,
+  payload: { testCases?: unknown[]; [field: string]: unknown },
+  { priority, deadline }: EnqueueOptions
+): Promise<void> => {
+  let data = payload;
+  if (useTestSets && priority !== "run" && Array.isArray(payload.testCases)) {
+    const { testCases, ...rest } = payload;
+    data = { ...rest, testSetRef: await storeTestSet(testCases) };
+  }
+
+  const fields: Record<string, string> = {
+    data: JSON.stringify(data),
+    createdAt: Date.now().toString(),
+    priority,
+  };
+  if (deadline) {
+    fields.deadline = Math.floor(deadline).toString();
+  }
+
+  const multi = redisClient.multi().hSet(`judge:${jobId}`, fields);
+  if (useStreams) {
+    multi.xAdd(JUDGE_STREAMS[priority], "*", { jobId });
+  } else {
+    const wakeKey = priority === "plagiarism" ? JUDGE_PLAGIARISM_WAKE_KEY : JUDGE_WAKE_KEY;
+    multi
+      .lPush(JUDGE_LANES[priority], jobId)
+      .lPush(wakeKey, "1")
+      .lTrim(wakeKey, 0, JUDGE_WAKE_TOKENS - 1);
+  }
+  await multi.exec();
+};
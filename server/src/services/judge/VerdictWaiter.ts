@@ -0,0 +1,84 @@
+import logger from "../../config/logger";
+import redisClient from "../../config/redis";
+
+// Upper bound for ?wait=, below the usual 30s proxy/browser idle timeouts.
+const MAX_WAIT_MS = 25000;
+
+/**
+ * One subscriber connection shared by every waiting request. The judge
+ * PUBLISHes on a channel named like the verdict key in the same MULTI that
+ * writes the key, so a waiter wakes as soon as the verdict is stored
+ * instead of polling GET.
+ */
+const subscriber = redisClient.duplicate();
+subscriber.on("error", (err) =>
+  logger.error({ fn: "VerdictWaiter" }, `Subscriber error: ${err.message}`));
+let connecting: Promise<unknown> | null = null;
+
+const ensureSubscriber = async (): Promise<void> => {
+  if (subscriber.isReady) return;
+  connecting ??= subscriber.connect().catch((err) => {
+    connecting = null;
+    throw err;
+  });
+  await connecting;
+};
+
+/**
+ * How long a status request may be held open, from its `wait` query
+ * parameter (ms). 0 keeps the old answer-immediately behaviour.
+ */
+export const verdictWaitMs = (wait: unknown): number => {
+  const ms = typeof wait === "string" ? parseInt(wait, 10) : 0;
+  return Number.isFinite(ms) && ms > 0 ? Math.min(ms, MAX_WAIT_MS) : 0;
+};
+
+/**
+ * Reads a verdict key, waiting up to `waitMs` for the judge to publish it
+ * if it is not there yet.
+ * @returns the raw verdict, or null if it is still pending after the wait
+ */
+export const readVerdict = async (key: string, waitMs: number): Promise<string | null> => {
+  const raw = await redisClient.get(key);
+  if (raw !== null || waitMs <= 0) {
+    return raw;
+  }
+
+  try {
+    await ensureSubscriber();
+  } catch (err) {
+    // the client polls again, as before
+    logger.warn({ fn: "readVerdict", key }, `Cannot subscribe, not waiting: ${err}`);
+    return null;
+  }
+
+  let listener: (message: string) => void = () => {};
+  let timer: NodeJS.Timeout | undefined;
+  const published = new Promise<void>((resolve) => {
+    listener = (message: string) => {
+      const publishedAt = parseInt(message, 10);
+      if (Number.isFinite(publishedAt)) {
+        logger.debug(
+          { fn: "readVerdict", key, deliveryMs: Date.now() - publishedAt },
+          `Verdict ${key} pushed`
+        );
+      }
+      resolve();
+    };
+    timer = setTimeout(resolve, waitMs);
+  });
+
+  try {
+    await subscriber.subscribe(key, listener);
+    // the verdict may have landed between the GET above and SUBSCRIBE
+    const landed = await redisClient.get(key);
+    if (landed !== null) {
+      return landed;
+    }
+    await published;
+    return await redisClient.get(key);
+  } finally {
+    clearTimeout(timer);
+    await subscriber.unsubscribe(key, listener).catch(() => undefined);
+  }
+};
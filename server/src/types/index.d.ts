@@ -233,6 +233,9 @@ export interface TestResult {
   actual?: string;
   expectedOutput?: string;
   executionTime?: number;
+  // CPU time and peak resident memory of the program, as the kernel counted them
+  cpuTimeMs?: number;
+  peakMemoryKb?: number;
   status: 'passed' | 'failed' | 'timeout' | 'error' | 'produced' | 'no_output';
   errorType?: string;
   errorMessage?: string
@@ -260,6 +263,10 @@ export interface JudgeVerdict {
     totalTests?: number;
     averageRuntime?: number;
     memoryUsage?: number;
+    // whole-sandbox cgroup accounting, runner included (native judge backend)
+    sandboxCpuTimeMs?: number;
+    sandboxThrottledMs?: number;
+    sandboxPeakMemoryKb?: number;
     privatePassedTests?: number;
     privateTestsTotal?: number;
   };
@@ -269,6 +276,7 @@ export interface SubmissionRecord {
   submission_id: number;
   assignment_id: number;
   code: string;
+  language: string | null;
 }
 
 export interface SubmissionResult {